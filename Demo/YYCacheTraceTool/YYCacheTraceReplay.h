@@ -0,0 +1,175 @@
+//
+//  YYCacheTraceReplay.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 16/2/2.
+//  Copyright (c) 2016 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import <Foundation/Foundation.h>
+#import "YYCacheTrace.h"
+
+@class YYCacheMetricsSnapshot;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// A record in a trace.
+typedef struct {
+    uint32_t keyIndex;               ///< index in `keys`
+    YYCacheTraceOperation operation; ///< operation
+    uint32_t size;                   ///< value size in bytes (0 if unknown)
+    uint64_t timestamp;              ///< microseconds since the first record
+} YYCacheTraceRecord;
+
+
+/**
+ The result of replaying a trace.
+ */
+@interface YYCacheTraceReport : NSObject
+
+/** The number of replayed operations. */
+@property (readonly) NSUInteger operationCount;
+
+/** The wall time of the replay in seconds. */
+@property (readonly) NSTimeInterval duration;
+
+/** operationCount / duration. */
+@property (readonly) double throughput;
+
+/** The bytes of the files in cache directory after the replay (0 for YYMemoryCache). */
+@property (readonly) uint64_t diskBytes;
+
+/** The hits, misses and latency histograms of the replay. */
+@property (readonly) YYCacheMetricsSnapshot *metrics;
+
+/** The hit ratio of get operations. */
+@property (readonly) double hitRatio;
+
+/** The median latency of get operations in seconds. */
+@property (readonly) NSTimeInterval getLatencyP50;
+
+/** The 99th percentile latency of get operations in seconds. */
+@property (readonly) NSTimeInterval getLatencyP99;
+
+/** The median latency of set operations in seconds. */
+@property (readonly) NSTimeInterval setLatencyP50;
+
+/** The 99th percentile latency of set operations in seconds. */
+@property (readonly) NSTimeInterval setLatencyP99;
+
+@end
+
+
+/**
+ YYCacheTrace is a sequence of cache operations, which is read from a file written
+ by YYCacheTraceRecorder, or created by a synthetic workload generator. It can be
+ replayed against YYMemoryCache, YYDiskCache or YYCache to compare the cache
+ configurations with the same workload.
+ */
+@interface YYCacheTrace : NSObject
+
+/** The keys referred by records. */
+@property (readonly) NSArray<NSString *> *keys;
+
+/** The records. */
+@property (readonly) const YYCacheTraceRecord *records NS_RETURNS_INNER_POINTER;
+
+/** The number of records. */
+@property (readonly) NSUInteger recordCount;
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+/**
+ Read a trace file written by YYCacheTraceRecorder or `writeToFile:`.
+
+ @param path The file path.
+ @return A new trace, or nil if the file is not a valid trace.
+ */
+- (nullable instancetype)initWithContentsOfFile:(NSString *)path;
+
+/**
+ Write the trace to a file.
+
+ @param path The file path, an existing file will be overwritten.
+ @return Whether succeed.
+ */
+- (BOOL)writeToFile:(NSString *)path;
+
+#pragma mark - Synthetic Workload
+///=============================================================================
+/// @name Synthetic Workload
+///=============================================================================
+
+/**
+ Create a trace of get operations, the keys follow the Zipf distribution
+ ("key_0" is the most popular one).
+
+ @param keyCount  The number of distinct keys.
+ @param length    The number of records.
+ @param exponent  The Zipf exponent, such as 0.8 (larger means more skewed).
+ @param valueSize The value size of all records.
+ @param seed      The random seed, the same seed creates the same trace.
+ */
++ (instancetype)zipfTraceWithKeyCount:(NSUInteger)keyCount
+                               length:(NSUInteger)length
+                             exponent:(double)exponent
+                            valueSize:(NSUInteger)valueSize
+                                 seed:(uint32_t)seed;
+
+/**
+ Create a trace of get operations, which scans the keys in order repeatedly.
+ It's the worst case of LRU when the key count is larger than the cache capacity.
+ */
++ (instancetype)scanTraceWithKeyCount:(NSUInteger)keyCount
+                               length:(NSUInteger)length
+                            valueSize:(NSUInteger)valueSize;
+
+/**
+ Create a trace which mixes the Zipf gets with scans and writes.
+
+ @param keyCount      The number of distinct keys of the Zipf part.
+ @param length        The number of records.
+ @param exponent      The Zipf exponent.
+ @param scanRatio     The ratio of records which belong to scans of one-time keys.
+ @param writeRatio    The ratio of set and remove operations in the Zipf part.
+ @param valueSize     The maximum value size, the size of each key is in range [valueSize / 8, valueSize].
+ @param seed          The random seed.
+ */
++ (instancetype)mixedTraceWithKeyCount:(NSUInteger)keyCount
+                                length:(NSUInteger)length
+                              exponent:(double)exponent
+                             scanRatio:(double)scanRatio
+                            writeRatio:(double)writeRatio
+                             valueSize:(NSUInteger)valueSize
+                                  seed:(uint32_t)seed;
+
+#pragma mark - Replay
+///=============================================================================
+/// @name Replay
+///=============================================================================
+
+/**
+ Replay the trace against a cache as fast as possible (the timestamps are ignored).
+
+ @discussion The records are dispatched to the threads in order, so the concurrent
+ threads run the trace roughly in the recorded order. The value of a set operation
+ is an NSData of the record size (the cost for YYMemoryCache). A get operation
+ which misses is followed by a set of the same key (read-through), as the most
+ cache users do, the set is not counted as an operation of the trace.
+
+ The cache is not cleared before replay, and this method blocks the calling thread
+ until the replay finished.
+
+ @param cache       A YYMemoryCache, YYDiskCache or YYCache instance.
+ @param threadCount The number of concurrent threads, 0 means 1.
+ @return The report, or nil if the cache is not supported.
+ */
+- (nullable YYCacheTraceReport *)replayWithCache:(id)cache threadCount:(NSUInteger)threadCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,433 @@
+//
+//  YYCacheTraceReplay.m
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 16/2/2.
+//  Copyright (c) 2016 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import "YYCacheTraceReplay.h"
+#import "YYCacheMetrics.h"
+#import "YYCache.h"
+#import "YYMemoryCache.h"
+#import "YYDiskCache.h"
+#import <time.h>
+
+/*
+ Trace file format (same as YYCacheTraceRecorder writes):
+
+ header: "YYCT" (4 bytes), version (1 byte)
+ record: tag, [key length, key bytes] or [key index], size, timestamp delta
+
+ All the integers in record are unsigned LEB128 varints. The tag is the operation
+ in the lower 2 bits, and bit 2 is set if the key occurs first time (the key bytes
+ are UTF-8 and the key index is the number of keys occurred before). The timestamp
+ delta is the microseconds since the previous record.
+ */
+static const char kYYCacheTraceMagic[4] = {'Y', 'Y', 'C', 'T'};
+static const uint8_t kYYCacheTraceVersion = 1;
+
+static inline void YYCacheTraceAppendVarint(NSMutableData *data, uint64_t value) {
+    uint8_t bytes[10];
+    int len = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value) byte |= 0x80;
+        bytes[len++] = byte;
+    } while (value);
+    [data appendBytes:bytes length:len];
+}
+
+static inline BOOL YYCacheTraceReadVarint(const uint8_t **cur, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*cur >= end) return NO;
+        uint8_t byte = *(*cur)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static inline void YYCacheTraceAppendRecord(NSMutableData *data, YYCacheTraceOperation operation,
+                                            NSString *newKey, uint32_t keyIndex, uint32_t size, uint64_t delta) {
+    if (newKey) {
+        NSData *keyData = [newKey dataUsingEncoding:NSUTF8StringEncoding];
+        YYCacheTraceAppendVarint(data, operation | 4);
+        YYCacheTraceAppendVarint(data, keyData.length);
+        [data appendData:keyData];
+    } else {
+        YYCacheTraceAppendVarint(data, operation);
+        YYCacheTraceAppendVarint(data, keyIndex);
+    }
+    YYCacheTraceAppendVarint(data, size);
+    YYCacheTraceAppendVarint(data, delta);
+}
+
+
+
+@interface YYCacheTraceReport ()
+@property (readwrite) NSUInteger operationCount;
+@property (readwrite) NSTimeInterval duration;
+@property (readwrite) uint64_t diskBytes;
+@property (readwrite) YYCacheMetricsSnapshot *metrics;
+@end
+
+@implementation YYCacheTraceReport
+
+- (double)throughput {
+    return _duration > 0 ? _operationCount / _duration : 0;
+}
+
+- (double)hitRatio {
+    return _metrics.hitRatio;
+}
+
+- (NSTimeInterval)getLatencyP50 {
+    return [_metrics latencyPercentile:0.5 ofOperation:YYCacheOperationGet];
+}
+
+- (NSTimeInterval)getLatencyP99 {
+    return [_metrics latencyPercentile:0.99 ofOperation:YYCacheOperationGet];
+}
+
+- (NSTimeInterval)setLatencyP50 {
+    return [_metrics latencyPercentile:0.5 ofOperation:YYCacheOperationSet];
+}
+
+- (NSTimeInterval)setLatencyP99 {
+    return [_metrics latencyPercentile:0.99 ofOperation:YYCacheOperationSet];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"ops:%lu time:%.3fs throughput:%.0f/s hit:%.2f%% get p50:%.1fus p99:%.1fus set p50:%.1fus p99:%.1fus disk:%.2fMB",
+            (unsigned long)_operationCount, _duration, self.throughput, self.hitRatio * 100,
+            self.getLatencyP50 * 1e6, self.getLatencyP99 * 1e6, self.setLatencyP50 * 1e6, self.setLatencyP99 * 1e6,
+            _diskBytes / 1024.0 / 1024.0];
+}
+
+@end
+
+
+
+@implementation YYCacheTrace {
+    YYCacheTraceRecord *_records;
+}
+
+- (instancetype)init {
+    @throw [NSException exceptionWithName:@"YYCacheTrace init error" reason:@"Use 'initWithContentsOfFile:' or the synthetic workload methods instead." userInfo:nil];
+    return [self _initWithKeys:@[] records:NULL count:0];
+}
+
+/// The records should be created by malloc, it's freed in dealloc.
+- (instancetype)_initWithKeys:(NSArray *)keys records:(YYCacheTraceRecord *)records count:(NSUInteger)count {
+    self = [super init];
+    _keys = keys.copy;
+    _records = records;
+    _recordCount = count;
+    return self;
+}
+
+- (void)dealloc {
+    if (_records) free(_records);
+}
+
+- (const YYCacheTraceRecord *)records {
+    return _records;
+}
+
+- (instancetype)initWithContentsOfFile:(NSString *)path {
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];
+    if (data.length < 5 || memcmp(data.bytes, kYYCacheTraceMagic, 4) != 0) return nil;
+    const uint8_t *cur = (const uint8_t *)data.bytes + 4;
+    const uint8_t *end = (const uint8_t *)data.bytes + data.length;
+    if (*cur++ != kYYCacheTraceVersion) return nil;
+
+    NSMutableArray *keys = [NSMutableArray new];
+    NSUInteger capacity = 1024, count = 0;
+    YYCacheTraceRecord *records = malloc(capacity * sizeof(YYCacheTraceRecord));
+    if (!records) return nil;
+    uint64_t timestamp = 0;
+    BOOL valid = YES;
+    while (cur < end) {
+        uint64_t tag, keyIndex, size, delta;
+        if (!YYCacheTraceReadVarint(&cur, end, &tag) || (tag & 3) > YYCacheTraceOperationRemove) { valid = NO; break; }
+        if (tag & 4) {
+            uint64_t length;
+            if (!YYCacheTraceReadVarint(&cur, end, &length) || length > (uint64_t)(end - cur)) { valid = NO; break; }
+            NSString *key = [[NSString alloc] initWithBytes:cur length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+            if (!key) { valid = NO; break; }
+            cur += length;
+            keyIndex = keys.count;
+            [keys addObject:key];
+        } else {
+            if (!YYCacheTraceReadVarint(&cur, end, &keyIndex) || keyIndex >= keys.count) { valid = NO; break; }
+        }
+        if (!YYCacheTraceReadVarint(&cur, end, &size) || size > UINT32_MAX) { valid = NO; break; }
+        if (!YYCacheTraceReadVarint(&cur, end, &delta)) { valid = NO; break; }
+
+        if (count == capacity) {
+            capacity *= 2;
+            YYCacheTraceRecord *newRecords = realloc(records, capacity * sizeof(YYCacheTraceRecord));
+            if (!newRecords) { valid = NO; break; }
+            records = newRecords;
+        }
+        timestamp += delta;
+        YYCacheTraceRecord *record = records + count++;
+        record->keyIndex = (uint32_t)keyIndex;
+        record->operation = (YYCacheTraceOperation)(tag & 3);
+        record->size = (uint32_t)size;
+        record->timestamp = timestamp;
+    }
+    if (!valid) {
+        free(records);
+        return nil;
+    }
+    return [self _initWithKeys:keys records:records count:count];
+}
+
+- (BOOL)writeToFile:(NSString *)path {
+    NSMutableData *data = [NSMutableData dataWithCapacity:5 + _recordCount * 4];
+    [data appendBytes:kYYCacheTraceMagic length:4];
+    [data appendBytes:&kYYCacheTraceVersion length:1];
+    uint8_t *written = calloc(_keys.count ? _keys.count : 1, 1); // whether the key is written
+    if (!written) return NO;
+    uint32_t nextIndex = 0;
+    uint32_t *fileIndexes = malloc((_keys.count ? _keys.count : 1) * sizeof(uint32_t)); // the key index in file
+    if (!fileIndexes) {
+        free(written);
+        return NO;
+    }
+    uint64_t lastTime = 0;
+    for (NSUInteger i = 0; i < _recordCount; i++) {
+        YYCacheTraceRecord record = _records[i];
+        uint64_t delta = record.timestamp > lastTime ? record.timestamp - lastTime : 0;
+        lastTime += delta;
+        NSString *newKey = nil;
+        if (!written[record.keyIndex]) {
+            written[record.keyIndex] = 1;
+            fileIndexes[record.keyIndex] = nextIndex++;
+            newKey = _keys[record.keyIndex];
+        }
+        YYCacheTraceAppendRecord(data, record.operation, newKey, fileIndexes[record.keyIndex], record.size, delta);
+    }
+    free(written);
+    free(fileIndexes);
+    return [data writeToFile:path atomically:YES];
+}
+
+#pragma mark - Synthetic Workload
+
+/// Returns the cumulative weights of Zipf distribution, the caller should free it.
+static double *YYCacheTraceCreateZipfCDF(NSUInteger n, double exponent) {
+    double *cdf = malloc(sizeof(double) * MAX(n, 1));
+    if (!cdf) return NULL;
+    double sum = 0;
+    for (NSUInteger i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, exponent);
+        cdf[i] = sum;
+    }
+    return cdf;
+}
+
+static NSUInteger YYCacheTraceNextZipf(const double *cdf, NSUInteger n, uint32_t *seed) {
+    double r = (double)rand_r(seed) / RAND_MAX * cdf[n - 1];
+    NSUInteger lo = 0, hi = n - 1;
+    while (lo < hi) {
+        NSUInteger mid = (lo + hi) / 2;
+        if (cdf[mid] < r) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static NSMutableArray *YYCacheTraceCreateKeys(NSString *prefix, NSUInteger count) {
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [keys addObject:[NSString stringWithFormat:@"%@_%lu", prefix, (unsigned long)i]];
+    }
+    return keys;
+}
+
++ (instancetype)zipfTraceWithKeyCount:(NSUInteger)keyCount length:(NSUInteger)length exponent:(double)exponent valueSize:(NSUInteger)valueSize seed:(uint32_t)seed {
+    return [self mixedTraceWithKeyCount:keyCount length:length exponent:exponent scanRatio:0 writeRatio:0 valueSize:valueSize seed:seed];
+}
+
++ (instancetype)scanTraceWithKeyCount:(NSUInteger)keyCount length:(NSUInteger)length valueSize:(NSUInteger)valueSize {
+    if (keyCount == 0) length = 0;
+    YYCacheTraceRecord *records = calloc(MAX(length, 1), sizeof(YYCacheTraceRecord));
+    for (NSUInteger i = 0; records && i < length; i++) {
+        records[i].keyIndex = (uint32_t)(i % keyCount);
+        records[i].operation = YYCacheTraceOperationGet;
+        records[i].size = (uint32_t)MIN(valueSize, UINT32_MAX);
+        records[i].timestamp = i;
+    }
+    return [[self alloc] _initWithKeys:YYCacheTraceCreateKeys(@"key", keyCount) records:records count:records ? length : 0];
+}
+
++ (instancetype)mixedTraceWithKeyCount:(NSUInteger)keyCount length:(NSUInteger)length exponent:(double)exponent scanRatio:(double)scanRatio writeRatio:(double)writeRatio valueSize:(NSUInteger)valueSize seed:(uint32_t)seed {
+    if (keyCount == 0) length = 0;
+    NSMutableArray *keys = YYCacheTraceCreateKeys(@"key", keyCount);
+    YYCacheTraceRecord *records = calloc(MAX(length, 1), sizeof(YYCacheTraceRecord));
+    uint32_t *sizes = malloc(MAX(keyCount, 1) * sizeof(uint32_t));
+    double *cdf = YYCacheTraceCreateZipfCDF(keyCount, exponent);
+    if (!records || !sizes || !cdf) {
+        if (records) free(records);
+        if (sizes) free(sizes);
+        if (cdf) free(cdf);
+        return [[self alloc] _initWithKeys:@[] records:NULL count:0];
+    }
+
+    uint32_t maxSize = (uint32_t)MIN(valueSize, UINT32_MAX);
+    uint32_t minSize = maxSize / 8;
+    for (NSUInteger i = 0; i < keyCount; i++) { // each key has a fixed size
+        sizes[i] = minSize + (maxSize > minSize ? rand_r(&seed) % (maxSize - minSize + 1) : 0);
+    }
+    NSUInteger scanCount = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        YYCacheTraceRecord *record = records + i;
+        record->timestamp = i;
+        double r = (double)rand_r(&seed) / RAND_MAX;
+        if (r < scanRatio) { // one-time key
+            record->keyIndex = (uint32_t)keys.count;
+            record->operation = YYCacheTraceOperationGet;
+            record->size = minSize + (maxSize > minSize ? rand_r(&seed) % (maxSize - minSize + 1) : 0);
+            [keys addObject:[NSString stringWithFormat:@"scan_%lu", (unsigned long)scanCount++]];
+            continue;
+        }
+        NSUInteger index = YYCacheTraceNextZipf(cdf, keyCount, &seed);
+        record->keyIndex = (uint32_t)index;
+        record->size = sizes[index];
+        r = (double)rand_r(&seed) / RAND_MAX;
+        if (r < writeRatio) {
+            record->operation = (rand_r(&seed) % 10 == 0) ? YYCacheTraceOperationRemove : YYCacheTraceOperationSet;
+        } else {
+            record->operation = YYCacheTraceOperationGet;
+        }
+    }
+    free(sizes);
+    free(cdf);
+    return [[self alloc] _initWithKeys:keys records:records count:length];
+}
+
+#pragma mark - Replay
+
+/// Monotonic time in seconds, the tool doesn't link QuartzCore.
+static inline NSTimeInterval YYCacheTraceTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/// Returns the bytes of all files in a directory.
+static uint64_t YYCacheTraceDirectorySize(NSString *path) {
+    uint64_t size = 0;
+    NSFileManager *manager = [NSFileManager defaultManager];
+    NSDirectoryEnumerator *enumerator = [manager enumeratorAtPath:path];
+    for (NSString *subpath in enumerator) {
+        NSDictionary *attributes = enumerator.fileAttributes;
+        if ([attributes[NSFileType] isEqualToString:NSFileTypeRegular]) {
+            size += [attributes[NSFileSize] unsignedLongLongValue];
+        }
+    }
+    return size;
+}
+
+- (YYCacheTraceReport *)replayWithCache:(id)cache threadCount:(NSUInteger)threadCount {
+    YYMemoryCache *memoryCache = nil;
+    YYDiskCache *diskCache = nil;
+    YYCache *fullCache = nil;
+    if ([cache isKindOfClass:[YYMemoryCache class]]) memoryCache = cache;
+    else if ([cache isKindOfClass:[YYDiskCache class]]) diskCache = cache;
+    else if ([cache isKindOfClass:[YYCache class]]) fullCache = cache;
+    else return nil;
+    if (threadCount == 0) threadCount = 1;
+
+    // the values share one random buffer
+    uint32_t maxSize = 0;
+    for (NSUInteger i = 0; i < _recordCount; i++) {
+        if (_records[i].size > maxSize) maxSize = _records[i].size;
+    }
+    NSMutableData *buffer = [NSMutableData dataWithLength:maxSize];
+    uint8_t *bytes = buffer.mutableBytes;
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < maxSize; i++) bytes[i] = rand_r(&seed);
+
+    NSArray *keys = _keys;
+    const YYCacheTraceRecord *records = _records;
+    int64_t count = _recordCount;
+    YYCacheMetrics *metrics = [YYCacheMetrics new];
+    __block volatile int64_t cursor = 0;
+
+    void (^set)(NSString *key, uint32_t size) = ^(NSString *key, uint32_t size) {
+        if (memoryCache) {
+            [memoryCache setObject:buffer forKey:key withCost:size]; // the cost is the size, no need to copy
+        } else {
+            NSData *value = [buffer subdataWithRange:NSMakeRange(0, size)];
+            if (diskCache) [diskCache setObject:value forKey:key];
+            else [fullCache setObject:value forKey:key];
+        }
+    };
+    id (^get)(NSString *key) = ^id(NSString *key) {
+        if (memoryCache) return [memoryCache objectForKey:key];
+        if (diskCache) return [diskCache objectForKey:key];
+        return [fullCache objectForKey:key];
+    };
+    void (^worker)(void) = ^{
+        for (;;) {
+            int64_t i = __sync_fetch_and_add(&cursor, 1);
+            if (i >= count) break;
+            @autoreleasepool {
+                YYCacheTraceRecord record = records[i];
+                NSString *key = keys[record.keyIndex];
+                NSTimeInterval begin = YYCacheTraceTime();
+                switch (record.operation) {
+                    case YYCacheTraceOperationGet: {
+                        id object = get(key);
+                        NSTimeInterval latency = YYCacheTraceTime() - begin;
+                        [metrics recordGetWithHitCount:object ? 1 : 0 missCount:object ? 0 : 1 bytesRead:object ? record.size : 0 latency:latency];
+                        if (!object) set(key, record.size); // read-through
+                    } break;
+                    case YYCacheTraceOperationSet: {
+                        set(key, record.size);
+                        [metrics recordSetWithCount:1 bytesWritten:record.size latency:YYCacheTraceTime() - begin];
+                    } break;
+                    case YYCacheTraceOperationRemove: {
+                        if (memoryCache) [memoryCache removeObjectForKey:key];
+                        else if (diskCache) [diskCache removeObjectForKey:key];
+                        else [fullCache removeObjectForKey:key];
+                    } break;
+                }
+            }
+        }
+    };
+
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    NSTimeInterval begin = YYCacheTraceTime();
+    for (NSUInteger i = 0; i < threadCount; i++) {
+        dispatch_group_async(group, queue, worker);
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    NSTimeInterval duration = YYCacheTraceTime() - begin;
+
+    YYCacheTraceReport *report = [YYCacheTraceReport new];
+    report.operationCount = _recordCount;
+    report.duration = duration;
+    report.metrics = [metrics snapshot];
+    if (fullCache) diskCache = fullCache.diskCache;
+    if (diskCache) {
+        [diskCache flush];
+        report.diskBytes = YYCacheTraceDirectorySize(diskCache.path);
+    }
+    return report;
+}
+
+@end
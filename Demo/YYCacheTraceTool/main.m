@@ -0,0 +1,179 @@
+//
+//  main.m
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 16/2/2.
+//  Copyright (c) 2016 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+/*
+ yycachetrace: generate cache traces and replay them against YYMemoryCache,
+ YYDiskCache (sqlite, file and mixed storage) and YYCache, without the demo app.
+
+ A trace is recorded by an app with `YYCache.traceRecorder`, or generated by this
+ tool (Zipf, scan or mixed workload). The replay prints the hit ratio, get/set
+ latency (p50/p99), throughput and disk bytes of each cache and thread count.
+
+ The tool itself only uses Foundation, the cache classes are linked from the
+ static library. Build the library for simulator, then run the tool headless
+ in a booted simulator:
+
+ xcodebuild -project ../../Framework/YYKit-Static.xcodeproj -sdk iphonesimulator -configuration Release SYMROOT=$PWD/build
+ xcrun -sdk iphonesimulator clang -fobjc-arc -O2 -mios-simulator-version-min=8.0 -I../../YYKit/Cache \
+     main.m YYCacheTraceReplay.m -ObjC build/Release-iphonesimulator/libYYKit.a \
+     -F../../Vendor -framework WebP -framework UIKit -framework CoreText -framework QuartzCore -framework ImageIO \
+     -framework Accelerate -framework AssetsLibrary -framework MobileCoreServices -framework SystemConfiguration \
+     -lsqlite3 -lz -o yycachetrace
+ xcrun simctl spawn booted $PWD/yycachetrace replay zipf -threads 1,4
+
+ Usage:
+ yycachetrace generate <zipf|scan|mixed> <output file> [options]
+ yycachetrace replay <zipf|scan|mixed|trace file> [options]
+
+ Options:
+ -keys N        distinct keys of the synthetic workload (default 10000)
+ -length N      records of the synthetic workload (default 100000)
+ -size N        value size in bytes (default 4096, the maximum for mixed)
+ -exponent F    Zipf exponent (default 0.8)
+ -scanRatio F   ratio of one-time keys for mixed (default 0.2)
+ -writeRatio F  ratio of set/remove for mixed (default 0.1)
+ -seed N        random seed (default 1)
+ -threads LIST  comma separated thread counts of replay (default 1,4)
+ -caches LIST   comma separated caches of replay: memory,sqlite,file,mixed,cache (default all)
+ -memoryCost N  cost limit of the memory caches in bytes (default 8MB)
+ -diskCost N    cost limit of the disk caches in bytes (default 64MB)
+ -dir PATH      directory of the disk caches (default a temporary directory)
+ */
+
+#import <Foundation/Foundation.h>
+#import "YYCache.h"
+#import "YYMemoryCache.h"
+#import "YYDiskCache.h"
+#import "YYCacheTraceReplay.h"
+
+static void YYCacheTraceToolPrintUsage() {
+    printf("usage: yycachetrace generate <zipf|scan|mixed> <output file> [options]\n");
+    printf("       yycachetrace replay <zipf|scan|mixed|trace file> [options]\n");
+    printf("see main.m for the options\n");
+}
+
+/// Returns the option from arguments ("-name value"), or the default value.
+static NSString *YYCacheTraceToolOption(NSString *name, NSString *defaultValue) {
+    NSString *value = [[NSUserDefaults standardUserDefaults] stringForKey:name];
+    return value.length ? value : defaultValue;
+}
+
+/// Create a synthetic trace, returns nil if the name is not a workload.
+static YYCacheTrace *YYCacheTraceToolGenerate(NSString *name) {
+    NSUInteger keyCount = (NSUInteger)YYCacheTraceToolOption(@"keys", @"10000").longLongValue;
+    NSUInteger length = (NSUInteger)YYCacheTraceToolOption(@"length", @"100000").longLongValue;
+    NSUInteger valueSize = (NSUInteger)YYCacheTraceToolOption(@"size", @"4096").longLongValue;
+    double exponent = YYCacheTraceToolOption(@"exponent", @"0.8").doubleValue;
+    double scanRatio = YYCacheTraceToolOption(@"scanRatio", @"0.2").doubleValue;
+    double writeRatio = YYCacheTraceToolOption(@"writeRatio", @"0.1").doubleValue;
+    uint32_t seed = (uint32_t)YYCacheTraceToolOption(@"seed", @"1").longLongValue;
+    if ([name isEqualToString:@"zipf"]) {
+        return [YYCacheTrace zipfTraceWithKeyCount:keyCount length:length exponent:exponent valueSize:valueSize seed:seed];
+    }
+    if ([name isEqualToString:@"scan"]) {
+        return [YYCacheTrace scanTraceWithKeyCount:keyCount length:length valueSize:valueSize];
+    }
+    if ([name isEqualToString:@"mixed"]) {
+        return [YYCacheTrace mixedTraceWithKeyCount:keyCount length:length exponent:exponent scanRatio:scanRatio writeRatio:writeRatio valueSize:valueSize seed:seed];
+    }
+    return nil;
+}
+
+/// Create an empty cache to replay, returns nil if the name is unknown.
+static id YYCacheTraceToolCreateCache(NSString *name, NSString *basePath) {
+    NSUInteger memoryCost = (NSUInteger)YYCacheTraceToolOption(@"memoryCost", @"8388608").longLongValue;
+    NSUInteger diskCost = (NSUInteger)YYCacheTraceToolOption(@"diskCost", @"67108864").longLongValue;
+    NSString *path = [basePath stringByAppendingPathComponent:name];
+    if ([name isEqualToString:@"memory"]) {
+        YYMemoryCache *cache = [YYMemoryCache new];
+        cache.costLimit = memoryCost;
+        return cache;
+    }
+    if ([name isEqualToString:@"cache"]) {
+        YYCache *cache = [[YYCache alloc] initWithPath:path];
+        cache.memoryCache.costLimit = memoryCost;
+        cache.diskCache.costLimit = diskCost;
+        [cache removeAllObjects];
+        return cache;
+    }
+    // the storage type is decided by the inline threshold
+    NSUInteger threshold;
+    if ([name isEqualToString:@"sqlite"]) threshold = NSUIntegerMax;
+    else if ([name isEqualToString:@"file"]) threshold = 0;
+    else if ([name isEqualToString:@"mixed"]) threshold = 20 * 1024;
+    else return nil;
+    YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:path inlineThreshold:threshold];
+    cache.costLimit = diskCost;
+    [cache removeAllObjects];
+    return cache;
+}
+
+static int YYCacheTraceToolReplay(YYCacheTrace *trace, NSString *name) {
+    NSString *basePath = YYCacheTraceToolOption(@"dir", [NSTemporaryDirectory() stringByAppendingPathComponent:@"yycachetrace"]);
+    [[NSFileManager defaultManager] createDirectoryAtPath:basePath withIntermediateDirectories:YES attributes:nil error:NULL];
+    NSArray *threadCounts = [YYCacheTraceToolOption(@"threads", @"1,4") componentsSeparatedByString:@","];
+    NSArray *cacheNames = [YYCacheTraceToolOption(@"caches", @"memory,sqlite,file,mixed,cache") componentsSeparatedByString:@","];
+
+    printf("==========================================\n");
+    printf("%s: %lu records, %lu keys\n", name.UTF8String, (unsigned long)trace.recordCount, (unsigned long)trace.keys.count);
+    for (NSString *threadCount in threadCounts) {
+        printf("------------------------------------------\n");
+        for (NSString *cacheName in cacheNames) {
+            @autoreleasepool {
+                id cache = YYCacheTraceToolCreateCache(cacheName, basePath);
+                if (!cache) {
+                    fprintf(stderr, "unknown cache: %s\n", cacheName.UTF8String);
+                    return 1;
+                }
+                YYCacheTraceReport *report = [trace replayWithCache:cache threadCount:(NSUInteger)threadCount.integerValue];
+                printf("%-7s threads:%d %s\n", cacheName.UTF8String, threadCount.intValue, report.description.UTF8String);
+                if ([cache respondsToSelector:@selector(removeAllObjects)]) [cache removeAllObjects];
+            }
+        }
+    }
+    printf("------------------------------------------\n");
+    return 0;
+}
+
+int main(int argc, const char * argv[]) {
+    @autoreleasepool {
+        if (argc < 3) {
+            YYCacheTraceToolPrintUsage();
+            return 1;
+        }
+        NSString *command = @(argv[1]);
+        NSString *name = @(argv[2]);
+        if ([command isEqualToString:@"generate"]) {
+            YYCacheTrace *trace = YYCacheTraceToolGenerate(name);
+            if (!trace || argc < 4) {
+                YYCacheTraceToolPrintUsage();
+                return 1;
+            }
+            if (![trace writeToFile:@(argv[3])]) {
+                fprintf(stderr, "cannot write trace: %s\n", argv[3]);
+                return 1;
+            }
+            printf("%s: %lu records, %lu keys\n", argv[3], (unsigned long)trace.recordCount, (unsigned long)trace.keys.count);
+            return 0;
+        }
+        if ([command isEqualToString:@"replay"]) {
+            YYCacheTrace *trace = YYCacheTraceToolGenerate(name);
+            if (!trace) trace = [[YYCacheTrace alloc] initWithContentsOfFile:name];
+            if (!trace) {
+                fprintf(stderr, "not a workload or trace file: %s\n", argv[2]);
+                return 1;
+            }
+            return YYCacheTraceToolReplay(trace, name.lastPathComponent);
+        }
+        YYCacheTraceToolPrintUsage();
+        return 1;
+    }
+}
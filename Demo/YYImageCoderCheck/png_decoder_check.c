@@ -0,0 +1,334 @@
+//
+//  png_decoder_check.c
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 15/5/13.
+//  Copyright (c) 2015 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+/*
+ Check the APNG pixel decoder (YYKit/Image/_YYImagePNG.c) against a plain scalar
+ reference decoder.
+
+ It generates APNG files of all the supported color types and bit depths, with
+ random filter types, several widths (to cover the SIMD tails) and a `fdAT` frame,
+ then decodes every frame with both decoders and compares the pixels. The files
+ passed in the arguments (such as the APNG files in Demo) are checked too.
+
+ The SIMD path of the host is used: NEON on arm64 (Apple Silicon or device),
+ SSE2 on x86_64. Add `-U__SSE2__` to check the scalar path on x86_64.
+
+ cc -O2 -I../../YYKit/Image png_decoder_check.c ../../YYKit/Image/_YYImagePNG.c -lz -lm -o png_decoder_check
+ ./png_decoder_check ../YYKitDemo/pia@2x.png ../YYKitDemo/cube@2x.png
+ */
+
+#include "_YYImagePNG.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#pragma mark - Reference Decoder
+
+static uint32_t ref_div255(uint32_t v) { return (v + ((v + 128) >> 8) + 128) >> 8; }
+static uint32_t ref_sample16(const uint8_t *p) { return ((((uint32_t)p[0] << 8) | p[1]) * 255 + 32895) >> 16; }
+static uint32_t ref_read32(const uint8_t *p) { return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static uint32_t ref_read16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+static int ref_paeth(int a, int b, int c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+static uint32_t ref_channels(int color_type) {
+    switch (color_type) {
+        case 2: return 3;
+        case 4: return 2;
+        case 6: return 4;
+        default: return 1;
+    }
+}
+
+static uint32_t ref_sample(const uint8_t *row, uint32_t x, int depth) {
+    uint32_t bit = x * depth;
+    return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+}
+
+/// Decode a frame by walking the chunks byte by byte, returns the premultiplied BGRA pixels.
+static uint32_t *ref_decode_frame(const uint8_t *data, size_t length, uint32_t index, uint32_t *width, uint32_t *height) {
+    const uint8_t *plte = NULL, *trns = NULL;
+    uint32_t plte_length = 0, trns_length = 0, frame = 0, w = 0, h = 0;
+    int color_type = 0, depth = 0, found = 0;
+    uint8_t *z = NULL;
+    size_t z_length = 0;
+    for (size_t offset = 8; offset + 12 <= length;) {
+        uint32_t chunk_length = ref_read32(data + offset);
+        const uint8_t *type = data + offset + 4, *chunk = data + offset + 8;
+        if (!memcmp(type, "IHDR", 4)) {
+            depth = chunk[8];
+            color_type = chunk[9];
+        } else if (!memcmp(type, "PLTE", 4)) {
+            plte = chunk; plte_length = chunk_length;
+        } else if (!memcmp(type, "tRNS", 4)) {
+            trns = chunk; trns_length = chunk_length;
+        } else if (!memcmp(type, "fcTL", 4)) {
+            found = frame++ == index;
+            if (found) { w = ref_read32(chunk + 4); h = ref_read32(chunk + 8); }
+        } else if (found && (!memcmp(type, "IDAT", 4) || !memcmp(type, "fdAT", 4))) {
+            uint32_t skip = type[0] == 'f' ? 4 : 0;
+            z = realloc(z, z_length + chunk_length - skip);
+            memcpy(z + z_length, chunk + skip, chunk_length - skip);
+            z_length += chunk_length - skip;
+        } else if (!memcmp(type, "IEND", 4)) {
+            break;
+        }
+        offset += 12 + chunk_length;
+    }
+    if (!z || !w || !h) { free(z); return NULL; }
+
+    uint32_t channels = ref_channels(color_type);
+    size_t row_length = ((size_t)w * channels * depth + 7) / 8;
+    uint32_t bpp = channels * depth / 8 ? channels * depth / 8 : 1;
+    uLongf raw_length = (uLongf)((row_length + 1) * h);
+    uint8_t *raw = malloc(raw_length), *prev = calloc(1, row_length);
+    uint32_t *pixels = calloc((size_t)w * h, 4);
+    if (uncompress(raw, &raw_length, z, (uLong)z_length) != Z_OK || raw_length != (row_length + 1) * h) {
+        free(z); free(raw); free(prev); free(pixels);
+        return NULL;
+    }
+    for (uint32_t y = 0; y < h; y++) {
+        uint8_t filter = raw[y * (row_length + 1)], *row = raw + y * (row_length + 1) + 1;
+        for (size_t i = 0; i < row_length; i++) {
+            int a = i >= bpp ? row[i - bpp] : 0, b = prev[i], c = i >= bpp ? prev[i - bpp] : 0;
+            int predict[5] = {0, a, b, (a + b) >> 1, ref_paeth(a, b, c)};
+            row[i] = (uint8_t)(row[i] + predict[filter]);
+        }
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t r = 0, g = 0, b = 0, a = 255, *px = pixels + y * w + x;
+            if (color_type == 6) {
+                const uint8_t *p = row + x * (depth == 16 ? 8 : 4);
+                if (depth == 16) { r = ref_sample16(p); g = ref_sample16(p + 2); b = ref_sample16(p + 4); a = ref_sample16(p + 6); }
+                else { r = p[0]; g = p[1]; b = p[2]; a = p[3]; }
+            } else if (color_type == 4) {
+                const uint8_t *p = row + x * (depth == 16 ? 4 : 2);
+                if (depth == 16) { r = ref_sample16(p); a = ref_sample16(p + 2); }
+                else { r = p[0]; a = p[1]; }
+                g = b = r;
+            } else if (color_type == 2) {
+                const uint8_t *p = row + x * (depth == 16 ? 6 : 3);
+                uint32_t raw3[3];
+                for (int k = 0; k < 3; k++) raw3[k] = depth == 16 ? ref_read16(p + k * 2) : p[k];
+                if (depth == 16) { r = ref_sample16(p); g = ref_sample16(p + 2); b = ref_sample16(p + 4); }
+                else { r = p[0]; g = p[1]; b = p[2]; }
+                if (trns_length == 6 && raw3[0] == ref_read16(trns) && raw3[1] == ref_read16(trns + 2) && raw3[2] == ref_read16(trns + 4)) a = 0;
+            } else if (color_type == 3) {
+                uint32_t s = depth == 8 ? row[x] : ref_sample(row, x, depth);
+                if (s * 3 + 3 > plte_length) { a = 0; }
+                else {
+                    r = plte[s * 3]; g = plte[s * 3 + 1]; b = plte[s * 3 + 2];
+                    if (trns && s < trns_length) a = trns[s];
+                }
+            } else {
+                uint32_t s = depth == 16 ? ref_read16(row + x * 2) : depth == 8 ? row[x] : ref_sample(row, x, depth);
+                r = g = b = depth == 16 ? ref_sample16(row + x * 2) : s * 255 / ((1 << depth) - 1);
+                if (trns_length == 2 && s == ref_read16(trns)) a = 0;
+            }
+            if (a == 0) { *px = 0; continue; }
+            if (a != 255) { r = ref_div255(r * a); g = ref_div255(g * a); b = ref_div255(b * a); }
+            *px = b | (g << 8) | (r << 16) | (a << 24);
+        }
+        memcpy(prev, row, row_length);
+    }
+    free(z); free(raw); free(prev);
+    *width = w;
+    *height = h;
+    return pixels;
+}
+
+#pragma mark - Check
+
+/// Returns the count of the frames which don't match the reference.
+static int check_data(const uint8_t *data, size_t length, const char *name) {
+    yy_png_info *info = yy_png_info_create(data, (uint32_t)length);
+    yy_png_pixel_format format;
+    if (!info || info->apng_frame_num == 0 || !yy_png_pixel_format_read(data, info, &format)) {
+        printf("%s: not supported by the decoder\n", name);
+        yy_png_info_release(info);
+        return 1;
+    }
+    int bad = 0;
+    for (uint32_t i = 0; i < info->apng_frame_num; i++) {
+        uint32_t w = 0, h = 0;
+        uint32_t *expected = ref_decode_frame(data, length, i, &w, &h);
+        uint32_t *pixels = calloc((size_t)w * h + 1, 4);
+        if (!expected || !yy_png_decode_frame(data, info, &format, i, (uint8_t *)pixels, w * 4)) {
+            printf("%s: frame %u decode failed\n", name, i);
+            bad++;
+        } else {
+            size_t diff = 0;
+            for (size_t p = 0; p < (size_t)w * h; p++) diff += pixels[p] != expected[p];
+            if (diff) {
+                printf("%s: frame %u has %zu different pixels\n", name, i, diff);
+                bad++;
+            }
+        }
+        free(expected);
+        free(pixels);
+    }
+    yy_png_info_release(info);
+    return bad;
+}
+
+#pragma mark - Generator
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+} png_buffer;
+
+static void png_append(png_buffer *buf, const void *bytes, size_t length) {
+    buf->data = realloc(buf->data, buf->length + length);
+    memcpy(buf->data + buf->length, bytes, length);
+    buf->length += length;
+}
+
+static void png_append32(png_buffer *buf, uint32_t v) {
+    uint8_t b[4] = {v >> 24, v >> 16, v >> 8, v};
+    png_append(buf, b, 4);
+}
+
+static void png_chunk(png_buffer *buf, const char *type, const uint8_t *data, uint32_t length) {
+    png_append32(buf, length);
+    size_t start = buf->length;
+    png_append(buf, type, 4);
+    if (length) png_append(buf, data, length);
+    png_append32(buf, (uint32_t)crc32(0, buf->data + start, length + 4));
+}
+
+static void png_fcTL(png_buffer *buf, uint32_t *sequence, uint32_t w, uint32_t h, uint32_t x, uint32_t y) {
+    uint8_t c[26] = {0};
+    uint32_t v[5] = {(*sequence)++, w, h, x, y};
+    for (int i = 0; i < 5; i++) {
+        c[i * 4] = v[i] >> 24; c[i * 4 + 1] = v[i] >> 16; c[i * 4 + 2] = v[i] >> 8; c[i * 4 + 3] = v[i];
+    }
+    c[21] = 1; c[23] = 10; // delay 1/10
+    png_chunk(buf, "fcTL", c, 26);
+}
+
+/// Returns the filtered and compressed scanlines of a random image.
+static uint8_t *png_random_frame(int color_type, int depth, uint32_t w, uint32_t h, uLongf *z_length) {
+    uint32_t channels = ref_channels(color_type);
+    size_t row_length = ((size_t)w * channels * depth + 7) / 8;
+    uint32_t bpp = channels * depth / 8 ? channels * depth / 8 : 1;
+    uint8_t *raw = malloc((row_length + 1) * h), *row = malloc(row_length), *prev = calloc(1, row_length);
+    for (uint32_t y = 0; y < h; y++) {
+        for (size_t i = 0; i < row_length; i++) row[i] = rand() & 1 ? (uint8_t)rand() : (uint8_t)(y * 3 + i);
+        if (color_type == 3 && depth == 8) for (size_t i = 0; i < row_length; i++) row[i] %= 16;
+        uint8_t filter = rand() % 5, *out = raw + y * (row_length + 1);
+        out[0] = filter;
+        for (size_t i = 0; i < row_length; i++) {
+            int a = i >= bpp ? row[i - bpp] : 0, b = prev[i], c = i >= bpp ? prev[i - bpp] : 0;
+            int predict[5] = {0, a, b, (a + b) >> 1, ref_paeth(a, b, c)};
+            out[i + 1] = (uint8_t)(row[i] - predict[filter]);
+        }
+        memcpy(prev, row, row_length);
+    }
+    *z_length = compressBound((uLong)((row_length + 1) * h));
+    uint8_t *z = malloc(*z_length);
+    compress2(z, z_length, raw, (uLong)((row_length + 1) * h), 6);
+    free(raw); free(row); free(prev);
+    return z;
+}
+
+/// An APNG with 2 frames: the cover image in `IDAT`, and a smaller frame in `fdAT`.
+static png_buffer png_generate(int color_type, int depth, uint32_t w, uint32_t h, const uint8_t *trns, uint32_t trns_length) {
+    png_buffer buf = {0};
+    png_append(&buf, "\x89PNG\r\n\x1a\n", 8);
+    uint8_t ihdr[13] = {w >> 24, w >> 16, w >> 8, w, h >> 24, h >> 16, h >> 8, h, depth, color_type, 0, 0, 0};
+    png_chunk(&buf, "IHDR", ihdr, 13);
+    uint8_t actl[8] = {0, 0, 0, 2, 0, 0, 0, 0};
+    png_chunk(&buf, "acTL", actl, 8);
+    if (color_type == 3) {
+        uint8_t plte[16 * 3];
+        for (int i = 0; i < 16 * 3; i++) plte[i] = (uint8_t)rand();
+        png_chunk(&buf, "PLTE", plte, sizeof(plte));
+    }
+    if (trns) png_chunk(&buf, "tRNS", trns, trns_length);
+
+    uint32_t sequence = 0;
+    uLongf z_length;
+    png_fcTL(&buf, &sequence, w, h, 0, 0);
+    uint8_t *z = png_random_frame(color_type, depth, w, h, &z_length);
+    for (uLongf i = 0; i < z_length; i += 97) { // several chunks, the rows cross the chunk boundaries
+        png_chunk(&buf, "IDAT", z + i, (uint32_t)(z_length - i < 97 ? z_length - i : 97));
+    }
+    free(z);
+
+    uint32_t fw = w > 1 ? w - 1 : 1, fh = h > 2 ? h - 2 : 1;
+    png_fcTL(&buf, &sequence, fw, fh, w - fw, h - fh);
+    z = png_random_frame(color_type, depth, fw, fh, &z_length);
+    for (uLongf i = 0; i < z_length; i += 61) {
+        uint32_t length = (uint32_t)(z_length - i < 61 ? z_length - i : 61);
+        uint8_t *fdat = malloc(length + 4);
+        fdat[0] = sequence >> 24; fdat[1] = sequence >> 16; fdat[2] = sequence >> 8; fdat[3] = sequence;
+        sequence++;
+        memcpy(fdat + 4, z + i, length);
+        png_chunk(&buf, "fdAT", fdat, length + 4);
+        free(fdat);
+    }
+    free(z);
+    png_chunk(&buf, "IEND", NULL, 0);
+    return buf;
+}
+
+int main(int argc, const char *argv[]) {
+    static const struct {
+        int color_type, depth;
+        const char *trns;
+        uint32_t trns_length;
+    } cases[] = {
+        {6, 8, NULL, 0}, {6, 16, NULL, 0},
+        {2, 8, "\0\1\0\2\0\3", 6}, {2, 16, "\0\1\0\2\0\3", 6},
+        {4, 8, NULL, 0}, {4, 16, NULL, 0},
+        {0, 1, NULL, 0}, {0, 2, NULL, 0}, {0, 4, "\0\3", 2}, {0, 8, NULL, 0}, {0, 16, "\0\3", 2},
+        {3, 1, "\0\200", 2}, {3, 2, NULL, 0}, {3, 4, "\12\24\36", 3}, {3, 8, "\0\12\24\36\50\62\74\106", 8},
+    };
+    static const uint32_t widths[] = {1, 2, 3, 5, 17, 33, 100};
+
+    int bad = 0, count = 0;
+    srand(1);
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+            png_buffer png = png_generate(cases[c].color_type, cases[c].depth, widths[i], 7,
+                                          (const uint8_t *)cases[c].trns, cases[c].trns_length);
+            char name[64];
+            snprintf(name, sizeof(name), "color %d depth %d width %u", cases[c].color_type, cases[c].depth, widths[i]);
+            bad += check_data(png.data, png.length, name) != 0;
+            count++;
+            free(png.data);
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (!file) {
+            printf("%s: can not open\n", argv[i]);
+            bad++;
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        size_t length = (size_t)ftell(file);
+        fseek(file, 0, SEEK_SET);
+        uint8_t *data = malloc(length);
+        size_t read = fread(data, 1, length, file);
+        fclose(file);
+        bad += check_data(data, read, argv[i]) != 0;
+        count++;
+        free(data);
+    }
+    printf("%d images checked, %d failed\n", count, bad);
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,13 @@
+//
+//  YYCacheBenchmark.h
+//  YYKitExample
+//
+//  Created by ibireme on 15/11/20.
+//  Copyright (c) 2015 ibireme. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+
+@interface YYCacheBenchmark : UITableViewController
+
+@end
@@ -0,0 +1,498 @@
+//
+//  YYCacheBenchmark.m
+//  YYKitExample
+//
+//  Created by ibireme on 15/11/20.
+//  Copyright (c) 2015 ibireme. All rights reserved.
+//
+
+#import "YYCacheBenchmark.h"
+#import "YYKit.h"
+#import <malloc/malloc.h>
+#import <mach/mach.h>
+#import <libkern/OSAtomic.h>
+
+/*
+ Count the allocations of default malloc zone (the zone functions are replaced
+ while counting). It's only used for benchmark.
+ */
+static volatile int64_t _YYAllocationCount = 0;
+static void *(*_YYOriginalMalloc)(struct _malloc_zone_t *zone, size_t size);
+static void *(*_YYOriginalCalloc)(struct _malloc_zone_t *zone, size_t num_items, size_t size);
+static void *(*_YYOriginalRealloc)(struct _malloc_zone_t *zone, void *ptr, size_t size);
+
+static void *_YYCountingMalloc(struct _malloc_zone_t *zone, size_t size) {
+    OSAtomicIncrement64(&_YYAllocationCount);
+    return _YYOriginalMalloc(zone, size);
+}
+
+static void *_YYCountingCalloc(struct _malloc_zone_t *zone, size_t num_items, size_t size) {
+    OSAtomicIncrement64(&_YYAllocationCount);
+    return _YYOriginalCalloc(zone, num_items, size);
+}
+
+static void *_YYCountingRealloc(struct _malloc_zone_t *zone, void *ptr, size_t size) {
+    OSAtomicIncrement64(&_YYAllocationCount);
+    return _YYOriginalRealloc(zone, ptr, size);
+}
+
+static void _YYAllocationCountingSetEnabled(BOOL enabled) {
+    malloc_zone_t *zone = malloc_default_zone();
+    vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(malloc_zone_t), 0, VM_PROT_READ | VM_PROT_WRITE);
+    if (enabled) {
+        _YYOriginalMalloc = zone->malloc;
+        _YYOriginalCalloc = zone->calloc;
+        _YYOriginalRealloc = zone->realloc;
+        zone->malloc = _YYCountingMalloc;
+        zone->calloc = _YYCountingCalloc;
+        zone->realloc = _YYCountingRealloc;
+    } else {
+        zone->malloc = _YYOriginalMalloc;
+        zone->calloc = _YYOriginalCalloc;
+        zone->realloc = _YYOriginalRealloc;
+    }
+    vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(malloc_zone_t), 0, VM_PROT_READ);
+}
+
+
+@interface YYBenchmarkUser : NSObject <NSCoding>
+@property (nonatomic, assign) uint64_t uid;
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, copy) NSString *avatar;
+@property (nonatomic, assign) int followers;
+@property (nonatomic, assign) BOOL verified;
+@end
+
+@implementation YYBenchmarkUser
+- (void)encodeWithCoder:(NSCoder *)aCoder { [self modelEncodeWithCoder:aCoder]; }
+- (id)initWithCoder:(NSCoder *)aDecoder { self = [super init]; return [self modelInitWithCoder:aDecoder]; }
+@end
+
+@interface YYBenchmarkPost : NSObject <NSCoding>
+@property (nonatomic, assign) int64_t pid;
+@property (nonatomic, copy) NSString *text;
+@property (nonatomic, strong) NSDate *created;
+@property (nonatomic, strong) NSURL *url;
+@property (nonatomic, assign) double score;
+@property (nonatomic, assign) CGSize imageSize;
+@property (nonatomic, strong) YYBenchmarkUser *user;
+@property (nonatomic, strong) NSArray *tags;
+@property (nonatomic, strong) NSDictionary *extra;
+@end
+
+@implementation YYBenchmarkPost
+- (void)encodeWithCoder:(NSCoder *)aCoder { [self modelEncodeWithCoder:aCoder]; }
+- (id)initWithCoder:(NSCoder *)aDecoder { self = [super init]; return [self modelInitWithCoder:aDecoder]; }
+@end
+
+
+@implementation YYCacheBenchmark {
+    NSMutableArray *_titles;
+    NSMutableArray *_blocks;
+    BOOL _running;
+}
+
+- (void)viewDidLoad {
+    [super viewDidLoad];
+    _titles = [NSMutableArray new];
+    _blocks = [NSMutableArray new];
+    self.title = @"Benchmark (See Logs in Xcode)";
+    
+    [self addCell:@"Memory Cache Lock Contention" selector:@selector(runMemoryCacheContentionBenchmark)];
+    [self addCell:@"Memory Cache Eviction Policy Hit Ratio" selector:@selector(runMemoryCacheEvictionPolicyBenchmark)];
+    [self addCell:@"Memory Cache Allocations" selector:@selector(runMemoryCacheAllocationBenchmark)];
+    [self addCell:@"Disk Cache Concurrent Read" selector:@selector(runDiskCacheConcurrentReadBenchmark)];
+    [self addCell:@"Disk Cache Read Your Writes" selector:@selector(runDiskCacheReadYourWritesCheck)];
+    [self addCell:@"Model Binary Codec" selector:@selector(runModelBinaryCodecBenchmark)];
+    
+    [self.tableView reloadData];
+}
+
+- (void)addCell:(NSString *)title selector:(SEL)sel {
+    __weak typeof(self) _self = self;
+    void (^block)(void) = ^() {
+        __strong typeof(_self) self = _self;
+        if (!self || self->_running || ![self respondsToSelector:sel]) return;
+        
+        self->_running = YES;
+        self.navigationController.view.userInteractionEnabled = NO;
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Warc-performSelector-leaks"
+            [self performSelector:sel];
+#pragma clang diagnostic pop
+            dispatch_async(dispatch_get_main_queue(), ^{
+                self->_running = NO;
+                self.navigationController.view.userInteractionEnabled = YES;
+            });
+        });
+    };
+    [_titles addObject:title];
+    [_blocks addObject:block];
+}
+
+- (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath {
+    [tableView deselectRowAtIndexPath:indexPath animated:YES];
+    ((void (^)(void))_blocks[indexPath.row])();
+}
+
+- (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section {
+    return _titles.count;
+}
+
+- (UITableViewCell *)tableView:(UITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath {
+    UITableViewCell *cell = [tableView dequeueReusableCellWithIdentifier:@"YY"];
+    if (!cell) {
+        cell = [[UITableViewCell alloc] initWithStyle:UITableViewCellStyleDefault reuseIdentifier:@"YY"];
+    }
+    cell.textLabel.text = _titles[indexPath.row];
+    return cell;
+}
+
+#pragma mark - Helper
+
+/// Keys like "key_0", "key_1"... (created before the benchmark runs)
+- (NSArray *)keysWithCount:(int)count {
+    NSMutableArray *keys = [NSMutableArray new];
+    for (int i = 0; i < count; i++) {
+        [keys addObject:[NSString stringWithFormat:@"key_%d", i]];
+    }
+    return keys;
+}
+
+/// A trace of keys which follows the Zipf distribution (key_0 is the most popular one).
+- (NSArray *)zipfTraceWithKeys:(NSArray *)keys length:(int)length exponent:(double)exponent seed:(uint32_t)seed {
+    int n = (int)keys.count;
+    double *cdf = malloc(sizeof(double) * n);
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, exponent);
+        cdf[i] = sum;
+    }
+    NSMutableArray *trace = [NSMutableArray new];
+    for (int i = 0; i < length; i++) {
+        double r = (double)rand_r(&seed) / RAND_MAX * sum;
+        int lo = 0, hi = n - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (cdf[mid] < r) lo = mid + 1;
+            else hi = mid;
+        }
+        [trace addObject:keys[lo]];
+    }
+    free(cdf);
+    return trace;
+}
+
+/// Replay the trace (get, and set on miss), returns the hit ratio.
+- (double)hitRatioOfTrace:(NSArray *)trace cache:(YYMemoryCache *)cache {
+    NSNumber *value = @(1);
+    for (NSString *key in trace) {
+        if (![cache objectForKey:key]) {
+            [cache setObject:value forKey:key];
+        }
+    }
+    NSUInteger hit = cache.hitCount, miss = cache.missCount;
+    return hit + miss > 0 ? (double)hit / (hit + miss) : 0;
+}
+
+#pragma mark - Benchmark
+
+- (void)runMemoryCacheContentionBenchmark {
+    printf("==========================================\n");
+    printf("Memory Cache Lock Contention Benchmark\n");
+    printf("(90%% get, 10%% set, ops/ms, larger is better)\n");
+    printf("threads shards   ops/ms\n");
+    
+    int keyCount = 20000;
+    int opCount = 200000; // per thread
+    NSArray *keys = [self keysWithCount:keyCount];
+    NSNumber *value = @(1);
+    
+    for (NSNumber *threadCount in @[@1, @2, @4, @8, @16]) {
+        for (NSNumber *shardCount in @[@1, @4, @16, @64]) {
+            @autoreleasepool {
+                YYMemoryCache *cache = [[YYMemoryCache alloc] initWithShardCount:shardCount.unsignedIntegerValue];
+                cache.countLimit = keyCount / 2; // keep evicting
+                for (NSString *key in keys) {
+                    [cache setObject:value forKey:key];
+                }
+                
+                size_t threads = threadCount.unsignedIntegerValue;
+                YYBenchmark(^{
+                    dispatch_apply(threads, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t t) {
+                        uint32_t seed = (uint32_t)t + 1;
+                        for (int i = 0; i < opCount; i++) {
+                            seed = seed * 1103515245 + 12345;
+                            NSString *key = keys[(seed >> 8) % keyCount];
+                            if ((seed & 0xFF) < 26) {
+                                [cache setObject:value forKey:key];
+                            } else {
+                                [cache objectForKey:key];
+                            }
+                        }
+                    });
+                }, ^(double ms) {
+                    printf("%7d %6d %8.1f\n", threadCount.intValue, (int)cache.shardCount, opCount * threads / ms);
+                });
+            }
+        }
+    }
+    printf("------------------------------------------\n\n");
+}
+
+- (void)runMemoryCacheEvictionPolicyBenchmark {
+    printf("==========================================\n");
+    printf("Memory Cache Eviction Policy Benchmark\n");
+    printf("(hit ratio %%, larger is better)\n");
+    
+    NSArray *keys = [self keysWithCount:100000];
+    NSArray *zipf = [self zipfTraceWithKeys:keys length:400000 exponent:0.9 seed:1];
+    
+    // zipf accesses, interrupted by long scans of keys which are never reused
+    NSMutableArray *scan = [NSMutableArray new];
+    NSArray *scanKeys = [self keysWithCount:50000];
+    for (int i = 0; i < 4; i++) {
+        [scan addObjectsFromArray:[zipf subarrayWithRange:NSMakeRange(i * 100000, 100000)]];
+        for (NSString *key in [scanKeys subarrayWithRange:NSMakeRange(i * 10000, 10000)]) {
+            [scan addObject:[@"scan_" stringByAppendingString:key]];
+        }
+    }
+    
+    // a loop over a working set which is a little larger than the cache
+    NSMutableArray *loop = [NSMutableArray new];
+    for (int i = 0; i < 200; i++) {
+        [loop addObjectsFromArray:[keys subarrayWithRange:NSMakeRange(0, 1200)]];
+    }
+    
+    NSDictionary *traces = @{@"zipf" : zipf, @"zipf+scan" : scan, @"loop" : loop};
+    NSArray *policyNames = @[@"LRU", @"SLRU", @"TinyLFU"];
+    printf("trace      cache    LRU   SLRU TinyLFU\n");
+    for (NSString *traceName in @[@"zipf", @"zipf+scan", @"loop"]) {
+        for (NSNumber *limit in @[@1000, @10000]) {
+            printf("%-10s %5d", traceName.UTF8String, limit.intValue);
+            for (NSUInteger policy = 0; policy < policyNames.count; policy++) {
+                @autoreleasepool {
+                    YYMemoryCache *cache = [YYMemoryCache new];
+                    cache.evictionPolicy = policy;
+                    cache.countLimit = limit.unsignedIntegerValue;
+                    cache.releaseAsynchronously = NO;
+                    double ratio = [self hitRatioOfTrace:traces[traceName] cache:cache];
+                    printf(" %6.2f", ratio * 100);
+                }
+            }
+            printf("\n");
+        }
+    }
+    printf("------------------------------------------\n\n");
+}
+
+- (void)runMemoryCacheAllocationBenchmark {
+    printf("==========================================\n");
+    printf("Memory Cache Allocation Benchmark\n");
+    printf("(malloc calls per op and time per op, smaller is better)\n");
+    printf("operation      allocs/op    ns/op\n");
+    
+    int keyCount = 10000;
+    int opCount = 200000;
+    NSArray *keys = [self keysWithCount:keyCount];
+    NSArray *newKeys = [self keysWithCount:opCount];
+    NSNumber *value = @(1);
+    
+    YYMemoryCache *cache = [YYMemoryCache new];
+    cache.countLimit = keyCount;
+    cache.releaseAsynchronously = NO; // do not count the release blocks
+    for (NSString *key in keys) {
+        [cache setObject:value forKey:key];
+    }
+    
+    void (^run)(const char *, void (^)(int i)) = ^(const char *name, void (^op)(int i)) {
+        __block int64_t allocs = 0;
+        YYBenchmark(^{
+            @autoreleasepool {
+                _YYAllocationCountingSetEnabled(YES);
+                int64_t begin = _YYAllocationCount;
+                for (int i = 0; i < opCount; i++) op(i);
+                allocs = _YYAllocationCount - begin;
+                _YYAllocationCountingSetEnabled(NO);
+            }
+        }, ^(double ms) {
+            printf("%-14s %9.3f %8.1f\n", name, (double)allocs / opCount, ms * 1000000.0 / opCount);
+        });
+    };
+    
+    run("get (hit)", ^(int i) {
+        [cache objectForKey:keys[i % keyCount]];
+    });
+    run("get (miss)", ^(int i) {
+        [cache objectForKey:newKeys[i]];
+    });
+    run("set (exist)", ^(int i) {
+        [cache setObject:value forKey:keys[i % keyCount]];
+    });
+    run("set (evict)", ^(int i) {
+        [cache setObject:value forKey:newKeys[i]];
+    });
+    printf("------------------------------------------\n\n");
+}
+
+- (void)runDiskCacheConcurrentReadBenchmark {
+    printf("==========================================\n");
+    printf("Disk Cache Concurrent Read Benchmark\n");
+    printf("(objectForKey: on multiple threads, ops/ms, larger is better)\n");
+    printf("threads readers   ops/ms\n");
+    
+    int keyCount = 10000;
+    int opCount = 20000; // per thread
+    NSArray *keys = [self keysWithCount:keyCount];
+    NSMutableArray *values = [NSMutableArray new];
+    for (int i = 0; i < keyCount; i++) {
+        [values addObject:[NSMutableData dataWithLength:200]];
+    }
+    NSString *basePath = [[UIApplication sharedApplication].cachesPath stringByAppendingPathComponent:@"benchmark_read"];
+    
+    for (NSNumber *readerCount in @[@0, @4]) {
+        NSString *path = [basePath stringByAppendingPathComponent:readerCount.stringValue];
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:path inlineThreshold:NSUIntegerMax];
+        cache.readConnectionCount = readerCount.unsignedIntegerValue;
+        [cache removeAllObjects];
+        [cache setObjects:values forKeys:keys];
+        [cache flush]; // the uncommitted objects are read with lock
+        
+        for (NSNumber *threadCount in @[@1, @2, @4, @8]) {
+            size_t threads = threadCount.unsignedIntegerValue;
+            YYBenchmark(^{
+                dispatch_apply(threads, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t t) {
+                    uint32_t seed = (uint32_t)t + 1;
+                    for (int i = 0; i < opCount; i++) {
+                        @autoreleasepool {
+                            seed = seed * 1103515245 + 12345;
+                            [cache objectForKey:keys[(seed >> 8) % keyCount]];
+                        }
+                    }
+                });
+            }, ^(double ms) {
+                printf("%7d %7d %8.1f\n", threadCount.intValue, readerCount.intValue, opCount * threads / ms);
+            });
+        }
+        [cache removeAllObjects];
+    }
+    printf("------------------------------------------\n\n");
+}
+
+- (void)runDiskCacheReadYourWritesCheck {
+    printf("==========================================\n");
+    printf("Disk Cache Read Your Writes Check\n");
+    printf("(write batch and read connections enabled, the batch expires between the writes)\n");
+    printf("storage  set  reset remove\n");
+    
+    NSTimeInterval latency = 0.2;
+    NSString *basePath = [[UIApplication sharedApplication].cachesPath stringByAppendingPathComponent:@"benchmark_ryw"];
+    for (NSNumber *threshold in @[@(NSUIntegerMax), @0]) { // sqlite, file
+        NSString *path = [basePath stringByAppendingPathComponent:threshold.stringValue];
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:path inlineThreshold:threshold.unsignedIntegerValue];
+        cache.writeBatchLatency = latency;
+        cache.readConnectionCount = 4;
+        [cache removeAllObjects];
+        
+        NSString *key = @"key";
+        [cache setObject:@"value_1" forKey:key];
+        BOOL set = [[cache objectForKey:key] isEqual:@"value_1"];
+        [NSThread sleepForTimeInterval:latency * 1.5]; // the next write rolls the expired batch
+        [cache setObject:@"value_2" forKey:key];
+        BOOL reset = [[cache objectForKey:key] isEqual:@"value_2"];
+        [NSThread sleepForTimeInterval:latency * 1.5];
+        [cache removeObjectForKey:key];
+        BOOL remove = [cache objectForKey:key] == nil;
+        
+        printf("%7s %4s %6s %6s\n", threshold.unsignedIntegerValue ? "sqlite" : "file",
+               set ? "OK" : "FAIL", reset ? "OK" : "FAIL", remove ? "OK" : "FAIL");
+        [cache removeAllObjects];
+    }
+    printf("------------------------------------------\n\n");
+}
+
+- (void)runModelBinaryCodecBenchmark {
+    printf("==========================================\n");
+    printf("Model Binary Codec Benchmark\n");
+    printf("(encode/decode an array of nested models, smaller is better)\n");
+    
+    int count = 1000;
+    int loop = 20;
+    NSMutableArray *posts = [NSMutableArray new];
+    for (int i = 0; i < count; i++) {
+        YYBenchmarkUser *user = [YYBenchmarkUser new];
+        user.uid = 1000000 + i;
+        user.name = [NSString stringWithFormat:@"user_%d", i];
+        user.avatar = [NSString stringWithFormat:@"https://example.com/avatar/%d.jpg", i];
+        user.followers = i * 17;
+        user.verified = i % 3 == 0;
+        
+        YYBenchmarkPost *post = [YYBenchmarkPost new];
+        post.pid = 5000000000LL + i;
+        post.text = [NSString stringWithFormat:@"This is the content of post %d, with some words to make it longer.", i];
+        post.created = [NSDate dateWithTimeIntervalSince1970:1400000000 + i];
+        post.url = [NSURL URLWithString:[NSString stringWithFormat:@"https://example.com/post/%d", i]];
+        post.score = i / 7.0;
+        post.imageSize = CGSizeMake(640, 480);
+        post.user = user;
+        post.tags = @[@"swift", @"objc", @(i)];
+        post.extra = @{@"source" : @"web", @"reposts" : @(i * 3)};
+        [posts addObject:post];
+    }
+    
+    __block NSData *keyedData = nil;
+    __block NSData *binaryData = nil;
+    printf("codec            encode(ms) decode(ms)   size(KB)\n");
+    
+    __block double encodeTime = 0;
+    YYBenchmark(^{
+        for (int i = 0; i < loop; i++) {
+            @autoreleasepool {
+                keyedData = [NSKeyedArchiver archivedDataWithRootObject:posts];
+            }
+        }
+    }, ^(double ms) {
+        encodeTime = ms;
+    });
+    YYBenchmark(^{
+        for (int i = 0; i < loop; i++) {
+            @autoreleasepool {
+                [NSKeyedUnarchiver unarchiveObjectWithData:keyedData];
+            }
+        }
+    }, ^(double ms) {
+        printf("NSKeyedArchiver  %10.2f %10.2f %10.1f\n", encodeTime / loop, ms / loop, keyedData.length / 1024.0);
+    });
+    
+    YYBenchmark(^{
+        for (int i = 0; i < loop; i++) {
+            @autoreleasepool {
+                binaryData = [posts modelToBinaryData];
+            }
+        }
+    }, ^(double ms) {
+        encodeTime = ms;
+    });
+    YYBenchmark(^{
+        for (int i = 0; i < loop; i++) {
+            @autoreleasepool {
+                [NSArray modelWithBinaryData:binaryData];
+            }
+        }
+    }, ^(double ms) {
+        printf("YYModel binary   %10.2f %10.2f %10.1f\n", encodeTime / loop, ms / loop, binaryData.length / 1024.0);
+    });
+    
+    NSArray *decoded = [NSArray modelWithBinaryData:binaryData];
+    BOOL equal = decoded.count == posts.count;
+    for (int i = 0; equal && i < count; i++) {
+        YYBenchmarkPost *p1 = posts[i], *p2 = decoded[i];
+        equal = [p1.text isEqualToString:p2.text] && p1.pid == p2.pid && [p1.user.name isEqualToString:p2.user.name] &&
+                CGSizeEqualToSize(p1.imageSize, p2.imageSize) && [p1.tags isEqualToArray:p2.tags] && [p1.extra isEqualToDictionary:p2.extra];
+    }
+    printf("round trip: %s\n", equal ? "OK" : "FAILED");
+    printf("------------------------------------------\n\n");
+}
+
+@end
@@ -19,6 +19,35 @@
 #define ENABLE_OUTPUT 0
 #define IMAGE_OUTPUT_DIR @"/Users/ibireme/Desktop/image_out/"
 
+/// The scalar version of YYImageBlendARGB8888(), blend = -1 for the opaque source.
+static void YYBenchmarkBlendScalar(uint8_t *dest, const uint8_t *src, size_t count, int blend) {
+    for (size_t i = 0; i < count * 4; i += 4) {
+        if (blend < 0) {
+            memcpy(dest + i, src + i, 3);
+            dest[i + 3] = 0xFF;
+        } else if (blend == YYImageBlendNone) {
+            memcpy(dest + i, src + i, 4);
+        } else {
+            uint32_t inv = 255 - src[i + 3];
+            for (int c = 0; c < 4; c++) {
+                uint32_t v = dest[i + c] * inv;
+                v = src[i + c] + ((v + ((v + 128) >> 8) + 128) >> 8);
+                dest[i + c] = v > 255 ? 255 : v;
+            }
+        }
+    }
+}
+
+/// Fill random premultiplied BGRA pixels, with many fully transparent and opaque pixels.
+static void YYBenchmarkFillRandomPixels(uint8_t *pixels, size_t count) {
+    for (size_t i = 0; i < count * 4; i += 4) {
+        uint32_t r = arc4random() % 4;
+        uint8_t a = r == 0 ? 0 : r == 1 ? 255 : arc4random() % 256;
+        for (int c = 0; c < 3; c++) pixels[i + c] = a ? arc4random() % (a + 1) : 0;
+        pixels[i + 3] = a;
+    }
+}
+
 
 
 @implementation YYImageBenchmark {
@@ -40,6 +69,7 @@
     [self addCell:@"WebP Encode and Decode (Slow)" selector:@selector(runWebPBenchmark)];
     [self addCell:@"BPG Decode" selector:@selector(runBPGBenchmark)];
     [self addCell:@"Animated Image Decode" selector:@selector(runAnimatedImageBenchmark)];
+    [self addCell:@"Image Blend Check" selector:@selector(runImageBlendCheck)];
     
     [self.tableView reloadData];
 }
@@ -739,4 +769,99 @@
 
 }
 
+- (void)runImageBlendCheck {
+    printf("==========================================\n");
+    printf("Image Blend Check\n");
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    printf("YYImageBlendARGB8888 with NEON\n");
+#elif defined(__SSE2__)
+    printf("YYImageBlendARGB8888 with SSE2\n");
+#else
+    printf("YYImageBlendARGB8888 without SIMD\n");
+#endif
+    printf("(scalar: same as the scalar version, cg: max difference to CGContextDrawImage)\n");
+    printf("blend   width scalar cg\n");
+    
+    CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst;
+    CGBitmapInfo opaqueInfo = kCGBitmapByteOrder32Host | kCGImageAlphaNoneSkipFirst;
+    size_t height = 8;
+    BOOL allPassed = YES;
+    for (NSNumber *blend in @[@(YYImageBlendNone), @(YYImageBlendOver), @(-1)]) {
+        const char *name = blend.intValue < 0 ? "opaque" : blend.intValue == YYImageBlendOver ? "over" : "none";
+        for (NSNumber *widthValue in @[@1, @3, @4, @7, @8, @9, @15, @16, @17, @33, @257]) {
+            size_t width = widthValue.unsignedIntegerValue, bytesPerRow = width * 4, length = bytesPerRow * height;
+            uint8_t *src = malloc(length), *dest = malloc(length), *result = malloc(length), *expected = malloc(length);
+            YYBenchmarkFillRandomPixels(src, width * height);
+            YYBenchmarkFillRandomPixels(dest, width * height);
+            
+            memcpy(result, dest, length);
+            YYImageBlendARGB8888(result, bytesPerRow, src, bytesPerRow, width, height,
+                                 blend.intValue < 0 ? YYImageBlendOver : blend.unsignedIntegerValue, blend.intValue < 0);
+            memcpy(expected, dest, length);
+            for (size_t y = 0; y < height; y++) {
+                YYBenchmarkBlendScalar(expected + y * bytesPerRow, src + y * bytesPerRow, width, blend.intValue);
+            }
+            BOOL scalarPassed = memcmp(result, expected, length) == 0;
+            
+            // the old canvas: draw the frame image into the bitmap context
+            memcpy(expected, dest, length);
+            CGContextRef context = CGBitmapContextCreate(expected, width, height, 8, bytesPerRow, space, bitmapInfo);
+            CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, src, length, NULL);
+            CGImageRef image = CGImageCreate(width, height, 8, 32, bytesPerRow, space, blend.intValue < 0 ? opaqueInfo : bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+            CGContextSetBlendMode(context, blend.intValue == YYImageBlendNone ? kCGBlendModeCopy : kCGBlendModeNormal);
+            CGContextDrawImage(context, CGRectMake(0, 0, width, height), image);
+            CGImageRelease(image);
+            CGDataProviderRelease(provider);
+            CGContextRelease(context);
+            int maxDiff = 0;
+            for (size_t i = 0; i < length; i++) maxDiff = MAX(maxDiff, abs((int)result[i] - (int)expected[i]));
+            
+            printf("%6s %6d %6s %2d\n", name, (int)width, scalarPassed ? "OK" : "FAIL", maxDiff);
+            if (!scalarPassed || maxDiff > 1) allPassed = NO;
+            free(src); free(dest); free(result); free(expected);
+        }
+    }
+    printf("%s\n", allPassed ? "all passed" : "FAILED");
+    
+    printf("------------------------------------------\n");
+    printf("Blend 1024x1024 over\n");
+    size_t width = 1024, bytesPerRow = width * 4, length = bytesPerRow * 1024;
+    uint8_t *src = malloc(length), *dest = malloc(length);
+    YYBenchmarkFillRandomPixels(src, width * 1024);
+    YYBenchmarkFillRandomPixels(dest, width * 1024);
+    int count = 20;
+    YYBenchmark(^{
+        for (int i = 0; i < count; i++) {
+            YYImageBlendARGB8888(dest, bytesPerRow, src, bytesPerRow, width, 1024, YYImageBlendOver, NO);
+        }
+    }, ^(double ms) {
+        printf("YYImageBlendARGB8888: %8.3f\n", ms / count);
+    });
+    YYBenchmark(^{
+        for (int i = 0; i < count; i++) {
+            YYBenchmarkBlendScalar(dest, src, width * 1024, YYImageBlendOver);
+        }
+    }, ^(double ms) {
+        printf("scalar:               %8.3f\n", ms / count);
+    });
+    CGContextRef context = CGBitmapContextCreate(dest, width, 1024, 8, bytesPerRow, space, bitmapInfo);
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, src, length, NULL);
+    CGImageRef image = CGImageCreate(width, 1024, 8, 32, bytesPerRow, space, bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+    YYBenchmark(^{
+        for (int i = 0; i < count; i++) {
+            CGContextDrawImage(context, CGRectMake(0, 0, width, 1024), image);
+        }
+    }, ^(double ms) {
+        printf("CGContextDrawImage:   %8.3f\n", ms / count);
+    });
+    CGImageRelease(image);
+    CGDataProviderRelease(provider);
+    CGContextRelease(context);
+    free(src);
+    free(dest);
+    CGColorSpaceRelease(space);
+    printf("------------------------------------------\n\n");
+}
+
 @end
@@ -25,6 +25,7 @@
     [self addCell:@"Image" class:@"YYImageExample"];
     [self addCell:@"Text" class:@"YYTextExample"];
 //    [self addCell:@"Utility" class:@"YYUtilityExample"];
+//    [self addCell:@"Cache Benchmark" class:@"YYCacheBenchmark"];
     [self addCell:@"Feed List Demo" class:@"YYFeedListExample"];
     [self.tableView reloadData];
     
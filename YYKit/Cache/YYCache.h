@@ -11,7 +11,7 @@
 
 #import <Foundation/Foundation.h>
 
-@class YYMemoryCache, YYDiskCache;
+@class YYMemoryCache, YYDiskCache, YYCacheTraceRecorder;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -33,6 +33,21 @@ NS_ASSUME_NONNULL_BEGIN
 /** The underlying disk cache. see `YYDiskCache` for more information.*/
 @property (strong, readonly) YYDiskCache *diskCache;
 
+/**
+ If `YES`, a `YYCacheMetrics` is set to both `memoryCache` and `diskCache` (if they
+ don't have one), then the statistics of each tier can be read from their `metrics`.
+ Set to `NO` to remove the metrics. Default is NO.
+ */
+@property BOOL metricsEnabled;
+
+/**
+ If it's not nil, the get, set and remove operations are recorded to it (a batch
+ operation is recorded as one record per key), the trace can be replayed later with
+ the command-line tool in Demo/YYCacheTraceTool to compare the cache configurations.
+ The size is recorded only if the object is NSData, it's 0 otherwise. Default is nil.
+ */
+@property (nullable, strong) YYCacheTraceRecorder *traceRecorder;
+
 /**
  Create a new instance with the specified name.
  Multiple instances with the same name will make the cache unstable.
@@ -118,6 +133,10 @@ NS_ASSUME_NONNULL_BEGIN
  This method returns immediately and invoke the passed block in background queue
  when the operation finished.
  
+ @discussion If the value is not in memory cache, and there's already a request of
+ the same key reading from disk cache, the block waits for that request and receives
+ the same value, instead of reading and unarchiving the data again.
+ 
  @param key A string identifying the value. If nil, just return nil.
  @param block A block which will be invoked in background queue when finished.
  */
@@ -142,6 +161,50 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)setObject:(nullable id<NSCoding>)object forKey:(NSString *)key withBlock:(nullable void(^)(void))block;
 
+/**
+ Returns the values associated with the given keys.
+ This method may blocks the calling thread until file read finished.
+ 
+ @discussion The values are looked up in memory cache first, and the missing ones 
+ are read from disk cache in a single transaction (and then put into memory cache).
+ 
+ @param keys An array of strings identifying the values.
+ @return A dictionary contains the found key-value pairs, the keys which are not
+     in cache will be absent.
+ */
+- (NSDictionary<NSString *, id<NSCoding>> *)objectsForKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Returns the values associated with the given keys.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param keys  An array of strings identifying the values.
+ @param block A block which will be invoked in background queue when finished.
+ */
+- (void)objectsForKeys:(NSArray<NSString *> *)keys withBlock:(nullable void(^)(NSDictionary<NSString *, id<NSCoding>> *objects))block;
+
+/**
+ Sets the values of the specified keys in the cache.
+ This method may blocks the calling thread until file write finished.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the values, the count should be
+     equal to the count of objects, otherwise this method has no effect.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Sets the values of the specified keys in the cache.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the values.
+ @param block   A block which will be invoked in background queue when finished.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys withBlock:(nullable void(^)(void))block;
+
 /**
  Removes the value of the specified key in the cache.
  This method may blocks the calling thread until file delete finished.
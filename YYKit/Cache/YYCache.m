@@ -12,8 +12,15 @@
 #import "YYCache.h"
 #import "YYMemoryCache.h"
 #import "YYDiskCache.h"
+#import "YYCacheMetrics.h"
+#import "YYCacheTrace.h"
+#import <pthread.h>
 
-@implementation YYCache
+@implementation YYCache {
+    pthread_mutex_t _flightLock;
+    NSMutableDictionary *_flights; ///< key -> NSMutableArray<block>, the disk reads in flight
+    NSMutableSet *_staleFlights;   ///< keys set or removed during their flights, the results are not put into memory
+}
 
 - (instancetype) init {
     NSLog(@"Use \"initWithName\" or \"initWithPath\" to create YYCache instance.");
@@ -39,9 +46,16 @@
     _name = name;
     _diskCache = diskCache;
     _memoryCache = memoryCache;
+    pthread_mutex_init(&_flightLock, NULL);
+    _flights = [NSMutableDictionary new];
+    _staleFlights = [NSMutableSet new];
     return self;
 }
 
+- (void)dealloc {
+    pthread_mutex_destroy(&_flightLock);
+}
+
 + (instancetype)cacheWithName:(NSString *)name {
 	return [[YYCache alloc] initWithName:name];
 }
@@ -50,6 +64,66 @@
     return [[YYCache alloc] initWithPath:path];
 }
 
+- (BOOL)metricsEnabled {
+    return _memoryCache.metrics != nil;
+}
+
+- (void)setMetricsEnabled:(BOOL)metricsEnabled {
+    if (metricsEnabled) {
+        if (!_memoryCache.metrics) _memoryCache.metrics = [YYCacheMetrics new];
+        if (!_diskCache.metrics) _diskCache.metrics = [YYCacheMetrics new];
+    } else {
+        _memoryCache.metrics = nil;
+        _diskCache.metrics = nil;
+    }
+}
+
+/// Call it before the key is set or removed, so the disk read in flight will not
+/// overwrite memory cache with the old object.
+- (void)_invalidateFlightForKey:(NSString *)key {
+    if (!key) return;
+    pthread_mutex_lock(&_flightLock);
+    if (_flights[key]) [_staleFlights addObject:key];
+    pthread_mutex_unlock(&_flightLock);
+}
+
+- (void)_invalidateFlightsForKeys:(NSArray *)keys {
+    pthread_mutex_lock(&_flightLock);
+    if (_flights.count) {
+        for (NSString *key in keys) {
+            if (_flights[key]) [_staleFlights addObject:key];
+        }
+    }
+    pthread_mutex_unlock(&_flightLock);
+}
+
+- (void)_invalidateAllFlights {
+    pthread_mutex_lock(&_flightLock);
+    [_staleFlights addObjectsFromArray:_flights.allKeys];
+    pthread_mutex_unlock(&_flightLock);
+}
+
+static inline NSUInteger YYCacheTraceSizeOfObject(id object) {
+    return [object isKindOfClass:[NSData class]] ? ((NSData *)object).length : 0;
+}
+
+/// Record a get operation for each key of a batch.
+static void YYCacheTraceRecordGets(YYCacheTraceRecorder *recorder, NSArray *keys, NSDictionary *objects) {
+    if (!recorder) return;
+    for (NSString *key in keys) {
+        [recorder recordOperation:YYCacheTraceOperationGet key:key size:YYCacheTraceSizeOfObject(objects[key])];
+    }
+}
+
+/// Record a set operation for each key of a batch.
+static void YYCacheTraceRecordSets(YYCacheTraceRecorder *recorder, NSArray *objects, NSArray *keys) {
+    if (!recorder) return;
+    NSUInteger count = MIN(objects.count, keys.count);
+    for (NSUInteger i = 0; i < count; i++) {
+        [recorder recordOperation:YYCacheTraceOperationSet key:keys[i] size:YYCacheTraceSizeOfObject(objects[i])];
+    }
+}
+
 - (BOOL)containsObjectForKey:(NSString *)key {
     return [_memoryCache containsObjectForKey:key] || [_diskCache containsObjectForKey:key];
 }
@@ -74,53 +148,175 @@
             [_memoryCache setObject:object forKey:key];
         }
     }
+    [_traceRecorder recordOperation:YYCacheTraceOperationGet key:key size:YYCacheTraceSizeOfObject(object)];
     return object;
 }
 
 - (void)objectForKey:(NSString *)key withBlock:(void (^)(NSString *key, id<NSCoding> object))block {
     if (!block) return;
     id<NSCoding> object = [_memoryCache objectForKey:key];
+    YYCacheTraceRecorder *traceRecorder = _traceRecorder;
+    if (traceRecorder) {
+        void (^userBlock)(NSString *key, id<NSCoding> object) = block;
+        block = ^(NSString *key, id<NSCoding> object) {
+            [traceRecorder recordOperation:YYCacheTraceOperationGet key:key size:YYCacheTraceSizeOfObject(object)];
+            userBlock(key, object);
+        };
+    }
     if (object) {
         dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
             block(key, object);
         });
-    } else {
+        return;
+    }
+    if (!key) {
         [_diskCache objectForKey:key withBlock:block];
+        return;
+    }
+    
+    // the concurrent requests of the same key share one disk read
+    pthread_mutex_lock(&_flightLock);
+    NSMutableArray *waiters = _flights[key];
+    if (waiters) {
+        [waiters addObject:[block copy]];
+        pthread_mutex_unlock(&_flightLock);
+        return;
     }
+    _flights[key] = [NSMutableArray arrayWithObject:[block copy]];
+    pthread_mutex_unlock(&_flightLock);
+    
+    [_diskCache objectForKey:key withBlock:^(NSString *key, id<NSCoding> object) {
+        pthread_mutex_lock(&self->_flightLock);
+        // put into memory in the lock, or a set/remove right after the check is overwritten
+        if ([self->_staleFlights containsObject:key]) {
+            [self->_staleFlights removeObject:key];
+        } else if (object) {
+            [self->_memoryCache setObject:object forKey:key];
+        }
+        NSArray *waiters = self->_flights[key];
+        [self->_flights removeObjectForKey:key];
+        pthread_mutex_unlock(&self->_flightLock);
+        for (void (^waiter)(NSString *key, id<NSCoding> object) in waiters) {
+            waiter(key, object);
+        }
+    }];
 }
 
 - (void)setObject:(id<NSCoding>)object forKey:(NSString *)key {
+    [_traceRecorder recordOperation:(object ? YYCacheTraceOperationSet : YYCacheTraceOperationRemove) key:key size:YYCacheTraceSizeOfObject(object)];
+    [self _invalidateFlightForKey:key];
     [_memoryCache setObject:object forKey:key];
     [_diskCache setObject:object forKey:key];
 }
 
 - (void)setObject:(id<NSCoding>)object forKey:(NSString *)key withBlock:(void (^)(void))block {
+    [_traceRecorder recordOperation:(object ? YYCacheTraceOperationSet : YYCacheTraceOperationRemove) key:key size:YYCacheTraceSizeOfObject(object)];
+    [self _invalidateFlightForKey:key];
     [_memoryCache setObject:object forKey:key];
     [_diskCache setObject:object forKey:key withBlock:block];
 }
 
+- (NSDictionary<NSString *, id<NSCoding>> *)objectsForKeys:(NSArray<NSString *> *)keys {
+    NSDictionary *objects = [self _objectsForKeys:keys];
+    YYCacheTraceRecordGets(_traceRecorder, keys, objects);
+    return objects;
+}
+
+- (NSDictionary *)_objectsForKeys:(NSArray *)keys {
+    NSDictionary *memoryObjects = [_memoryCache objectsForKeys:keys];
+    if (memoryObjects.count == keys.count) return memoryObjects;
+    
+    NSMutableArray *missingKeys = [NSMutableArray new];
+    for (NSString *key in keys) {
+        if (!memoryObjects[key]) [missingKeys addObject:key];
+    }
+    NSDictionary *diskObjects = [_diskCache objectsForKeys:missingKeys];
+    if (diskObjects.count == 0) return memoryObjects;
+    [_memoryCache setObjects:diskObjects.allValues forKeys:diskObjects.allKeys];
+    
+    NSMutableDictionary *objects = memoryObjects.mutableCopy;
+    [objects addEntriesFromDictionary:diskObjects];
+    return objects;
+}
+
+- (void)objectsForKeys:(NSArray<NSString *> *)keys withBlock:(void (^)(NSDictionary<NSString *, id<NSCoding>> *objects))block {
+    if (!block) return;
+    YYCacheTraceRecorder *traceRecorder = _traceRecorder;
+    if (traceRecorder) {
+        void (^userBlock)(NSDictionary *objects) = block;
+        block = ^(NSDictionary *objects) {
+            YYCacheTraceRecordGets(traceRecorder, keys, objects);
+            userBlock(objects);
+        };
+    }
+    NSDictionary *memoryObjects = [_memoryCache objectsForKeys:keys];
+    if (memoryObjects.count == keys.count) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            block(memoryObjects);
+        });
+        return;
+    }
+    
+    NSMutableArray *missingKeys = [NSMutableArray new];
+    for (NSString *key in keys) {
+        if (!memoryObjects[key]) [missingKeys addObject:key];
+    }
+    YYMemoryCache *memoryCache = _memoryCache;
+    [_diskCache objectsForKeys:missingKeys withBlock:^(NSDictionary *diskObjects) {
+        if (diskObjects.count == 0) {
+            block(memoryObjects);
+            return;
+        }
+        [memoryCache setObjects:diskObjects.allValues forKeys:diskObjects.allKeys];
+        NSMutableDictionary *objects = memoryObjects.mutableCopy;
+        [objects addEntriesFromDictionary:diskObjects];
+        block(objects);
+    }];
+}
+
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys {
+    YYCacheTraceRecordSets(_traceRecorder, objects, keys);
+    [self _invalidateFlightsForKeys:keys];
+    [_memoryCache setObjects:objects forKeys:keys];
+    [_diskCache setObjects:objects forKeys:keys];
+}
+
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys withBlock:(void (^)(void))block {
+    YYCacheTraceRecordSets(_traceRecorder, objects, keys);
+    [self _invalidateFlightsForKeys:keys];
+    [_memoryCache setObjects:objects forKeys:keys];
+    [_diskCache setObjects:objects forKeys:keys withBlock:block];
+}
+
 - (void)removeObjectForKey:(NSString *)key {
+    [_traceRecorder recordOperation:YYCacheTraceOperationRemove key:key size:0];
+    [self _invalidateFlightForKey:key];
     [_memoryCache removeObjectForKey:key];
     [_diskCache removeObjectForKey:key];
 }
 
 - (void)removeObjectForKey:(NSString *)key withBlock:(void (^)(NSString *key))block {
+    [_traceRecorder recordOperation:YYCacheTraceOperationRemove key:key size:0];
+    [self _invalidateFlightForKey:key];
     [_memoryCache removeObjectForKey:key];
     [_diskCache removeObjectForKey:key withBlock:block];
 }
 
 - (void)removeAllObjects {
+    [self _invalidateAllFlights];
     [_memoryCache removeAllObjects];
     [_diskCache removeAllObjects];
 }
 
 - (void)removeAllObjectsWithBlock:(void(^)(void))block {
+    [self _invalidateAllFlights];
     [_memoryCache removeAllObjects];
     [_diskCache removeAllObjectsWithBlock:block];
 }
 
 - (void)removeAllObjectsWithProgressBlock:(void(^)(int removedCount, int totalCount))progress
                                  endBlock:(void(^)(BOOL error))end {
+    [self _invalidateAllFlights];
     [_memoryCache removeAllObjects];
     [_diskCache removeAllObjectsWithProgressBlock:progress endBlock:end];
     
@@ -0,0 +1,139 @@
+//
+//  YYCacheMetrics.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 16/1/20.
+//  Copyright (c) 2016 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The reason why objects are evicted from a cache.
+typedef NS_ENUM(NSUInteger, YYCacheEvictionReason) {
+    YYCacheEvictionReasonCost = 0,  ///< over the cost limit
+    YYCacheEvictionReasonCount,     ///< over the count limit
+    YYCacheEvictionReasonAge,       ///< over the age limit
+    YYCacheEvictionReasonFreeSpace, ///< below the free disk space limit
+};
+
+/// The cache operations which are timed.
+typedef NS_ENUM(NSUInteger, YYCacheOperation) {
+    YYCacheOperationGet = 0, ///< objectForKey:, objectsForKeys:
+    YYCacheOperationSet,     ///< setObject:forKey:, setObjects:forKeys:
+    YYCacheOperationTrim,    ///< trimToCost:, trimToCount:, trimToAge: and auto trim
+};
+
+/// The number of buckets in a latency histogram.
+#define YYCacheLatencyBucketCount 24
+
+
+/**
+ An immutable copy of the counters in YYCacheMetrics.
+
+ The latency histogram has `YYCacheLatencyBucketCount` buckets with power of 2 bounds:
+ bucket 0 is [0, 1) microsecond, bucket n is [2^(n-1), 2^n) microseconds, and the
+ last bucket also contains all larger values.
+ */
+@interface YYCacheMetricsSnapshot : NSObject <NSCopying>
+
+/** The number of objects found by get operations. */
+@property (readonly) uint64_t hitCount;
+
+/** The number of objects not found by get operations. */
+@property (readonly) uint64_t missCount;
+
+/** hitCount / (hitCount + missCount), or 0 if there's no get operation. */
+@property (readonly) double hitRatio;
+
+/** The number of objects set to the cache (including replaced objects). */
+@property (readonly) uint64_t insertionCount;
+
+/** The number of objects evicted by all reasons. */
+@property (readonly) uint64_t evictionCount;
+
+/** The bytes of the hit objects (the `cost` for YYMemoryCache). */
+@property (readonly) uint64_t bytesRead;
+
+/** The bytes of the set objects (the `cost` for YYMemoryCache). */
+@property (readonly) uint64_t bytesWritten;
+
+/** The number of objects evicted by the reason. */
+- (uint64_t)evictionCountForReason:(YYCacheEvictionReason)reason;
+
+/** The number of timed operations. */
+- (uint64_t)countOfOperation:(YYCacheOperation)operation;
+
+/** The number of timed operations in a latency bucket. */
+- (uint64_t)countOfOperation:(YYCacheOperation)operation inLatencyBucket:(NSUInteger)bucket;
+
+/**
+ Returns the estimated latency (upper bound of the histogram bucket) in seconds.
+
+ @param percentile  A value in range [0, 1], such as 0.5 (median) or 0.99.
+ @param operation   The operation.
+ @return The latency in seconds, or 0 if there's no such operation.
+ */
+- (NSTimeInterval)latencyPercentile:(double)percentile ofOperation:(YYCacheOperation)operation;
+
+/**
+ Returns a snapshot which contains the difference between the receiver and an
+ earlier snapshot, it's used to get the metrics of a time window.
+ */
+- (YYCacheMetricsSnapshot *)snapshotBySubtractingSnapshot:(YYCacheMetricsSnapshot *)snapshot;
+
+@end
+
+
+/**
+ YYCacheMetrics collects the statistics of a cache, such as hits, misses, evictions
+ and operation latency. Set an instance to the `metrics` property of YYMemoryCache
+ or YYDiskCache to enable it (it's disabled by default).
+
+ @discussion Each thread records to its own counters without lock or atomic
+ read-modify-write, so it's cheap enough to be enabled in production. The counters
+ are summed when a snapshot is taken, the snapshot may miss the records which are
+ in progress on other threads. All methods are thread-safe.
+
+ An instance should be used by only one cache, or the counters are mixed.
+ */
+@interface YYCacheMetrics : NSObject
+
+/** Returns the sum of all the counters. */
+- (YYCacheMetricsSnapshot *)snapshot;
+
+/**
+ Record a get operation.
+
+ @param hitCount   The number of objects found.
+ @param missCount  The number of objects not found.
+ @param bytes      The bytes of the found objects.
+ @param latency    The duration of the operation in seconds, pass a negative value to skip it.
+ */
+- (void)recordGetWithHitCount:(NSUInteger)hitCount missCount:(NSUInteger)missCount bytesRead:(uint64_t)bytes latency:(NSTimeInterval)latency;
+
+/**
+ Record a set operation.
+
+ @param count    The number of objects set.
+ @param bytes    The bytes of the objects set.
+ @param latency  The duration of the operation in seconds, pass a negative value to skip it.
+ */
+- (void)recordSetWithCount:(NSUInteger)count bytesWritten:(uint64_t)bytes latency:(NSTimeInterval)latency;
+
+/**
+ Record a trim operation.
+
+ @param count    The number of objects evicted.
+ @param reason   The eviction reason.
+ @param latency  The duration of the operation in seconds, pass a negative value to skip it.
+ */
+- (void)recordTrimWithEvictionCount:(NSUInteger)count reason:(YYCacheEvictionReason)reason latency:(NSTimeInterval)latency;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,312 @@
+//
+//  YYCacheMetrics.m
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 16/1/20.
+//  Copyright (c) 2016 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import "YYCacheMetrics.h"
+#import <pthread.h>
+
+#define kEvictionReasonCount 4
+#define kOperationCount 3
+
+typedef struct {
+    uint64_t hit;
+    uint64_t miss;
+    uint64_t insertion;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t eviction[kEvictionReasonCount];
+    uint64_t latency[kOperationCount][YYCacheLatencyBucketCount];
+} _YYCacheCounters;
+
+/**
+ The counters of a thread. It's written only by the owner thread (so a plain
+ load and an atomic store is enough), and read by the snapshot.
+ When the thread exits, the slot is reused by the next new thread.
+ */
+typedef struct _YYCacheMetricsSlot {
+    _YYCacheCounters counters;
+    struct _YYCacheMetricsSlot *next;
+    int32_t inUse;
+    BOOL shared; ///< shared by all threads if the thread-specific key is not available
+} _YYCacheMetricsSlot;
+
+/// The slots of a thread, one for each metrics instance which is used on the thread.
+typedef struct {
+    NSUInteger count;
+    NSUInteger capacity;
+    struct {
+        NSUInteger metricsId;
+        _YYCacheMetricsSlot *slot;
+    } *entries;
+} _YYCacheMetricsThreadTable;
+
+static pthread_key_t _YYCacheMetricsKey;
+static BOOL _YYCacheMetricsKeyAvailable;
+static pthread_mutex_t _YYCacheMetricsGlobalLock = PTHREAD_MUTEX_INITIALIZER;
+static NSMutableIndexSet *_YYCacheMetricsLiveIds; ///< ids of the living metrics instances
+static NSUInteger _YYCacheMetricsLastId;
+
+/// Called when a thread exits, gives the slots back to the living metrics instances.
+static void _YYCacheMetricsThreadTableFree(void *value) {
+    _YYCacheMetricsThreadTable *table = value;
+    pthread_mutex_lock(&_YYCacheMetricsGlobalLock);
+    for (NSUInteger i = 0; i < table->count; i++) {
+        if ([_YYCacheMetricsLiveIds containsIndex:table->entries[i].metricsId]) {
+            __atomic_store_n(&table->entries[i].slot->inUse, 0, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&_YYCacheMetricsGlobalLock);
+    free(table->entries);
+    free(table);
+}
+
+static inline void _YYCounterAdd(_YYCacheMetricsSlot *slot, uint64_t *counter, uint64_t value) {
+    if (slot->shared) {
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void _YYCounterAddLatency(_YYCacheMetricsSlot *slot, YYCacheOperation operation, NSTimeInterval latency) {
+    if (latency < 0 || operation >= kOperationCount) return;
+    if (latency > 3600) latency = 3600;
+    uint64_t us = (uint64_t)(latency * 1000000.0);
+    NSUInteger bucket = us ? 64 - __builtin_clzll(us) : 0;
+    if (bucket >= YYCacheLatencyBucketCount) bucket = YYCacheLatencyBucketCount - 1;
+    _YYCounterAdd(slot, &slot->counters.latency[operation][bucket], 1);
+}
+
+static void _YYCacheCountersAdd(_YYCacheCounters *sum, const _YYCacheCounters *counters) {
+    const uint64_t *src = (const uint64_t *)counters;
+    uint64_t *dst = (uint64_t *)sum;
+    for (size_t i = 0; i < sizeof(_YYCacheCounters) / sizeof(uint64_t); i++) {
+        dst[i] += __atomic_load_n(src + i, __ATOMIC_RELAXED);
+    }
+}
+
+
+@implementation YYCacheMetricsSnapshot {
+    @package
+    _YYCacheCounters _counters;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+- (uint64_t)hitCount {
+    return _counters.hit;
+}
+
+- (uint64_t)missCount {
+    return _counters.miss;
+}
+
+- (double)hitRatio {
+    uint64_t total = _counters.hit + _counters.miss;
+    return total ? (double)_counters.hit / total : 0;
+}
+
+- (uint64_t)insertionCount {
+    return _counters.insertion;
+}
+
+- (uint64_t)evictionCount {
+    uint64_t count = 0;
+    for (int i = 0; i < kEvictionReasonCount; i++) count += _counters.eviction[i];
+    return count;
+}
+
+- (uint64_t)bytesRead {
+    return _counters.bytesRead;
+}
+
+- (uint64_t)bytesWritten {
+    return _counters.bytesWritten;
+}
+
+- (uint64_t)evictionCountForReason:(YYCacheEvictionReason)reason {
+    if (reason >= kEvictionReasonCount) return 0;
+    return _counters.eviction[reason];
+}
+
+- (uint64_t)countOfOperation:(YYCacheOperation)operation {
+    if (operation >= kOperationCount) return 0;
+    uint64_t count = 0;
+    for (int i = 0; i < YYCacheLatencyBucketCount; i++) count += _counters.latency[operation][i];
+    return count;
+}
+
+- (uint64_t)countOfOperation:(YYCacheOperation)operation inLatencyBucket:(NSUInteger)bucket {
+    if (operation >= kOperationCount || bucket >= YYCacheLatencyBucketCount) return 0;
+    return _counters.latency[operation][bucket];
+}
+
+- (NSTimeInterval)latencyPercentile:(double)percentile ofOperation:(YYCacheOperation)operation {
+    uint64_t total = [self countOfOperation:operation];
+    if (total == 0) return 0;
+    if (percentile < 0) percentile = 0;
+    if (percentile > 1) percentile = 1;
+    uint64_t target = (uint64_t)ceil(total * percentile);
+    if (target == 0) target = 1;
+    uint64_t count = 0;
+    for (int i = 0; i < YYCacheLatencyBucketCount; i++) {
+        count += _counters.latency[operation][i];
+        if (count >= target) return ldexp(1, i) / 1000000.0;
+    }
+    return ldexp(1, YYCacheLatencyBucketCount - 1) / 1000000.0;
+}
+
+- (YYCacheMetricsSnapshot *)snapshotBySubtractingSnapshot:(YYCacheMetricsSnapshot *)snapshot {
+    YYCacheMetricsSnapshot *one = [YYCacheMetricsSnapshot new];
+    const uint64_t *a = (const uint64_t *)&_counters;
+    const uint64_t *b = snapshot ? (const uint64_t *)&snapshot->_counters : NULL;
+    uint64_t *dst = (uint64_t *)&one->_counters;
+    for (size_t i = 0; i < sizeof(_YYCacheCounters) / sizeof(uint64_t); i++) {
+        uint64_t value = b ? b[i] : 0;
+        dst[i] = a[i] > value ? a[i] - value : 0;
+    }
+    return one;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p> (hit:%llu miss:%llu insert:%llu evict:%llu read:%llu written:%llu)",
+            self.class, self, _counters.hit, _counters.miss, _counters.insertion,
+            self.evictionCount, _counters.bytesRead, _counters.bytesWritten];
+}
+
+@end
+
+
+@implementation YYCacheMetrics {
+    pthread_mutex_t _lock; ///< protects the slot list
+    _YYCacheMetricsSlot *_slots;
+    NSUInteger _metricsId;
+}
+
+- (instancetype)init {
+    self = [super init];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _YYCacheMetricsKeyAvailable = pthread_key_create(&_YYCacheMetricsKey, _YYCacheMetricsThreadTableFree) == 0;
+        _YYCacheMetricsLiveIds = [NSMutableIndexSet new];
+    });
+    pthread_mutex_init(&_lock, NULL);
+    pthread_mutex_lock(&_YYCacheMetricsGlobalLock);
+    _metricsId = ++_YYCacheMetricsLastId;
+    [_YYCacheMetricsLiveIds addIndex:_metricsId];
+    pthread_mutex_unlock(&_YYCacheMetricsGlobalLock);
+    if (!_YYCacheMetricsKeyAvailable) {
+        _slots = calloc(1, sizeof(_YYCacheMetricsSlot));
+        if (!_slots) return nil;
+        _slots->shared = YES;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    // the exiting threads won't touch the slots after the id is removed
+    pthread_mutex_lock(&_YYCacheMetricsGlobalLock);
+    [_YYCacheMetricsLiveIds removeIndex:_metricsId];
+    pthread_mutex_unlock(&_YYCacheMetricsGlobalLock);
+    _YYCacheMetricsSlot *slot = _slots;
+    while (slot) {
+        _YYCacheMetricsSlot *next = slot->next;
+        free(slot);
+        slot = next;
+    }
+    pthread_mutex_destroy(&_lock);
+}
+
+/// Returns the slot of current thread, or NULL if there's no memory.
+- (_YYCacheMetricsSlot *)_slot {
+    if (!_YYCacheMetricsKeyAvailable) return _slots;
+    _YYCacheMetricsThreadTable *table = pthread_getspecific(_YYCacheMetricsKey);
+    if (table) {
+        for (NSUInteger i = 0; i < table->count; i++) {
+            if (table->entries[i].metricsId == _metricsId) return table->entries[i].slot;
+        }
+    } else {
+        table = calloc(1, sizeof(_YYCacheMetricsThreadTable));
+        if (!table) return NULL;
+        if (pthread_setspecific(_YYCacheMetricsKey, table) != 0) {
+            free(table);
+            return NULL;
+        }
+    }
+    if (table->count == table->capacity) {
+        NSUInteger capacity = table->capacity ? table->capacity * 2 : 4;
+        void *entries = realloc(table->entries, capacity * sizeof(*table->entries));
+        if (!entries) return NULL;
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+
+    // reuse a slot of an exited thread, or create a new one
+    pthread_mutex_lock(&_lock);
+    _YYCacheMetricsSlot *slot = _slots;
+    while (slot && __atomic_load_n(&slot->inUse, __ATOMIC_ACQUIRE)) slot = slot->next;
+    if (!slot) {
+        slot = calloc(1, sizeof(_YYCacheMetricsSlot));
+        if (slot) {
+            slot->next = _slots;
+            _slots = slot;
+        }
+    }
+    if (slot) slot->inUse = 1;
+    pthread_mutex_unlock(&_lock);
+    if (!slot) return NULL;
+
+    table->entries[table->count].metricsId = _metricsId;
+    table->entries[table->count].slot = slot;
+    table->count++;
+    return slot;
+}
+
+- (YYCacheMetricsSnapshot *)snapshot {
+    YYCacheMetricsSnapshot *snapshot = [YYCacheMetricsSnapshot new];
+    pthread_mutex_lock(&_lock);
+    for (_YYCacheMetricsSlot *slot = _slots; slot; slot = slot->next) {
+        _YYCacheCountersAdd(&snapshot->_counters, &slot->counters);
+    }
+    pthread_mutex_unlock(&_lock);
+    return snapshot;
+}
+
+- (void)recordGetWithHitCount:(NSUInteger)hitCount missCount:(NSUInteger)missCount bytesRead:(uint64_t)bytes latency:(NSTimeInterval)latency {
+    _YYCacheMetricsSlot *slot = [self _slot];
+    if (!slot) return;
+    if (hitCount) _YYCounterAdd(slot, &slot->counters.hit, hitCount);
+    if (missCount) _YYCounterAdd(slot, &slot->counters.miss, missCount);
+    if (bytes) _YYCounterAdd(slot, &slot->counters.bytesRead, bytes);
+    _YYCounterAddLatency(slot, YYCacheOperationGet, latency);
+}
+
+- (void)recordSetWithCount:(NSUInteger)count bytesWritten:(uint64_t)bytes latency:(NSTimeInterval)latency {
+    _YYCacheMetricsSlot *slot = [self _slot];
+    if (!slot) return;
+    if (count) _YYCounterAdd(slot, &slot->counters.insertion, count);
+    if (bytes) _YYCounterAdd(slot, &slot->counters.bytesWritten, bytes);
+    _YYCounterAddLatency(slot, YYCacheOperationSet, latency);
+}
+
+- (void)recordTrimWithEvictionCount:(NSUInteger)count reason:(YYCacheEvictionReason)reason latency:(NSTimeInterval)latency {
+    _YYCacheMetricsSlot *slot = [self _slot];
+    if (!slot) return;
+    if (count && reason < kEvictionReasonCount) _YYCounterAdd(slot, &slot->counters.eviction[reason], count);
+    _YYCounterAddLatency(slot, YYCacheOperationTrim, latency);
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p> %@", self.class, self, [self snapshot]];
+}
+
+@end
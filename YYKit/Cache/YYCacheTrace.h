@@ -0,0 +1,67 @@
+//
+//  YYCacheTrace.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 16/2/2.
+//  Copyright (c) 2016 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The operation of a trace record.
+typedef NS_ENUM(uint8_t, YYCacheTraceOperation) {
+    YYCacheTraceOperationGet = 0, ///< objectForKey:
+    YYCacheTraceOperationSet,     ///< setObject:forKey:
+    YYCacheTraceOperationRemove,  ///< removeObjectForKey:
+};
+
+
+/**
+ YYCacheTraceRecorder writes the operations of a cache to a trace file.
+ Set an instance to the `traceRecorder` property of YYCache to record its workload.
+
+ @discussion The file is a sequence of variable length records, the key is written
+ only at its first occurrence and referred by index after that, so a trace of
+ millions operations is usually a few megabytes. The records are buffered in
+ memory and written when the buffer is full, or `flush` is called, or the recorder
+ is deallocated. All methods are thread-safe.
+ */
+@interface YYCacheTraceRecorder : NSObject
+
+/** The path of the trace file. */
+@property (readonly) NSString *path;
+
+/** The number of records. */
+@property (readonly) NSUInteger recordCount;
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+/**
+ Create a recorder which writes to a file.
+
+ @param path The file path, an existing file will be overwritten.
+ @return A new recorder, or nil if the file cannot be created.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path NS_DESIGNATED_INITIALIZER;
+
+/**
+ Record an operation.
+
+ @param operation The operation.
+ @param key       The key, nil is ignored.
+ @param size      The value size in bytes, pass 0 if it's unknown.
+ */
+- (void)recordOperation:(YYCacheTraceOperation)operation key:(nullable NSString *)key size:(NSUInteger)size;
+
+/** Write the buffered records to file. */
+- (void)flush;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,139 @@
+//
+//  YYCacheTrace.m
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 16/2/2.
+//  Copyright (c) 2016 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import "YYCacheTrace.h"
+#import <QuartzCore/QuartzCore.h>
+#import <pthread.h>
+
+/*
+ Trace file format:
+
+ header: "YYCT" (4 bytes), version (1 byte)
+ record: tag, [key length, key bytes] or [key index], size, timestamp delta
+
+ All the integers in record are unsigned LEB128 varints. The tag is the operation
+ in the lower 2 bits, and bit 2 is set if the key occurs first time (the key bytes
+ are UTF-8 and the key index is the number of keys occurred before). The timestamp
+ delta is the microseconds since the previous record.
+ */
+static const char kYYCacheTraceMagic[4] = {'Y', 'Y', 'C', 'T'};
+static const uint8_t kYYCacheTraceVersion = 1;
+static const NSUInteger kYYCacheTraceBufferSize = 64 * 1024;
+
+static inline void YYCacheTraceAppendVarint(NSMutableData *data, uint64_t value) {
+    uint8_t bytes[10];
+    int len = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value) byte |= 0x80;
+        bytes[len++] = byte;
+    } while (value);
+    [data appendBytes:bytes length:len];
+}
+
+static inline void YYCacheTraceAppendRecord(NSMutableData *data, YYCacheTraceOperation operation,
+                                            NSString *newKey, uint32_t keyIndex, uint32_t size, uint64_t delta) {
+    if (newKey) {
+        NSData *keyData = [newKey dataUsingEncoding:NSUTF8StringEncoding];
+        YYCacheTraceAppendVarint(data, operation | 4);
+        YYCacheTraceAppendVarint(data, keyData.length);
+        [data appendData:keyData];
+    } else {
+        YYCacheTraceAppendVarint(data, operation);
+        YYCacheTraceAppendVarint(data, keyIndex);
+    }
+    YYCacheTraceAppendVarint(data, size);
+    YYCacheTraceAppendVarint(data, delta);
+}
+
+static inline uint64_t YYCacheTraceNow() {
+    return (uint64_t)(CACurrentMediaTime() * 1000000);
+}
+
+
+
+@implementation YYCacheTraceRecorder {
+    pthread_mutex_t _lock;
+    FILE *_file;
+    NSMutableData *_buffer;
+    NSMutableDictionary *_keyIndexes; ///< key -> index
+    NSUInteger _recordCount;
+    uint64_t _lastTime;
+}
+
+- (instancetype)init {
+    @throw [NSException exceptionWithName:@"YYCacheTraceRecorder init error" reason:@"YYCacheTraceRecorder must be initialized with a path. Use 'initWithPath:' instead." userInfo:nil];
+    return [self initWithPath:@""];
+}
+
+- (instancetype)initWithPath:(NSString *)path {
+    if (path.length == 0) return nil;
+    FILE *file = fopen(path.fileSystemRepresentation, "wb");
+    if (!file) return nil;
+    if (fwrite(kYYCacheTraceMagic, 1, 4, file) != 4 || fwrite(&kYYCacheTraceVersion, 1, 1, file) != 1) {
+        fclose(file);
+        return nil;
+    }
+    self = [super init];
+    pthread_mutex_init(&_lock, NULL);
+    _path = path.copy;
+    _file = file;
+    _buffer = [NSMutableData dataWithCapacity:kYYCacheTraceBufferSize];
+    _keyIndexes = [NSMutableDictionary new];
+    _lastTime = YYCacheTraceNow();
+    return self;
+}
+
+- (void)dealloc {
+    [self _flush];
+    fclose(_file);
+    pthread_mutex_destroy(&_lock);
+}
+
+/// Write the buffer to file, the lock should be held (or in dealloc).
+- (void)_flush {
+    if (_buffer.length) {
+        fwrite(_buffer.bytes, 1, _buffer.length, _file);
+        _buffer.length = 0;
+    }
+    fflush(_file);
+}
+
+- (void)recordOperation:(YYCacheTraceOperation)operation key:(NSString *)key size:(NSUInteger)size {
+    if (!key) return;
+    uint64_t now = YYCacheTraceNow();
+    pthread_mutex_lock(&_lock);
+    uint64_t delta = now > _lastTime ? now - _lastTime : 0; // keep the order of records
+    _lastTime += delta;
+    NSNumber *index = _keyIndexes[key];
+    if (!index) _keyIndexes[key] = @(_keyIndexes.count);
+    YYCacheTraceAppendRecord(_buffer, operation, index ? nil : key, index.unsignedIntValue,
+                             (uint32_t)MIN(size, UINT32_MAX), delta);
+    _recordCount++;
+    if (_buffer.length >= kYYCacheTraceBufferSize) [self _flush];
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)recordCount {
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = _recordCount;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (void)flush {
+    pthread_mutex_lock(&_lock);
+    [self _flush];
+    pthread_mutex_unlock(&_lock);
+}
+
+@end
@@ -11,6 +11,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class YYCacheMetrics;
+
 NS_ASSUME_NONNULL_BEGIN
 
 /**
@@ -52,12 +54,60 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (readonly) NSUInteger inlineThreshold;
 
+/**
+ If `YES`, the objects larger than `inlineThreshold` are appended to large segment
+ files instead of being stored as separated files, it avoids the cost of creating
+ and deleting a file for each object. The space of removed objects is reclaimed 
+ in background (see `autoTrimInterval`).
+ 
+ The default value is NO.
+ */
+@property (readonly, getter=isSegmented) BOOL segmented;
+
+/**
+ If `YES`, the archived data is compressed before it's stored, and decompressed
+ transparently when it's read. It's chosen per object: the small data and the data 
+ which looks compressed already (such as image) are stored as-is, others are 
+ compressed with LZ4 (zlib on iOS 8 and earlier) if it saves at least 1/8.
+ 
+ The `totalCost` and `costLimit` are measured with the stored (compressed) size.
+ The objects stored before are still readable after this value is changed.
+ 
+ The default value is NO.
+ */
+@property BOOL compressionEnabled;
+
+/**
+ If `YES`, the objects are archived with `modelToBinaryData` (see NSObject+YYModel)
+ instead of NSKeyedArchiver, it's faster and smaller for the model objects, and the
+ objects don't need to implement the `NSCoding` protocol. The data archived before
+ is still readable after this value is changed. It's ignored if `customArchiveBlock` 
+ or `customUnarchiveBlock` is set.
+ 
+ If a model class's properties is changed, the data archived with the old class is
+ treated as invalid and `objectForKey:` returns nil.
+ 
+ The default value is NO.
+ */
+@property BOOL modelCodingEnabled;
+
+/**
+ The metrics of the cache, see `YYCacheMetrics`. It records the hits, misses,
+ insertions, evictions (by count, cost, age and free disk space), the stored bytes
+ read and written, and the latency of access and trim methods.
+ Default is nil (disabled).
+ */
+@property (nullable, strong) YYCacheMetrics *metrics;
+
 /**
  If this block is not nil, then the block will be used to archive object instead
  of NSKeyedArchiver. You can use this block to support the objects which do not
  conform to the `NSCoding` protocol.
  
  The default value is nil.
+ 
+ @warning The batch methods (such as `setObjects:forKeys:`) may invoke the custom
+ blocks concurrently, so the blocks should be thread-safe.
  */
 @property (nullable, copy) NSData *(^customArchiveBlock)(id object);
 
@@ -136,6 +186,59 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property BOOL errorLogsEnabled;
 
+/**
+ The maximum time (in seconds) that a write may stay uncommitted.
+ 
+ @discussion The writes (including the access time updates of reads) are grouped 
+ into one sqlite transaction, which is committed after this latency, or when the 
+ batch is full (see `writeBatchMaxCount`), or when the app enters background.
+ The writes in an uncommitted batch may be lost if the app crashes, but the cache 
+ is always consistent. Call `flush` if you need durability at a specific point.
+ 
+ The default value is 0, which means each write is committed immediately.
+ */
+@property NSTimeInterval writeBatchLatency;
+
+/**
+ The maximum number of writes in a write batch. The default value is 64.
+ */
+@property NSUInteger writeBatchMaxCount;
+
+/**
+ If `YES`, the data of objects stored as files (larger than `inlineThreshold`) is
+ read with memory mapping instead of being copied into memory, and it's passed to
+ `customUnarchiveBlock` (or NSKeyedUnarchiver) directly. It's useful for large data 
+ which is parsed incrementally, such as animated images.
+ 
+ The default value is NO.
+ */
+@property BOOL fileMappingEnabled;
+
+/**
+ If `YES`, the access times of read objects are kept in memory and written to disk
+ in bulk (before trimming by LRU, or in `flush`), so the reads don't generate disk
+ writes. The default value is NO.
+ */
+@property BOOL accessTimeDeferred;
+
+/**
+ The minimum time interval (in seconds) between two access time updates of an object.
+ If an object is read again within this interval, its access time is not updated.
+ It makes the LRU order less precise. The default value is 0.
+ */
+@property NSTimeInterval accessTimeUpdateInterval;
+
+/**
+ The maximum number of read-only sqlite connections. `objectForKey:` reads with 
+ these connections without the cache lock, so the reads on multiple threads are 
+ not serialized. The objects changed by uncommitted writes are still read with 
+ the lock. Set 0 to disable it.
+ 
+ The default value is 0. The active processor count (at most 4) is a good choice
+ for the caches which are read on many threads.
+ */
+@property NSUInteger readConnectionCount;
+
 #pragma mark - Initializer
 ///=============================================================================
 /// @name Initializer
@@ -157,7 +260,7 @@ NS_ASSUME_NONNULL_BEGIN
 - (nullable instancetype)initWithPath:(NSString *)path;
 
 /**
- The designated initializer.
+ Create a new cache based on the specified path and inline threshold.
  
  @param path       Full path of a directory in which the cache will write data.
      Once initialized you should not read and write to this directory.
@@ -175,7 +278,29 @@ NS_ASSUME_NONNULL_BEGIN
      this method will return it directly, instead of creating a new instance.
  */
 - (nullable instancetype)initWithPath:(NSString *)path
-                      inlineThreshold:(NSUInteger)threshold NS_DESIGNATED_INITIALIZER;
+                      inlineThreshold:(NSUInteger)threshold;
+
+/**
+ The designated initializer.
+ 
+ @param path       Full path of a directory in which the cache will write data.
+     Once initialized you should not read and write to this directory.
+ 
+ @param threshold  The data store inline threshold in bytes, see `initWithPath:inlineThreshold:`.
+ 
+ @param segmented  If `YES`, the objects larger than `threshold` are appended to
+     segment files instead of being stored as separated files. It's ignored if
+     the `threshold` is NSUIntegerMax. After first initialized you should not 
+     change this value of the specified path.
+ 
+ @return A new cache object, or nil if an error occurs.
+ 
+ @warning If the cache instance for the specified path already exists in memory,
+     this method will return it directly, instead of creating a new instance.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                      inlineThreshold:(NSUInteger)threshold
+                            segmented:(BOOL)segmented NS_DESIGNATED_INITIALIZER;
 
 
 #pragma mark - Access Methods
@@ -240,6 +365,78 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)setObject:(nullable id<NSCoding>)object forKey:(NSString *)key withBlock:(void(^)(void))block;
 
+/**
+ Sets the value of the specified key in the cache, and the value expires after the ttl.
+ This method may blocks the calling thread until file write finished.
+ 
+ @discussion The expired value is not returned by the get methods, and it's removed
+ by the next auto trim (see `autoTrimInterval`). The expiration time is in seconds 
+ (unix timestamp), so it's not affected by `ageLimit`.
+ 
+ @param object The object to be stored in the cache. If nil, it calls `removeObjectForKey:`.
+ @param key    The key with which to associate the value. If nil, this method has no effect.
+ @param ttl    The time to live in seconds, 0 or a negative value means never expires.
+ */
+- (void)setObject:(nullable id<NSCoding>)object forKey:(NSString *)key ttl:(NSTimeInterval)ttl;
+
+/**
+ Sets the value of the specified key in the cache, and the value expires after the ttl.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param object The object to be stored in the cache. If nil, it calls `removeObjectForKey:`.
+ @param ttl    The time to live in seconds, 0 or a negative value means never expires.
+ @param block  A block which will be invoked in background queue when finished.
+ */
+- (void)setObject:(nullable id<NSCoding>)object forKey:(NSString *)key ttl:(NSTimeInterval)ttl withBlock:(void(^)(void))block;
+
+/**
+ Returns the values associated with the given keys.
+ This method may blocks the calling thread until file read finished.
+ 
+ @discussion The items are read in a single sqlite transaction, and then decoded
+ in parallel.
+ 
+ @param keys An array of strings identifying the values.
+ @return A dictionary contains the found key-value pairs, the keys which are not
+     in cache will be absent.
+ */
+- (NSDictionary<NSString *, id<NSCoding>> *)objectsForKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Returns the values associated with the given keys.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param keys  An array of strings identifying the values.
+ @param block A block which will be invoked in background queue when finished.
+ */
+- (void)objectsForKeys:(NSArray<NSString *> *)keys withBlock:(void(^)(NSDictionary<NSString *, id<NSCoding>> *objects))block;
+
+/**
+ Sets the values of the specified keys in the cache.
+ This method may blocks the calling thread until file write finished.
+ 
+ @discussion The objects are encoded in parallel, and then saved in a single
+ sqlite transaction.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the values, the count should be
+     equal to the count of objects, otherwise this method has no effect.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Sets the values of the specified keys in the cache.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the values.
+ @param block   A block which will be invoked in background queue when finished.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys withBlock:(nullable void(^)(void))block;
+
 /**
  Removes the value of the specified key in the cache.
  This method may blocks the calling thread until file delete finished.
@@ -285,6 +482,21 @@ NS_ASSUME_NONNULL_BEGIN
                                  endBlock:(nullable void(^)(BOOL error))end;
 
 
+/**
+ Commits the pending writes to disk.
+ This method may blocks the calling thread until the commit finished.
+ */
+- (void)flush;
+
+/**
+ Commits the pending writes to disk.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param block  A block which will be invoked in background queue when finished.
+ */
+- (void)flushWithBlock:(nullable void(^)(void))block;
+
 /**
  Returns the number of objects in this cache.
  This method may blocks the calling thread until file read finished.
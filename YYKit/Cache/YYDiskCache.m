@@ -11,10 +11,15 @@
 
 #import "YYDiskCache.h"
 #import "YYKVStorage.h"
+#import "YYCacheMetrics.h"
 #import "NSString+YYAdd.h"
+#import "NSData+YYAdd.h"
 #import "UIDevice+YYAdd.h"
+#import "NSObject+YYModel.h"
 #import <objc/runtime.h>
+#import <QuartzCore/QuartzCore.h>
 #import <time.h>
+#import <dlfcn.h>
 
 #define Lock() dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER)
 #define Unlock() dispatch_semaphore_signal(self->_lock)
@@ -32,6 +37,115 @@ static int64_t _YYDiskSpaceFree() {
 }
 
 
+/*
+ The compressed value is saved as [original length (uint32, little endian)][payload],
+ and the codec is saved in manifest (YYKVStorageItem.compression).
+ */
+static const int kYYDiskCacheCodecZlib = 1;
+static const int kYYDiskCacheCodecLZ4 = 2;
+static const NSUInteger kYYDiskCacheCompressMinLength = 256;
+static const double kYYDiskCacheCompressMaxEntropy = 7.5; // bits per byte
+static const NSUInteger kYYDiskCacheDecompressMaxRatio = 1032; // deflate can't do better, LZ4 is about 255
+
+/// compression_encode_buffer() and compression_decode_buffer() in libcompression.
+typedef size_t (*_YYCompressionBufferFunc)(uint8_t *dst, size_t dst_size, const uint8_t *src, size_t src_size, void *scratch, int algorithm);
+static const int _YYCompressionLZ4 = 0x100; // COMPRESSION_LZ4
+static _YYCompressionBufferFunc _YYCompressionEncode;
+static _YYCompressionBufferFunc _YYCompressionDecode;
+
+/// libcompression is available since iOS 9, it's loaded at runtime to support iOS 6~8.
+static BOOL _YYCompressionLoad() {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        void *lib = dlopen("/usr/lib/libcompression.dylib", RTLD_LAZY);
+        if (!lib) return;
+        _YYCompressionBufferFunc encode = (_YYCompressionBufferFunc)dlsym(lib, "compression_encode_buffer");
+        _YYCompressionBufferFunc decode = (_YYCompressionBufferFunc)dlsym(lib, "compression_decode_buffer");
+        if (encode && decode) {
+            _YYCompressionEncode = encode;
+            _YYCompressionDecode = decode;
+        }
+    });
+    return _YYCompressionEncode != NULL;
+}
+
+/// Estimate the entropy (bits per byte) with at most 4096 sampled bytes.
+static double _YYDataEntropy(NSData *data) {
+    const uint8_t *bytes = data.bytes;
+    size_t length = data.length;
+    size_t step = length > 4096 ? length / 4096 : 1;
+    uint32_t counts[256] = {0};
+    size_t sampled = 0;
+    for (size_t i = 0; i < length && sampled < 4096; i += step, sampled++) {
+        counts[bytes[i]]++;
+    }
+    double entropy = 0;
+    for (int i = 0; i < 256; i++) {
+        if (counts[i] == 0) continue;
+        double p = (double)counts[i] / sampled;
+        entropy -= p * log2(p);
+    }
+    return entropy;
+}
+
+/**
+ Compress the data with LZ4 (or zlib if LZ4 is not available). The small data and
+ the compressed data (such as image) are skipped by the size and entropy, and the 
+ result is dropped if it saves less than 1/8.
+ @return The compressed data, or the original data if `codec` is 0.
+ */
+static NSData *_YYDiskCacheCompress(NSData *data, int *codec) {
+    *codec = 0;
+    NSUInteger length = data.length;
+    if (length < kYYDiskCacheCompressMinLength || length > UINT32_MAX) return data;
+    if (_YYDataEntropy(data) > kYYDiskCacheCompressMaxEntropy) return data;
+    
+    NSUInteger maxLength = length - length / 8;
+    NSMutableData *compressed = nil;
+    int usedCodec = 0;
+    if (_YYCompressionLoad()) {
+        compressed = [NSMutableData dataWithLength:maxLength];
+        // returns 0 if the result doesn't fit in the buffer
+        size_t size = _YYCompressionEncode((uint8_t *)compressed.mutableBytes + 4, maxLength - 4, data.bytes, length, NULL, _YYCompressionLZ4);
+        if (size == 0) return data;
+        compressed.length = size + 4;
+        usedCodec = kYYDiskCacheCodecLZ4;
+    } else {
+        NSData *deflated = [data zlibDeflate];
+        if (!deflated || deflated.length + 4 > maxLength) return data;
+        compressed = [NSMutableData dataWithLength:4];
+        [compressed appendData:deflated];
+        usedCodec = kYYDiskCacheCodecZlib;
+    }
+    uint32_t header = CFSwapInt32HostToLittle((uint32_t)length);
+    memcpy(compressed.mutableBytes, &header, 4);
+    *codec = usedCodec;
+    return compressed;
+}
+
+static NSData *_YYDiskCacheDecompress(NSData *data, int codec) {
+    if (data.length <= 4) return nil;
+    uint32_t header;
+    memcpy(&header, data.bytes, 4);
+    size_t length = CFSwapInt32LittleToHost(header);
+    // the header of a damaged value may ask for a huge buffer, don't trust it
+    if (length < kYYDiskCacheCompressMinLength || length > (data.length - 4) * kYYDiskCacheDecompressMaxRatio) return nil;
+    switch (codec) {
+        case kYYDiskCacheCodecLZ4: {
+            if (!_YYCompressionLoad()) return nil;
+            NSMutableData *decompressed = [NSMutableData dataWithLength:length];
+            size_t size = _YYCompressionDecode(decompressed.mutableBytes, length, (const uint8_t *)data.bytes + 4, data.length - 4, NULL, _YYCompressionLZ4);
+            return size == length ? decompressed : nil;
+        }
+        case kYYDiskCacheCodecZlib: {
+            NSData *decompressed = [[data subdataWithRange:NSMakeRange(4, data.length - 4)] zlibInflate];
+            return decompressed.length == length ? decompressed : nil;
+        }
+        default: return nil;
+    }
+}
+
+
 /// weak reference for all instances
 static NSMapTable *_globalInstances;
 static dispatch_semaphore_t _globalInstancesLock;
@@ -67,6 +181,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     YYKVStorage *_kv;
     dispatch_semaphore_t _lock;
     dispatch_queue_t _queue;
+    BOOL _flushScheduled;
 }
 
 - (void)_trimRecursively {
@@ -85,35 +200,65 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
         __strong typeof(_self) self = _self;
         if (!self) return;
         Lock();
+        [self _trimExpired];
         [self _trimToCost:self.costLimit];
         [self _trimToCount:self.countLimit];
         [self _trimToAge:self.ageLimit];
         [self _trimToFreeDiskSpace:self.freeDiskSpaceLimit];
+        [self->_kv compactSegments];
+        [self _scheduleFlush];
         Unlock();
     });
 }
 
+/// Run the trim block and record the removed items to metrics, the lock should be held.
+- (void)_trimWithReason:(YYCacheEvictionReason)reason block:(void (^)(void))block {
+    YYCacheMetrics *metrics = self.metrics;
+    if (!metrics) {
+        block();
+        return;
+    }
+    NSTimeInterval begin = CACurrentMediaTime();
+    int count = [_kv getItemsCount];
+    block();
+    int removed = count - [_kv getItemsCount];
+    [metrics recordTrimWithEvictionCount:removed > 0 ? removed : 0 reason:reason latency:CACurrentMediaTime() - begin];
+}
+
+- (void)_trimExpired {
+    [self _trimWithReason:YYCacheEvictionReasonAge block:^{
+        [self->_kv removeExpiredItems];
+    }];
+}
+
 - (void)_trimToCost:(NSUInteger)costLimit {
     if (costLimit >= INT_MAX) return;
-    [_kv removeItemsToFitSize:(int)costLimit];
-    
+    [self _trimWithReason:YYCacheEvictionReasonCost block:^{
+        [self->_kv removeItemsToFitSize:(int)costLimit];
+    }];
 }
 
 - (void)_trimToCount:(NSUInteger)countLimit {
     if (countLimit >= INT_MAX) return;
-    [_kv removeItemsToFitCount:(int)countLimit];
+    [self _trimWithReason:YYCacheEvictionReasonCount block:^{
+        [self->_kv removeItemsToFitCount:(int)countLimit];
+    }];
 }
 
 - (void)_trimToAge:(NSTimeInterval)ageLimit {
     if (ageLimit <= 0) {
-        [_kv removeAllItems];
+        [self _trimWithReason:YYCacheEvictionReasonAge block:^{
+            [self->_kv removeAllItems];
+        }];
         return;
     }
     long timestamp = time(NULL);
     if (timestamp <= ageLimit) return;
     long age = timestamp - ageLimit;
     if (age >= INT_MAX) return;
-    [_kv removeItemsEarlierThanTime:(int)age];
+    [self _trimWithReason:YYCacheEvictionReasonAge block:^{
+        [self->_kv removeItemsEarlierThanTime:(int)age];
+    }];
 }
 
 - (void)_trimToFreeDiskSpace:(NSUInteger)targetFreeDiskSpace {
@@ -126,7 +271,24 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     if (needTrimBytes <= 0) return;
     int64_t costLimit = totalBytes - needTrimBytes;
     if (costLimit < 0) costLimit = 0;
-    [self _trimToCost:(int)costLimit];
+    [self _trimWithReason:YYCacheEvictionReasonFreeSpace block:^{
+        [self->_kv removeItemsToFitSize:(int)costLimit];
+    }];
+}
+
+/// Commit the write batch of kv storage after the latency, the lock should be held.
+- (void)_scheduleFlush {
+    if (_flushScheduled || !_kv.hasPendingWrites) return;
+    _flushScheduled = YES;
+    __weak typeof(self) _self = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_kv.writeBatchLatency * NSEC_PER_SEC)), _queue, ^{
+        __strong typeof(_self) self = _self;
+        if (!self) return;
+        Lock();
+        self->_flushScheduled = NO;
+        [self->_kv flush];
+        Unlock();
+    });
 }
 
 - (NSString *)_filenameForKey:(NSString *)key {
@@ -136,9 +298,78 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     return filename;
 }
 
+- (NSData *)_archivedDataWithObject:(id<NSCoding>)object {
+    NSData *value = nil;
+    if (_customArchiveBlock) {
+        value = _customArchiveBlock(object);
+    } else if (_modelCodingEnabled && !_customUnarchiveBlock) {
+        value = [(NSObject *)object modelToBinaryData];
+    } else {
+        @try {
+            value = [NSKeyedArchiver archivedDataWithRootObject:object];
+        }
+        @catch (NSException *exception) {
+            // nothing to do...
+        }
+    }
+    return value;
+}
+
+- (id)_objectWithItem:(YYKVStorageItem *)item {
+    NSData *value = item.value;
+    if (value && item.compression) {
+        value = _YYDiskCacheDecompress(value, item.compression);
+    }
+    if (!value) return nil;
+    id object = nil;
+    if (_customUnarchiveBlock) {
+        object = _customUnarchiveBlock(value);
+    } else if (!_customArchiveBlock && value.length > 4 && memcmp(value.bytes, "YYMB", 4) == 0) { // modelToBinaryData
+        object = [NSObject modelWithBinaryData:value];
+    } else {
+        @try {
+            object = [NSKeyedUnarchiver unarchiveObjectWithData:value];
+        }
+        @catch (NSException *exception) {
+            // nothing to do...
+        }
+    }
+    if (object && item.extendedData) {
+        [YYDiskCache setExtendedData:item.extendedData toObject:object];
+    }
+    return object;
+}
+
+- (YYKVStorageItem *)_itemWithObject:(id<NSCoding>)object forKey:(NSString *)key {
+    NSData *value = [self _archivedDataWithObject:object];
+    if (!value) return nil;
+    YYKVStorageItem *item = [YYKVStorageItem new];
+    if (_compressionEnabled) {
+        int codec = 0;
+        value = _YYDiskCacheCompress(value, &codec);
+        item.compression = codec;
+    }
+    item.key = key;
+    item.value = value;
+    item.extendedData = [YYDiskCache getExtendedDataFromObject:object];
+    if (_kv.type != YYKVStorageTypeSQLite) {
+        if (value.length > _inlineThreshold) {
+            // the filename is only a flag for segment storage
+            item.filename = _segmented ? key : [self _filenameForKey:key];
+        }
+    }
+    return item;
+}
+
 - (void)_appWillBeTerminated {
     Lock();
-    _kv = nil;
+    [_kv flush]; // keep the instance, it's read without lock
+    Unlock();
+}
+
+- (void)_appDidEnterBackground {
+    Lock();
+    [_kv flush];
     Unlock();
 }
 
@@ -146,6 +377,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationWillTerminateNotification object:nil];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
 }
 
 - (instancetype)init {
@@ -159,6 +391,12 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (instancetype)initWithPath:(NSString *)path
              inlineThreshold:(NSUInteger)threshold {
+    return [self initWithPath:path inlineThreshold:threshold segmented:NO];
+}
+
+- (instancetype)initWithPath:(NSString *)path
+             inlineThreshold:(NSUInteger)threshold
+                   segmented:(BOOL)segmented {
     self = [super init];
     if (!self) return nil;
     
@@ -166,10 +404,13 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     if (globalCache) return globalCache;
     
     YYKVStorageType type;
-    if (threshold == 0) {
-        type = YYKVStorageTypeFile;
-    } else if (threshold == NSUIntegerMax) {
+    if (threshold == NSUIntegerMax) {
         type = YYKVStorageTypeSQLite;
+        segmented = NO;
+    } else if (segmented) {
+        type = YYKVStorageTypeSegment;
+    } else if (threshold == 0) {
+        type = YYKVStorageTypeFile;
     } else {
         type = YYKVStorageTypeMixed;
     }
@@ -182,6 +423,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     _lock = dispatch_semaphore_create(1);
     _queue = dispatch_queue_create("com.ibireme.cache.disk", DISPATCH_QUEUE_CONCURRENT);
     _inlineThreshold = threshold;
+    _segmented = segmented;
     _countLimit = NSUIntegerMax;
     _costLimit = NSUIntegerMax;
     _ageLimit = DBL_MAX;
@@ -192,6 +434,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     _YYDiskCacheSetGlobal(self);
     
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appWillBeTerminated) name:UIApplicationWillTerminateNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidEnterBackground) name:UIApplicationDidEnterBackgroundNotification object:nil];
     return self;
 }
 
@@ -215,25 +458,17 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (id<NSCoding>)objectForKey:(NSString *)key {
     if (!key) return nil;
-    Lock();
-    YYKVStorageItem *item = [_kv getItemForKey:key];
-    Unlock();
-    if (!item.value) return nil;
-    
-    id object = nil;
-    if (_customUnarchiveBlock) {
-        object = _customUnarchiveBlock(item.value);
-    } else {
-        @try {
-            object = [NSKeyedUnarchiver unarchiveObjectWithData:item.value];
-        }
-        @catch (NSException *exception) {
-            // nothing to do...
-        }
-    }
-    if (object && item.extendedData) {
-        [YYDiskCache setExtendedData:item.extendedData toObject:object];
+    YYCacheMetrics *metrics = self.metrics;
+    NSTimeInterval begin = metrics ? CACurrentMediaTime() : 0;
+    YYKVStorageItem *item = nil;
+    if (![_kv readItemForKey:key item:&item]) {
+        Lock();
+        item = [_kv getItemForKey:key];
+        [self _scheduleFlush];
+        Unlock();
     }
+    id object = [self _objectWithItem:item];
+    if (metrics) [metrics recordGetWithHitCount:object ? 1 : 0 missCount:object ? 0 : 1 bytesRead:object ? item.value.length : 0 latency:CACurrentMediaTime() - begin];
     return object;
 }
 
@@ -248,42 +483,135 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 }
 
 - (void)setObject:(id<NSCoding>)object forKey:(NSString *)key {
+    [self setObject:object forKey:key ttl:0];
+}
+
+- (void)setObject:(id<NSCoding>)object forKey:(NSString *)key withBlock:(void(^)(void))block {
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        [self setObject:object forKey:key];
+        if (block) block();
+    });
+}
+
+- (void)setObject:(id<NSCoding>)object forKey:(NSString *)key ttl:(NSTimeInterval)ttl {
     if (!key) return;
     if (!object) {
         [self removeObjectForKey:key];
         return;
     }
     
-    NSData *extendedData = [YYDiskCache getExtendedDataFromObject:object];
-    NSData *value = nil;
-    if (_customArchiveBlock) {
-        value = _customArchiveBlock(object);
-    } else {
-        @try {
-            value = [NSKeyedArchiver archivedDataWithRootObject:object];
-        }
-        @catch (NSException *exception) {
-            // nothing to do...
+    YYCacheMetrics *metrics = self.metrics;
+    NSTimeInterval begin = metrics ? CACurrentMediaTime() : 0;
+    YYKVStorageItem *item = [self _itemWithObject:object forKey:key];
+    if (!item) return;
+    if (ttl > 0) {
+        double expireTime = ceil(time(NULL) + ttl);
+        if (expireTime < INT_MAX) item.expireTime = (int)expireTime; // too far to expire
+    }
+    
+    Lock();
+    BOOL suc = [_kv saveItem:item];
+    [self _scheduleFlush];
+    Unlock();
+    if (metrics && suc) [metrics recordSetWithCount:1 bytesWritten:item.value.length latency:CACurrentMediaTime() - begin];
+}
+
+- (void)setObject:(id<NSCoding>)object forKey:(NSString *)key ttl:(NSTimeInterval)ttl withBlock:(void(^)(void))block {
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        [self setObject:object forKey:key ttl:ttl];
+        if (block) block();
+    });
+}
+
+- (NSDictionary<NSString *, id<NSCoding>> *)objectsForKeys:(NSArray<NSString *> *)keys {
+    if (keys.count == 0) return [NSDictionary new];
+    YYCacheMetrics *metrics = self.metrics;
+    NSTimeInterval begin = metrics ? CACurrentMediaTime() : 0;
+    Lock();
+    NSArray *items = [_kv getItemForKeys:keys];
+    [self _scheduleFlush];
+    Unlock();
+    NSUInteger count = items.count;
+    if (count == 0) {
+        if (metrics) [metrics recordGetWithHitCount:0 missCount:keys.count bytesRead:0 latency:CACurrentMediaTime() - begin];
+        return [NSDictionary new];
+    }
+    
+    // decode in parallel
+    CFTypeRef *objects = calloc(count, sizeof(CFTypeRef));
+    if (!objects) return [NSDictionary new];
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        @autoreleasepool {
+            id object = [self _objectWithItem:items[i]];
+            if (object) objects[i] = CFBridgingRetain(object);
         }
+    });
+    NSMutableDictionary *dic = [NSMutableDictionary dictionaryWithCapacity:count];
+    uint64_t bytes = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (!objects[i]) continue;
+        id object = CFBridgingRelease(objects[i]);
+        YYKVStorageItem *item = items[i];
+        if (item.key) dic[item.key] = object;
+        bytes += item.value.length;
     }
-    if (!value) return;
-    NSString *filename = nil;
-    if (_kv.type != YYKVStorageTypeSQLite) {
-        if (value.length > _inlineThreshold) {
-            filename = [self _filenameForKey:key];
+    free(objects);
+    if (metrics) [metrics recordGetWithHitCount:dic.count missCount:keys.count - dic.count bytesRead:bytes latency:CACurrentMediaTime() - begin];
+    return dic;
+}
+
+- (void)objectsForKeys:(NSArray<NSString *> *)keys withBlock:(void(^)(NSDictionary<NSString *, id<NSCoding>> *objects))block {
+    if (!block) return;
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        NSDictionary *objects = [self objectsForKeys:keys];
+        block(objects ? objects : [NSDictionary new]);
+    });
+}
+
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys {
+    NSUInteger count = keys.count;
+    if (count == 0 || objects.count != count) return;
+    YYCacheMetrics *metrics = self.metrics;
+    NSTimeInterval begin = metrics ? CACurrentMediaTime() : 0;
+    
+    // encode in parallel
+    CFTypeRef *items = calloc(count, sizeof(CFTypeRef));
+    if (!items) return;
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        @autoreleasepool {
+            YYKVStorageItem *item = [self _itemWithObject:objects[i] forKey:keys[i]];
+            if (item) items[i] = CFBridgingRetain(item);
         }
+    });
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+    uint64_t bytes = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (!items[i]) continue;
+        YYKVStorageItem *item = CFBridgingRelease(items[i]);
+        [array addObject:item];
+        bytes += item.value.length;
     }
+    free(items);
+    if (array.count == 0) return;
     
     Lock();
-    [_kv saveItemWithKey:key value:value filename:filename extendedData:extendedData];
+    BOOL suc = [_kv saveItems:array];
+    [self _scheduleFlush];
     Unlock();
+    if (metrics && suc) [metrics recordSetWithCount:array.count bytesWritten:bytes latency:CACurrentMediaTime() - begin];
 }
 
-- (void)setObject:(id<NSCoding>)object forKey:(NSString *)key withBlock:(void(^)(void))block {
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys withBlock:(void(^)(void))block {
     __weak typeof(self) _self = self;
     dispatch_async(_queue, ^{
         __strong typeof(_self) self = _self;
-        [self setObject:object forKey:key];
+        [self setObjects:objects forKeys:keys];
         if (block) block();
     });
 }
@@ -292,6 +620,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     if (!key) return;
     Lock();
     [_kv removeItemForKey:key];
+    [self _scheduleFlush];
     Unlock();
 }
 
@@ -334,6 +663,21 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     });
 }
 
+- (void)flush {
+    Lock();
+    [_kv flush];
+    Unlock();
+}
+
+- (void)flushWithBlock:(void(^)(void))block {
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        [self flush];
+        if (block) block();
+    });
+}
+
 - (NSInteger)totalCount {
     Lock();
     int count = [_kv getItemsCount];
@@ -441,4 +785,82 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     Unlock();
 }
 
+- (NSTimeInterval)writeBatchLatency {
+    Lock();
+    NSTimeInterval latency = _kv.writeBatchLatency;
+    Unlock();
+    return latency;
+}
+
+- (void)setWriteBatchLatency:(NSTimeInterval)writeBatchLatency {
+    Lock();
+    _kv.writeBatchLatency = writeBatchLatency;
+    Unlock();
+}
+
+- (BOOL)fileMappingEnabled {
+    Lock();
+    BOOL enabled = _kv.fileMappingEnabled;
+    Unlock();
+    return enabled;
+}
+
+- (void)setFileMappingEnabled:(BOOL)fileMappingEnabled {
+    Lock();
+    _kv.fileMappingEnabled = fileMappingEnabled;
+    Unlock();
+}
+
+- (BOOL)accessTimeDeferred {
+    Lock();
+    BOOL deferred = _kv.accessTimeDeferred;
+    Unlock();
+    return deferred;
+}
+
+- (void)setAccessTimeDeferred:(BOOL)accessTimeDeferred {
+    Lock();
+    _kv.accessTimeDeferred = accessTimeDeferred;
+    Unlock();
+}
+
+- (NSUInteger)readConnectionCount {
+    Lock();
+    NSUInteger count = _kv.readConnectionCount;
+    Unlock();
+    return count;
+}
+
+- (void)setReadConnectionCount:(NSUInteger)readConnectionCount {
+    Lock();
+    _kv.readConnectionCount = readConnectionCount;
+    Unlock();
+}
+
+- (NSTimeInterval)accessTimeUpdateInterval {
+    Lock();
+    NSTimeInterval interval = _kv.accessTimeUpdateInterval;
+    Unlock();
+    return interval;
+}
+
+- (void)setAccessTimeUpdateInterval:(NSTimeInterval)accessTimeUpdateInterval {
+    Lock();
+    _kv.accessTimeUpdateInterval = accessTimeUpdateInterval;
+    Unlock();
+}
+
+- (NSUInteger)writeBatchMaxCount {
+    Lock();
+    NSUInteger count = _kv.writeBatchMaxCount;
+    Unlock();
+    return count;
+}
+
+- (void)setWriteBatchMaxCount:(NSUInteger)writeBatchMaxCount {
+    Lock();
+    _kv.writeBatchMaxCount = writeBatchMaxCount;
+    Unlock();
+}
+
 @end
@@ -25,6 +25,8 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic) int modTime;                          ///< modification unix timestamp
 @property (nonatomic) int accessTime;                       ///< last access unix timestamp
 @property (nullable, nonatomic, strong) NSData *extendedData; ///< extended data (nil if no extended data)
+@property (nonatomic) int compression;                      ///< value's compression codec (0 if not compressed), stored as-is
+@property (nonatomic) int expireTime;                       ///< expiration unix timestamp (0 if never expires)
 @end
 
 /**
@@ -40,6 +42,8 @@ NS_ASSUME_NONNULL_BEGIN
  * If you want to store large files (such as image cache),
    use YYKVStorageTypeFile to get better performance.
  * You can use YYKVStorageTypeMixed and choice your storage type for each item.
+ * If you want to store large number of medium or large datas, use 
+   YYKVStorageTypeSegment to avoid the cost of creating and deleting files.
  
  See <http://www.sqlite.org/intern-v-extern-blob.html> for more information.
  */
@@ -53,6 +57,10 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
     
     /// The `value` is stored in file system or sqlite based on your choice.
     YYKVStorageTypeMixed = 2,
+    
+    /// The `value` is appended to a large segment file or stored in sqlite based 
+    /// on your choice. The space of removed values is reclaimed by `compactSegments`.
+    YYKVStorageTypeSegment = 3,
 };
 
 
@@ -84,6 +92,76 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 @property (nonatomic, readonly) YYKVStorageType type;  ///< The type of this storage.
 @property (nonatomic) BOOL errorLogsEnabled;           ///< Set `YES` to enable error logs for debug.
 
+/**
+ The maximum time (in seconds) that a write may stay uncommitted in a write batch.
+ 
+ @discussion If the value is larger than 0, the writes (insert, delete and access 
+ time update) are grouped into one sqlite transaction, which is committed by the 
+ next write after it's expired or full (see `writeBatchMaxCount`), or by `flush`.
+ So you should call `flush` by yourself when there's no more writes.
+ 
+ The files in data directory are written before the rows are committed, and the 
+ files of deleted rows are removed after that. If the app crashes before commit, 
+ the orphan files are removed at next launch.
+ 
+ The default value is 0, which means each write is committed immediately.
+ */
+@property (nonatomic) NSTimeInterval writeBatchLatency;
+
+/** The maximum number of writes in a write batch. The default value is 64. */
+@property (nonatomic) NSUInteger writeBatchMaxCount;
+
+/** Whether there's an uncommitted write batch. */
+@property (nonatomic, readonly) BOOL hasPendingWrites;
+
+/**
+ If `YES`, the values stored as files (or in segment files) are read with memory 
+ mapping (mmap) instead of being copied into memory, the pages are loaded on demand 
+ and can be purged by the system, and the file is unmapped when the returned `NSData` 
+ is deallocated.
+ 
+ @discussion The mapped data is still valid after the item is removed or trashed,
+ because the files are only unlinked or renamed. When this is enabled, the files
+ are written atomically (write to a temp file and rename) instead of in place, so 
+ the mapped data will not be changed.
+ 
+ The default value is NO.
+ */
+@property (nonatomic) BOOL fileMappingEnabled;
+
+/**
+ If `YES`, the access times of read items are kept in an in-memory table, and 
+ written to sqlite in bulk, so the reads don't generate writes.
+ 
+ @discussion The table is written when it's large enough, before the items are 
+ removed by time (such as `removeItemsToFitSize:`) so they are still removed in 
+ LRU order, and in `flush`. The access times in the table may be lost if the app 
+ crashes.
+ 
+ The default value is NO, which means the access time is updated on each read.
+ */
+@property (nonatomic) BOOL accessTimeDeferred;
+
+/**
+ The minimum time interval (in seconds) between two access time updates of an item.
+ If an item is read again within this interval, the access time is not updated.
+ 
+ The default value is 0, which means the access time is updated on every read.
+ */
+@property (nonatomic) NSTimeInterval accessTimeUpdateInterval;
+
+/**
+ The maximum number of read-only sqlite connections used by `readItemForKey:item:`.
+ 
+ @discussion The sqlite is in WAL mode, so the readers don't block each other and 
+ the writer. Each connection has its own statement cache. When this value is 
+ larger than 0, the files are written atomically like `fileMappingEnabled`.
+ Set it before the concurrent reads begin.
+ 
+ The default value is 0, which means `readItemForKey:item:` always returns NO.
+ */
+@property (nonatomic) NSUInteger readConnectionCount;
+
 #pragma mark - Initializer
 ///=============================================================================
 /// @name Initializer
@@ -105,6 +183,20 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 - (nullable instancetype)initWithPath:(NSString *)path type:(YYKVStorageType)type NS_DESIGNATED_INITIALIZER;
 
 
+#pragma mark - Write Batch
+///=============================================================================
+/// @name Write Batch
+///=============================================================================
+
+/**
+ Write the deferred access times and commit the current write batch (if any).
+ Call this method at the durability points, such as entering background.
+ 
+ @return Whether succeed. If failed, the writes in the batch are rolled back.
+ */
+- (BOOL)flush;
+
+
 #pragma mark - Save Items
 ///=============================================================================
 /// @name Save Items
@@ -113,14 +205,17 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 /**
  Save an item or update the item with 'key' if it already exists.
  
- @discussion This method will save the item.key, item.value, item.filename and
- item.extendedData to disk or sqlite, other properties will be ignored. item.key 
+ @discussion This method will save the item.key, item.value, item.filename,
+ item.extendedData and item.compression to disk or sqlite, other properties will be ignored. item.key 
  and item.value should not be empty (nil or zero length).
  
  If the `type` is YYKVStorageTypeFile, then the item.filename should not be empty.
  If the `type` is YYKVStorageTypeSQLite, then the item.filename will be ignored.
  It the `type` is YYKVStorageTypeMixed, then the item.value will be saved to file 
  system if the item.filename is not empty, otherwise it will be saved to sqlite.
+ If the `type` is YYKVStorageTypeSegment, then the item.value will be appended to
+ a segment file if the item.filename is not empty (the name itself is not used), 
+ otherwise it will be saved to sqlite.
  
  @param item  An item.
  @return Whether succeed.
@@ -147,6 +242,8 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  If the `type` is YYKVStorageTypeSQLite, then the `filename` will be ignored.
  It the `type` is YYKVStorageTypeMixed, then the `value` will be saved to file
  system if the `filename` is not empty, otherwise it will be saved to sqlite.
+ If the `type` is YYKVStorageTypeSegment, then the `value` will be appended to a
+ segment file if the `filename` is not empty, otherwise it will be saved to sqlite.
  
  @param key           The key, should not be empty (nil or zero length).
  @param value         The key, should not be empty (nil or zero length).
@@ -160,6 +257,18 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
                filename:(nullable NSString *)filename
            extendedData:(nullable NSData *)extendedData;
 
+/**
+ Save items or update the items with the same keys in a single transaction.
+ 
+ @discussion Each item is saved as `saveItem:`. The files are written before the
+ transaction is committed, and the replaced files are deleted after that. If any 
+ item fails, the transaction is rolled back and no item will be saved.
+ 
+ @param items  An array of items.
+ @return Whether succeed.
+ */
+- (BOOL)saveItems:(NSArray<YYKVStorageItem *> *)items;
+
 #pragma mark - Remove Items
 ///=============================================================================
 /// @name Remove Items
@@ -198,6 +307,17 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  */
 - (BOOL)removeItemsEarlierThanTime:(int)time;
 
+/**
+ Remove the items whose `expireTime` is reached.
+ 
+ @discussion The expired items are invisible to the get methods even before they're
+ removed. The rows are found by the index on `expire_time`, so the cost depends on
+ the number of expired items, not the total item count.
+ 
+ @return Whether succeed.
+ */
+- (BOOL)removeExpiredItems;
+
 /**
  Remove items to make the total size not larger than a specified size.
  The least recently used (LRU) items will be removed first.
@@ -238,6 +358,27 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
                                endBlock:(nullable void(^)(BOOL error))end;
 
 
+#pragma mark - Compaction
+///=============================================================================
+/// @name Compaction
+///=============================================================================
+
+/**
+ Reclaim the space of the removed or replaced values in segment files.
+ 
+ @discussion If the `type` is YYKVStorageTypeSegment, this method finds the segment
+ with the most dead space (at least half of the file), moves the live values to 
+ the active segment, and deletes it. At most one segment is compacted in each call, 
+ so you may call it periodically in background. Otherwise it does nothing.
+ 
+ The values read with `fileMappingEnabled` are still valid after compaction, 
+ because the segment files are only appended or unlinked.
+ 
+ @return Whether succeed.
+ */
+- (BOOL)compactSegments;
+
+
 #pragma mark - Get Items
 ///=============================================================================
 /// @name Get Items
@@ -270,6 +411,7 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 
 /**
  Get items with an array of keys.
+ The items are queried and the access time is updated in a single transaction.
  
  @param keys  An array of specified keys.
  @return An array of `YYKVStorageItem`, or nil if not exists / error occurs.
@@ -294,6 +436,24 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  */
 - (nullable NSDictionary<NSString *, NSData *> *)getItemValueForKeys:(NSArray<NSString *> *)keys;
 
+/**
+ Get item with a specified key with a read-only connection. 
+ 
+ @discussion Unlike the other methods, this method is thread-safe, it can be called 
+ concurrently with each other and with the other methods.
+ 
+ It returns NO if the item can't be read by a reader, such as the key is changed by 
+ an uncommitted write batch, all the readers are busy, or the file of the item is 
+ missing. Then you should call `getItemForKey:` instead (with the same lock as other 
+ methods). The access time is always deferred, it's written in `flush` or before 
+ trimming by time.
+ 
+ @param key   A specified key.
+ @param item  Output the item for the key, or nil if not exists.
+ @return Whether the item is read by a reader.
+ */
+- (BOOL)readItemForKey:(NSString *)key item:(YYKVStorageItem *_Nullable *_Nonnull)item;
+
 #pragma mark - Get Storage Status
 ///=============================================================================
 /// @name Get Storage Status
@@ -13,6 +13,11 @@
 #import "UIApplication+YYAdd.h"
 #import <UIKit/UIKit.h>
 #import <time.h>
+#import <pthread.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
 
 #if __has_include(<sqlite3.h>)
 #import <sqlite3.h>
@@ -24,11 +29,22 @@
 static const NSUInteger kMaxErrorRetryCount = 8;
 static const NSTimeInterval kMinRetryTimeInterval = 2.0;
 static const int kPathLengthMax = PATH_MAX - 64;
+static const NSUInteger kMaxJoinedKeyCount = 500; // SQLITE_MAX_VARIABLE_NUMBER is 999 by default
+static const CFIndex kMaxDeferredAccessTimeCount = 256;
 static NSString *const kDBFileName = @"manifest.sqlite";
 static NSString *const kDBShmFileName = @"manifest.sqlite-shm";
 static NSString *const kDBWalFileName = @"manifest.sqlite-wal";
+static NSString *const kDBPendingFileName = @"manifest.pending";
 static NSString *const kDataDirectoryName = @"data";
 static NSString *const kTrashDirectoryName = @"trash";
+static NSString *const kSegmentFilePrefix = @"segment_";
+static const int64_t kSegmentMaxSize = 32 * 1024 * 1024; // a new segment is started when it's full
+static const double kSegmentCompactionRatio = 0.5; // compact a segment when half of it is dead
+
+/// Whether an item with the `expire_time` is expired at the time (0 means never expires).
+static inline BOOL YYKVStorageExpired(int expireTime, int now) {
+    return expireTime > 0 && expireTime <= now;
+}
 
 /*
  File:
@@ -36,9 +52,11 @@ static NSString *const kTrashDirectoryName = @"trash";
       /manifest.sqlite
       /manifest.sqlite-shm
       /manifest.sqlite-wal
+      /manifest.pending (exists while a write batch with files is not committed)
       /data/
            /e10adc3949ba59abbe56e057f20f883e
            /e10adc3949ba59abbe56e057f20f883e
+           /segment_00000001 (YYKVStorageTypeSegment, values appended one by one)
       /trash/
             /unused_file_or_folder
  
@@ -51,14 +69,72 @@ static NSString *const kTrashDirectoryName = @"trash";
     modification_time   integer,
     last_access_time    integer,
     extended_data       blob,
+    segment             integer,
+    segment_offset      integer,
+    compression         integer,
+    expire_time         integer,
     primary key(key)
  ); 
  create index if not exists last_access_time_idx on manifest(last_access_time);
+ create index if not exists expire_time_idx on manifest(expire_time);
+ create index if not exists segment_idx on manifest(segment); (YYKVStorageTypeSegment)
+ 
+ create table if not exists manifest_stat (
+    id                  integer primary key check (id = 0),
+    size                integer,
+    count               integer
+ );
+ (the single row is maintained by the triggers on manifest, and reconciled on open)
  */
 
+@interface YYKVStorageItem ()
+@property (nonatomic) int segment;              ///< segment id (0 if not in segment)
+@property (nonatomic) int64_t segmentOffset;    ///< value's offset in segment file
+@end
+
 @implementation YYKVStorageItem
 @end
 
+
+/**
+ A read-only sqlite connection with its own statement cache, it's used by one
+ thread at a time.
+ */
+@interface _YYKVStorageReader : NSObject {
+    @package
+    sqlite3 *_db;
+    CFMutableDictionaryRef _stmtCache;
+    NSUInteger _generation;
+}
+@end
+
+@implementation _YYKVStorageReader
+
+- (sqlite3_stmt *)prepareStmt:(NSString *)sql {
+    sqlite3_stmt *stmt = (sqlite3_stmt *)CFDictionaryGetValue(_stmtCache, (__bridge const void *)(sql));
+    if (!stmt) {
+        if (sqlite3_prepare_v2(_db, sql.UTF8String, -1, &stmt, NULL) != SQLITE_OK) return NULL;
+        CFDictionarySetValue(_stmtCache, (__bridge const void *)(sql), stmt);
+    } else {
+        sqlite3_reset(stmt);
+    }
+    return stmt;
+}
+
+- (void)dealloc {
+    if (_stmtCache) CFRelease(_stmtCache);
+    if (_db) {
+        sqlite3_stmt *stmt;
+        while ((stmt = sqlite3_next_stmt(_db, nil)) != 0) {
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(_db);
+    }
+}
+
+@end
+
+
 @implementation YYKVStorage {
     dispatch_queue_t _trashQueue;
     
@@ -71,6 +147,27 @@ static NSString *const kTrashDirectoryName = @"trash";
     CFMutableDictionaryRef _dbStmtCache;
     NSTimeInterval _dbLastOpenErrorTime;
     NSUInteger _dbOpenErrorCount;
+    
+    BOOL _dbInBatch;                   ///< a write batch transaction is open
+    NSUInteger _dbBatchWriteCount;     ///< statements in current batch
+    NSTimeInterval _dbBatchBeginTime;
+    NSUInteger _dbSavepointDepth;
+    NSUInteger _dbWriteDepth;          ///< nested _dbBeginWrite, the batch is not committed in it
+    NSMutableSet *_pendingDeleteFilenames; ///< deleted after the batch is committed
+    BOOL _pendingFileExists;
+    
+    CFMutableDictionaryRef _deferredAccessTimes; ///< key -> access timestamp (int)
+    
+    int _segmentFd;        ///< the active segment to append, -1 if not opened
+    int _segmentId;        ///< the active segment id, 0 if unknown
+    int64_t _segmentSize;  ///< the active segment size
+    
+    pthread_mutex_t _readerLock;        ///< guards the following reader states
+    NSMutableArray *_readerPool;        ///< idle readers
+    NSUInteger _readerOpenCount;        ///< idle and busy readers
+    NSUInteger _readerGeneration;       ///< increased when the db is reset
+    NSMutableSet *_readerDirtyKeys;     ///< keys changed by the uncommitted writes
+    CFMutableDictionaryRef _readerAccessTimes; ///< key -> access timestamp (int)
 }
 
 
@@ -130,6 +227,13 @@ static NSString *const kTrashDirectoryName = @"trash";
         }
     } while (retry);
     _db = NULL;
+    
+    // the uncommitted batch is rolled back by sqlite
+    _dbInBatch = NO;
+    _dbBatchWriteCount = 0;
+    _dbSavepointDepth = 0;
+    [_pendingDeleteFilenames removeAllObjects];
+    [self _readerClearDirtyKeys];
     return YES;
 }
 
@@ -146,12 +250,62 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (BOOL)_dbInitialize {
-    NSString *sql = @"pragma journal_mode = wal; pragma synchronous = normal; create table if not exists manifest (key text, filename text, size integer, inline_data blob, modification_time integer, last_access_time integer, extended_data blob, primary key(key)); create index if not exists last_access_time_idx on manifest(last_access_time);";
+    NSString *sql = @"pragma journal_mode = wal; pragma synchronous = normal; create table if not exists manifest (key text, filename text, size integer, inline_data blob, modification_time integer, last_access_time integer, extended_data blob, segment integer, segment_offset integer, compression integer, expire_time integer, primary key(key)); create index if not exists last_access_time_idx on manifest(last_access_time);";
+    if (![self _dbExecute:sql]) return NO;
+    if (![self _dbMigrate]) return NO;
+    if (![self _dbExecute:@"create index if not exists expire_time_idx on manifest(expire_time);"]) return NO;
+    if (_type == YYKVStorageTypeSegment) {
+        if (![self _dbExecute:@"create index if not exists segment_idx on manifest(segment);"]) return NO;
+    }
+    return [self _dbInitializeStat];
+}
+
+/**
+ Keep the total size and count in `manifest_stat`, so they're not scanned each time.
+ The triggers update the totals in the same statement as the manifest change, and
+ `recursive_triggers` makes the replaced row of `insert or replace` fire the delete 
+ trigger. The totals are recomputed once on open, in case they're broken.
+ */
+- (BOOL)_dbInitializeStat {
+    NSString *sql = @"pragma recursive_triggers = on; "
+    "create table if not exists manifest_stat (id integer primary key check (id = 0), size integer, count integer); "
+    "create trigger if not exists manifest_stat_insert after insert on manifest begin "
+    "update manifest_stat set size = size + new.size, count = count + 1 where id = 0; end; "
+    "create trigger if not exists manifest_stat_delete after delete on manifest begin "
+    "update manifest_stat set size = size - old.size, count = count - 1 where id = 0; end; "
+    "create trigger if not exists manifest_stat_update after update of size on manifest begin "
+    "update manifest_stat set size = size - old.size + new.size where id = 0; end; "
+    "insert or replace into manifest_stat (id, size, count) select 0, ifnull(sum(size), 0), count(*) from manifest;";
+    return [self _dbExecute:sql];
+}
+
+/// Add the columns which are not exist in the manifest created by older version.
+- (BOOL)_dbMigrate {
+    sqlite3_stmt *stmt = NULL;
+    int result = sqlite3_prepare_v2(_db, "pragma table_info(manifest);", -1, &stmt, NULL);
+    if (result != SQLITE_OK) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    NSMutableSet *columns = [NSMutableSet new];
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        char *name = (char *)sqlite3_column_text(stmt, 1);
+        if (name) [columns addObject:[NSString stringWithUTF8String:name]];
+    }
+    sqlite3_finalize(stmt);
+    
+    NSMutableString *sql = [NSMutableString new];
+    for (NSString *column in @[@"segment", @"segment_offset", @"compression", @"expire_time"]) {
+        if (![columns containsObject:column]) [sql appendFormat:@"alter table manifest add column %@ integer; ", column];
+    }
+    if (sql.length == 0) return YES;
     return [self _dbExecute:sql];
 }
 
 - (void)_dbCheckpoint {
     if (![self _dbCheck]) return;
+    if (_dbSavepointDepth > 0) return;
+    [self flush];
     // Cause a checkpoint to occur, merge `sqlite-wal` file to `sqlite` file.
     sqlite3_wal_checkpoint(_db, NULL);
 }
@@ -170,6 +324,85 @@ static NSString *const kTrashDirectoryName = @"trash";
     return result == SQLITE_OK;
 }
 
+/**
+ Open a write batch transaction if the batch is enabled, or commit the current
+ batch if it's full or expired. It should be called before each write statement.
+ */
+- (void)_dbWillWrite {
+    if (_dbSavepointDepth == 0 && _dbWriteDepth == 0) {
+        if (_dbInBatch && (_dbBatchWriteCount >= _writeBatchMaxCount ||
+                           CACurrentMediaTime() - _dbBatchBeginTime >= _writeBatchLatency)) {
+            [self _dbCommitBatch];
+        }
+        if (!_dbInBatch && _writeBatchLatency > 0) {
+            if ([self _dbExecute:@"begin immediate transaction;"]) {
+                _dbInBatch = YES;
+                _dbBatchWriteCount = 0;
+                _dbBatchBeginTime = CACurrentMediaTime();
+            }
+        }
+    }
+    if (_dbInBatch) _dbBatchWriteCount++;
+}
+
+/**
+ Begin a write operation which changes files and rows. The batch is opened (or
+ rolled) before anything is changed, and not committed until _dbEndWrite, so the
+ pending file is created before the data files, and all the changes of the
+ operation are in the same batch.
+ */
+- (void)_dbBeginWrite {
+    if (_dbWriteDepth == 0 && _dbSavepointDepth == 0) {
+        [self _dbWillWrite];
+        if (_dbInBatch) _dbBatchWriteCount--; // counted by the statements
+    }
+    _dbWriteDepth++;
+}
+
+- (void)_dbEndWrite {
+    if (_dbWriteDepth > 0) _dbWriteDepth--;
+}
+
+/// Commit the current write batch transaction.
+- (BOOL)_dbCommitBatch {
+    if (!_dbInBatch) return YES;
+    _dbInBatch = NO;
+    _dbBatchWriteCount = 0;
+    BOOL suc = [self _dbExecute:@"commit transaction;"];
+    [self _readerClearDirtyKeys]; // committed or rolled back
+    if (!suc) {
+        [self _dbExecute:@"rollback transaction;"];
+        [_pendingDeleteFilenames removeAllObjects]; // the rows are restored
+        return NO; // keep the pending file, the orphans will be removed at next launch
+    }
+    [self _fileMoveToTrashWithNames:_pendingDeleteFilenames.allObjects];
+    [_pendingDeleteFilenames removeAllObjects];
+    if (_pendingFileExists) {
+        [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBPendingFileName] error:NULL];
+        _pendingFileExists = NO;
+    }
+    return YES;
+}
+
+/// Begin a nested transaction, all the writes before release are atomic.
+- (BOOL)_dbBeginSavepoint {
+    if (_dbSavepointDepth == 0) [self _dbWillWrite]; // join the write batch
+    if (![self _dbExecute:@"savepoint yy_savepoint;"]) return NO;
+    _dbSavepointDepth++;
+    return YES;
+}
+
+- (BOOL)_dbReleaseSavepoint {
+    if (![self _dbExecute:@"release savepoint yy_savepoint;"]) return NO;
+    _dbSavepointDepth--;
+    return YES;
+}
+
+- (void)_dbRollbackSavepoint {
+    [self _dbExecute:@"rollback to savepoint yy_savepoint;"];
+    if ([self _dbExecute:@"release savepoint yy_savepoint;"]) _dbSavepointDepth--;
+}
+
 - (sqlite3_stmt *)_dbPrepareStmt:(NSString *)sql {
     if (![self _dbCheck] || sql.length == 0 || !_dbStmtCache) return NULL;
     sqlite3_stmt *stmt = (sqlite3_stmt *)CFDictionaryGetValue(_dbStmtCache, (__bridge const void *)(sql));
@@ -186,6 +419,89 @@ static NSString *const kTrashDirectoryName = @"trash";
     return stmt;
 }
 
+/// Write the deferred access times to db in a single transaction.
+- (BOOL)_dbFlushAccessTimes {
+    [self _readerMergeAccessTimes];
+    CFIndex count = _deferredAccessTimes ? CFDictionaryGetCount(_deferredAccessTimes) : 0;
+    if (count == 0) return YES;
+    if (![self _dbCheck]) return NO;
+    
+    const void **keys = malloc(sizeof(void *) * count);
+    const void **times = malloc(sizeof(void *) * count);
+    if (!keys || !times) {
+        free(keys);
+        free(times);
+        return NO;
+    }
+    CFDictionaryGetKeysAndValues(_deferredAccessTimes, keys, times);
+    NSString *sql = @"update manifest set last_access_time = ?1 where key = ?2 and last_access_time < ?1;";
+    BOOL inTransaction = [self _dbBeginSavepoint];
+    BOOL suc = YES;
+    for (CFIndex i = 0; i < count; i++) {
+        sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+        if (!stmt) {
+            suc = NO;
+            break;
+        }
+        [self _dbWillWrite];
+        sqlite3_bind_int(stmt, 1, (int)(intptr_t)times[i]);
+        sqlite3_bind_text(stmt, 2, ((__bridge NSString *)keys[i]).UTF8String, -1, NULL);
+        int result = sqlite3_step(stmt);
+        if (result != SQLITE_DONE) {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite update error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            suc = NO;
+            break;
+        }
+    }
+    if (inTransaction) {
+        if (suc) suc = [self _dbReleaseSavepoint];
+        if (!suc) [self _dbRollbackSavepoint];
+    }
+    free(keys);
+    free(times);
+    if (suc) CFDictionaryRemoveAllValues(_deferredAccessTimes);
+    return suc;
+}
+
+/**
+ Record an access of the items, the access time is updated in db immediately, or
+ deferred if `accessTimeDeferred` is YES.
+ The `accessTime` of the items is used to skip the update (see `accessTimeUpdateInterval`),
+ pass the items with 0 `accessTime` if it's unknown.
+ */
+- (void)_recordAccessOfItems:(NSArray<YYKVStorageItem *> *)items {
+    int now = (int)time(NULL);
+    NSMutableArray *keys = [NSMutableArray new];
+    for (YYKVStorageItem *item in items) {
+        if (!item.key) continue;
+        if (_accessTimeUpdateInterval > 0) {
+            int lastTime = item.accessTime;
+            if (_deferredAccessTimes) {
+                int deferredTime = (int)(intptr_t)CFDictionaryGetValue(_deferredAccessTimes, (__bridge const void *)(item.key));
+                if (deferredTime > lastTime) lastTime = deferredTime;
+            }
+            if (lastTime > 0 && now - lastTime < _accessTimeUpdateInterval) continue;
+        }
+        [keys addObject:item.key];
+    }
+    if (keys.count == 0) return;
+    
+    if (_accessTimeDeferred && _deferredAccessTimes) {
+        for (NSString *key in keys) {
+            CFDictionarySetValue(_deferredAccessTimes, (__bridge const void *)(key), (const void *)(intptr_t)now);
+        }
+        if (CFDictionaryGetCount(_deferredAccessTimes) >= kMaxDeferredAccessTimeCount) {
+            [self _dbFlushAccessTimes];
+        }
+    } else if (keys.count == 1) {
+        [self _dbUpdateAccessTimeWithKey:keys.firstObject];
+    } else {
+        for (NSUInteger i = 0, max = keys.count; i < max; i += kMaxJoinedKeyCount) {
+            [self _dbUpdateAccessTimeWithKeys:[keys subarrayWithRange:NSMakeRange(i, MIN(kMaxJoinedKeyCount, max - i))]];
+        }
+    }
+}
+
 - (NSString *)_dbJoinedKeys:(NSArray *)keys {
     NSMutableString *string = [NSMutableString new];
     for (NSUInteger i = 0,max = keys.count; i < max; i++) {
@@ -204,16 +520,17 @@ static NSString *const kTrashDirectoryName = @"trash";
     }
 }
 
-- (BOOL)_dbSaveWithKey:(NSString *)key value:(NSData *)value fileName:(NSString *)fileName extendedData:(NSData *)extendedData {
-    NSString *sql = @"insert or replace into manifest (key, filename, size, inline_data, modification_time, last_access_time, extended_data) values (?1, ?2, ?3, ?4, ?5, ?6, ?7);";
+- (BOOL)_dbSaveWithKey:(NSString *)key value:(NSData *)value fileName:(NSString *)fileName extendedData:(NSData *)extendedData segment:(int)segment offset:(int64_t)offset compression:(int)compression expireTime:(int)expireTime {
+    NSString *sql = @"insert or replace into manifest (key, filename, size, inline_data, modification_time, last_access_time, extended_data, segment, segment_offset, compression, expire_time) values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11);";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return NO;
+    [self _dbWillWrite];
     
     int timestamp = (int)time(NULL);
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     sqlite3_bind_text(stmt, 2, fileName.UTF8String, -1, NULL);
     sqlite3_bind_int(stmt, 3, (int)value.length);
-    if (fileName.length == 0) {
+    if (fileName.length == 0 && segment == 0) {
         sqlite3_bind_blob(stmt, 4, value.bytes, (int)value.length, 0);
     } else {
         sqlite3_bind_blob(stmt, 4, NULL, 0, 0);
@@ -221,6 +538,23 @@ static NSString *const kTrashDirectoryName = @"trash";
     sqlite3_bind_int(stmt, 5, timestamp);
     sqlite3_bind_int(stmt, 6, timestamp);
     sqlite3_bind_blob(stmt, 7, extendedData.bytes, (int)extendedData.length, 0);
+    if (segment > 0) {
+        sqlite3_bind_int(stmt, 8, segment);
+        sqlite3_bind_int64(stmt, 9, offset);
+    } else {
+        sqlite3_bind_null(stmt, 8);
+        sqlite3_bind_null(stmt, 9);
+    }
+    if (compression != 0) {
+        sqlite3_bind_int(stmt, 10, compression);
+    } else {
+        sqlite3_bind_null(stmt, 10);
+    }
+    if (expireTime > 0) {
+        sqlite3_bind_int(stmt, 11, expireTime);
+    } else {
+        sqlite3_bind_null(stmt, 11);
+    }
     
     int result = sqlite3_step(stmt);
     if (result != SQLITE_DONE) {
@@ -234,6 +568,7 @@ static NSString *const kTrashDirectoryName = @"trash";
     NSString *sql = @"update manifest set last_access_time = ?1 where key = ?2;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return NO;
+    [self _dbWillWrite];
     sqlite3_bind_int(stmt, 1, (int)time(NULL));
     sqlite3_bind_text(stmt, 2, key.UTF8String, -1, NULL);
     int result = sqlite3_step(stmt);
@@ -256,6 +591,7 @@ static NSString *const kTrashDirectoryName = @"trash";
         return NO;
     }
     
+    [self _dbWillWrite];
     [self _dbBindJoinedKeys:keys stmt:stmt fromIndex:1];
     result = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
@@ -270,6 +606,7 @@ static NSString *const kTrashDirectoryName = @"trash";
     NSString *sql = @"delete from manifest where key = ?1;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return NO;
+    [self _dbWillWrite];
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     
     int result = sqlite3_step(stmt);
@@ -290,6 +627,7 @@ static NSString *const kTrashDirectoryName = @"trash";
         return NO;
     }
     
+    [self _dbWillWrite];
     [self _dbBindJoinedKeys:keys stmt:stmt fromIndex:1];
     result = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
@@ -304,6 +642,7 @@ static NSString *const kTrashDirectoryName = @"trash";
     NSString *sql = @"delete from manifest where size > ?1;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return NO;
+    [self _dbWillWrite];
     sqlite3_bind_int(stmt, 1, size);
     int result = sqlite3_step(stmt);
     if (result != SQLITE_DONE) {
@@ -317,6 +656,7 @@ static NSString *const kTrashDirectoryName = @"trash";
     NSString *sql = @"delete from manifest where last_access_time < ?1;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return NO;
+    [self _dbWillWrite];
     sqlite3_bind_int(stmt, 1, time);
     int result = sqlite3_step(stmt);
     if (result != SQLITE_DONE) {
@@ -337,6 +677,10 @@ static NSString *const kTrashDirectoryName = @"trash";
     int last_access_time = sqlite3_column_int(stmt, i++);
     const void *extended_data = sqlite3_column_blob(stmt, i);
     int extended_data_bytes = sqlite3_column_bytes(stmt, i++);
+    int segment = sqlite3_column_int(stmt, i++);
+    sqlite3_int64 segment_offset = sqlite3_column_int64(stmt, i++);
+    int compression = sqlite3_column_int(stmt, i++);
+    int expire_time = sqlite3_column_int(stmt, i++);
     
     YYKVStorageItem *item = [YYKVStorageItem new];
     if (key) item.key = [NSString stringWithUTF8String:key];
@@ -346,11 +690,15 @@ static NSString *const kTrashDirectoryName = @"trash";
     item.modTime = modification_time;
     item.accessTime = last_access_time;
     if (extended_data_bytes > 0 && extended_data) item.extendedData = [NSData dataWithBytes:extended_data length:extended_data_bytes];
+    item.segment = segment;
+    item.segmentOffset = segment_offset;
+    item.compression = compression;
+    item.expireTime = expire_time;
     return item;
 }
 
 - (YYKVStorageItem *)_dbGetItemWithKey:(NSString *)key excludeInlineData:(BOOL)excludeInlineData {
-    NSString *sql = excludeInlineData ? @"select key, filename, size, modification_time, last_access_time, extended_data from manifest where key = ?1;" : @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data from manifest where key = ?1;";
+    NSString *sql = excludeInlineData ? @"select key, filename, size, modification_time, last_access_time, extended_data, segment, segment_offset, compression, expire_time from manifest where key = ?1;" : @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data, segment, segment_offset, compression, expire_time from manifest where key = ?1;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return nil;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
@@ -359,6 +707,7 @@ static NSString *const kTrashDirectoryName = @"trash";
     int result = sqlite3_step(stmt);
     if (result == SQLITE_ROW) {
         item = [self _dbGetItemFromStmt:stmt excludeInlineData:excludeInlineData];
+        if (YYKVStorageExpired(item.expireTime, (int)time(NULL))) item = nil; // removed by `removeExpiredItems`
     } else {
         if (result != SQLITE_DONE) {
             if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
@@ -371,9 +720,9 @@ static NSString *const kTrashDirectoryName = @"trash";
     if (![self _dbCheck]) return nil;
     NSString *sql;
     if (excludeInlineData) {
-        sql = [NSString stringWithFormat:@"select key, filename, size, modification_time, last_access_time, extended_data from manifest where key in (%@);", [self _dbJoinedKeys:keys]];
+        sql = [NSString stringWithFormat:@"select key, filename, size, modification_time, last_access_time, extended_data, segment, segment_offset, compression, expire_time from manifest where key in (%@);", [self _dbJoinedKeys:keys]];
     } else {
-        sql = [NSString stringWithFormat:@"select key, filename, size, inline_data, modification_time, last_access_time, extended_data from manifest where key in (%@)", [self _dbJoinedKeys:keys]];
+        sql = [NSString stringWithFormat:@"select key, filename, size, inline_data, modification_time, last_access_time, extended_data, segment, segment_offset, compression, expire_time from manifest where key in (%@)", [self _dbJoinedKeys:keys]];
     }
     
     sqlite3_stmt *stmt = NULL;
@@ -385,11 +734,12 @@ static NSString *const kTrashDirectoryName = @"trash";
     
     [self _dbBindJoinedKeys:keys stmt:stmt fromIndex:1];
     NSMutableArray *items = [NSMutableArray new];
+    int now = (int)time(NULL);
     do {
         result = sqlite3_step(stmt);
         if (result == SQLITE_ROW) {
             YYKVStorageItem *item = [self _dbGetItemFromStmt:stmt excludeInlineData:excludeInlineData];
-            if (item) [items addObject:item];
+            if (item && !YYKVStorageExpired(item.expireTime, now)) [items addObject:item];
         } else if (result == SQLITE_DONE) {
             break;
         } else {
@@ -403,10 +753,11 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (NSData *)_dbGetValueWithKey:(NSString *)key {
-    NSString *sql = @"select inline_data from manifest where key = ?1;";
+    NSString *sql = @"select inline_data from manifest where key = ?1 and (expire_time is null or expire_time > ?2);";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return nil;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
+    sqlite3_bind_int(stmt, 2, (int)time(NULL));
     
     int result = sqlite3_step(stmt);
     if (result == SQLITE_ROW) {
@@ -473,6 +824,20 @@ static NSString *const kTrashDirectoryName = @"trash";
     return filenames;
 }
 
+- (BOOL)_dbDeleteItemsWithExpireTimeNotLaterThan:(int)time {
+    NSString *sql = @"delete from manifest where expire_time > 0 and expire_time <= ?1;";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return NO;
+    [self _dbWillWrite];
+    sqlite3_bind_int(stmt, 1, time);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite delete error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
 - (NSMutableArray *)_dbGetFilenamesWithSizeLargerThan:(int)size {
     NSString *sql = @"select filename from manifest where size > ?1 and filename is not null;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
@@ -525,6 +890,32 @@ static NSString *const kTrashDirectoryName = @"trash";
     return filenames;
 }
 
+- (NSMutableArray *)_dbGetFilenamesWithExpireTimeNotLaterThan:(int)time {
+    NSString *sql = @"select filename from manifest where expire_time > 0 and expire_time <= ?1 and filename is not null;";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return nil;
+    sqlite3_bind_int(stmt, 1, time);
+    
+    NSMutableArray *filenames = [NSMutableArray new];
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            char *filename = (char *)sqlite3_column_text(stmt, 0);
+            if (filename && *filename != 0) {
+                NSString *name = [NSString stringWithUTF8String:filename];
+                if (name) [filenames addObject:name];
+            }
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            filenames = nil;
+            break;
+        }
+    } while (1);
+    return filenames;
+}
+
 - (NSMutableArray *)_dbGetItemSizeInfoOrderByTimeAscWithLimit:(int)count {
     NSString *sql = @"select key, filename, size from manifest order by last_access_time asc limit ?1;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
@@ -554,11 +945,60 @@ static NSString *const kTrashDirectoryName = @"trash";
     return items;
 }
 
+/**
+ Scan the items in LRU order, until at least `count` items and `size` bytes are 
+ covered. The filenames of these items are added to `filenames`.
+ @return The number of items, -1 when an error occurs.
+ */
+- (int)_dbGetItemCountOrderByTimeAscToFitCount:(int)count size:(int64_t)size filenames:(NSMutableArray *)filenames {
+    NSString *sql = @"select filename, size from manifest order by last_access_time asc, rowid asc;";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return -1;
+    
+    int itemCount = 0;
+    int64_t itemSize = 0;
+    while (itemCount < count || itemSize < size) {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            char *filename = (char *)sqlite3_column_text(stmt, 0);
+            if (filename && *filename != 0) {
+                NSString *name = [NSString stringWithUTF8String:filename];
+                if (name) [filenames addObject:name];
+            }
+            itemSize += sqlite3_column_int(stmt, 1);
+            itemCount++;
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            itemCount = -1;
+            break;
+        }
+    }
+    sqlite3_reset(stmt); // release the read cursor
+    return itemCount;
+}
+
+- (BOOL)_dbDeleteItemsOrderByTimeAscWithLimit:(int)count {
+    NSString *sql = @"delete from manifest where rowid in (select rowid from manifest order by last_access_time asc, rowid asc limit ?1);";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return NO;
+    [self _dbWillWrite];
+    sqlite3_bind_int(stmt, 1, count);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite delete error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
 - (int)_dbGetItemCountWithKey:(NSString *)key {
-    NSString *sql = @"select count(key) from manifest where key = ?1;";
+    NSString *sql = @"select count(key) from manifest where key = ?1 and (expire_time is null or expire_time > ?2);";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return -1;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
+    sqlite3_bind_int(stmt, 2, (int)time(NULL));
     int result = sqlite3_step(stmt);
     if (result != SQLITE_ROW) {
         if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
@@ -568,7 +1008,7 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (int)_dbGetTotalItemSize {
-    NSString *sql = @"select sum(size) from manifest;";
+    NSString *sql = @"select size from manifest_stat where id = 0;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return -1;
     int result = sqlite3_step(stmt);
@@ -580,7 +1020,7 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (int)_dbGetTotalItemCount {
-    NSString *sql = @"select count(*) from manifest;";
+    NSString *sql = @"select count from manifest_stat where id = 0;";
     sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
     if (!stmt) return -1;
     int result = sqlite3_step(stmt);
@@ -591,25 +1031,153 @@ static NSString *const kTrashDirectoryName = @"trash";
     return sqlite3_column_int(stmt, 0);
 }
 
+/// segment id -> total size of the values referenced by manifest
+- (NSMutableDictionary *)_dbGetSegmentLiveSizes {
+    NSString *sql = @"select segment, sum(size) from manifest where segment > 0 group by segment;";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return nil;
+    
+    NSMutableDictionary *sizes = [NSMutableDictionary new];
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            int segment = sqlite3_column_int(stmt, 0);
+            sqlite3_int64 size = sqlite3_column_int64(stmt, 1);
+            sizes[@(segment)] = @(size);
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            sizes = nil;
+            break;
+        }
+    } while (1);
+    return sizes;
+}
+
+/// The items (key, size, segment offset) in a segment, ordered by offset.
+- (NSMutableArray *)_dbGetItemsInSegment:(int)segment {
+    NSString *sql = @"select key, size, segment_offset from manifest where segment = ?1 order by segment_offset;";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return nil;
+    sqlite3_bind_int(stmt, 1, segment);
+    
+    NSMutableArray *items = [NSMutableArray new];
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            char *key = (char *)sqlite3_column_text(stmt, 0);
+            if (!key) continue;
+            YYKVStorageItem *item = [YYKVStorageItem new];
+            item.key = [NSString stringWithUTF8String:key];
+            item.size = sqlite3_column_int(stmt, 1);
+            item.segment = segment;
+            item.segmentOffset = sqlite3_column_int64(stmt, 2);
+            [items addObject:item];
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            items = nil;
+            break;
+        }
+    } while (1);
+    return items;
+}
+
+- (BOOL)_dbUpdateSegmentWithKey:(NSString *)key segment:(int)segment offset:(int64_t)offset {
+    NSString *sql = @"update manifest set segment = ?1, segment_offset = ?2 where key = ?3;";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return NO;
+    [self _dbWillWrite];
+    sqlite3_bind_int(stmt, 1, segment);
+    sqlite3_bind_int64(stmt, 2, offset);
+    sqlite3_bind_text(stmt, 3, key.UTF8String, -1, NULL);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite update error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
 
 #pragma mark - file
 
 - (BOOL)_fileWriteWithName:(NSString *)filename data:(NSData *)data {
+    if (_dbInBatch) {
+        [_pendingDeleteFilenames removeObject:filename]; // it's used again
+        if (!_pendingFileExists) {
+            // the file may be orphaned if the batch is not committed
+            NSString *pendingPath = [_path stringByAppendingPathComponent:kDBPendingFileName];
+            _pendingFileExists = [[NSData data] writeToFile:pendingPath atomically:NO];
+        }
+    }
     NSString *path = [_dataPath stringByAppendingPathComponent:filename];
-    return [data writeToFile:path atomically:NO];
+    // A mapped file should not be changed in place, or the reader may get SIGBUS.
+    // Write to a temp file and rename it, so the old file is kept for the mappings
+    // and the concurrent readers.
+    return [data writeToFile:path atomically:_fileMappingEnabled || _readConnectionCount > 0];
 }
 
 - (NSData *)_fileReadWithName:(NSString *)filename {
     NSString *path = [_dataPath stringByAppendingPathComponent:filename];
-    NSData *data = [NSData dataWithContentsOfFile:path];
+    NSData *data = nil;
+    if (_fileMappingEnabled) {
+        // the file is unmapped when the data is deallocated
+        data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];
+    } else {
+        data = [NSData dataWithContentsOfFile:path];
+    }
     return data;
 }
 
 - (BOOL)_fileDeleteWithName:(NSString *)filename {
+    if (_dbInBatch) {
+        // the row may be restored if the batch is not committed
+        [_pendingDeleteFilenames addObject:filename];
+        return YES;
+    }
     NSString *path = [_dataPath stringByAppendingPathComponent:filename];
     return [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
 }
 
+/**
+ Move the files to a new folder in trash, and empty the trash in background.
+ A rename is much cheaper than unlinking a large file, so the caller is not blocked
+ by the number or the size of the files.
+ */
+- (void)_fileMoveToTrashWithNames:(NSArray *)filenames {
+    if (filenames.count == 0) return;
+    if (filenames.count == 1) {
+        NSString *path = [_dataPath stringByAppendingPathComponent:filenames.firstObject];
+        [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+        return;
+    }
+    CFUUIDRef uuidRef = CFUUIDCreate(NULL);
+    CFStringRef uuid = CFUUIDCreateString(NULL, uuidRef);
+    CFRelease(uuidRef);
+    NSString *tmpPath = [_trashPath stringByAppendingPathComponent:(__bridge NSString *)(uuid)];
+    CFRelease(uuid);
+    BOOL suc = [[NSFileManager defaultManager] createDirectoryAtPath:tmpPath withIntermediateDirectories:YES attributes:nil error:NULL];
+    for (NSString *filename in filenames) {
+        NSString *path = [_dataPath stringByAppendingPathComponent:filename];
+        if (!suc || rename(path.fileSystemRepresentation, [tmpPath stringByAppendingPathComponent:filename].fileSystemRepresentation) != 0) {
+            [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+        }
+    }
+    if (suc) [self _fileEmptyTrashInBackground];
+}
+
+- (BOOL)_fileDeleteWithNames:(NSArray *)filenames {
+    if (_dbInBatch) {
+        [_pendingDeleteFilenames addObjectsFromArray:filenames];
+        return YES;
+    }
+    [self _fileMoveToTrashWithNames:filenames];
+    return YES;
+}
+
 - (BOOL)_fileMoveAllToTrash {
     CFUUIDRef uuidRef = CFUUIDCreate(NULL);
     CFStringRef uuid = CFUUIDCreateString(NULL, uuidRef);
@@ -623,6 +1191,41 @@ static NSString *const kTrashDirectoryName = @"trash";
     return suc;
 }
 
+/**
+ Move the files which are not referenced by the manifest to trash.
+ They may be left by a write batch which was not committed (crash or kill).
+ */
+- (void)_fileMoveOrphansToTrash {
+    NSString *sql = @"select filename from manifest where filename is not null and filename != '';";
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    if (!stmt) return;
+    NSMutableSet *filenames = [NSMutableSet new];
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            char *filename = (char *)sqlite3_column_text(stmt, 0);
+            if (filename && *filename != 0) [filenames addObject:[NSString stringWithUTF8String:filename]];
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            return;
+        }
+    } while (1);
+    
+    NSFileManager *manager = [NSFileManager defaultManager];
+    for (NSString *name in [manager contentsOfDirectoryAtPath:_dataPath error:NULL]) {
+        if ([filenames containsObject:name]) continue;
+        if (_type == YYKVStorageTypeSegment && [self _segmentIdWithName:name] > 0) continue; // compacted later
+        CFUUIDRef uuidRef = CFUUIDCreate(NULL);
+        CFStringRef uuid = CFUUIDCreateString(NULL, uuidRef);
+        CFRelease(uuidRef);
+        NSString *trashPath = [_trashPath stringByAppendingPathComponent:(__bridge NSString *)(uuid)];
+        CFRelease(uuid);
+        [manager moveItemAtPath:[_dataPath stringByAppendingPathComponent:name] toPath:trashPath error:NULL];
+    }
+}
+
 - (void)_fileEmptyTrashInBackground {
     NSString *trashPath = _trashPath;
     dispatch_queue_t queue = _trashQueue;
@@ -637,8 +1240,256 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 
+#pragma mark - segment
+
+- (NSString *)_segmentNameWithId:(int)segment {
+    return [NSString stringWithFormat:@"%@%08d", kSegmentFilePrefix, segment];
+}
+
+/// Returns the segment id, or 0 if it's not a segment file.
+- (int)_segmentIdWithName:(NSString *)name {
+    if (![name hasPrefix:kSegmentFilePrefix]) return 0;
+    return [name substringFromIndex:kSegmentFilePrefix.length].intValue;
+}
+
+- (void)_segmentClose {
+    if (_segmentFd >= 0) close(_segmentFd);
+    _segmentFd = -1;
+    _segmentSize = 0;
+}
+
+/**
+ Open the active segment, or start a new one if the value of `length` can not be
+ appended to it. The segment files are never changed except appending, so the 
+ mapped values are not affected.
+ */
+- (BOOL)_segmentPrepareForLength:(NSUInteger)length {
+    if (_segmentFd >= 0) {
+        if (_segmentSize == 0 || _segmentSize + (int64_t)length <= kSegmentMaxSize) return YES;
+        [self _segmentClose];
+        _segmentId++;
+    } else if (_segmentId == 0) {
+        _segmentId = 1;
+        for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_dataPath error:NULL]) {
+            _segmentId = MAX(_segmentId, [self _segmentIdWithName:name]);
+        }
+    }
+    while (1) {
+        NSString *path = [_dataPath stringByAppendingPathComponent:[self _segmentNameWithId:_segmentId]];
+        int fd = open(path.fileSystemRepresentation, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d segment open error (%d).", __FUNCTION__, __LINE__, errno);
+            return NO;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return NO;
+        }
+        if (st.st_size > 0 && st.st_size + (int64_t)length > kSegmentMaxSize) {
+            close(fd);
+            _segmentId++;
+            continue;
+        }
+        _segmentFd = fd;
+        _segmentSize = st.st_size;
+        return YES;
+    }
+}
+
+/**
+ Append the data to the active segment. The bytes are dead until the row which 
+ references them is saved, so it's fine if the row is not committed at last.
+ */
+- (BOOL)_segmentAppendData:(NSData *)data segment:(int *)segment offset:(int64_t *)offset {
+    if (![self _segmentPrepareForLength:data.length]) return NO;
+    const uint8_t *bytes = data.bytes;
+    size_t left = data.length;
+    off_t position = _segmentSize;
+    while (left > 0) {
+        ssize_t written = pwrite(_segmentFd, bytes, left, position);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (_errorLogsEnabled) NSLog(@"%s line:%d segment write error (%d).", __FUNCTION__, __LINE__, errno);
+            return NO;
+        }
+        bytes += written;
+        left -= written;
+        position += written;
+    }
+    *segment = _segmentId;
+    *offset = _segmentSize;
+    _segmentSize = position;
+    return YES;
+}
+
+- (NSData *)_segmentReadWithItem:(YYKVStorageItem *)item mapped:(BOOL)mapped {
+    if (item.segment <= 0 || item.size <= 0 || item.segmentOffset < 0) return nil;
+    NSString *path = [_dataPath stringByAppendingPathComponent:[self _segmentNameWithId:item.segment]];
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) return nil;
+    
+    NSData *data = nil;
+    size_t length = item.size;
+    off_t offset = item.segmentOffset;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && offset + (off_t)length <= st.st_size) { // it's SIGBUS to touch the pages beyond the end of file
+        if (mapped) {
+            off_t pageOffset = offset & ~((off_t)getpagesize() - 1);
+            size_t mapLength = length + (size_t)(offset - pageOffset);
+            void *map = mmap(NULL, mapLength, PROT_READ, MAP_PRIVATE, fd, pageOffset);
+            if (map != MAP_FAILED) {
+                // the segment is unlinked after compaction, but the mapping is still valid
+                data = [[NSData alloc] initWithBytesNoCopy:(uint8_t *)map + (offset - pageOffset) length:length deallocator:^(void *bytes, NSUInteger len) {
+                    munmap(map, mapLength);
+                }];
+            }
+        } else {
+            NSMutableData *buffer = [NSMutableData dataWithLength:length];
+            ssize_t readLength = pread(fd, buffer.mutableBytes, length, offset);
+            if (readLength == (ssize_t)length) data = buffer;
+        }
+    }
+    close(fd);
+    return data;
+}
+
+/**
+ Move the live values of a segment to the active segment, then delete it.
+ */
+- (BOOL)_segmentCompactWithId:(int)segment {
+    NSArray *items = [self _dbGetItemsInSegment:segment];
+    if (!items) return NO;
+    if (items.count > 0) {
+        if (![self _dbBeginSavepoint]) return NO;
+        BOOL suc = YES;
+        for (YYKVStorageItem *item in items) {
+            NSData *value = [self _segmentReadWithItem:item mapped:NO];
+            int newSegment = 0;
+            int64_t newOffset = 0;
+            if (!value) {
+                suc = [self _dbDeleteItemWithKey:item.key]; // broken
+            } else if ([self _segmentAppendData:value segment:&newSegment offset:&newOffset]) {
+                suc = [self _dbUpdateSegmentWithKey:item.key segment:newSegment offset:newOffset];
+            } else {
+                suc = NO;
+            }
+            if (!suc) break;
+        }
+        if (suc) suc = [self _dbReleaseSavepoint];
+        if (!suc) {
+            [self _dbRollbackSavepoint];
+            return NO;
+        }
+    }
+    // deferred until the batch is committed, the rows are moved at that time
+    return [self _fileDeleteWithName:[self _segmentNameWithId:segment]];
+}
+
+
+#pragma mark - reader
+
+- (_YYKVStorageReader *)_readerOpen {
+    sqlite3 *db = NULL;
+    int result = sqlite3_open_v2(_dbPath.UTF8String, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+    if (result != SQLITE_OK) {
+        if (db) sqlite3_close(db);
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite open failed (%d).", __FUNCTION__, __LINE__, result);
+        return nil;
+    }
+    _YYKVStorageReader *reader = [_YYKVStorageReader new];
+    reader->_db = db;
+    CFDictionaryKeyCallBacks keyCallbacks = kCFCopyStringDictionaryKeyCallBacks;
+    CFDictionaryValueCallBacks valueCallbacks = {0};
+    reader->_stmtCache = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &keyCallbacks, &valueCallbacks);
+    return reader;
+}
+
+/**
+ Mark the key as changed, the readers will not read it until the change is committed.
+ It should be called after _dbBeginWrite (or _dbBeginSavepoint), and before the key is written.
+ */
+- (void)_readerMarkDirtyKey:(NSString *)key {
+    if (_readConnectionCount == 0 || !key) return;
+    pthread_mutex_lock(&_readerLock);
+    if (!_dbInBatch && _dbSavepointDepth == 0) {
+        [_readerDirtyKeys removeAllObjects]; // the last writes are committed
+    }
+    [_readerDirtyKeys addObject:key];
+    pthread_mutex_unlock(&_readerLock);
+}
+
+- (void)_readerMarkDirtyKeys:(NSArray *)keys {
+    if (_readConnectionCount == 0) return;
+    for (NSString *key in keys) {
+        [self _readerMarkDirtyKey:key];
+    }
+}
+
+- (void)_readerClearDirtyKeys {
+    pthread_mutex_lock(&_readerLock);
+    [_readerDirtyKeys removeAllObjects];
+    pthread_mutex_unlock(&_readerLock);
+}
+
+/// Close the idle readers, the busy readers are closed when they're returned.
+- (void)_readerReset {
+    pthread_mutex_lock(&_readerLock);
+    NSArray *readers = _readerPool.copy;
+    _readerOpenCount -= readers.count;
+    [_readerPool removeAllObjects];
+    _readerGeneration++;
+    [_readerDirtyKeys removeAllObjects];
+    pthread_mutex_unlock(&_readerLock);
+    readers = nil; // close outside the lock
+}
+
+/// Move the access times recorded by readers to the deferred access times.
+- (void)_readerMergeAccessTimes {
+    if (!_readerAccessTimes || !_deferredAccessTimes) return;
+    pthread_mutex_lock(&_readerLock);
+    CFIndex count = CFDictionaryGetCount(_readerAccessTimes);
+    if (count > 0) {
+        const void **keys = malloc(sizeof(void *) * count);
+        const void **times = malloc(sizeof(void *) * count);
+        if (keys && times) {
+            CFDictionaryGetKeysAndValues(_readerAccessTimes, keys, times);
+            for (CFIndex i = 0; i < count; i++) {
+                intptr_t time = (intptr_t)CFDictionaryGetValue(_deferredAccessTimes, keys[i]);
+                if ((intptr_t)times[i] > time) CFDictionarySetValue(_deferredAccessTimes, keys[i], times[i]);
+            }
+            CFDictionaryRemoveAllValues(_readerAccessTimes);
+        }
+        free(keys);
+        free(times);
+    }
+    pthread_mutex_unlock(&_readerLock);
+}
+
+
 #pragma mark - private
 
+/**
+ Remove the least recently used items, until at least `count` items and `size` 
+ bytes are removed. The rows are deleted with a single statement, and the files
+ are moved to trash and deleted in background.
+ */
+- (BOOL)_removeItemsOrderByTimeAscToFitCount:(int)count size:(int64_t)size {
+    if (![self _dbBeginSavepoint]) return NO;
+    NSMutableArray *filenames = [NSMutableArray new];
+    int victimCount = [self _dbGetItemCountOrderByTimeAscToFitCount:count size:size filenames:filenames];
+    BOOL suc = victimCount >= 0;
+    if (suc && victimCount > 0) suc = [self _dbDeleteItemsOrderByTimeAscWithLimit:victimCount];
+    if (suc) suc = [self _dbReleaseSavepoint];
+    if (!suc) {
+        [self _dbRollbackSavepoint];
+        return NO;
+    }
+    [self _fileDeleteWithNames:filenames];
+    [self _dbCheckpoint];
+    return YES;
+}
+
 /**
  Delete all files and empty in background.
  Make sure the db is closed.
@@ -647,6 +1498,11 @@ static NSString *const kTrashDirectoryName = @"trash";
     [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBFileName] error:nil];
     [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBShmFileName] error:nil];
     [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBWalFileName] error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBPendingFileName] error:nil];
+    _pendingFileExists = NO;
+    [self _readerReset];
+    [self _segmentClose];
+    _segmentId = 0;
     [self _fileMoveAllToTrash];
     [self _fileEmptyTrashInBackground];
 }
@@ -663,12 +1519,15 @@ static NSString *const kTrashDirectoryName = @"trash";
         NSLog(@"YYKVStorage init error: invalid path: [%@].", path);
         return nil;
     }
-    if (type > YYKVStorageTypeMixed) {
+    if (type > YYKVStorageTypeSegment) {
         NSLog(@"YYKVStorage init error: invalid type: %lu.", (unsigned long)type);
         return nil;
     }
     
     self = [super init];
+    pthread_mutex_init(&_readerLock, NULL);
+    _readerPool = [NSMutableArray new];
+    _readerDirtyKeys = [NSMutableSet new];
     _path = path.copy;
     _type = type;
     _dataPath = [path stringByAppendingPathComponent:kDataDirectoryName];
@@ -676,6 +1535,14 @@ static NSString *const kTrashDirectoryName = @"trash";
     _trashQueue = dispatch_queue_create("com.ibireme.cache.disk.trash", DISPATCH_QUEUE_SERIAL);
     _dbPath = [path stringByAppendingPathComponent:kDBFileName];
     _errorLogsEnabled = YES;
+    _writeBatchLatency = 0;
+    _writeBatchMaxCount = 64;
+    _pendingDeleteFilenames = [NSMutableSet new];
+    _segmentFd = -1;
+    CFDictionaryKeyCallBacks keyCallbacks = kCFCopyStringDictionaryKeyCallBacks;
+    CFDictionaryValueCallBacks valueCallbacks = {0};
+    _deferredAccessTimes = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &keyCallbacks, &valueCallbacks);
+    _readerAccessTimes = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &keyCallbacks, &valueCallbacks);
     NSError *error = nil;
     if (![[NSFileManager defaultManager] createDirectoryAtPath:path
                                    withIntermediateDirectories:YES
@@ -703,20 +1570,64 @@ static NSString *const kTrashDirectoryName = @"trash";
         }
         return nil;
     }
+    NSString *pendingPath = [path stringByAppendingPathComponent:kDBPendingFileName];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:pendingPath]) {
+        // the last write batch was not committed
+        [self _fileMoveOrphansToTrash];
+        [[NSFileManager defaultManager] removeItemAtPath:pendingPath error:NULL];
+    }
     [self _fileEmptyTrashInBackground]; // empty the trash if failed at last time
     return self;
 }
 
 - (void)dealloc {
     UIBackgroundTaskIdentifier taskID = [[UIApplication sharedExtensionApplication] beginBackgroundTaskWithExpirationHandler:^{}];
+    [self flush];
     [self _dbClose];
+    [self _segmentClose];
+    [self _readerReset];
+    if (_deferredAccessTimes) CFRelease(_deferredAccessTimes);
+    if (_readerAccessTimes) CFRelease(_readerAccessTimes);
+    pthread_mutex_destroy(&_readerLock);
     if (taskID != UIBackgroundTaskInvalid) {
         [[UIApplication sharedExtensionApplication] endBackgroundTask:taskID];
     }
 }
 
+- (void)setWriteBatchLatency:(NSTimeInterval)writeBatchLatency {
+    _writeBatchLatency = writeBatchLatency;
+    if (writeBatchLatency <= 0) [self flush];
+}
+
+- (BOOL)hasPendingWrites {
+    if (_dbInBatch) return YES;
+    pthread_mutex_lock(&_readerLock);
+    BOOL hasAccessTimes = _readerAccessTimes && CFDictionaryGetCount(_readerAccessTimes) > 0;
+    pthread_mutex_unlock(&_readerLock);
+    return hasAccessTimes;
+}
+
+- (void)setReadConnectionCount:(NSUInteger)readConnectionCount {
+    pthread_mutex_lock(&_readerLock);
+    BOOL shrink = readConnectionCount < _readConnectionCount;
+    _readConnectionCount = readConnectionCount;
+    pthread_mutex_unlock(&_readerLock);
+    if (shrink) [self _readerReset];
+}
+
+- (void)setAccessTimeDeferred:(BOOL)accessTimeDeferred {
+    _accessTimeDeferred = accessTimeDeferred;
+    if (!accessTimeDeferred) [self _dbFlushAccessTimes];
+}
+
+- (BOOL)flush {
+    if (_dbSavepointDepth > 0) return NO;
+    BOOL suc = [self _dbFlushAccessTimes];
+    return [self _dbCommitBatch] && suc;
+}
+
 - (BOOL)saveItem:(YYKVStorageItem *)item {
-    return [self saveItemWithKey:item.key value:item.value filename:item.filename extendedData:item.extendedData];
+    return [self _saveItemWithKey:item.key value:item.value filename:item.filename extendedData:item.extendedData compression:item.compression expireTime:item.expireTime];
 }
 
 - (BOOL)saveItemWithKey:(NSString *)key value:(NSData *)value {
@@ -724,16 +1635,36 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (BOOL)saveItemWithKey:(NSString *)key value:(NSData *)value filename:(NSString *)filename extendedData:(NSData *)extendedData {
+    return [self _saveItemWithKey:key value:value filename:filename extendedData:extendedData compression:0 expireTime:0];
+}
+
+- (BOOL)_saveItemWithKey:(NSString *)key value:(NSData *)value filename:(NSString *)filename extendedData:(NSData *)extendedData compression:(int)compression expireTime:(int)expireTime {
     if (key.length == 0 || value.length == 0) return NO;
     if (_type == YYKVStorageTypeFile && filename.length == 0) {
         return NO;
     }
+    [self _dbBeginWrite];
+    [self _readerMarkDirtyKey:key]; // after the batch is rolled, or it's cleared by the commit
+    BOOL suc = [self _saveItemInBatchWithKey:key value:value filename:filename extendedData:extendedData compression:compression expireTime:expireTime];
+    [self _dbEndWrite];
+    return suc;
+}
+
+- (BOOL)_saveItemInBatchWithKey:(NSString *)key value:(NSData *)value filename:(NSString *)filename extendedData:(NSData *)extendedData compression:(int)compression expireTime:(int)expireTime {
+    if (_type == YYKVStorageTypeSegment) {
+        int segment = 0;
+        int64_t offset = 0;
+        if (filename.length && ![self _segmentAppendData:value segment:&segment offset:&offset]) {
+            return NO;
+        }
+        return [self _dbSaveWithKey:key value:value fileName:nil extendedData:extendedData segment:segment offset:offset compression:compression expireTime:expireTime];
+    }
     
     if (filename.length) {
         if (![self _fileWriteWithName:filename data:value]) {
             return NO;
         }
-        if (![self _dbSaveWithKey:key value:value fileName:filename extendedData:extendedData]) {
+        if (![self _dbSaveWithKey:key value:value fileName:filename extendedData:extendedData segment:0 offset:0 compression:compression expireTime:expireTime]) {
             [self _fileDeleteWithName:filename];
             return NO;
         }
@@ -745,14 +1676,79 @@ static NSString *const kTrashDirectoryName = @"trash";
                 [self _fileDeleteWithName:filename];
             }
         }
-        return [self _dbSaveWithKey:key value:value fileName:nil extendedData:extendedData];
+        return [self _dbSaveWithKey:key value:value fileName:nil extendedData:extendedData segment:0 offset:0 compression:compression expireTime:expireTime];
     }
 }
 
+- (BOOL)saveItems:(NSArray<YYKVStorageItem *> *)items {
+    if (items.count == 0) return NO;
+    for (YYKVStorageItem *item in items) {
+        if (item.key.length == 0 || item.value.length == 0) return NO;
+        if (_type == YYKVStorageTypeFile && item.filename.length == 0) return NO;
+    }
+    if (![self _dbBeginSavepoint]) return NO;
+    for (YYKVStorageItem *item in items) {
+        [self _readerMarkDirtyKey:item.key];
+    }
+    
+    BOOL suc = YES;
+    NSMutableArray *writtenFilenames = [NSMutableArray new];
+    NSMutableArray *replacedFilenames = [NSMutableArray new];
+    for (YYKVStorageItem *item in items) {
+        NSString *filename = item.filename;
+        int segment = 0;
+        int64_t offset = 0;
+        if (_type == YYKVStorageTypeSegment) {
+            if (filename.length && ![self _segmentAppendData:item.value segment:&segment offset:&offset]) {
+                suc = NO;
+                break;
+            }
+            filename = nil;
+        } else if (filename.length) {
+            if (![self _fileWriteWithName:filename data:item.value]) {
+                suc = NO;
+                break;
+            }
+            [writtenFilenames addObject:filename];
+        } else if (_type != YYKVStorageTypeSQLite) {
+            NSString *oldFilename = [self _dbGetFilenameWithKey:item.key];
+            if (oldFilename) [replacedFilenames addObject:oldFilename];
+        }
+        if (![self _dbSaveWithKey:item.key value:item.value fileName:filename extendedData:item.extendedData segment:segment offset:offset compression:item.compression expireTime:item.expireTime]) {
+            suc = NO;
+            break;
+        }
+    }
+    if (suc) suc = [self _dbReleaseSavepoint];
+    if (!suc) {
+        [self _dbRollbackSavepoint];
+        for (NSString *filename in writtenFilenames) {
+            [self _fileDeleteWithName:filename];
+        }
+        return NO;
+    }
+    // the old files are deleted after the new rows are saved
+    for (NSString *filename in replacedFilenames) {
+        if (![writtenFilenames containsObject:filename]) {
+            [self _fileDeleteWithName:filename];
+        }
+    }
+    return YES;
+}
+
 - (BOOL)removeItemForKey:(NSString *)key {
     if (key.length == 0) return NO;
+    [self _dbBeginWrite];
+    [self _readerMarkDirtyKey:key];
+    BOOL suc = [self _removeItemInBatchForKey:key];
+    [self _dbEndWrite];
+    return suc;
+}
+
+- (BOOL)_removeItemInBatchForKey:(NSString *)key {
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             return [self _dbDeleteItemWithKey:key];
         } break;
         case YYKVStorageTypeFile:
@@ -769,16 +1765,23 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (BOOL)removeItemForKeys:(NSArray *)keys {
     if (keys.count == 0) return NO;
+    [self _dbBeginWrite];
+    [self _readerMarkDirtyKeys:keys];
+    BOOL suc = [self _removeItemsInBatchForKeys:keys];
+    [self _dbEndWrite];
+    return suc;
+}
+
+- (BOOL)_removeItemsInBatchForKeys:(NSArray *)keys {
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             return [self _dbDeleteItemWithKeys:keys];
         } break;
         case YYKVStorageTypeFile:
         case YYKVStorageTypeMixed: {
             NSArray *filenames = [self _dbGetFilenameWithKeys:keys];
-            for (NSString *filename in filenames) {
-                [self _fileDeleteWithName:filename];
-            }
+            [self _fileDeleteWithNames:filenames];
             return [self _dbDeleteItemWithKeys:keys];
         } break;
         default: return NO;
@@ -790,7 +1793,8 @@ static NSString *const kTrashDirectoryName = @"trash";
     if (size <= 0) return [self removeAllItems];
     
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             if ([self _dbDeleteItemsWithSizeLargerThan:size]) {
                 [self _dbCheckpoint];
                 return YES;
@@ -799,9 +1803,7 @@ static NSString *const kTrashDirectoryName = @"trash";
         case YYKVStorageTypeFile:
         case YYKVStorageTypeMixed: {
             NSArray *filenames = [self _dbGetFilenamesWithSizeLargerThan:size];
-            for (NSString *name in filenames) {
-                [self _fileDeleteWithName:name];
-            }
+            [self _fileDeleteWithNames:filenames];
             if ([self _dbDeleteItemsWithSizeLargerThan:size]) {
                 [self _dbCheckpoint];
                 return YES;
@@ -814,9 +1816,11 @@ static NSString *const kTrashDirectoryName = @"trash";
 - (BOOL)removeItemsEarlierThanTime:(int)time {
     if (time <= 0) return YES;
     if (time == INT_MAX) return [self removeAllItems];
+    [self _dbFlushAccessTimes];
     
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             if ([self _dbDeleteItemsWithTimeEarlierThan:time]) {
                 [self _dbCheckpoint];
                 return YES;
@@ -825,9 +1829,7 @@ static NSString *const kTrashDirectoryName = @"trash";
         case YYKVStorageTypeFile:
         case YYKVStorageTypeMixed: {
             NSArray *filenames = [self _dbGetFilenamesWithTimeEarlierThan:time];
-            for (NSString *name in filenames) {
-                [self _fileDeleteWithName:name];
-            }
+            [self _fileDeleteWithNames:filenames];
             if ([self _dbDeleteItemsWithTimeEarlierThan:time]) {
                 [self _dbCheckpoint];
                 return NO;
@@ -837,6 +1839,33 @@ static NSString *const kTrashDirectoryName = @"trash";
     return NO;
 }
 
+- (BOOL)removeExpiredItems {
+    int now = (int)time(NULL);
+    switch (_type) {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
+            if ([self _dbDeleteItemsWithExpireTimeNotLaterThan:now]) {
+                [self _dbCheckpoint];
+                return YES;
+            }
+        } break;
+        case YYKVStorageTypeFile:
+        case YYKVStorageTypeMixed: {
+            NSArray *filenames = [self _dbGetFilenamesWithExpireTimeNotLaterThan:now];
+            if (!filenames) return NO;
+            if ([self _dbDeleteItemsWithExpireTimeNotLaterThan:now]) {
+                // deferred by `_fileDeleteWithName:` if it's in a batch
+                for (NSString *filename in filenames) {
+                    [self _fileDeleteWithName:filename];
+                }
+                [self _dbCheckpoint];
+                return YES;
+            }
+        } break;
+    }
+    return NO;
+}
+
 - (BOOL)removeItemsToFitSize:(int)maxSize {
     if (maxSize == INT_MAX) return YES;
     if (maxSize <= 0) return [self removeAllItems];
@@ -844,27 +1873,8 @@ static NSString *const kTrashDirectoryName = @"trash";
     int total = [self _dbGetTotalItemSize];
     if (total < 0) return NO;
     if (total <= maxSize) return YES;
-    
-    NSArray *items = nil;
-    BOOL suc = NO;
-    do {
-        int perCount = 16;
-        items = [self _dbGetItemSizeInfoOrderByTimeAscWithLimit:perCount];
-        for (YYKVStorageItem *item in items) {
-            if (total > maxSize) {
-                if (item.filename) {
-                    [self _fileDeleteWithName:item.filename];
-                }
-                suc = [self _dbDeleteItemWithKey:item.key];
-                total -= item.size;
-            } else {
-                break;
-            }
-            if (!suc) break;
-        }
-    } while (total > maxSize && items.count > 0 && suc);
-    if (suc) [self _dbCheckpoint];
-    return suc;
+    [self _dbFlushAccessTimes];
+    return [self _removeItemsOrderByTimeAscToFitCount:0 size:(int64_t)total - maxSize];
 }
 
 - (BOOL)removeItemsToFitCount:(int)maxCount {
@@ -874,30 +1884,12 @@ static NSString *const kTrashDirectoryName = @"trash";
     int total = [self _dbGetTotalItemCount];
     if (total < 0) return NO;
     if (total <= maxCount) return YES;
-    
-    NSArray *items = nil;
-    BOOL suc = NO;
-    do {
-        int perCount = 16;
-        items = [self _dbGetItemSizeInfoOrderByTimeAscWithLimit:perCount];
-        for (YYKVStorageItem *item in items) {
-            if (total > maxCount) {
-                if (item.filename) {
-                    [self _fileDeleteWithName:item.filename];
-                }
-                suc = [self _dbDeleteItemWithKey:item.key];
-                total--;
-            } else {
-                break;
-            }
-            if (!suc) break;
-        }
-    } while (total > maxCount && items.count > 0 && suc);
-    if (suc) [self _dbCheckpoint];
-    return suc;
+    [self _dbFlushAccessTimes];
+    return [self _removeItemsOrderByTimeAscToFitCount:total - maxCount size:0];
 }
 
 - (BOOL)removeAllItems {
+    if (_deferredAccessTimes) CFDictionaryRemoveAllValues(_deferredAccessTimes);
     if (![self _dbClose]) return NO;
     [self _reset];
     if (![self _dbOpen]) return NO;
@@ -937,13 +1929,40 @@ static NSString *const kTrashDirectoryName = @"trash";
     }
 }
 
+- (BOOL)compactSegments {
+    if (_type != YYKVStorageTypeSegment) return YES;
+    if (_dbSavepointDepth > 0) return NO;
+    NSDictionary *liveSizes = [self _dbGetSegmentLiveSizes];
+    if (!liveSizes) return NO;
+    if (![self _segmentPrepareForLength:0]) return NO; // the active segment is not compacted
+    
+    NSFileManager *manager = [NSFileManager defaultManager];
+    int candidate = 0;
+    int64_t candidateDeadSize = 0;
+    for (NSString *name in [manager contentsOfDirectoryAtPath:_dataPath error:NULL]) {
+        int segment = [self _segmentIdWithName:name];
+        if (segment <= 0 || segment == _segmentId) continue;
+        if ([_pendingDeleteFilenames containsObject:name]) continue;
+        NSDictionary *attributes = [manager attributesOfItemAtPath:[_dataPath stringByAppendingPathComponent:name] error:NULL];
+        if (!attributes) continue;
+        int64_t fileSize = (int64_t)attributes.fileSize;
+        int64_t deadSize = fileSize - [liveSizes[@(segment)] longLongValue];
+        if (deadSize > 0 && deadSize >= fileSize * kSegmentCompactionRatio && deadSize > candidateDeadSize) {
+            candidate = segment;
+            candidateDeadSize = deadSize;
+        }
+    }
+    if (candidate == 0) return YES;
+    return [self _segmentCompactWithId:candidate];
+}
+
 - (YYKVStorageItem *)getItemForKey:(NSString *)key {
     if (key.length == 0) return nil;
     YYKVStorageItem *item = [self _dbGetItemWithKey:key excludeInlineData:NO];
     if (item) {
-        [self _dbUpdateAccessTimeWithKey:key];
-        if (item.filename) {
-            item.value = [self _fileReadWithName:item.filename];
+        [self _recordAccessOfItems:@[item]];
+        if (item.filename || item.segment > 0) {
+            item.value = item.filename ? [self _fileReadWithName:item.filename] : [self _segmentReadWithItem:item mapped:_fileMappingEnabled];
             if (!item.value) {
                 [self _dbDeleteItemWithKey:key];
                 item = nil;
@@ -963,46 +1982,123 @@ static NSString *const kTrashDirectoryName = @"trash";
     if (key.length == 0) return nil;
     NSData *value = nil;
     switch (_type) {
-        case YYKVStorageTypeFile: {
-            NSString *filename = [self _dbGetFilenameWithKey:key];
-            if (filename) {
-                value = [self _fileReadWithName:filename];
-                if (!value) {
-                    [self _dbDeleteItemWithKey:key];
-                    value = nil;
-                }
-            }
-        } break;
         case YYKVStorageTypeSQLite: {
             value = [self _dbGetValueWithKey:key];
         } break;
-        case YYKVStorageTypeMixed: {
-            NSString *filename = [self _dbGetFilenameWithKey:key];
-            if (filename) {
-                value = [self _fileReadWithName:filename];
+        case YYKVStorageTypeFile:
+        case YYKVStorageTypeMixed:
+        case YYKVStorageTypeSegment: {
+            // the item (not only the filename) is queried to check its expire time
+            YYKVStorageItem *item = [self _dbGetItemWithKey:key excludeInlineData:(_type == YYKVStorageTypeFile)];
+            if (item.filename || item.segment > 0) {
+                value = item.filename ? [self _fileReadWithName:item.filename] : [self _segmentReadWithItem:item mapped:_fileMappingEnabled];
                 if (!value) {
                     [self _dbDeleteItemWithKey:key];
-                    value = nil;
                 }
             } else {
-                value = [self _dbGetValueWithKey:key];
+                value = item.value;
             }
         } break;
     }
     if (value) {
-        [self _dbUpdateAccessTimeWithKey:key];
+        YYKVStorageItem *item = [YYKVStorageItem new];
+        item.key = key;
+        [self _recordAccessOfItems:@[item]];
     }
     return value;
 }
 
+- (BOOL)readItemForKey:(NSString *)key item:(YYKVStorageItem **)item {
+    if (item) *item = nil;
+    if (key.length == 0) return YES;
+    
+    _YYKVStorageReader *reader = nil;
+    NSUInteger generation = 0;
+    pthread_mutex_lock(&_readerLock);
+    if (_readConnectionCount == 0 || [_readerDirtyKeys containsObject:key]) {
+        pthread_mutex_unlock(&_readerLock);
+        return NO;
+    }
+    generation = _readerGeneration;
+    reader = _readerPool.lastObject;
+    if (reader) {
+        [_readerPool removeLastObject];
+    } else if (_readerOpenCount < _readConnectionCount) {
+        _readerOpenCount++;
+    } else {
+        pthread_mutex_unlock(&_readerLock);
+        return NO; // all readers are busy
+    }
+    pthread_mutex_unlock(&_readerLock);
+    if (!reader) {
+        reader = [self _readerOpen];
+        if (!reader) {
+            pthread_mutex_lock(&_readerLock);
+            _readerOpenCount--;
+            pthread_mutex_unlock(&_readerLock);
+            return NO;
+        }
+        reader->_generation = generation;
+    }
+    
+    BOOL suc = NO;
+    YYKVStorageItem *result = nil;
+    NSString *sql = @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data, segment, segment_offset, compression, expire_time from manifest where key = ?1;";
+    sqlite3_stmt *stmt = [reader prepareStmt:sql];
+    if (stmt) {
+        sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            result = [self _dbGetItemFromStmt:stmt excludeInlineData:NO];
+            if (YYKVStorageExpired(result.expireTime, (int)time(NULL))) result = nil;
+            suc = YES;
+        } else if (rc == SQLITE_DONE) {
+            suc = YES;
+        }
+        sqlite3_reset(stmt); // end the read transaction
+    }
+    if (result.filename || result.segment > 0) {
+        result.value = result.filename ? [self _fileReadWithName:result.filename] : [self _segmentReadWithItem:result mapped:_fileMappingEnabled];
+        if (!result.value) { // it may be removed, leave it to the writer
+            result = nil;
+            suc = NO;
+        }
+    }
+    
+    int now = (int)time(NULL);
+    pthread_mutex_lock(&_readerLock);
+    if (result && (_accessTimeUpdateInterval <= 0 || now - result.accessTime >= _accessTimeUpdateInterval)) {
+        CFDictionarySetValue(_readerAccessTimes, (__bridge const void *)(key), (const void *)(intptr_t)now);
+    }
+    if (reader->_generation == _readerGeneration) {
+        [_readerPool addObject:reader];
+    } else {
+        _readerOpenCount--; // the db is reset, close it
+    }
+    pthread_mutex_unlock(&_readerLock);
+    
+    if (suc && item) *item = result;
+    return suc;
+}
+
 - (NSArray *)getItemForKeys:(NSArray *)keys {
     if (keys.count == 0) return nil;
-    NSMutableArray *items = [self _dbGetItemWithKeys:keys excludeInlineData:NO];
+    BOOL inTransaction = [self _dbBeginSavepoint];
+    NSMutableArray *items = [NSMutableArray new];
+    for (NSUInteger i = 0, max = keys.count; i < max; i += kMaxJoinedKeyCount) {
+        NSArray *subKeys = max <= kMaxJoinedKeyCount ? keys : [keys subarrayWithRange:NSMakeRange(i, MIN(kMaxJoinedKeyCount, max - i))];
+        NSArray *subItems = [self _dbGetItemWithKeys:subKeys excludeInlineData:NO];
+        if (!subItems) {
+            items = nil;
+            break;
+        }
+        [items addObjectsFromArray:subItems];
+    }
     if (_type != YYKVStorageTypeSQLite) {
         for (NSInteger i = 0, max = items.count; i < max; i++) {
             YYKVStorageItem *item = items[i];
-            if (item.filename) {
-                item.value = [self _fileReadWithName:item.filename];
+            if (item.filename || item.segment > 0) {
+                item.value = item.filename ? [self _fileReadWithName:item.filename] : [self _segmentReadWithItem:item mapped:_fileMappingEnabled];
                 if (!item.value) {
                     if (item.key) [self _dbDeleteItemWithKey:item.key];
                     [items removeObjectAtIndex:i];
@@ -1013,8 +2109,9 @@ static NSString *const kTrashDirectoryName = @"trash";
         }
     }
     if (items.count > 0) {
-        [self _dbUpdateAccessTimeWithKeys:keys];
+        [self _recordAccessOfItems:items];
     }
+    if (inTransaction && ![self _dbReleaseSavepoint]) [self _dbRollbackSavepoint];
     return items.count ? items : nil;
 }
 
@@ -11,8 +11,32 @@
 
 #import <Foundation/Foundation.h>
 
+@class YYCacheMetrics;
+
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+ The policy used by YYMemoryCache to choose which object to evict.
+ */
+typedef NS_ENUM(NSUInteger, YYMemoryCacheEvictionPolicy) {
+    
+    /// Least recently used. An object which is accessed only once (such as 
+    /// the images in a fast scroll) may push out the frequently used objects.
+    YYMemoryCacheEvictionPolicyLRU = 0,
+    
+    /// Segmented LRU (similar to 2Q). New objects enter a probation segment,
+    /// and are promoted to a protected segment (80% of the cache) when they are
+    /// accessed again. A scan only flushes the probation segment.
+    YYMemoryCacheEvictionPolicySegmentedLRU = 1,
+    
+    /// Window TinyLFU. New objects enter a small LRU window (1% of the cache), 
+    /// then the segmented LRU. On eviction, a count-min sketch of recent access 
+    /// frequency decides whether the window's least recently used object or the
+    /// probation's least recently used object is evicted. It has the best hit ratio for most 
+    /// workloads, with a little more cost per access.
+    YYMemoryCacheEvictionPolicyTinyLFU = 2,
+};
+
 /**
  YYMemoryCache is a fast in-memory cache that stores key-value pairs.
  In contrast to NSDictionary, keys are retained and not copied.
@@ -20,16 +44,46 @@ NS_ASSUME_NONNULL_BEGIN
  
  YYMemoryCache objects differ from NSCache in a few ways:
  
- * It uses LRU (least-recently-used) to remove objects; NSCache's eviction method
-   is non-deterministic.
+ * It uses LRU (least-recently-used) or a scan-resistant policy to remove objects;
+   NSCache's eviction method is non-deterministic.
  * It can be controlled by cost, count and age; NSCache's limits are imprecise.
  * It can be configured to automatically evict objects when receive memory 
    warning or app enter background.
  
  The time of `Access Methods` in YYMemoryCache is typically in constant time (O(1)).
+ The entries are stored in a preallocated node pool, so a cache hit (and an update 
+ of an existing key) does not allocate memory.
  */
 @interface YYMemoryCache : NSObject
 
+#pragma mark - Initializer
+///=============================================================================
+/// @name Initializer
+///=============================================================================
+
+/**
+ Create a new cache with a single shard.
+ All objects are kept in one LRU list which is guarded by one lock.
+ */
+- (instancetype)init;
+
+/**
+ The designated initializer.
+ 
+ @discussion The objects are distributed to several shards by the key's hash, each 
+ shard has its own lock and LRU list, so the threads which access different keys 
+ rarely wait for each other. The `countLimit` and `costLimit` are divided evenly 
+ among the shards; the background trim evicts the least recently used objects 
+ across all shards (approximately LRU) until the whole cache fits the limits.
+ 
+ You may use a sharded cache if it's accessed by many threads concurrently 
+ (such as image decode threads), otherwise the single shard is a better choice.
+ 
+ @param shardCount The number of shards. It will be rounded up to a power of 2,
+     and the max value is 64. 0 or 1 means no sharding.
+ */
+- (instancetype)initWithShardCount:(NSUInteger)shardCount NS_DESIGNATED_INITIALIZER;
+
 #pragma mark - Attribute
 ///=============================================================================
 /// @name Attribute
@@ -38,24 +92,53 @@ NS_ASSUME_NONNULL_BEGIN
 /** The name of the cache. Default is nil. */
 @property (nullable, copy) NSString *name;
 
+/** The number of shards in the cache (read-only). Default is 1. */
+@property (readonly) NSUInteger shardCount;
+
 /** The number of objects in the cache (read-only) */
 @property (readonly) NSUInteger totalCount;
 
 /** The total cost of objects in the cache (read-only). */
 @property (readonly) NSUInteger totalCost;
 
+/** The number of keys found by `objectForKey:` and `objectsForKeys:` (read-only). */
+@property (readonly) NSUInteger hitCount;
+
+/** The number of keys not found by `objectForKey:` and `objectsForKeys:` (read-only). */
+@property (readonly) NSUInteger missCount;
+
+/**
+ The metrics of the cache, see `YYCacheMetrics`. It records the hits, misses,
+ insertions, evictions (by count, cost and age) and the latency of access and
+ trim methods. The bytes in metrics are the `cost` of objects.
+ Default is nil (disabled).
+ */
+@property (nullable, strong) YYCacheMetrics *metrics;
+
 
 #pragma mark - Limit
 ///=============================================================================
 /// @name Limit
 ///=============================================================================
 
+/**
+ The policy used to choose which object to evict when the cache goes over its 
+ count or cost limit. Default is YYMemoryCacheEvictionPolicyLRU.
+ 
+ @discussion The age limit always removes the objects which are not accessed
+ for the longest time, regardless of this policy. Changing the policy of a 
+ non-empty cache keeps the recency order of its objects, but loses the segments
+ and frequency information.
+ */
+@property YYMemoryCacheEvictionPolicy evictionPolicy;
+
 /**
  The maximum number of objects the cache should hold.
  
  @discussion The default value is NSUIntegerMax, which means no limit.
  This is not a strict limit—if the cache goes over the limit, some objects in the
  cache could be evicted later in backgound thread.
+ If the cache is sharded, each shard holds at most 1/shardCount of the limit.
  */
 @property NSUInteger countLimit;
 
@@ -65,6 +148,7 @@ NS_ASSUME_NONNULL_BEGIN
  @discussion The default value is NSUIntegerMax, which means no limit.
  This is not a strict limit—if the cache goes over the limit, some objects in the
  cache could be evicted later in backgound thread.
+ If the cache is sharded, each shard holds at most 1/shardCount of the limit.
  */
 @property NSUInteger costLimit;
 
@@ -169,6 +253,43 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)setObject:(nullable id)object forKey:(id)key withCost:(NSUInteger)cost;
 
+/**
+ Sets the value of the specified key in the cache with the specified cost, and the 
+ value expires after the ttl.
+ 
+ @param object The object to store in the cache. If nil, it calls `removeObjectForKey`.
+ @param key    The key with which to associate the value. If nil, this method has no effect.
+ @param cost   The cost with which to associate the key-value pair.
+ @param ttl    The time to live in seconds, 0 or a negative value means never expires.
+ @discussion The expired value is not returned by `objectForKey:`. It's removed when 
+ it's accessed, or by the next auto trim (see `autoTrimInterval`), which only visits 
+ the timer wheel slots of the passed seconds. The value set again without ttl never 
+ expires.
+ */
+- (void)setObject:(nullable id)object forKey:(id)key withCost:(NSUInteger)cost ttl:(NSTimeInterval)ttl;
+
+/**
+ Returns the values associated with the given keys.
+ 
+ @discussion Each shard is locked only once for all the keys in it.
+ 
+ @param keys An array of objects identifying the values.
+ @return A dictionary contains the found key-value pairs, the keys which are not
+     in cache will be absent.
+ */
+- (NSDictionary *)objectsForKeys:(NSArray *)keys;
+
+/**
+ Sets the values of the specified keys in the cache (0 cost).
+ 
+ @discussion Each shard is locked only once for all the keys in it.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the values, the count should be
+     equal to the count of objects, otherwise this method has no effect.
+ */
+- (void)setObjects:(NSArray *)objects forKeys:(NSArray *)keys;
+
 /**
  Removes the value of the specified key in the cache.
  
@@ -188,14 +309,14 @@ NS_ASSUME_NONNULL_BEGIN
 ///=============================================================================
 
 /**
- Removes objects from the cache with LRU, until the `totalCount` is below or equal to
+ Removes objects from the cache with `evictionPolicy`, until the `totalCount` is below or equal to
  the specified value.
  @param count  The total count allowed to remain after the cache has been trimmed.
  */
 - (void)trimToCount:(NSUInteger)count;
 
 /**
- Removes objects from the cache with LRU, until the `totalCost` is or equal to
+ Removes objects from the cache with `evictionPolicy`, until the `totalCost` is or equal to
  the specified value.
  @param cost The total cost allowed to remain after the cache has been trimmed.
  */
@@ -208,6 +329,58 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)trimToAge:(NSTimeInterval)age;
 
+
+#pragma mark - Snapshot
+///=============================================================================
+/// @name Snapshot
+///=============================================================================
+
+/**
+ The file to save the keys of the most recently used objects (with their costs),
+ which can be used to warm up a new cache after the app restarts.
+ Default is nil (disabled).
+ 
+ @discussion The snapshot is written when the app enters background (before the 
+ objects are removed) or terminates, by `writeSnapshot`, and by the auto trim every 
+ `snapshotInterval` seconds. Only the property list keys (such as NSString and 
+ NSNumber) are saved, the objects are not saved.
+ */
+@property (nullable, copy) NSString *snapshotPath;
+
+/** The maximum number of keys in snapshot. Default is 100. */
+@property NSUInteger snapshotLimit;
+
+/**
+ The time interval in seconds to write the snapshot in auto trim. Default is 0,
+ which means the snapshot is only written when the app enters background or terminates.
+ */
+@property NSTimeInterval snapshotInterval;
+
+/**
+ Returns the keys of the objects in cache, from the most recently used to the least.
+ 
+ @param limit The maximum number of keys.
+ @param costs Output the costs of the objects in the same order, pass NULL to ignore it.
+ @return The keys (not copied).
+ */
+- (NSArray *)recentlyUsedKeysWithLimit:(NSUInteger)limit costs:(NSArray<NSNumber *> * _Nullable * _Nullable)costs;
+
+/**
+ Write the snapshot to `snapshotPath` immediately.
+ @return Whether succeed.
+ */
+- (BOOL)writeSnapshot;
+
+/**
+ Read the keys saved by `writeSnapshot`.
+ 
+ @param path  The snapshot file path.
+ @param costs Output the costs of the keys in the same order, pass NULL to ignore it.
+ @return The keys from the most recently used to the least, or nil if the file is 
+     not exist or invalid.
+ */
++ (nullable NSArray *)keysFromSnapshotAtPath:(NSString *)path costs:(NSArray<NSNumber *> * _Nullable * _Nullable)costs;
+
 @end
 
 NS_ASSUME_NONNULL_END
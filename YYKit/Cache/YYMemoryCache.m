@@ -10,6 +10,7 @@
 //
 
 #import "YYMemoryCache.h"
+#import "YYCacheMetrics.h"
 #import <UIKit/UIKit.h>
 #import <CoreFoundation/CoreFoundation.h>
 #import <QuartzCore/QuartzCore.h>
@@ -30,161 +31,759 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 #endif
 
 /**
- A node in linked map.
- Typically, you should not use this class directly.
+ A count-min sketch with 4-bit counters, used by the TinyLFU policy to estimate
+ the access frequency of keys. All counters are halved after a number of accesses
+ (sample size), so the old history fades out.
  */
-@interface _YYLinkedMapNode : NSObject {
-    @package
-    __unsafe_unretained _YYLinkedMapNode *_prev; // retained by dic
-    __unsafe_unretained _YYLinkedMapNode *_next; // retained by dic
-    id _key;
-    id _value;
-    NSUInteger _cost;
-    NSTimeInterval _time;
+typedef struct {
+    uint64_t *table; // each slot holds 16 counters
+    uint32_t mask;   // table length - 1
+    uint32_t additions;
+    uint32_t sampleSize;
+} _YYFrequencySketch;
+
+static const uint64_t _YYFrequencySketchSeed[4] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+
+static inline uint32_t _YYFrequencySketchSpread(uint64_t hash) {
+    uint32_t x = (uint32_t)(hash ^ (hash >> 32));
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    return (x >> 16) ^ x;
+}
+
+static inline uint32_t _YYFrequencySketchIndex(_YYFrequencySketch *sketch, uint32_t hash, int i) {
+    uint64_t h = (hash + _YYFrequencySketchSeed[i]) * _YYFrequencySketchSeed[i];
+    h += h >> 32;
+    return (uint32_t)h & sketch->mask;
+}
+
+/// Resize the table for the specified number of keys, the history will be lost.
+static void _YYFrequencySketchEnsureCapacity(_YYFrequencySketch *sketch, NSUInteger capacity) {
+    uint32_t maximum = (uint32_t)MIN(MAX(capacity, 16), 1 << 24);
+    uint32_t length = 16;
+    while (length < maximum) length <<= 1;
+    if (sketch->table && sketch->mask + 1 >= length) return;
+    uint64_t *table = calloc(length, sizeof(uint64_t));
+    if (!table) return;
+    free(sketch->table);
+    sketch->table = table;
+    sketch->mask = length - 1;
+    sketch->additions = 0;
+    sketch->sampleSize = length * 10;
+}
+
+static void _YYFrequencySketchFree(_YYFrequencySketch *sketch) {
+    free(sketch->table);
+    memset(sketch, 0, sizeof(_YYFrequencySketch));
+}
+
+static uint32_t _YYFrequencySketchGet(_YYFrequencySketch *sketch, uint64_t keyHash) {
+    if (!sketch->table) return 0;
+    uint32_t hash = _YYFrequencySketchSpread(keyHash);
+    uint32_t start = (hash & 3) << 2;
+    uint32_t frequency = 15;
+    for (int i = 0; i < 4; i++) {
+        uint32_t index = _YYFrequencySketchIndex(sketch, hash, i);
+        uint32_t count = (uint32_t)((sketch->table[index] >> ((start + i) << 2)) & 0xF);
+        if (count < frequency) frequency = count;
+    }
+    return frequency;
+}
+
+static void _YYFrequencySketchIncrement(_YYFrequencySketch *sketch, uint64_t keyHash) {
+    if (!sketch->table) return;
+    uint32_t hash = _YYFrequencySketchSpread(keyHash);
+    uint32_t start = (hash & 3) << 2;
+    BOOL added = NO;
+    for (int i = 0; i < 4; i++) {
+        uint32_t index = _YYFrequencySketchIndex(sketch, hash, i);
+        uint32_t offset = (start + i) << 2;
+        uint64_t mask = 0xFULL << offset;
+        if ((sketch->table[index] & mask) != mask) {
+            sketch->table[index] += 1ULL << offset;
+            added = YES;
+        }
+    }
+    if (added && ++sketch->additions == sketch->sampleSize) {
+        // halve all counters
+        uint32_t odd = 0;
+        for (uint32_t i = 0; i <= sketch->mask; i++) {
+            odd += __builtin_popcountll(sketch->table[i] & 0x1111111111111111ULL);
+            sketch->table[i] = (sketch->table[i] >> 1) & 0x7777777777777777ULL;
+        }
+        sketch->additions = (sketch->additions >> 1) - (odd >> 2);
+    }
 }
-@end
 
-@implementation _YYLinkedMapNode
-@end
 
+/// The segments of linked map, see `YYMemoryCacheEvictionPolicy`.
+typedef NS_ENUM(uint8_t, _YYLinkedMapSegment) {
+    _YYLinkedMapSegmentProbation = 0, ///< the only segment of LRU policy
+    _YYLinkedMapSegmentProtected = 1, ///< nodes accessed at least twice
+    _YYLinkedMapSegmentWindow = 2,    ///< admission window of TinyLFU
+};
+#define _YYLinkedMapSegmentCount 3
+
+/// An invalid node index.
+#define _YYLinkedMapNil UINT32_MAX
+
+/// The slot count of timer wheel, each slot covers 1 second.
+#define _YYLinkedMapWheelSize 512
+
+/**
+ A node in linked map. The nodes are allocated in a slab, and linked by index.
+ Typically, you should not use this struct directly.
+ */
+typedef struct {
+    uint32_t prev;   // index of prev node in segment, or _YYLinkedMapNil
+    uint32_t next;   // index of next node in segment (or in free list), or _YYLinkedMapNil
+    uint64_t hash;   // hash of key, see _YYMemoryCacheHash()
+    CFTypeRef key;   // retained, NULL if the node is free
+    CFTypeRef value; // retained
+    NSUInteger cost;
+    NSTimeInterval time;
+    NSTimeInterval expire; // CACurrentMediaTime() when expires, 0 if never expires
+    uint32_t wheelPrev;    // index of prev node in timer wheel slot, or _YYLinkedMapNil
+    uint32_t wheelNext;    // index of next node in timer wheel slot, or _YYLinkedMapNil
+    _YYLinkedMapSegment segment;
+} _YYLinkedMapNode;
+
+/// A slot of the hash index (open addressing with linear probing).
+typedef struct {
+    uint32_t index; // node index, or _YYLinkedMapNil if the slot is empty
+    uint32_t hash;  // low 32 bits of key hash
+} _YYLinkedMapSlot;
 
 /**
  A linked map used by YYMemoryCache.
  It's not thread-safe and does not validate the parameters.
  
- Typically, you should not use this class directly.
+ The nodes are plain C structs in a slab which grows by doubling, the removed 
+ nodes are recycled with a free list, and the keys are indexed by an open 
+ addressing hash table which stores the hash of keys. So the access methods 
+ don't allocate memory, and don't retain the key or node.
+ 
+ The nodes are kept in several LRU lists (segments) based on the eviction policy:
+ LRU uses a single list; SLRU moves the nodes which are accessed again from 
+ probation to protected; TinyLFU puts new nodes in a small window in front of the 
+ SLRU, and uses a frequency sketch to choose between the window's candidate and 
+ the probation's victim on eviction.
+ 
+ The nodes which have an expire time are also linked in a hashed timer wheel:
+ the node is put in the slot of the second it expires (modulo wheel size), so the 
+ expired nodes are found by visiting the slots passed since last time, instead of 
+ scanning all nodes. A slot may contain nodes of later rounds, they're skipped.
+ 
+ Typically, you should not use this struct directly.
  */
-@interface _YYLinkedMap : NSObject {
-    @package
-    CFMutableDictionaryRef _dic; // do not set object directly
-    NSUInteger _totalCost;
-    NSUInteger _totalCount;
-    _YYLinkedMapNode *_head; // MRU, do not change it directly
-    _YYLinkedMapNode *_tail; // LRU, do not change it directly
-    BOOL _releaseOnMainThread;
-    BOOL _releaseAsynchronously;
+typedef struct {
+    _YYLinkedMapNode *nodes; // slab, do not keep node pointer while inserting
+    uint32_t nodeCapacity;
+    uint32_t freeHead;       // first free node
+    _YYLinkedMapSlot *slots; // hash index
+    uint32_t slotMask;       // slot count - 1
+    NSUInteger totalCost;
+    NSUInteger totalCount;
+    uint32_t heads[_YYLinkedMapSegmentCount]; // MRU, do not change it directly
+    uint32_t tails[_YYLinkedMapSegmentCount]; // LRU, do not change it directly
+    NSUInteger counts[_YYLinkedMapSegmentCount];
+    YYMemoryCacheEvictionPolicy policy;
+    _YYFrequencySketch sketch;
+    uint32_t *wheel;         // heads of timer wheel slots, NULL if no node has expire time
+    uint64_t wheelTick;      // the last tick (second) reclaimed
+    NSUInteger hitCount;
+    NSUInteger missCount;
+    BOOL releaseOnMainThread;
+    BOOL releaseAsynchronously;
+} _YYLinkedMap;
+
+/// Returns the hash of a key, the bits are well mixed.
+static inline uint64_t _YYMemoryCacheHash(id key) {
+    uint64_t hash = CFHash((__bridge CFTypeRef)key);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
 }
 
-/// Insert a node at head and update the total cost.
-/// Node and node.key should not be nil.
-- (void)insertNodeAtHead:(_YYLinkedMapNode *)node;
+static void _YYLinkedMapInit(_YYLinkedMap *map) {
+    memset(map, 0, sizeof(_YYLinkedMap));
+    map->freeHead = _YYLinkedMapNil;
+    for (int i = 0; i < _YYLinkedMapSegmentCount; i++) {
+        map->heads[i] = _YYLinkedMapNil;
+        map->tails[i] = _YYLinkedMapNil;
+    }
+    map->policy = YYMemoryCacheEvictionPolicyLRU;
+    map->releaseOnMainThread = NO;
+    map->releaseAsynchronously = YES;
+}
 
-/// Bring a inner node to header.
-/// Node should already inside the dic.
-- (void)bringNodeToHead:(_YYLinkedMapNode *)node;
+/// Release the key and value in the queue specified by the map.
+static void _YYLinkedMapReleaseObjects(_YYLinkedMap *map, CFTypeRef key, CFTypeRef value) {
+    if (map->releaseAsynchronously) {
+        dispatch_queue_t queue = map->releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
+        dispatch_async(queue, ^{
+            CFRelease(key); // release in queue
+            CFRelease(value);
+        });
+    } else if (map->releaseOnMainThread && !pthread_main_np()) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            CFRelease(key); // release in queue
+            CFRelease(value);
+        });
+    } else {
+        CFRelease(key);
+        CFRelease(value);
+    }
+}
 
-/// Remove a inner node and update the total cost.
-/// Node should already inside the dic.
-- (void)removeNode:(_YYLinkedMapNode *)node;
+#pragma mark hash index
 
-/// Remove tail node if exist.
-- (_YYLinkedMapNode *)removeTailNode;
+static inline void _YYLinkedMapIndexInsert(_YYLinkedMap *map, uint32_t index, uint32_t hash) {
+    uint32_t mask = map->slotMask;
+    uint32_t i = hash & mask;
+    while (map->slots[i].index != _YYLinkedMapNil) i = (i + 1) & mask;
+    map->slots[i].index = index;
+    map->slots[i].hash = hash;
+}
 
-/// Remove all node in background queue.
-- (void)removeAll;
+/// Make sure the index can hold `count` keys with load factor <= 0.5.
+static BOOL _YYLinkedMapIndexReserve(_YYLinkedMap *map, NSUInteger count) {
+    uint32_t capacity = map->slots ? map->slotMask + 1 : 0;
+    if (count * 2 <= capacity) return YES;
+    uint64_t newCapacity = capacity ? capacity : 16;
+    while (count * 2 > newCapacity) newCapacity *= 2;
+    if (newCapacity > ((uint64_t)1 << 31)) return NO;
+    _YYLinkedMapSlot *slots = malloc(sizeof(_YYLinkedMapSlot) * (size_t)newCapacity);
+    if (!slots) return NO;
+    memset(slots, 0xFF, sizeof(_YYLinkedMapSlot) * (size_t)newCapacity);
+    
+    _YYLinkedMapSlot *oldSlots = map->slots;
+    map->slots = slots;
+    map->slotMask = (uint32_t)newCapacity - 1;
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (oldSlots[i].index != _YYLinkedMapNil) {
+            _YYLinkedMapIndexInsert(map, oldSlots[i].index, oldSlots[i].hash);
+        }
+    }
+    free(oldSlots);
+    return YES;
+}
 
-@end
+/// Remove the node's slot, and shift the following slots back (no tombstone).
+static void _YYLinkedMapIndexRemove(_YYLinkedMap *map, uint32_t index) {
+    _YYLinkedMapSlot *slots = map->slots;
+    uint32_t mask = map->slotMask;
+    uint32_t i = (uint32_t)map->nodes[index].hash & mask;
+    while (slots[i].index != index) i = (i + 1) & mask;
+    uint32_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (slots[j].index == _YYLinkedMapNil) break;
+        uint32_t k = slots[j].hash & mask; // the ideal slot
+        BOOL stay = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stay) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].index = _YYLinkedMapNil;
+}
 
-@implementation _YYLinkedMap
+/// Returns the node index for the key, or _YYLinkedMapNil if not found.
+static inline uint32_t _YYLinkedMapFind(_YYLinkedMap *map, CFTypeRef key, uint64_t hash) {
+    if (!map->slots) return _YYLinkedMapNil;
+    uint32_t h = (uint32_t)hash;
+    uint32_t mask = map->slotMask;
+    for (uint32_t i = h & mask; ; i = (i + 1) & mask) {
+        _YYLinkedMapSlot slot = map->slots[i];
+        if (slot.index == _YYLinkedMapNil) return _YYLinkedMapNil;
+        if (slot.hash == h) {
+            CFTypeRef nodeKey = map->nodes[slot.index].key;
+            if (nodeKey == key || CFEqual(nodeKey, key)) return slot.index;
+        }
+    }
+}
 
-- (instancetype)init {
-    self = [super init];
-    _dic = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-    _releaseOnMainThread = NO;
-    _releaseAsynchronously = YES;
-    return self;
+#pragma mark segment list
+
+static inline void _YYLinkedMapLink(_YYLinkedMap *map, uint32_t index, _YYLinkedMapSegment segment) {
+    _YYLinkedMapNode *node = map->nodes + index;
+    node->segment = segment;
+    node->prev = _YYLinkedMapNil;
+    node->next = map->heads[segment];
+    if (map->heads[segment] != _YYLinkedMapNil) {
+        map->nodes[map->heads[segment]].prev = index;
+    } else {
+        map->tails[segment] = index;
+    }
+    map->heads[segment] = index;
+    map->counts[segment]++;
 }
 
-- (void)dealloc {
-    CFRelease(_dic);
+/// Link the node at the tail (LRU end) of the segment.
+static inline void _YYLinkedMapLinkTail(_YYLinkedMap *map, uint32_t index, _YYLinkedMapSegment segment) {
+    _YYLinkedMapNode *node = map->nodes + index;
+    node->segment = segment;
+    node->next = _YYLinkedMapNil;
+    node->prev = map->tails[segment];
+    if (node->prev != _YYLinkedMapNil) {
+        map->nodes[node->prev].next = index;
+    } else {
+        map->heads[segment] = index;
+    }
+    map->tails[segment] = index;
+    map->counts[segment]++;
+}
+
+static inline void _YYLinkedMapUnlink(_YYLinkedMap *map, uint32_t index) {
+    _YYLinkedMapNode *node = map->nodes + index;
+    _YYLinkedMapSegment segment = node->segment;
+    if (node->next != _YYLinkedMapNil) map->nodes[node->next].prev = node->prev;
+    else map->tails[segment] = node->prev;
+    if (node->prev != _YYLinkedMapNil) map->nodes[node->prev].next = node->next;
+    else map->heads[segment] = node->next;
+    node->prev = node->next = _YYLinkedMapNil;
+    map->counts[segment]--;
+}
+
+/// Keep the protected segment within 80% of the main space, and the window within 1% of all
+/// (plus the newest node, so the candidate of admission is never the node just inserted).
+static void _YYLinkedMapBalance(_YYLinkedMap *map) {
+    if (map->policy == YYMemoryCacheEvictionPolicyLRU) return;
+    if (map->policy == YYMemoryCacheEvictionPolicyTinyLFU) {
+        NSUInteger windowMax = MAX(map->totalCount / 100, 1) + 1;
+        while (map->counts[_YYLinkedMapSegmentWindow] > windowMax) {
+            uint32_t index = map->tails[_YYLinkedMapSegmentWindow];
+            _YYLinkedMapUnlink(map, index);
+            _YYLinkedMapLink(map, index, _YYLinkedMapSegmentProbation);
+        }
+    }
+    NSUInteger mainCount = map->counts[_YYLinkedMapSegmentProbation] + map->counts[_YYLinkedMapSegmentProtected];
+    NSUInteger protectedMax = mainCount * 4 / 5;
+    while (map->counts[_YYLinkedMapSegmentProtected] > protectedMax) {
+        uint32_t index = map->tails[_YYLinkedMapSegmentProtected];
+        _YYLinkedMapUnlink(map, index);
+        _YYLinkedMapLink(map, index, _YYLinkedMapSegmentProbation);
+    }
 }
 
-- (void)insertNodeAtHead:(_YYLinkedMapNode *)node {
-    CFDictionarySetValue(_dic, (__bridge const void *)(node->_key), (__bridge const void *)(node));
-    _totalCost += node->_cost;
-    _totalCount++;
-    if (_head) {
-        node->_next = _head;
-        _head->_prev = node;
-        _head = node;
+#pragma mark timer wheel
+
+static inline uint32_t _YYLinkedMapWheelSlot(NSTimeInterval expire) {
+    return (uint32_t)((uint64_t)ceil(expire) & (_YYLinkedMapWheelSize - 1));
+}
+
+/// Link the node to timer wheel if it has expire time.
+static inline void _YYLinkedMapWheelLink(_YYLinkedMap *map, uint32_t index) {
+    _YYLinkedMapNode *node = map->nodes + index;
+    node->wheelPrev = node->wheelNext = _YYLinkedMapNil;
+    if (node->expire <= 0) return;
+    if (!map->wheel) {
+        map->wheel = malloc(sizeof(uint32_t) * _YYLinkedMapWheelSize);
+        if (!map->wheel) return; // still checked on access
+        memset(map->wheel, 0xFF, sizeof(uint32_t) * _YYLinkedMapWheelSize);
+    }
+    uint32_t slot = _YYLinkedMapWheelSlot(node->expire);
+    node->wheelNext = map->wheel[slot];
+    if (node->wheelNext != _YYLinkedMapNil) map->nodes[node->wheelNext].wheelPrev = index;
+    map->wheel[slot] = index;
+}
+
+static inline void _YYLinkedMapWheelUnlink(_YYLinkedMap *map, uint32_t index) {
+    _YYLinkedMapNode *node = map->nodes + index;
+    if (node->expire <= 0 || !map->wheel) return;
+    if (node->wheelPrev != _YYLinkedMapNil) {
+        map->nodes[node->wheelPrev].wheelNext = node->wheelNext;
     } else {
-        _head = _tail = node;
+        uint32_t slot = _YYLinkedMapWheelSlot(node->expire);
+        if (map->wheel[slot] != index) return; // not linked
+        map->wheel[slot] = node->wheelNext;
     }
+    if (node->wheelNext != _YYLinkedMapNil) map->nodes[node->wheelNext].wheelPrev = node->wheelPrev;
+    node->wheelPrev = node->wheelNext = _YYLinkedMapNil;
+}
+
+/// Change the expire time of a node, 0 means never expires.
+static inline void _YYLinkedMapSetExpire(_YYLinkedMap *map, uint32_t index, NSTimeInterval expire) {
+    _YYLinkedMapNode *node = map->nodes + index;
+    if (node->expire == expire) return;
+    _YYLinkedMapWheelUnlink(map, index);
+    node->expire = expire;
+    _YYLinkedMapWheelLink(map, index);
 }
 
-- (void)bringNodeToHead:(_YYLinkedMapNode *)node {
-    if (_head == node) return;
+static inline BOOL _YYLinkedMapNodeExpired(_YYLinkedMapNode *node, NSTimeInterval now) {
+    return node->expire > 0 && node->expire <= now;
+}
+
+#pragma mark map
+
+/// Make sure there's a free node in slab.
+static BOOL _YYLinkedMapNodeReserve(_YYLinkedMap *map) {
+    if (map->freeHead != _YYLinkedMapNil) return YES;
+    uint32_t capacity = map->nodeCapacity;
+    uint64_t newCapacity = capacity ? (uint64_t)capacity * 2 : 16;
+    if (newCapacity >= _YYLinkedMapNil) return NO;
+    _YYLinkedMapNode *nodes = realloc(map->nodes, sizeof(_YYLinkedMapNode) * (size_t)newCapacity);
+    if (!nodes) return NO;
+    for (uint32_t i = capacity; i < newCapacity; i++) {
+        nodes[i].key = NULL;
+        nodes[i].value = NULL;
+        nodes[i].next = (i + 1 < newCapacity) ? i + 1 : _YYLinkedMapNil;
+    }
+    map->nodes = nodes;
+    map->nodeCapacity = (uint32_t)newCapacity;
+    map->freeHead = capacity;
+    return YES;
+}
+
+/// Insert a node at head and update the total cost, the key and value are retained.
+/// Returns the node index, or _YYLinkedMapNil if there's no memory.
+/// Key should not be inside the map.
+static uint32_t _YYLinkedMapInsert(_YYLinkedMap *map, id key, id value, NSUInteger cost, NSTimeInterval time, uint64_t hash) {
+    if (!_YYLinkedMapNodeReserve(map)) return _YYLinkedMapNil;
+    if (!_YYLinkedMapIndexReserve(map, map->totalCount + 1)) return _YYLinkedMapNil;
+    uint32_t index = map->freeHead;
+    _YYLinkedMapNode *node = map->nodes + index;
+    map->freeHead = node->next;
+    node->key = CFBridgingRetain(key);
+    node->value = CFBridgingRetain(value);
+    node->cost = cost;
+    node->time = time;
+    node->expire = 0;
+    node->wheelPrev = node->wheelNext = _YYLinkedMapNil;
+    node->hash = hash;
+    _YYLinkedMapIndexInsert(map, index, (uint32_t)hash);
+    map->totalCost += cost;
+    map->totalCount++;
+    if (map->policy == YYMemoryCacheEvictionPolicyTinyLFU) {
+        if (map->totalCount > map->sketch.mask + 1) _YYFrequencySketchEnsureCapacity(&map->sketch, map->totalCount);
+        _YYLinkedMapLink(map, index, _YYLinkedMapSegmentWindow);
+        _YYLinkedMapBalance(map);
+    } else {
+        _YYLinkedMapLink(map, index, _YYLinkedMapSegmentProbation);
+    }
+    return index;
+}
+
+/// Bring a inner node to header (it may be promoted to another segment).
+static void _YYLinkedMapBringToHead(_YYLinkedMap *map, uint32_t index) {
+    _YYLinkedMapSegment segment = map->nodes[index].segment;
+    if (map->policy != YYMemoryCacheEvictionPolicyLRU && segment == _YYLinkedMapSegmentProbation) {
+        _YYLinkedMapUnlink(map, index);
+        _YYLinkedMapLink(map, index, _YYLinkedMapSegmentProtected);
+        _YYLinkedMapBalance(map);
+        return;
+    }
+    if (map->heads[segment] == index) return;
+    _YYLinkedMapUnlink(map, index);
+    _YYLinkedMapLink(map, index, segment);
+}
+
+/// Remove a inner node and update the total cost, the node is recycled.
+/// The caller takes the ownership of key and value.
+static void _YYLinkedMapRemove(_YYLinkedMap *map, uint32_t index, CFTypeRef *key, CFTypeRef *value) {
+    _YYLinkedMapIndexRemove(map, index);
+    _YYLinkedMapUnlink(map, index);
+    _YYLinkedMapWheelUnlink(map, index);
+    _YYLinkedMapNode *node = map->nodes + index;
+    map->totalCost -= node->cost;
+    map->totalCount--;
+    *key = node->key;
+    *value = node->value;
+    node->key = NULL;
+    node->value = NULL;
+    node->next = map->freeHead;
+    map->freeHead = index;
+}
+
+/// The node to evict chosen by the eviction policy, or _YYLinkedMapNil if empty.
+/// The caller should remove the node. For TinyLFU, the window's candidate may be
+/// admitted to probation segment in this function.
+static uint32_t _YYLinkedMapVictim(_YYLinkedMap *map) {
+    switch (map->policy) {
+        case YYMemoryCacheEvictionPolicyLRU: {
+            return map->tails[_YYLinkedMapSegmentProbation];
+        }
+        case YYMemoryCacheEvictionPolicySegmentedLRU: {
+            uint32_t victim = map->tails[_YYLinkedMapSegmentProbation];
+            return victim != _YYLinkedMapNil ? victim : map->tails[_YYLinkedMapSegmentProtected];
+        }
+        case YYMemoryCacheEvictionPolicyTinyLFU: {
+            // the window's oldest node is the candidate (except the newest node), it's
+            // admitted to main space only if it's used more frequently than the victim.
+            uint32_t candidate = map->counts[_YYLinkedMapSegmentWindow] > 1 ? map->tails[_YYLinkedMapSegmentWindow] : _YYLinkedMapNil;
+            uint32_t victim = map->tails[_YYLinkedMapSegmentProbation];
+            if (victim == _YYLinkedMapNil) victim = map->tails[_YYLinkedMapSegmentProtected];
+            if (victim == _YYLinkedMapNil) return map->tails[_YYLinkedMapSegmentWindow];
+            if (candidate == _YYLinkedMapNil) return victim;
+            uint32_t candidateFreq = _YYFrequencySketchGet(&map->sketch, map->nodes[candidate].hash);
+            uint32_t victimFreq = _YYFrequencySketchGet(&map->sketch, map->nodes[victim].hash);
+            if (candidateFreq <= victimFreq) return candidate;
+            _YYLinkedMapUnlink(map, candidate);
+            _YYLinkedMapLink(map, candidate, _YYLinkedMapSegmentProbation);
+            return victim;
+        }
+    }
+    return _YYLinkedMapNil;
+}
+
+/// The least recently used node of all segments, or _YYLinkedMapNil if empty.
+static uint32_t _YYLinkedMapOldest(_YYLinkedMap *map) {
+    uint32_t oldest = _YYLinkedMapNil;
+    for (int i = 0; i < _YYLinkedMapSegmentCount; i++) {
+        uint32_t tail = map->tails[i];
+        if (tail == _YYLinkedMapNil) continue;
+        if (oldest == _YYLinkedMapNil || map->nodes[tail].time < map->nodes[oldest].time) oldest = tail;
+    }
+    return oldest;
+}
+
+/// Record an access of the key for the frequency sketch.
+static inline void _YYLinkedMapRecordAccess(_YYLinkedMap *map, uint64_t hash) {
+    if (map->policy != YYMemoryCacheEvictionPolicyTinyLFU) return;
+    _YYFrequencySketchIncrement(&map->sketch, hash);
+}
+
+/// Change the eviction policy, all nodes will be merged into probation segment
+/// by access time, so the most recently used nodes are still evicted last.
+static void _YYLinkedMapSetPolicy(_YYLinkedMap *map, YYMemoryCacheEvictionPolicy policy) {
+    if (map->policy == policy) return;
+    map->policy = policy;
+    // detach the segments, each of them is ordered by access time (except the
+    // demoted nodes at head), then merge them from the most recently used.
+    uint32_t heads[_YYLinkedMapSegmentCount];
+    for (int i = 0; i < _YYLinkedMapSegmentCount; i++) {
+        heads[i] = map->heads[i];
+        map->heads[i] = _YYLinkedMapNil;
+        map->tails[i] = _YYLinkedMapNil;
+        map->counts[i] = 0;
+    }
+    for (;;) {
+        int segment = -1;
+        for (int i = 0; i < _YYLinkedMapSegmentCount; i++) {
+            if (heads[i] == _YYLinkedMapNil) continue;
+            if (segment < 0 || map->nodes[heads[i]].time > map->nodes[heads[segment]].time) segment = i;
+        }
+        if (segment < 0) break;
+        uint32_t index = heads[segment];
+        heads[segment] = map->nodes[index].next;
+        _YYLinkedMapLinkTail(map, index, _YYLinkedMapSegmentProbation);
+    }
+    if (policy == YYMemoryCacheEvictionPolicyTinyLFU) {
+        _YYFrequencySketchEnsureCapacity(&map->sketch, map->totalCount);
+    } else {
+        _YYFrequencySketchFree(&map->sketch);
+    }
+    _YYLinkedMapBalance(map);
+}
+
+/// Remove all node, the objects are released in background queue.
+static void _YYLinkedMapRemoveAll(_YYLinkedMap *map) {
+    if (map->totalCount == 0) return;
+    _YYLinkedMapNode *nodes = map->nodes;
+    uint32_t capacity = map->nodeCapacity;
+    free(map->slots);
+    free(map->wheel);
+    map->nodes = NULL;
+    map->nodeCapacity = 0;
+    map->freeHead = _YYLinkedMapNil;
+    map->slots = NULL;
+    map->slotMask = 0;
+    map->wheel = NULL;
+    map->totalCost = 0;
+    map->totalCount = 0;
+    for (int i = 0; i < _YYLinkedMapSegmentCount; i++) {
+        map->heads[i] = _YYLinkedMapNil;
+        map->tails[i] = _YYLinkedMapNil;
+        map->counts[i] = 0;
+    }
     
-    if (_tail == node) {
-        _tail = node->_prev;
-        _tail->_next = nil;
+    void (^release)(void) = ^{
+        for (uint32_t i = 0; i < capacity; i++) {
+            if (!nodes[i].key) continue;
+            CFRelease(nodes[i].key);
+            CFRelease(nodes[i].value);
+        }
+        free(nodes);
+    };
+    if (map->releaseAsynchronously) {
+        dispatch_queue_t queue = map->releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
+        dispatch_async(queue, release); // hold and release in specified queue
+    } else if (map->releaseOnMainThread && !pthread_main_np()) {
+        dispatch_async(dispatch_get_main_queue(), release); // hold and release in specified queue
     } else {
-        node->_next->_prev = node->_prev;
-        node->_prev->_next = node->_next;
-    }
-    node->_next = _head;
-    node->_prev = nil;
-    _head->_prev = node;
-    _head = node;
-}
-
-- (void)removeNode:(_YYLinkedMapNode *)node {
-    CFDictionaryRemoveValue(_dic, (__bridge const void *)(node->_key));
-    _totalCost -= node->_cost;
-    _totalCount--;
-    if (node->_next) node->_next->_prev = node->_prev;
-    if (node->_prev) node->_prev->_next = node->_next;
-    if (_head == node) _head = node->_next;
-    if (_tail == node) _tail = node->_prev;
-}
-
-- (_YYLinkedMapNode *)removeTailNode {
-    if (!_tail) return nil;
-    _YYLinkedMapNode *tail = _tail;
-    CFDictionaryRemoveValue(_dic, (__bridge const void *)(_tail->_key));
-    _totalCost -= _tail->_cost;
-    _totalCount--;
-    if (_head == _tail) {
-        _head = _tail = nil;
+        release();
+    }
+}
+
+static void _YYLinkedMapDestroy(_YYLinkedMap *map) {
+    _YYLinkedMapRemoveAll(map);
+    free(map->nodes);
+    free(map->slots);
+    free(map->wheel);
+    _YYFrequencySketchFree(&map->sketch);
+}
+
+
+#define YYMemoryCacheMaxShardCount 64
+
+/**
+ A shard of YYMemoryCache, the linked map is guarded by the lock.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    _YYLinkedMap lru;
+} __attribute__((aligned(64))) _YYMemoryCacheShard; // avoid false sharing between locks
+
+/// Returns the shard index of the key hash (the low bits are used by hash index).
+static inline NSUInteger _YYMemoryCacheShardIndex(NSUInteger mask, uint64_t hash) {
+    return (hash >> 32) & mask;
+}
+
+/// Returns the shard which holds the key.
+static inline _YYMemoryCacheShard *_YYMemoryCacheGetShard(_YYMemoryCacheShard *shards, NSUInteger mask, uint64_t hash) {
+    return shards + _YYMemoryCacheShardIndex(mask, hash);
+}
+
+/// Returns the limit of each shard (rounded up).
+static inline NSUInteger _YYMemoryCacheShardLimit(NSUInteger limit, NSUInteger shardCount) {
+    if (shardCount <= 1 || limit == NSUIntegerMax) return limit;
+    return limit / shardCount + (limit % shardCount ? 1 : 0);
+}
+
+static int _YYMemoryCacheUIntegerCompare(const void *a, const void *b) {
+    NSUInteger va = *(const NSUInteger *)a, vb = *(const NSUInteger *)b;
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+/// Returns the largest part `p` which makes sum(MIN(values[i], p)) <= limit, so the
+/// space unused by small shards is left to the others. `values` is sorted in place.
+static NSUInteger _YYMemoryCacheFairLimit(NSUInteger *values, NSUInteger count, NSUInteger limit) {
+    qsort(values, count, sizeof(NSUInteger), _YYMemoryCacheUIntegerCompare);
+    for (NSUInteger i = 0; i < count; i++) {
+        NSUInteger part = limit / (count - i);
+        if (values[i] > part) return part;
+        limit -= values[i];
+    }
+    return NSUIntegerMax;
+}
+
+/// Get the value and bring the node to head, the shard should be locked.
+/// Returns the value (not retained) or NULL if not found, the cost is added to `cost`.
+/// The expired node is removed and treated as not found.
+static inline CFTypeRef _YYMemoryCacheShardGet(_YYLinkedMap *lru, CFTypeRef key, uint64_t hash, NSTimeInterval now, NSUInteger *cost) {
+    _YYLinkedMapRecordAccess(lru, hash);
+    uint32_t index = _YYLinkedMapFind(lru, key, hash);
+    if (index != _YYLinkedMapNil && _YYLinkedMapNodeExpired(lru->nodes + index, now)) {
+        CFTypeRef nodeKey, nodeValue;
+        _YYLinkedMapRemove(lru, index, &nodeKey, &nodeValue);
+        _YYLinkedMapReleaseObjects(lru, nodeKey, nodeValue);
+        index = _YYLinkedMapNil;
+    }
+    if (index == _YYLinkedMapNil) {
+        lru->missCount++;
+        return NULL;
+    }
+    _YYLinkedMapNode *node = lru->nodes + index;
+    node->time = now;
+    CFTypeRef value = node->value;
+    *cost += node->cost;
+    _YYLinkedMapBringToHead(lru, index);
+    lru->hitCount++;
+    return value;
+}
+
+/// Set the value and evict a node if the shard goes over the count limit, the shard
+/// should be locked. Returns the replaced value which should be released after unlock.
+/// The number of evicted nodes is added to `evictCount`.
+static inline CFTypeRef _YYMemoryCacheShardSet(_YYLinkedMap *lru, id key, id object, NSUInteger cost, uint64_t hash, NSTimeInterval now, NSTimeInterval expire, NSUInteger countLimit, NSUInteger *evictCount) {
+    CFTypeRef oldValue = NULL;
+    _YYLinkedMapRecordAccess(lru, hash);
+    uint32_t index = _YYLinkedMapFind(lru, (__bridge CFTypeRef)key, hash);
+    if (index != _YYLinkedMapNil) {
+        _YYLinkedMapNode *node = lru->nodes + index;
+        lru->totalCost -= node->cost;
+        lru->totalCost += cost;
+        node->cost = cost;
+        node->time = now;
+        if (node->value != (__bridge CFTypeRef)object) {
+            oldValue = node->value;
+            node->value = CFBridgingRetain(object);
+        }
+        _YYLinkedMapSetExpire(lru, index, expire);
+        _YYLinkedMapBringToHead(lru, index);
     } else {
-        _tail = _tail->_prev;
-        _tail->_next = nil;
-    }
-    return tail;
-}
-
-- (void)removeAll {
-    _totalCost = 0;
-    _totalCount = 0;
-    _head = nil;
-    _tail = nil;
-    if (CFDictionaryGetCount(_dic) > 0) {
-        CFMutableDictionaryRef holder = _dic;
-        _dic = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        
-        if (_releaseAsynchronously) {
-            dispatch_queue_t queue = _releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                CFRelease(holder); // hold and release in specified queue
-            });
-        } else if (_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                CFRelease(holder); // hold and release in specified queue
-            });
-        } else {
-            CFRelease(holder);
+        index = _YYLinkedMapInsert(lru, key, object, cost, now, hash);
+        if (index != _YYLinkedMapNil && expire > 0) _YYLinkedMapSetExpire(lru, index, expire);
+    }
+    if (lru->totalCount > countLimit) {
+        uint32_t victim = _YYLinkedMapVictim(lru);
+        CFTypeRef victimKey, victimValue;
+        _YYLinkedMapRemove(lru, victim, &victimKey, &victimValue);
+        _YYLinkedMapReleaseObjects(lru, victimKey, victimValue);
+        (*evictCount)++;
+    }
+    return oldValue;
+}
+
+/// Remove the node and put the key and value into the holder (released later).
+static inline void _YYMemoryCacheRemoveToHolder(_YYLinkedMap *lru, uint32_t index, NSMutableArray *holder) {
+    CFTypeRef key, value;
+    _YYLinkedMapRemove(lru, index, &key, &value);
+    [holder addObject:(__bridge_transfer id)key];
+    [holder addObject:(__bridge_transfer id)value];
+}
+
+/// Remove the expired nodes in the timer wheel slots passed since last time, the
+/// shard should be locked. Each slot is visited at most once.
+static void _YYMemoryCacheShardReclaim(_YYLinkedMap *lru, NSTimeInterval now, NSMutableArray *holder) {
+    uint64_t tick = (uint64_t)floor(now);
+    if (!lru->wheel || tick <= lru->wheelTick) {
+        if (tick > lru->wheelTick) lru->wheelTick = tick;
+        return;
+    }
+    uint64_t from = lru->wheelTick + 1;
+    if (tick - lru->wheelTick > _YYLinkedMapWheelSize) from = tick - _YYLinkedMapWheelSize + 1;
+    for (uint64_t t = from; t <= tick; t++) {
+        uint32_t index = lru->wheel[t & (_YYLinkedMapWheelSize - 1)];
+        while (index != _YYLinkedMapNil) {
+            uint32_t next = lru->nodes[index].wheelNext;
+            if (_YYLinkedMapNodeExpired(lru->nodes + index, now)) {
+                _YYMemoryCacheRemoveToHolder(lru, index, holder);
+            }
+            index = next;
         }
     }
+    lru->wheelTick = tick;
 }
 
-@end
+/// An entry of the snapshot, see `recentlyUsedKeysWithLimit:costs:`.
+typedef struct {
+    CFTypeRef key; // retained
+    NSUInteger cost;
+    NSTimeInterval time;
+} _YYMemoryCacheSnapshotEntry;
 
+/// The most recently used first.
+static int _YYMemoryCacheSnapshotEntryCompare(const void *a, const void *b) {
+    NSTimeInterval ta = ((const _YYMemoryCacheSnapshotEntry *)a)->time;
+    NSTimeInterval tb = ((const _YYMemoryCacheSnapshotEntry *)b)->time;
+    return ta > tb ? -1 : (ta < tb ? 1 : 0);
+}
+
+static const NSInteger _YYMemoryCacheSnapshotVersion = 1;
 
 
 @implementation YYMemoryCache {
-    pthread_mutex_t _lock;
-    _YYLinkedMap *_lru;
+    _YYMemoryCacheShard *_shards;
+    NSUInteger _shardCount;
+    NSUInteger _shardMask;
     dispatch_queue_t _queue;
+    NSTimeInterval _lastSnapshotTime; ///< accessed in _queue
 }
 
 - (void)_trimRecursively {
@@ -199,113 +798,155 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 
 - (void)_trimInBackground {
     dispatch_async(_queue, ^{
+        [self _trimExpired];
         [self _trimToCost:self->_costLimit];
         [self _trimToCount:self->_countLimit];
         [self _trimToAge:self->_ageLimit];
+        [self _writeSnapshotIfNeeded];
     });
 }
 
-- (void)_trimToCost:(NSUInteger)costLimit {
-    BOOL finish = NO;
-    pthread_mutex_lock(&_lock);
-    if (costLimit == 0) {
-        [_lru removeAll];
-        finish = YES;
-    } else if (_lru->_totalCost <= costLimit) {
-        finish = YES;
+- (void)_writeSnapshotIfNeeded {
+    NSTimeInterval interval = self.snapshotInterval;
+    if (interval <= 0 || !self.snapshotPath) return;
+    NSTimeInterval now = CACurrentMediaTime();
+    if (now - _lastSnapshotTime < interval) return;
+    _lastSnapshotTime = now;
+    [self writeSnapshot];
+}
+
+- (void)_releaseObjectsInHolder:(NSMutableArray *)holder {
+    if (holder.count) {
+        dispatch_queue_t queue = _shards->lru.releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
+        dispatch_async(queue, ^{
+            [holder count]; // release in queue
+        });
     }
-    pthread_mutex_unlock(&_lock);
-    if (finish) return;
-    
+}
+
+- (void)_trimExpired {
+    NSTimeInterval now = CACurrentMediaTime();
+    YYCacheMetrics *metrics = self.metrics;
+    NSMutableArray *holder = [NSMutableArray new];
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        _YYMemoryCacheShard *shard = _shards + i;
+        pthread_mutex_lock(&shard->lock);
+        _YYMemoryCacheShardReclaim(&shard->lru, now, holder);
+        pthread_mutex_unlock(&shard->lock);
+    }
+    if (metrics && holder.count) [metrics recordTrimWithEvictionCount:holder.count / 2 reason:YYCacheEvictionReasonAge latency:CACurrentMediaTime() - now];
+    [self _releaseObjectsInHolder:holder];
+}
+
+/// Trim a single shard, used when the shard goes over its part of the cost limit.
+- (void)_trimShard:(_YYMemoryCacheShard *)shard toCost:(NSUInteger)costLimit {
+    YYCacheMetrics *metrics = self.metrics;
+    NSTimeInterval begin = metrics ? CACurrentMediaTime() : 0;
+    BOOL finish = NO;
     NSMutableArray *holder = [NSMutableArray new];
     while (!finish) {
-        if (pthread_mutex_trylock(&_lock) == 0) {
-            if (_lru->_totalCost > costLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
+        if (pthread_mutex_trylock(&shard->lock) == 0) {
+            uint32_t victim = _YYLinkedMapVictim(&shard->lru);
+            if (shard->lru.totalCost > costLimit && victim != _YYLinkedMapNil) {
+                _YYMemoryCacheRemoveToHolder(&shard->lru, victim, holder);
             } else {
                 finish = YES;
             }
-            pthread_mutex_unlock(&_lock);
+            pthread_mutex_unlock(&shard->lock);
         } else {
             usleep(10 * 1000); //10 ms
         }
     }
-    if (holder.count) {
-        dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-        dispatch_async(queue, ^{
-            [holder count]; // release in queue
-        });
-    }
+    if (metrics) [metrics recordTrimWithEvictionCount:holder.count / 2 reason:YYCacheEvictionReasonCost latency:CACurrentMediaTime() - begin];
+    [self _releaseObjectsInHolder:holder];
 }
 
-- (void)_trimToCount:(NSUInteger)countLimit {
-    BOOL finish = NO;
-    pthread_mutex_lock(&_lock);
-    if (countLimit == 0) {
-        [_lru removeAll];
-        finish = YES;
-    } else if (_lru->_totalCount <= countLimit) {
-        finish = YES;
+/// Trim each shard to its part of the limit in one pass, the parts are decided
+/// with `_YYMemoryCacheFairLimit()` from the shards' current cost or count.
+- (void)_trimShardsToLimit:(NSUInteger)limit byCost:(BOOL)byCost {
+    NSUInteger *values = malloc(_shardCount * sizeof(NSUInteger));
+    if (!values) return;
+    NSUInteger total = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        _YYMemoryCacheShard *shard = _shards + i;
+        pthread_mutex_lock(&shard->lock);
+        values[i] = byCost ? shard->lru.totalCost : shard->lru.totalCount;
+        pthread_mutex_unlock(&shard->lock);
+        total += values[i];
     }
-    pthread_mutex_unlock(&_lock);
-    if (finish) return;
+    NSUInteger part = total > limit ? _YYMemoryCacheFairLimit(values, _shardCount, limit) : NSUIntegerMax;
+    free(values);
+    if (part == NSUIntegerMax) return;
     
+    YYCacheMetrics *metrics = self.metrics;
+    NSTimeInterval begin = metrics ? CACurrentMediaTime() : 0;
     NSMutableArray *holder = [NSMutableArray new];
-    while (!finish) {
-        if (pthread_mutex_trylock(&_lock) == 0) {
-            if (_lru->_totalCount > countLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        _YYMemoryCacheShard *shard = _shards + i;
+        BOOL finish = NO;
+        while (!finish) {
+            if (pthread_mutex_trylock(&shard->lock) == 0) {
+                NSUInteger value = byCost ? shard->lru.totalCost : shard->lru.totalCount;
+                uint32_t victim = value > part ? _YYLinkedMapVictim(&shard->lru) : _YYLinkedMapNil;
+                if (victim != _YYLinkedMapNil) {
+                    _YYMemoryCacheRemoveToHolder(&shard->lru, victim, holder);
+                } else {
+                    finish = YES;
+                }
+                pthread_mutex_unlock(&shard->lock);
             } else {
-                finish = YES;
+                usleep(10 * 1000); //10 ms
             }
-            pthread_mutex_unlock(&_lock);
-        } else {
-            usleep(10 * 1000); //10 ms
         }
     }
-    if (holder.count) {
-        dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-        dispatch_async(queue, ^{
-            [holder count]; // release in queue
-        });
+    YYCacheEvictionReason reason = byCost ? YYCacheEvictionReasonCost : YYCacheEvictionReasonCount;
+    if (metrics) [metrics recordTrimWithEvictionCount:holder.count / 2 reason:reason latency:CACurrentMediaTime() - begin];
+    [self _releaseObjectsInHolder:holder];
+}
+
+- (void)_trimToCost:(NSUInteger)costLimit {
+    if (costLimit == 0) {
+        [self removeAllObjects];
+        return;
+    }
+    [self _trimShardsToLimit:costLimit byCost:YES];
+}
+
+- (void)_trimToCount:(NSUInteger)countLimit {
+    if (countLimit == 0) {
+        [self removeAllObjects];
+        return;
     }
+    [self _trimShardsToLimit:countLimit byCost:NO];
 }
 
 - (void)_trimToAge:(NSTimeInterval)ageLimit {
-    BOOL finish = NO;
-    NSTimeInterval now = CACurrentMediaTime();
-    pthread_mutex_lock(&_lock);
     if (ageLimit <= 0) {
-        [_lru removeAll];
-        finish = YES;
-    } else if (!_lru->_tail || (now - _lru->_tail->_time) <= ageLimit) {
-        finish = YES;
+        [self removeAllObjects];
+        return;
     }
-    pthread_mutex_unlock(&_lock);
-    if (finish) return;
-    
+    NSTimeInterval now = CACurrentMediaTime();
+    YYCacheMetrics *metrics = self.metrics;
     NSMutableArray *holder = [NSMutableArray new];
-    while (!finish) {
-        if (pthread_mutex_trylock(&_lock) == 0) {
-            if (_lru->_tail && (now - _lru->_tail->_time) > ageLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        _YYMemoryCacheShard *shard = _shards + i;
+        BOOL finish = NO;
+        while (!finish) {
+            if (pthread_mutex_trylock(&shard->lock) == 0) {
+                uint32_t oldest = _YYLinkedMapOldest(&shard->lru);
+                if (oldest != _YYLinkedMapNil && (now - shard->lru.nodes[oldest].time) > ageLimit) {
+                    _YYMemoryCacheRemoveToHolder(&shard->lru, oldest, holder);
+                } else {
+                    finish = YES;
+                }
+                pthread_mutex_unlock(&shard->lock);
             } else {
-                finish = YES;
+                usleep(10 * 1000); //10 ms
             }
-            pthread_mutex_unlock(&_lock);
-        } else {
-            usleep(10 * 1000); //10 ms
         }
     }
-    if (holder.count) {
-        dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-        dispatch_async(queue, ^{
-            [holder count]; // release in queue
-        });
-    }
+    if (metrics) [metrics recordTrimWithEvictionCount:holder.count / 2 reason:YYCacheEvictionReasonAge latency:CACurrentMediaTime() - now];
+    [self _releaseObjectsInHolder:holder];
 }
 
 - (void)_appDidReceiveMemoryWarningNotification {
@@ -321,17 +962,37 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     if (self.didEnterBackgroundBlock) {
         self.didEnterBackgroundBlock(self);
     }
+    if (self.snapshotPath) {
+        [self writeSnapshot]; // before the objects are removed
+    }
     if (self.shouldRemoveAllObjectsWhenEnteringBackground) {
         [self removeAllObjects];
     }
 }
 
+- (void)_appWillTerminateNotification {
+    if (self.snapshotPath) {
+        [self writeSnapshot];
+    }
+}
+
 #pragma mark - public
 
 - (instancetype)init {
+    return [self initWithShardCount:1];
+}
+
+- (instancetype)initWithShardCount:(NSUInteger)shardCount {
     self = super.init;
-    pthread_mutex_init(&_lock, NULL);
-    _lru = [_YYLinkedMap new];
+    if (shardCount > YYMemoryCacheMaxShardCount) shardCount = YYMemoryCacheMaxShardCount;
+    _shardCount = 1;
+    while (_shardCount < shardCount) _shardCount <<= 1;
+    _shardMask = _shardCount - 1;
+    if (posix_memalign((void **)&_shards, 64, sizeof(_YYMemoryCacheShard) * _shardCount) != 0) return nil;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_init(&_shards[i].lock, NULL);
+        _YYLinkedMapInit(&_shards[i].lru);
+    }
     _queue = dispatch_queue_create("com.ibireme.cache.memory", DISPATCH_QUEUE_SERIAL);
     
     _countLimit = NSUIntegerMax;
@@ -340,9 +1001,12 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     _autoTrimInterval = 5.0;
     _shouldRemoveAllObjectsOnMemoryWarning = YES;
     _shouldRemoveAllObjectsWhenEnteringBackground = YES;
+    _snapshotLimit = 100;
+    _lastSnapshotTime = CACurrentMediaTime();
     
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidReceiveMemoryWarningNotification) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidEnterBackgroundNotification) name:UIApplicationDidEnterBackgroundNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appWillTerminateNotification) name:UIApplicationWillTerminateNotification object:nil];
     
     [self _trimRecursively];
     return self;
@@ -351,68 +1015,128 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
-    [_lru removeAll];
-    pthread_mutex_destroy(&_lock);
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationWillTerminateNotification object:nil];
+    if (!_shards) return;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        _YYLinkedMapDestroy(&_shards[i].lru);
+        pthread_mutex_destroy(&_shards[i].lock);
+    }
+    free(_shards);
+}
+
+- (NSUInteger)shardCount {
+    return _shardCount;
 }
 
 - (NSUInteger)totalCount {
-    pthread_mutex_lock(&_lock);
-    NSUInteger count = _lru->_totalCount;
-    pthread_mutex_unlock(&_lock);
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        count += _shards[i].lru.totalCount;
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
     return count;
 }
 
 - (NSUInteger)totalCost {
-    pthread_mutex_lock(&_lock);
-    NSUInteger totalCost = _lru->_totalCost;
-    pthread_mutex_unlock(&_lock);
+    NSUInteger totalCost = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        totalCost += _shards[i].lru.totalCost;
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
     return totalCost;
 }
 
+- (NSUInteger)hitCount {
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        count += _shards[i].lru.hitCount;
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
+    return count;
+}
+
+- (NSUInteger)missCount {
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        count += _shards[i].lru.missCount;
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
+    return count;
+}
+
+- (YYMemoryCacheEvictionPolicy)evictionPolicy {
+    pthread_mutex_lock(&_shards->lock);
+    YYMemoryCacheEvictionPolicy policy = _shards->lru.policy;
+    pthread_mutex_unlock(&_shards->lock);
+    return policy;
+}
+
+- (void)setEvictionPolicy:(YYMemoryCacheEvictionPolicy)evictionPolicy {
+    if (evictionPolicy > YYMemoryCacheEvictionPolicyTinyLFU) return;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        _YYLinkedMapSetPolicy(&_shards[i].lru, evictionPolicy);
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
+}
+
 - (BOOL)releaseOnMainThread {
-    pthread_mutex_lock(&_lock);
-    BOOL releaseOnMainThread = _lru->_releaseOnMainThread;
-    pthread_mutex_unlock(&_lock);
+    pthread_mutex_lock(&_shards->lock);
+    BOOL releaseOnMainThread = _shards->lru.releaseOnMainThread;
+    pthread_mutex_unlock(&_shards->lock);
     return releaseOnMainThread;
 }
 
 - (void)setReleaseOnMainThread:(BOOL)releaseOnMainThread {
-    pthread_mutex_lock(&_lock);
-    _lru->_releaseOnMainThread = releaseOnMainThread;
-    pthread_mutex_unlock(&_lock);
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        _shards[i].lru.releaseOnMainThread = releaseOnMainThread;
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
 }
 
 - (BOOL)releaseAsynchronously {
-    pthread_mutex_lock(&_lock);
-    BOOL releaseAsynchronously = _lru->_releaseAsynchronously;
-    pthread_mutex_unlock(&_lock);
+    pthread_mutex_lock(&_shards->lock);
+    BOOL releaseAsynchronously = _shards->lru.releaseAsynchronously;
+    pthread_mutex_unlock(&_shards->lock);
     return releaseAsynchronously;
 }
 
 - (void)setReleaseAsynchronously:(BOOL)releaseAsynchronously {
-    pthread_mutex_lock(&_lock);
-    _lru->_releaseAsynchronously = releaseAsynchronously;
-    pthread_mutex_unlock(&_lock);
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        _shards[i].lru.releaseAsynchronously = releaseAsynchronously;
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
 }
 
 - (BOOL)containsObjectForKey:(id)key {
     if (!key) return NO;
-    pthread_mutex_lock(&_lock);
-    BOOL contains = CFDictionaryContainsKey(_lru->_dic, (__bridge const void *)(key));
-    pthread_mutex_unlock(&_lock);
+    uint64_t hash = _YYMemoryCacheHash(key);
+    _YYMemoryCacheShard *shard = _YYMemoryCacheGetShard(_shards, _shardMask, hash);
+    pthread_mutex_lock(&shard->lock);
+    uint32_t index = _YYLinkedMapFind(&shard->lru, (__bridge CFTypeRef)key, hash);
+    BOOL contains = index != _YYLinkedMapNil && !_YYLinkedMapNodeExpired(shard->lru.nodes + index, CACurrentMediaTime());
+    pthread_mutex_unlock(&shard->lock);
     return contains;
 }
 
 - (id)objectForKey:(id)key {
     if (!key) return nil;
-    pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
-    if (node) {
-        node->_time = CACurrentMediaTime();
-        [_lru bringNodeToHead:node];
-    }
-    pthread_mutex_unlock(&_lock);
-    return node ? node->_value : nil;
+    uint64_t hash = _YYMemoryCacheHash(key);
+    _YYMemoryCacheShard *shard = _YYMemoryCacheGetShard(_shards, _shardMask, hash);
+    NSTimeInterval now = CACurrentMediaTime();
+    NSUInteger cost = 0;
+    pthread_mutex_lock(&shard->lock);
+    id value = (__bridge id)_YYMemoryCacheShardGet(&shard->lru, (__bridge CFTypeRef)key, hash, now, &cost); // retained before unlock
+    pthread_mutex_unlock(&shard->lock);
+    YYCacheMetrics *metrics = self.metrics;
+    if (metrics) [metrics recordGetWithHitCount:value ? 1 : 0 missCount:value ? 0 : 1 bytesRead:cost latency:CACurrentMediaTime() - now];
+    return value;
 }
 
 - (void)setObject:(id)object forKey:(id)key {
@@ -420,74 +1144,151 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 }
 
 - (void)setObject:(id)object forKey:(id)key withCost:(NSUInteger)cost {
+    [self setObject:object forKey:key withCost:cost ttl:0];
+}
+
+- (void)setObject:(id)object forKey:(id)key withCost:(NSUInteger)cost ttl:(NSTimeInterval)ttl {
     if (!key) return;
     if (!object) {
         [self removeObjectForKey:key];
         return;
     }
-    pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
+    uint64_t hash = _YYMemoryCacheHash(key);
+    _YYMemoryCacheShard *shard = _YYMemoryCacheGetShard(_shards, _shardMask, hash);
+    _YYLinkedMap *lru = &shard->lru;
     NSTimeInterval now = CACurrentMediaTime();
-    if (node) {
-        _lru->_totalCost -= node->_cost;
-        _lru->_totalCost += cost;
-        node->_cost = cost;
-        node->_time = now;
-        node->_value = object;
-        [_lru bringNodeToHead:node];
-    } else {
-        node = [_YYLinkedMapNode new];
-        node->_cost = cost;
-        node->_time = now;
-        node->_key = key;
-        node->_value = object;
-        [_lru insertNodeAtHead:node];
-    }
-    if (_lru->_totalCost > _costLimit) {
+    NSTimeInterval expire = ttl > 0 ? now + ttl : 0;
+    NSUInteger costLimit = _YYMemoryCacheShardLimit(_costLimit, _shardCount);
+    NSUInteger countLimit = _YYMemoryCacheShardLimit(_countLimit, _shardCount);
+    NSUInteger evictCount = 0;
+    pthread_mutex_lock(&shard->lock);
+    CFTypeRef oldValue = _YYMemoryCacheShardSet(lru, key, object, cost, hash, now, expire, countLimit, &evictCount);
+    if (lru->totalCost > costLimit) {
         dispatch_async(_queue, ^{
-            [self trimToCost:_costLimit];
+            [self _trimShard:shard toCost:costLimit];
         });
     }
-    if (_lru->_totalCount > _countLimit) {
-        _YYLinkedMapNode *node = [_lru removeTailNode];
-        if (_lru->_releaseAsynchronously) {
-            dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                [node class]; //hold and release in queue
-            });
-        } else if (_lru->_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [node class]; //hold and release in queue
+    pthread_mutex_unlock(&shard->lock);
+    if (oldValue) CFRelease(oldValue);
+    YYCacheMetrics *metrics = self.metrics;
+    if (metrics) {
+        [metrics recordSetWithCount:1 bytesWritten:cost latency:CACurrentMediaTime() - now];
+        if (evictCount) [metrics recordTrimWithEvictionCount:evictCount reason:YYCacheEvictionReasonCount latency:-1];
+    }
+}
+
+- (NSDictionary *)objectsForKeys:(NSArray *)keys {
+    NSUInteger count = keys.count;
+    if (count == 0) return [NSDictionary new];
+    uint64_t *hashes = malloc(sizeof(uint64_t) * count);
+    CFTypeRef *values = calloc(count, sizeof(CFTypeRef));
+    if (!hashes || !values) {
+        free(hashes);
+        free(values);
+        return [NSDictionary new];
+    }
+    uint64_t usedShards = 0; // bit set, there's at most 64 shards
+    for (NSUInteger i = 0; i < count; i++) {
+        hashes[i] = _YYMemoryCacheHash(keys[i]);
+        usedShards |= 1ULL << _YYMemoryCacheShardIndex(_shardMask, hashes[i]);
+    }
+    
+    // lock each shard once
+    NSTimeInterval now = CACurrentMediaTime();
+    NSUInteger cost = 0;
+    for (NSUInteger s = 0; s < _shardCount; s++) {
+        if (!(usedShards & (1ULL << s))) continue;
+        _YYMemoryCacheShard *shard = _shards + s;
+        pthread_mutex_lock(&shard->lock);
+        for (NSUInteger i = 0; i < count; i++) {
+            if (_YYMemoryCacheShardIndex(_shardMask, hashes[i]) != s) continue;
+            CFTypeRef value = _YYMemoryCacheShardGet(&shard->lru, (__bridge CFTypeRef)keys[i], hashes[i], now, &cost);
+            if (value) values[i] = CFRetain(value);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    
+    NSMutableDictionary *dic = [NSMutableDictionary dictionaryWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        if (values[i]) dic[keys[i]] = CFBridgingRelease(values[i]);
+    }
+    free(hashes);
+    free(values);
+    YYCacheMetrics *metrics = self.metrics;
+    if (metrics) [metrics recordGetWithHitCount:dic.count missCount:count - dic.count bytesRead:cost latency:CACurrentMediaTime() - now];
+    return dic;
+}
+
+- (void)setObjects:(NSArray *)objects forKeys:(NSArray *)keys {
+    NSUInteger count = keys.count;
+    if (count == 0 || objects.count != count) return;
+    uint64_t *hashes = malloc(sizeof(uint64_t) * count);
+    CFTypeRef *oldValues = calloc(count, sizeof(CFTypeRef));
+    if (!hashes || !oldValues) {
+        free(hashes);
+        free(oldValues);
+        return;
+    }
+    uint64_t usedShards = 0; // bit set, there's at most 64 shards
+    for (NSUInteger i = 0; i < count; i++) {
+        hashes[i] = _YYMemoryCacheHash(keys[i]);
+        usedShards |= 1ULL << _YYMemoryCacheShardIndex(_shardMask, hashes[i]);
+    }
+    
+    // lock each shard once
+    NSTimeInterval now = CACurrentMediaTime();
+    NSUInteger costLimit = _YYMemoryCacheShardLimit(_costLimit, _shardCount);
+    NSUInteger countLimit = _YYMemoryCacheShardLimit(_countLimit, _shardCount);
+    NSUInteger evictCount = 0;
+    for (NSUInteger s = 0; s < _shardCount; s++) {
+        if (!(usedShards & (1ULL << s))) continue;
+        _YYMemoryCacheShard *shard = _shards + s;
+        pthread_mutex_lock(&shard->lock);
+        for (NSUInteger i = 0; i < count; i++) {
+            if (_YYMemoryCacheShardIndex(_shardMask, hashes[i]) != s) continue;
+            oldValues[i] = _YYMemoryCacheShardSet(&shard->lru, keys[i], objects[i], 0, hashes[i], now, 0, countLimit, &evictCount);
+        }
+        if (shard->lru.totalCost > costLimit) {
+            dispatch_async(_queue, ^{
+                [self _trimShard:shard toCost:costLimit];
             });
         }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        if (oldValues[i]) CFRelease(oldValues[i]);
+    }
+    free(hashes);
+    free(oldValues);
+    YYCacheMetrics *metrics = self.metrics;
+    if (metrics) {
+        [metrics recordSetWithCount:count bytesWritten:0 latency:CACurrentMediaTime() - now];
+        if (evictCount) [metrics recordTrimWithEvictionCount:evictCount reason:YYCacheEvictionReasonCount latency:-1];
     }
-    pthread_mutex_unlock(&_lock);
 }
 
 - (void)removeObjectForKey:(id)key {
     if (!key) return;
-    pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
-    if (node) {
-        [_lru removeNode:node];
-        if (_lru->_releaseAsynchronously) {
-            dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                [node class]; //hold and release in queue
-            });
-        } else if (_lru->_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [node class]; //hold and release in queue
-            });
-        }
+    uint64_t hash = _YYMemoryCacheHash(key);
+    _YYMemoryCacheShard *shard = _YYMemoryCacheGetShard(_shards, _shardMask, hash);
+    _YYLinkedMap *lru = &shard->lru;
+    pthread_mutex_lock(&shard->lock);
+    uint32_t index = _YYLinkedMapFind(lru, (__bridge CFTypeRef)key, hash);
+    if (index != _YYLinkedMapNil) {
+        CFTypeRef nodeKey, nodeValue;
+        _YYLinkedMapRemove(lru, index, &nodeKey, &nodeValue);
+        _YYLinkedMapReleaseObjects(lru, nodeKey, nodeValue);
     }
-    pthread_mutex_unlock(&_lock);
+    pthread_mutex_unlock(&shard->lock);
 }
 
 - (void)removeAllObjects {
-    pthread_mutex_lock(&_lock);
-    [_lru removeAll];
-    pthread_mutex_unlock(&_lock);
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_mutex_lock(&_shards[i].lock);
+        _YYLinkedMapRemoveAll(&_shards[i].lru);
+        pthread_mutex_unlock(&_shards[i].lock);
+    }
 }
 
 - (void)trimToCount:(NSUInteger)count {
@@ -506,6 +1307,99 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
     [self _trimToAge:age];
 }
 
+- (NSArray *)recentlyUsedKeysWithLimit:(NSUInteger)limit costs:(NSArray<NSNumber *> **)costs {
+    NSMutableArray *keys = [NSMutableArray new];
+    NSMutableArray *costArray = costs ? [NSMutableArray new] : nil;
+    if (costs) *costs = costArray;
+    if (limit == 0) return keys;
+    
+    // each segment list is ordered by access time, so only its first `limit` nodes are needed
+    NSTimeInterval now = CACurrentMediaTime();
+    _YYMemoryCacheSnapshotEntry *entries = NULL;
+    NSUInteger count = 0, capacity = 0;
+    for (NSUInteger s = 0; s < _shardCount; s++) {
+        _YYMemoryCacheShard *shard = _shards + s;
+        pthread_mutex_lock(&shard->lock);
+        _YYLinkedMap *lru = &shard->lru;
+        NSUInteger need = 0;
+        for (int i = 0; i < _YYLinkedMapSegmentCount; i++) need += MIN(lru->counts[i], limit);
+        if (count + need > capacity) {
+            NSUInteger newCapacity = MAX(count + need, capacity * 2);
+            _YYMemoryCacheSnapshotEntry *newEntries = realloc(entries, sizeof(_YYMemoryCacheSnapshotEntry) * newCapacity);
+            if (!newEntries) {
+                pthread_mutex_unlock(&shard->lock);
+                break;
+            }
+            entries = newEntries;
+            capacity = newCapacity;
+        }
+        for (int i = 0; i < _YYLinkedMapSegmentCount; i++) {
+            NSUInteger n = 0;
+            for (uint32_t index = lru->heads[i]; index != _YYLinkedMapNil && n < limit; index = lru->nodes[index].next, n++) {
+                _YYLinkedMapNode *node = lru->nodes + index;
+                if (_YYLinkedMapNodeExpired(node, now)) continue;
+                entries[count].key = CFRetain(node->key);
+                entries[count].cost = node->cost;
+                entries[count].time = node->time;
+                count++;
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    
+    if (count > 1) qsort(entries, count, sizeof(_YYMemoryCacheSnapshotEntry), _YYMemoryCacheSnapshotEntryCompare);
+    for (NSUInteger i = 0; i < count; i++) {
+        if (i < limit) {
+            [keys addObject:(__bridge id)entries[i].key];
+            [costArray addObject:@(entries[i].cost)];
+        }
+        CFRelease(entries[i].key);
+    }
+    free(entries);
+    return keys;
+}
+
+- (BOOL)writeSnapshot {
+    NSString *path = self.snapshotPath;
+    if (path.length == 0) return NO;
+    NSArray *costs = nil;
+    NSArray *keys = [self recentlyUsedKeysWithLimit:self.snapshotLimit costs:&costs];
+    NSMutableArray *plistKeys = [NSMutableArray new];
+    NSMutableArray *plistCosts = [NSMutableArray new];
+    for (NSUInteger i = 0, max = keys.count; i < max; i++) {
+        id key = keys[i];
+        if ([key isKindOfClass:[NSString class]] || [key isKindOfClass:[NSNumber class]] ||
+            [key isKindOfClass:[NSData class]] || [key isKindOfClass:[NSDate class]]) {
+            [plistKeys addObject:key];
+            [plistCosts addObject:costs[i]];
+        }
+    }
+    // keep the last snapshot if the cache is emptied (such as entering background)
+    if (plistKeys.count == 0) return NO;
+    
+    NSDictionary *snapshot = @{@"version" : @(_YYMemoryCacheSnapshotVersion), @"keys" : plistKeys, @"costs" : plistCosts};
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:snapshot format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+    if (!data) return NO;
+    [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL];
+    return [data writeToFile:path atomically:YES];
+}
+
++ (NSArray *)keysFromSnapshotAtPath:(NSString *)path costs:(NSArray<NSNumber *> **)costs {
+    if (costs) *costs = nil;
+    if (path.length == 0) return nil;
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (!data) return nil;
+    NSDictionary *snapshot = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:NULL];
+    if (![snapshot isKindOfClass:[NSDictionary class]]) return nil;
+    if ([snapshot[@"version"] integerValue] != _YYMemoryCacheSnapshotVersion) return nil;
+    NSArray *keys = snapshot[@"keys"];
+    NSArray *costArray = snapshot[@"costs"];
+    if (![keys isKindOfClass:[NSArray class]] || ![costArray isKindOfClass:[NSArray class]]) return nil;
+    if (keys.count != costArray.count) return nil;
+    if (costs) *costs = costArray;
+    return keys;
+}
+
 - (NSString *)description {
     if (_name) return [NSString stringWithFormat:@"<%@: %p> (%@)", self.class, self, _name];
     else return [NSString stringWithFormat:@"<%@: %p>", self.class, self];
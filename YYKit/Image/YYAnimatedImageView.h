@@ -25,6 +25,12 @@ NS_ASSUME_NONNULL_BEGIN
  this view may cache some or all future frames in an inner buffer for lower CPU cost.
  Buffer size is dynamically adjusted based on the current state of the device memory.
  
+ All the playing views in process are driven by one timer and share one frame buffer
+ budget (see `globalMaxBufferSize`) and one decode queue, the frames are decoded in
+ order of the time they should be displayed, and the views which are not on screen
+ are decoded later. When the decoding cannot keep up, the views play with lower 
+ frame rate instead of some of them stall.
+ 
  Sample Code:
  
      // ani@3x.gif
@@ -80,6 +86,21 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic) NSUInteger maxBufferSize;
 
+/**
+ The max size (in bytes) for the frame buffers of all the playing views, default is 0
+ (dynamically, based on the device memory).
+ 
+ Each playing view gets an equal share of this budget, and its `maxBufferSize`
+ limits its share further.
+ */
++ (NSUInteger)globalMaxBufferSize;
+
+/**
+ Set the max size (in bytes) for the frame buffers of all the playing views.
+ 0 means the budget is dynamically adjusted based on the device memory.
+ */
++ (void)setGlobalMaxBufferSize:(NSUInteger)globalMaxBufferSize;
+
 @end
 
 
@@ -120,6 +141,12 @@ NS_ASSUME_NONNULL_BEGIN
 /// will be displayed. The rectangle should not outside the image's bounds.
 /// It may used to display sprite animation with a single image (sprite sheet).
 - (CGRect)animatedImageContentsRectAtIndex:(NSUInteger)index;
+
+/// Sets the memory limit in bytes of the decode state kept by the image to seek
+/// frames faster (such as canvas checkpoints of blended animation), 0 means none.
+/// YYAnimatedImageView gives a part of its buffer budget when not all frames can
+/// be buffered. This method may be called on background thread.
+- (void)animatedImageSetDecodeMemoryLimit:(NSUInteger)limit;
 @end
 
 NS_ASSUME_NONNULL_END
@@ -14,8 +14,10 @@
 #import "UIDevice+YYAdd.h"
 #import "YYImageCoder.h"
 #import "YYKitMacro.h"
+#import <libkern/OSAtomic.h>
 
 #define BUFFER_SIZE (10 * 1024 * 1024) // 10MB (minimum memory buffer size)
+#define INVISIBLE_DEADLINE_DELAY 0.5 // seconds, the fetch of invisible view is scheduled later
 
 #define LOCK(...) dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER); \
 __VA_ARGS__; \
@@ -40,9 +42,9 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     
     dispatch_once_t _onceToken;
     dispatch_semaphore_t _lock; ///< lock for _buffer
-    NSOperationQueue *_requestQueue; ///< image request queue, serial
+    NSOperation *_fetchOperation; ///< the last image request (pending or running), only accessed on main thread
     
-    CADisplayLink *_link; ///< ticker for change frame
+    BOOL _ticking; ///< whether the view is driven by coordinator's ticker
     NSTimeInterval _time; ///< time after last frame
     
     UIImage *_curFrame; ///< current frame to display
@@ -60,16 +62,47 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     
     CGRect _curContentsRect;
     BOOL _curImageHasContentsRect; ///< image has implementated "animatedImageContentsRectAtIndex:"
+    BOOL _curImageHasDecodeMemory; ///< image has implementated "animatedImageSetDecodeMemoryLimit:"
+    NSUInteger _decodeMemoryLimit; ///< decode memory limit given to current image
 }
 @property (nonatomic, readwrite) BOOL currentIsPlayingAnimation;
 - (void)calcMaxBufferCount;
+- (void)step:(CADisplayLink *)link;
 @end
 
+
+/**
+ The coordinator of all animated image views in process.
+ 
+ @discussion All the playing views are driven by one display link (per runloop mode),
+ share one frame buffer budget, and request frames with one decode queue. The requests
+ are scheduled by the deadline of next frame, the invisible views are scheduled later.
+ The pending requests are ordered by the absolute deadline, so a view that waits longer
+ gets higher priority, a throttled view plays with lower frame rate but never stalls.
+ 
+ All methods should be called on main thread, except `bufferSizeForView:` and `shouldYield`.
+ */
+@class _YYAnimatedImageViewFetchOperation;
+
+@interface _YYAnimatedImageCoordinator : NSObject
++ (instancetype)sharedCoordinator;
+@property (nonatomic) NSUInteger maxBufferSize; ///< global buffer budget, 0 means dynamically
+- (void)addView:(YYAnimatedImageView *)view;
+- (void)removeView:(YYAnimatedImageView *)view;
+- (void)enqueueOperation:(_YYAnimatedImageViewFetchOperation *)operation; ///< schedule a fetch operation by its deadline
+- (void)addOperation:(NSOperation *)operation;     ///< run an operation in decode queue immediately
+- (void)cancelOperation:(NSOperation *)operation;  ///< cancel an operation, a pending one is moved to decode queue to finish
+- (NSUInteger)bufferSizeForView:(YYAnimatedImageView *)view;
+- (BOOL)shouldYield; ///< whether a running fetch should stop early for others
+@end
+
+
 /// An operation for image fetch
 @interface _YYAnimatedImageViewFetchOperation : NSOperation
 @property (nonatomic, weak) YYAnimatedImageView *view;
 @property (nonatomic, assign) NSUInteger nextIndex;
 @property (nonatomic, strong) UIImage <YYAnimatedImage> *curImage;
+@property (nonatomic, assign) CFTimeInterval deadline; ///< the time when next frame should be displayed
 @end
 
 @implementation _YYAnimatedImageViewFetchOperation
@@ -78,7 +111,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     if (!view) return;
     if ([self isCancelled]) return;
     view->_incrBufferCount++;
-    if (view->_incrBufferCount == 0) [view calcMaxBufferCount];
+    [view calcMaxBufferCount]; // the share of global budget changes with the playing views
     if (view->_incrBufferCount > (NSInteger)view->_maxBufferCount) {
         view->_incrBufferCount = view->_maxBufferCount;
     }
@@ -87,10 +120,12 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     NSUInteger total = view->_totalFrameCount;
     view = nil;
     
+    _YYAnimatedImageCoordinator *coordinator = [_YYAnimatedImageCoordinator sharedCoordinator];
     for (int i = 0; i < max; i++, idx++) {
         @autoreleasepool {
             if (idx >= total) idx = 0;
             if ([self isCancelled]) break;
+            if (i > 0 && [coordinator shouldYield]) break; // the next frame is ready, let other views go first
             __strong YYAnimatedImageView *view = _view;
             if (!view) break;
             LOCK_VIEW(BOOL miss = (view->_buffer[@(idx)] == nil));
@@ -106,6 +141,171 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 }
 @end
 
+
+@implementation _YYAnimatedImageCoordinator {
+    NSMutableDictionary *_links;   ///< runloop mode -> CADisplayLink
+    NSMutableDictionary *_views;   ///< runloop mode -> NSHashTable<YYAnimatedImageView> (weak)
+    NSMutableArray *_pending;      ///< Array<_YYAnimatedImageViewFetchOperation>, not in queue yet
+    NSOperationQueue *_queue;      ///< decode queue shared by all views
+    volatile int32_t _viewCount;   ///< playing view count
+    volatile int32_t _pendingCount;
+    volatile int32_t _runningCount; ///< fetch operations in decode queue and not finished
+    volatile int64_t _deviceBufferSize; ///< buffer budget from device memory, updated once per tick
+}
+
++ (instancetype)sharedCoordinator {
+    static _YYAnimatedImageCoordinator *coordinator;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        coordinator = [self new];
+    });
+    return coordinator;
+}
+
+- (instancetype)init {
+    self = [super init];
+    _links = [NSMutableDictionary new];
+    _views = [NSMutableDictionary new];
+    _pending = [NSMutableArray new];
+    _queue = [NSOperationQueue new];
+    NSInteger count = [NSProcessInfo processInfo].activeProcessorCount - 1; // keep a core for main thread
+    _queue.maxConcurrentOperationCount = YY_CLAMP(count, 1, 4);
+    [self _updateDeviceBufferSize];
+    return self;
+}
+
+/// Read the free memory of device, it's a syscall, so it's called once per tick
+/// instead of once per fetch.
+- (void)_updateDeviceBufferSize {
+    int64_t total = [UIDevice currentDevice].memoryTotal;
+    int64_t free = [UIDevice currentDevice].memoryFree;
+    int64_t max = MIN(total * 0.2, free * 0.6);
+    _deviceBufferSize = MAX(max, BUFFER_SIZE);
+}
+
+- (void)addView:(YYAnimatedImageView *)view {
+    NSString *mode = view.runloopMode;
+    if (!mode.length) return; // not in any runloop, same as a paused ticker
+    NSHashTable *views = _views[mode];
+    if (!views) {
+        views = [NSHashTable weakObjectsHashTable];
+        _views[mode] = views;
+    }
+    if ([views containsObject:view]) return;
+    [views addObject:view];
+    OSAtomicIncrement32(&_viewCount);
+    
+    CADisplayLink *link = _links[mode];
+    if (!link) {
+        link = [CADisplayLink displayLinkWithTarget:[YYWeakProxy proxyWithTarget:self] selector:@selector(step:)];
+        [link addToRunLoop:[NSRunLoop mainRunLoop] forMode:mode];
+        _links[mode] = link;
+    }
+    link.paused = NO;
+}
+
+- (void)removeView:(YYAnimatedImageView *)view {
+    [_views enumerateKeysAndObjectsUsingBlock:^(NSString *mode, NSHashTable *views, BOOL *stop) {
+        if ([views containsObject:view]) {
+            [views removeObject:view];
+            OSAtomicDecrement32(&_viewCount);
+        }
+    }];
+}
+
+- (void)step:(CADisplayLink *)link {
+    NSString *mode = [_links allKeysForObject:link].firstObject;
+    NSHashTable *views = mode ? _views[mode] : nil;
+    NSArray *allViews = views.allObjects;
+    
+    // the deallocated views are removed from hash table without notification
+    int32_t count = 0;
+    for (NSHashTable *table in _views.allValues) count += (int32_t)table.allObjects.count;
+    _viewCount = count;
+    if (_maxBufferSize == 0) [self _updateDeviceBufferSize];
+    
+    if (allViews.count == 0) {
+        link.paused = YES;
+    } else {
+        for (YYAnimatedImageView *view in allViews) {
+            [view step:link];
+        }
+    }
+    [self _schedule];
+}
+
+- (void)enqueueOperation:(_YYAnimatedImageViewFetchOperation *)operation {
+    [_pending addObject:operation];
+    OSAtomicIncrement32(&_pendingCount);
+    [self _schedule];
+}
+
+- (void)addOperation:(NSOperation *)operation {
+    [_queue addOperation:operation];
+}
+
+- (void)cancelOperation:(NSOperation *)operation {
+    if (!operation) return;
+    [operation cancel];
+    NSUInteger index = [_pending indexOfObjectIdenticalTo:operation];
+    if (index != NSNotFound) {
+        // a cancelled operation finishes without running, but it should still finish,
+        // other operations (such as the trim after memory warning) may depend on it
+        [_pending removeObjectAtIndex:index];
+        OSAtomicDecrement32(&_pendingCount);
+        [_queue addOperation:operation];
+    }
+}
+
+/// Move the most urgent pending requests to decode queue.
+- (void)_schedule {
+    if (_pending.count == 0) return;
+    // finish the cancelled and orphaned operations first, they don't take a worker
+    for (NSInteger i = (NSInteger)_pending.count - 1; i >= 0; i--) {
+        _YYAnimatedImageViewFetchOperation *operation = _pending[i];
+        if (operation.isCancelled || !operation.view) {
+            [_pending removeObjectAtIndex:i];
+            OSAtomicDecrement32(&_pendingCount);
+            [_queue addOperation:operation];
+        }
+    }
+    // only the running fetches are counted, an operation waiting for its dependency
+    // (such as the trim after memory warning) doesn't take a worker
+    NSInteger idle = _queue.maxConcurrentOperationCount - (NSInteger)_runningCount;
+    if (_pending.count == 0 || idle <= 0) return;
+    [_pending sortUsingComparator:^NSComparisonResult(_YYAnimatedImageViewFetchOperation *op1, _YYAnimatedImageViewFetchOperation *op2) {
+        if (op1.deadline < op2.deadline) return NSOrderedAscending;
+        if (op1.deadline > op2.deadline) return NSOrderedDescending;
+        return NSOrderedSame;
+    }];
+    while (_pending.count && idle > 0) {
+        _YYAnimatedImageViewFetchOperation *operation = _pending.firstObject;
+        [_pending removeObjectAtIndex:0];
+        OSAtomicDecrement32(&_pendingCount);
+        OSAtomicIncrement32(&_runningCount);
+        operation.completionBlock = ^{
+            OSAtomicDecrement32(&self->_runningCount);
+        };
+        [_queue addOperation:operation];
+        idle--;
+    }
+}
+
+- (NSUInteger)bufferSizeForView:(YYAnimatedImageView *)view {
+    int64_t max = _maxBufferSize;
+    if (max == 0) max = _deviceBufferSize;
+    int32_t count = _viewCount;
+    if (count > 1) max /= count;
+    if (view.maxBufferSize) max = max > view.maxBufferSize ? view.maxBufferSize : max;
+    return (NSUInteger)max;
+}
+
+- (BOOL)shouldYield {
+    return _pendingCount > 0;
+}
+
+@end
+
 @implementation YYAnimatedImageView
 
 - (instancetype)init {
@@ -147,19 +347,12 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     dispatch_once(&_onceToken, ^{
         _lock = dispatch_semaphore_create(1);
         _buffer = [NSMutableDictionary new];
-        _requestQueue = [[NSOperationQueue alloc] init];
-        _requestQueue.maxConcurrentOperationCount = 1;
-        _link = [CADisplayLink displayLinkWithTarget:[YYWeakProxy proxyWithTarget:self] selector:@selector(step:)];
-        if (_runloopMode) {
-            [_link addToRunLoop:[NSRunLoop mainRunLoop] forMode:_runloopMode];
-        }
-        _link.paused = YES;
         
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
     });
     
-    [_requestQueue cancelAllOperations];
+    [self cancelFetch];
     LOCK(
          if (_buffer.count) {
              NSMutableDictionary *holder = _buffer;
@@ -171,13 +364,17 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
              });
          }
     );
-    _link.paused = YES;
+    [self setTicking:NO];
     _time = 0;
     if (_curIndex != 0) {
         [self willChangeValueForKey:@"currentAnimatedImageIndex"];
         _curIndex = 0;
         [self didChangeValueForKey:@"currentAnimatedImageIndex"];
     }
+    if (_decodeMemoryLimit) { // the memory was given from this view's share
+        [_curAnimatedImage animatedImageSetDecodeMemoryLimit:0];
+        _decodeMemoryLimit = 0;
+    }
     _curAnimatedImage = nil;
     _curFrame = nil;
     _curLoop = 0;
@@ -210,7 +407,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 
 - (void)setHighlighted:(BOOL)highlighted {
     [super setHighlighted:highlighted];
-    if (_link) [self resetAnimated];
+    if (_buffer) [self resetAnimated];
     [self imageChanged];
 }
 
@@ -240,7 +437,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 
 - (void)setImage:(id)image withType:(YYAnimatedImageType)type {
     [self stopAnimating];
-    if (_link) [self resetAnimated];
+    if (_buffer) [self resetAnimated];
     _curFrame = nil;
     switch (type) {
         case YYAnimatedImageTypeNone: break;
@@ -284,32 +481,65 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
         _curFrame = newVisibleImage;
         _totalLoop = _curAnimatedImage.animatedImageLoopCount;
         _totalFrameCount = _curAnimatedImage.animatedImageFrameCount;
+        _curImageHasDecodeMemory = [_curAnimatedImage respondsToSelector:@selector(animatedImageSetDecodeMemoryLimit:)];
+        _decodeMemoryLimit = 0;
         [self calcMaxBufferCount];
     }
     [self setNeedsDisplay];
     [self didMoved];
 }
 
-// dynamically adjust buffer size for current memory.
+// dynamically adjust buffer size for current memory and the playing views.
 - (void)calcMaxBufferCount {
     int64_t bytes = (int64_t)_curAnimatedImage.animatedImageBytesPerFrame;
     if (bytes == 0) bytes = 1024;
     
-    int64_t total = [UIDevice currentDevice].memoryTotal;
-    int64_t free = [UIDevice currentDevice].memoryFree;
-    int64_t max = MIN(total * 0.2, free * 0.6);
-    max = MAX(max, BUFFER_SIZE);
-    if (_maxBufferSize) max = max > _maxBufferSize ? _maxBufferSize : max;
+    int64_t max = [[_YYAnimatedImageCoordinator sharedCoordinator] bufferSizeForView:self];
+    
+    // If not all frames can be buffered, a quarter of the share is given to the image
+    // to seek frames faster (checkpoints of blended animation). It's rounded down to
+    // power of 2, so the image doesn't drop its state when the share changes slightly.
+    NSUInteger decodeMemory = 0;
+    if (_curImageHasDecodeMemory && max / bytes < (int64_t)_totalFrameCount && max >= 4) {
+        decodeMemory = (NSUInteger)1 << (NSUInteger)floor(log2(max / 4));
+        max -= decodeMemory;
+    }
+    if (decodeMemory != _decodeMemoryLimit) {
+        _decodeMemoryLimit = decodeMemory;
+        [_curAnimatedImage animatedImageSetDecodeMemoryLimit:decodeMemory];
+    }
+    
     double maxBufferCount = (double)max / (double)bytes;
     maxBufferCount = YY_CLAMP(maxBufferCount, 1, 512);
     _maxBufferCount = maxBufferCount;
 }
 
 - (void)dealloc {
-    [_requestQueue cancelAllOperations];
+    [_fetchOperation cancel];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
-    [_link invalidate];
+}
+
+- (void)cancelFetch {
+    [[_YYAnimatedImageCoordinator sharedCoordinator] cancelOperation:_fetchOperation];
+    _fetchOperation = nil;
+}
+
+/// Add to (or remove from) the coordinator's ticker.
+- (void)setTicking:(BOOL)ticking {
+    if (_ticking == ticking) return;
+    _ticking = ticking;
+    _YYAnimatedImageCoordinator *coordinator = [_YYAnimatedImageCoordinator sharedCoordinator];
+    if (ticking) [coordinator addView:self];
+    else [coordinator removeView:self];
+}
+
+/// Whether the view is on screen.
+- (BOOL)isVisible {
+    UIWindow *window = self.window;
+    if (!window || self.hidden || self.alpha < 0.01) return NO;
+    CGRect rect = [self convertRect:self.bounds toView:nil];
+    return CGRectIntersectsRect(rect, window.bounds);
 }
 
 - (BOOL)isAnimating {
@@ -318,8 +548,8 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 
 - (void)stopAnimating {
     [super stopAnimating];
-    [_requestQueue cancelAllOperations];
-    _link.paused = YES;
+    [self cancelFetch];
+    [self setTicking:NO];
     self.currentIsPlayingAnimation = NO;
 }
 
@@ -332,19 +562,24 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
             self.currentIsPlayingAnimation = YES;
         }
     } else {
-        if (_curAnimatedImage && _link.paused) {
+        if (_curAnimatedImage && !_ticking) {
             _curLoop = 0;
             _loopEnd = NO;
-            _link.paused = NO;
+            [self setTicking:YES];
             self.currentIsPlayingAnimation = YES;
         }
     }
 }
 
 - (void)didReceiveMemoryWarning:(NSNotification *)notification {
-    [_requestQueue cancelAllOperations];
-    [_requestQueue addOperationWithBlock: ^{
+    NSOperation *fetchOperation = _fetchOperation;
+    [self cancelFetch];
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock: ^{
         _incrBufferCount = -60 - (int)(arc4random() % 120); // about 1~3 seconds to grow back..
+        if (_decodeMemoryLimit) { // given back by the next `calcMaxBufferCount`
+            [_curAnimatedImage animatedImageSetDecodeMemoryLimit:0];
+            _decodeMemoryLimit = 0;
+        }
         NSNumber *next = @((_curIndex + 1) % _totalFrameCount);
         LOCK(
              NSArray * keys = _buffer.allKeys;
@@ -355,10 +590,14 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
              }
         )//LOCK
     }];
+    // run after the cancelled fetch, as the old serial request queue did
+    if (fetchOperation) [operation addDependency:fetchOperation];
+    _fetchOperation = operation;
+    [[_YYAnimatedImageCoordinator sharedCoordinator] addOperation:operation];
 }
 
 - (void)didEnterBackground:(NSNotification *)notification {
-    [_requestQueue cancelAllOperations];
+    [self cancelFetch];
     NSNumber *next = @((_curIndex + 1) % _totalFrameCount);
     LOCK(
          NSArray * keys = _buffer.allKeys;
@@ -429,12 +668,16 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
         [self.layer setNeedsDisplay]; // let system call `displayLayer:` before runloop sleep
     }
     
-    if (!bufferIsFull && _requestQueue.operationCount == 0) { // if some work not finished, wait for next opportunity
+    if (!bufferIsFull && (!_fetchOperation || _fetchOperation.isFinished)) { // if some work not finished, wait for next opportunity
         _YYAnimatedImageViewFetchOperation *operation = [_YYAnimatedImageViewFetchOperation new];
         operation.view = self;
         operation.nextIndex = nextIndex;
         operation.curImage = image;
-        [_requestQueue addOperation:operation];
+        // the time to show next frame, it's past if the frame is missed
+        NSTimeInterval remain = _bufferMiss ? 0 : [image animatedImageDurationAtIndex:_curIndex] - _time;
+        operation.deadline = CACurrentMediaTime() + MAX(remain, 0) + ([self isVisible] ? 0 : INVISIBLE_DEADLINE_DELAY);
+        _fetchOperation = operation;
+        [[_YYAnimatedImageCoordinator sharedCoordinator] enqueueOperation:operation];
     }
 }
 
@@ -492,7 +735,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     
     dispatch_async_on_main_queue(^{
         LOCK(
-             [_requestQueue cancelAllOperations];
+             [self cancelFetch];
              [_buffer removeAllObjects];
              [self willChangeValueForKey:@"currentAnimatedImageIndex"];
              _curIndex = currentAnimatedImageIndex;
@@ -515,15 +758,18 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 
 - (void)setRunloopMode:(NSString *)runloopMode {
     if ([_runloopMode isEqual:runloopMode]) return;
-    if (_link) {
-        if (_runloopMode) {
-            [_link removeFromRunLoop:[NSRunLoop mainRunLoop] forMode:_runloopMode];
-        }
-        if (runloopMode.length) {
-            [_link addToRunLoop:[NSRunLoop mainRunLoop] forMode:runloopMode];
-        }
-    }
+    BOOL ticking = _ticking;
+    [self setTicking:NO];
     _runloopMode = runloopMode.copy;
+    [self setTicking:ticking]; // move to the ticker of new mode
+}
+
++ (NSUInteger)globalMaxBufferSize {
+    return [_YYAnimatedImageCoordinator sharedCoordinator].maxBufferSize;
+}
+
++ (void)setGlobalMaxBufferSize:(NSUInteger)globalMaxBufferSize {
+    [_YYAnimatedImageCoordinator sharedCoordinator].maxBufferSize = globalMaxBufferSize;
 }
 
 #pragma mark - Overrice NSObject(NSKeyValueObservingCustomization)
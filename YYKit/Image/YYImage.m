@@ -164,6 +164,10 @@
     return [_decoder frameAtIndex:index decodeForDisplay:YES].image;
 }
 
+- (void)animatedImageSetDecodeMemoryLimit:(NSUInteger)limit {
+    _decoder.blendCheckpointMemoryLimit = limit;
+}
+
 - (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index {
     NSTimeInterval duration = [_decoder frameDurationAtIndex:index];
     
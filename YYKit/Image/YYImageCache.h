@@ -59,7 +59,13 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
 /** The underlying memory cache. see `YYMemoryCache` for more information.*/
 @property (strong, readonly) YYMemoryCache *memoryCache;
 
-/** The underlying disk cache. see `YYDiskCache` for more information.*/
+/** 
+ The underlying disk cache. see `YYDiskCache` for more information.
+ 
+ @discussion The disk cache reads the large image files with memory mapping 
+ (`fileMappingEnabled` is YES), and the mapped data is passed to YYImageDecoder 
+ without copying, so an animated image only keeps the pages it's decoding in memory.
+ */
 @property (strong, readonly) YYDiskCache *diskCache;
 
 /**
@@ -78,6 +84,43 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
  */
 @property BOOL decodeForDisplay;
 
+/**
+ If `YES`, a `YYCacheMetrics` is set to both `memoryCache` and `diskCache` (if they
+ don't have one), then the statistics of each tier can be read from their `metrics`.
+ Set to `NO` to remove the metrics. Default is NO.
+ */
+@property BOOL metricsEnabled;
+
+/**
+ If `YES`, the decoded images read from `diskCache` are also saved to `bitmapCache` 
+ as raw pixels, and the next disk read gets the image from there without decoding.
+ Default is NO.
+ 
+ @discussion Only the still images which are decoded for display (see 
+ `decodeForDisplay`) and not larger than `bitmapCacheImageCostLimit` are saved, so 
+ it's useful for the thumbnails which are displayed again and again. The raw pixels 
+ are much larger than the compressed image data, so it costs more disk space.
+ */
+@property BOOL bitmapCacheEnabled;
+
+/**
+ The optional third tier, which stores the decoded pixels in a raw format (a small
+ header with size, stride and bitmap info, followed by the pixels), in the `bitmap` 
+ directory under the cache path. It's nil if `bitmapCacheEnabled` is NO.
+ 
+ @discussion The pixel files are memory mapped and used by the CGImage's data provider
+ directly, so there's no copy or decode work. The default `costLimit` is 64MB.
+ The entry is removed when the image of the same key is set or removed with the 
+ disk type. An entry is used only while `diskCache` still contains the original data,
+ so the images removed from `diskCache` directly (such as `removeAllObjects`, or the
+ trims by its limits) are not served from here, the stale entry is removed when it's
+ found, or evicted by the `costLimit` of this cache.
+ */
+@property (nullable, strong, readonly) YYDiskCache *bitmapCache;
+
+/** The maximum cost (decoded bytes) of an image saved to `bitmapCache`. Default is 1MB. */
+@property NSUInteger bitmapCacheImageCostLimit;
+
 
 #pragma mark - Initializer
 ///=============================================================================
@@ -103,6 +146,34 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
 - (nullable instancetype)initWithPath:(NSString *)path NS_DESIGNATED_INITIALIZER;
 
 
+#pragma mark - Warm Start
+///=============================================================================
+/// @name Warm Start
+///=============================================================================
+
+/**
+ Load the images which were in memory cache at the end of last launch from disk
+ cache to memory cache (decoded) in background, from the most recently used one, 
+ so the first screens can get the images from memory.
+ 
+ @discussion The keys are read from the snapshot of `memoryCache`, which is saved 
+ in the cache directory (see `YYMemoryCache.snapshotPath`). The initializer calls
+ this method with a default budget (64 images, 32MB cost and 2 seconds) if there's
+ a snapshot. The images which are already in memory cache are skipped.
+ 
+ @param countLimit The maximum number of images to load.
+ @param costLimit  The maximum total cost (decoded bytes) of the loaded images.
+ @param timeLimit  The maximum time in seconds to spend, the images not loaded 
+     in time are skipped.
+ @param completion A block which will be called on main thread with the number 
+     of loaded images, or nil.
+ */
+- (void)warmUpWithCountLimit:(NSUInteger)countLimit
+                   costLimit:(NSUInteger)costLimit
+                   timeLimit:(NSTimeInterval)timeLimit
+                  completion:(nullable void(^)(NSUInteger loadedCount))completion;
+
+
 #pragma mark - Access Methods
 ///=============================================================================
 /// @name Access Methods
@@ -197,6 +268,10 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
 /**
  Asynchronously get the image associated with a given key.
  
+ @discussion If the image is not in memory, and there's already a request of the same
+ key and type reading from disk, the block waits for that request and receives the
+ same image, instead of reading and decoding the image data again.
+ 
  @param key   A string identifying the image. If nil, just return nil.
  @param type  The cache type.
  @param block A completion block which will be called on main thread.
@@ -223,6 +298,59 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
 - (void)getImageDataForKey:(NSString *)key
                  withBlock:(void(^)(NSData * _Nullable imageData))block;
 
+#pragma mark - Size Variant
+///=============================================================================
+/// @name Size Variant
+///=============================================================================
+
+/**
+ Returns the memory cache key of the variant which is downsampled to a pixel size.
+ 
+ @param key          The key of the original image.
+ @param maxPixelSize The maximum width and height of the variant in pixels.
+ @return The variant key, or the original key if `maxPixelSize` is 0.
+ */
++ (NSString *)variantKeyForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize;
+
+/**
+ Returns a downsampled image associated with a given key.
+ 
+ @discussion The variants are only kept in memory cache (with the variant key), the 
+ disk cache only has the original image data. The image is returned in this order:
+ 
+ 1. The variant of the same size in memory.
+ 2. Downsampled from the nearest larger variant (or the original image) in memory.
+ 3. Decoded from disk with downsampling, so the full size bitmap is not created.
+ 
+ The variant is a still image (the first frame of an animated image). It's removed 
+ when the image of the key is set or removed from memory cache.
+ 
+ If the variant is not in memory and the `type` contains `YYImageCacheTypeDisk`,
+ this method may blocks the calling thread until file read finished.
+ 
+ @param key          A string identifying the image. If nil, just return nil.
+ @param maxPixelSize The maximum width and height of the image in pixels, the aspect 
+    ratio is kept. The image is not scaled up. 0 means the original image.
+ @param type         The cache type.
+ @return The image associated with key, or nil if no image is associated with key.
+ */
+- (nullable UIImage *)getImageForKey:(NSString *)key
+                        maxPixelSize:(NSUInteger)maxPixelSize
+                            withType:(YYImageCacheType)type;
+
+/**
+ Asynchronously get a downsampled image associated with a given key.
+ 
+ @param key          A string identifying the image. If nil, just return nil.
+ @param maxPixelSize The maximum width and height of the image in pixels.
+ @param type         The cache type.
+ @param block        A completion block which will be called on main thread.
+ */
+- (void)getImageForKey:(NSString *)key
+          maxPixelSize:(NSUInteger)maxPixelSize
+              withType:(YYImageCacheType)type
+             withBlock:(void(^)(UIImage * _Nullable image, YYImageCacheType type))block;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -12,9 +12,12 @@
 #import "YYImageCache.h"
 #import "YYMemoryCache.h"
 #import "YYDiskCache.h"
+#import "YYCacheMetrics.h"
 #import "UIImage+YYAdd.h"
 #import "NSObject+YYAdd.h"
 #import "YYImage.h"
+#import <QuartzCore/QuartzCore.h>
+#import <pthread.h>
 
 #if __has_include("YYDispatchQueuePool.h")
 #import "YYDispatchQueuePool.h"
@@ -37,14 +40,123 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
 #endif
 }
 
+static NSString *const kYYImageCacheSnapshotName = @"memory_snapshot.plist";
+static const NSUInteger kYYImageCacheWarmStartCountLimit = 64;
+static const NSUInteger kYYImageCacheWarmStartCostLimit = 32 * 1024 * 1024;
+static const NSTimeInterval kYYImageCacheWarmStartTimeLimit = 2.0;
+static NSString *const kYYImageCacheBitmapDirectoryName = @"bitmap";
+static const NSUInteger kYYImageCacheVariantIndexLimit = 1024;
+
+
+/**
+ The header of the data in bitmap tier, it's followed by the pixels (bytesPerRow * height).
+ The values are in host byte order, as the pixels are. The header is 64 bytes, so the
+ rows of a memory mapped file are aligned to cache line.
+ */
+typedef struct {
+    uint32_t magic;       // 'YYBM'
+    uint32_t version;     // 1
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerRow;
+    uint32_t bitmapInfo;  // CGBitmapInfo, 8 bits per component, 32 bits per pixel, device RGB
+    float scale;
+    uint32_t orientation; // UIImageOrientation
+    uint8_t reserved[32];
+} _YYImageCacheBitmapHeader;
+
+#define YYImageCacheBitmapMagic 0x4D425959 // "YYBM" in little endian
+#define YYImageCacheBitmapVersion 1
+
+/// Returns the data for bitmap tier, or nil if the image is not a decoded RGB bitmap.
+static NSData *YYImageCacheCreateBitmapData(UIImage *image) {
+    CGImageRef imageRef = image.CGImage;
+    if (!imageRef) return nil;
+    if (CGImageGetBitsPerComponent(imageRef) != 8 || CGImageGetBitsPerPixel(imageRef) != 32) return nil;
+    CGColorSpaceRef space = CGImageGetColorSpace(imageRef);
+    if (!space || CGColorSpaceGetModel(space) != kCGColorSpaceModelRGB) return nil;
+    CGBitmapInfo bitmapInfo = CGImageGetBitmapInfo(imageRef);
+    if (bitmapInfo & kCGBitmapFloatComponents) return nil;
+    size_t width = CGImageGetWidth(imageRef);
+    size_t height = CGImageGetHeight(imageRef);
+    size_t bytesPerRow = CGImageGetBytesPerRow(imageRef);
+    if (width == 0 || height == 0 || width > UINT32_MAX || height > UINT32_MAX || bytesPerRow > UINT32_MAX) return nil;
+    
+    CGDataProviderRef provider = CGImageGetDataProvider(imageRef);
+    CFDataRef pixels = provider ? CGDataProviderCopyData(provider) : NULL;
+    if (!pixels) return nil;
+    size_t length = bytesPerRow * height;
+    if ((size_t)CFDataGetLength(pixels) < length) {
+        CFRelease(pixels);
+        return nil;
+    }
+    
+    _YYImageCacheBitmapHeader header = {0};
+    header.magic = YYImageCacheBitmapMagic;
+    header.version = YYImageCacheBitmapVersion;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.bytesPerRow = (uint32_t)bytesPerRow;
+    header.bitmapInfo = bitmapInfo;
+    header.scale = image.scale;
+    header.orientation = (uint32_t)image.imageOrientation;
+    NSMutableData *data = [NSMutableData dataWithCapacity:sizeof(header) + length];
+    [data appendBytes:&header length:sizeof(header)];
+    [data appendBytes:CFDataGetBytePtr(pixels) length:length];
+    CFRelease(pixels);
+    return data;
+}
+
+static void YYImageCacheReleaseBitmapData(void *info, const void *data, size_t size) {
+    CFRelease(info);
+}
+
+/// Returns the image which uses the pixels in data directly (no copy, no decode).
+static UIImage *YYImageCacheImageWithBitmapData(NSData *data) {
+    if (data.length < sizeof(_YYImageCacheBitmapHeader)) return nil;
+    _YYImageCacheBitmapHeader header;
+    memcpy(&header, data.bytes, sizeof(header));
+    if (header.magic != YYImageCacheBitmapMagic || header.version != YYImageCacheBitmapVersion) return nil;
+    if (header.width == 0 || header.height == 0 || header.bytesPerRow < (uint64_t)header.width * 4) return nil;
+    if (!(header.scale > 0) || header.orientation > UIImageOrientationRightMirrored) return nil;
+    uint64_t length = (uint64_t)header.bytesPerRow * header.height;
+    if (data.length - sizeof(header) < length) return nil;
+    
+    const uint8_t *pixels = (const uint8_t *)data.bytes + sizeof(header);
+    CGDataProviderRef provider = CGDataProviderCreateWithData((__bridge_retained void *)data, pixels, (size_t)length, YYImageCacheReleaseBitmapData);
+    if (!provider) {
+        CFRelease((__bridge CFTypeRef)data);
+        return nil;
+    }
+    CGImageRef imageRef = CGImageCreate(header.width, header.height, 8, 32, header.bytesPerRow, YYCGColorSpaceGetDeviceRGB(), header.bitmapInfo, provider, NULL, NO, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+    if (!imageRef) return nil;
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:header.scale orientation:(UIImageOrientation)header.orientation];
+    CGImageRelease(imageRef);
+    image.isDecodedForDisplay = YES;
+    return image;
+}
+
 
 @interface YYImageCache ()
+@property (nullable, strong, readwrite) YYDiskCache *bitmapCache;
 - (NSUInteger)imageCost:(UIImage *)image;
 - (UIImage *)imageFromData:(NSData *)data;
 @end
 
 
-@implementation YYImageCache
+@implementation YYImageCache {
+    pthread_mutex_t _flightLock;
+    NSMutableDictionary *_diskFlights; ///< key -> NSMutableArray<block>, YYImageCacheTypeDisk requests in flight
+    NSMutableDictionary *_allFlights;  ///< key -> NSMutableArray<block>, YYImageCacheTypeAll requests in flight
+    pthread_mutex_t _variantLock;
+    NSMutableDictionary *_variantSizes; ///< key -> NSMutableIndexSet, the pixel sizes of variants set to memory cache
+    NSUInteger _variantPruneCount;      ///< the evicted variants are removed from index when its count reaches this value
+    pthread_mutex_t _generationLock;
+    uint64_t _diskGeneration;           ///< increased when an image in disk cache is set or removed
+    NSUInteger _diskReadCount;          ///< disk reads in progress (including the bitmap writes after them)
+    NSMutableDictionary *_diskGenerations; ///< key -> NSNumber, the generation when the key changed, kept only while reading
+}
 
 - (NSUInteger)imageCost:(UIImage *)image {
     CGImageRef cgImage = image.CGImage;
@@ -56,13 +168,105 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     return cost;
 }
 
-- (UIImage *)imageFromData:(NSData *)data {
+/// Whether the image can be saved to bitmap tier.
+- (BOOL)_shouldSaveBitmapOfImage:(UIImage *)image {
+    if (!image.isDecodedForDisplay || image.images.count > 1) return NO;
+    if ([image conformsToProtocol:@protocol(YYAnimatedImage)] &&
+        [(id<YYAnimatedImage>)image animatedImageFrameCount] > 1) return NO;
+    return [self imageCost:image] <= self.bitmapCacheImageCostLimit;
+}
+
+/// Returns the current disk generation, call it before reading disk cache and
+/// balance it with `_endDiskRead`.
+- (uint64_t)_beginDiskRead {
+    pthread_mutex_lock(&_generationLock);
+    uint64_t generation = _diskGeneration;
+    _diskReadCount++;
+    pthread_mutex_unlock(&_generationLock);
+    return generation;
+}
+
+/// Returns whether the key is not changed since the generation.
+- (BOOL)_isDiskKey:(NSString *)key unchangedSince:(uint64_t)generation {
+    pthread_mutex_lock(&_generationLock);
+    BOOL unchanged = [_diskGenerations[key] unsignedLongLongValue] <= generation;
+    pthread_mutex_unlock(&_generationLock);
+    return unchanged;
+}
+
+- (void)_endDiskRead {
+    pthread_mutex_lock(&_generationLock);
+    if (_diskReadCount > 0) _diskReadCount--;
+    if (_diskReadCount == 0 && _diskGenerations.count) [_diskGenerations removeAllObjects];
+    pthread_mutex_unlock(&_generationLock);
+}
+
+/// Call it after the image in disk cache is set or removed, the bitmap created
+/// from old data is removed, and the bitmap writes in progress are skipped.
+- (void)_diskImageDidChangeForKey:(NSString *)key {
+    pthread_mutex_lock(&_generationLock);
+    _diskGeneration++;
+    if (_diskReadCount > 0) _diskGenerations[key] = @(_diskGeneration);
+    pthread_mutex_unlock(&_generationLock);
+    [self.bitmapCache removeObjectForKey:key];
+}
+
+/// Returns the image from bitmap tier. The entry is used only while the original
+/// data is still in disk cache, which may be emptied or trimmed without this cache
+/// knowing it, the stale entry is removed.
+- (UIImage *)_bitmapImageForKey:(NSString *)key {
+    YYDiskCache *bitmapCache = self.bitmapCache;
+    if (!bitmapCache) return nil;
+    NSData *data = (id)[bitmapCache objectForKey:key];
+    if (!data) return nil;
+    if (![_diskCache containsObjectForKey:key]) {
+        [bitmapCache removeObjectForKey:key];
+        return nil;
+    }
+    return YYImageCacheImageWithBitmapData(data);
+}
+
+/// Returns the image from bitmap tier or disk cache, the image decoded from
+/// disk cache is saved to bitmap tier in background.
+- (UIImage *)_diskImageForKey:(NSString *)key {
+    UIImage *bitmapImage = [self _bitmapImageForKey:key];
+    if (bitmapImage) return bitmapImage;
+    YYDiskCache *bitmapCache = self.bitmapCache;
+    uint64_t generation = [self _beginDiskRead];
+    UIImage *image = [self imageFromData:(id)[_diskCache objectForKey:key]];
+    if (image && bitmapCache && [self _shouldSaveBitmapOfImage:image]) {
+        __weak typeof(self) _self = self;
+        dispatch_async(YYImageCacheIOQueue(), ^{
+            __strong typeof(_self) self = _self;
+            if (!self) return;
+            // the data may be set or removed since it's read, don't bring the old one back
+            if ([self _isDiskKey:key unchangedSince:generation]) {
+                NSData *data = YYImageCacheCreateBitmapData(image);
+                if (data) [bitmapCache setObject:data forKey:key];
+                // changed during the write, it may have missed the removal
+                if (![self _isDiskKey:key unchangedSince:generation]) [bitmapCache removeObjectForKey:key];
+            }
+            [self _endDiskRead];
+        });
+    } else {
+        [self _endDiskRead];
+    }
+    return image;
+}
+
+/// Returns the image scale saved with the data, or the screen scale.
+- (CGFloat)_scaleOfImageData:(NSData *)data {
     NSData *scaleData = [YYDiskCache getExtendedDataFromObject:data];
     CGFloat scale = 0;
     if (scaleData) {
         scale = ((NSNumber *)[NSKeyedUnarchiver unarchiveObjectWithData:scaleData]).doubleValue;
     }
     if (scale <= 0) scale = [UIScreen mainScreen].scale;
+    return scale;
+}
+
+- (UIImage *)imageFromData:(NSData *)data {
+    CGFloat scale = [self _scaleOfImageData:data];
     UIImage *image;
     if (_allowAnimatedImage) {
         image = [[YYImage alloc] initWithData:data scale:scale];
@@ -105,6 +309,7 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     YYDiskCache *diskCache = [[YYDiskCache alloc] initWithPath:path];
     diskCache.customArchiveBlock = ^(id object) { return (NSData *)object; };
     diskCache.customUnarchiveBlock = ^(NSData *data) { return (id)data; };
+    diskCache.fileMappingEnabled = YES; // the data is passed to decoder directly
     if (!memoryCache || !diskCache) return nil;
     
     self = [super init];
@@ -112,9 +317,117 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     _diskCache = diskCache;
     _allowAnimatedImage = YES;
     _decodeForDisplay = YES;
+    pthread_mutex_init(&_flightLock, NULL);
+    _diskFlights = [NSMutableDictionary new];
+    _allFlights = [NSMutableDictionary new];
+    _bitmapCacheImageCostLimit = 1024 * 1024;
+    pthread_mutex_init(&_variantLock, NULL);
+    _variantSizes = [NSMutableDictionary new];
+    _variantPruneCount = kYYImageCacheVariantIndexLimit;
+    pthread_mutex_init(&_generationLock, NULL);
+    _diskGenerations = [NSMutableDictionary new];
+    
+    // the snapshot of last launch is read before it's overwritten
+    NSString *snapshotPath = [path stringByAppendingPathComponent:kYYImageCacheSnapshotName];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:snapshotPath]) {
+        [self warmUpWithCountLimit:kYYImageCacheWarmStartCountLimit
+                         costLimit:kYYImageCacheWarmStartCostLimit
+                         timeLimit:kYYImageCacheWarmStartTimeLimit
+                        completion:nil];
+    }
+    memoryCache.snapshotPath = snapshotPath;
+    
+    // the variants are removed with all objects, so is the index
+    __weak typeof(self) _self = self;
+    memoryCache.didReceiveMemoryWarningBlock = ^(YYMemoryCache *cache) {
+        if (cache.shouldRemoveAllObjectsOnMemoryWarning) [_self _removeAllVariantSizes];
+    };
+    memoryCache.didEnterBackgroundBlock = ^(YYMemoryCache *cache) {
+        if (cache.shouldRemoveAllObjectsWhenEnteringBackground) [_self _removeAllVariantSizes];
+    };
     return self;
 }
 
+- (void)dealloc {
+    pthread_mutex_destroy(&_flightLock);
+    pthread_mutex_destroy(&_variantLock);
+    pthread_mutex_destroy(&_generationLock);
+}
+
+- (void)warmUpWithCountLimit:(NSUInteger)countLimit
+                   costLimit:(NSUInteger)costLimit
+                   timeLimit:(NSTimeInterval)timeLimit
+                  completion:(void(^)(NSUInteger loadedCount))completion {
+    NSString *snapshotPath = [_diskCache.path stringByAppendingPathComponent:kYYImageCacheSnapshotName];
+    NSArray *costs = nil;
+    NSArray *keys = [YYMemoryCache keysFromSnapshotAtPath:snapshotPath costs:&costs];
+    __weak typeof(self) _self = self;
+    dispatch_async(YYImageCacheDecodeQueue(), ^{
+        __strong typeof(_self) self = _self;
+        NSUInteger loadedCount = 0;
+        if (self && keys.count && countLimit > 0 && costLimit > 0 && timeLimit > 0) {
+            NSTimeInterval begin = CACurrentMediaTime();
+            NSUInteger totalCost = 0;
+            for (NSUInteger i = 0, max = keys.count; i < max && loadedCount < countLimit; i++) {
+                if (CACurrentMediaTime() - begin > timeLimit) break;
+                NSString *key = keys[i];
+                if (![key isKindOfClass:[NSString class]]) continue;
+                // the cost in snapshot is the decoded size, skip the large image before reading it
+                NSUInteger cost = [costs[i] unsignedIntegerValue];
+                if (totalCost + cost > costLimit) continue;
+                if ([self.memoryCache containsObjectForKey:key]) continue;
+                
+                UIImage *image = [self _diskImageForKey:key];
+                if (!image) continue;
+                cost = [self imageCost:image];
+                if (totalCost + cost > costLimit) continue;
+                if ([self.memoryCache containsObjectForKey:key]) continue; // set by others
+                [self.memoryCache setObject:image forKey:key withCost:cost];
+                totalCost += cost;
+                loadedCount++;
+            }
+        }
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(loadedCount);
+            });
+        }
+    });
+}
+
+- (BOOL)bitmapCacheEnabled {
+    return self.bitmapCache != nil;
+}
+
+- (void)setBitmapCacheEnabled:(BOOL)bitmapCacheEnabled {
+    if (!bitmapCacheEnabled) {
+        self.bitmapCache = nil;
+        return;
+    }
+    if (self.bitmapCache) return;
+    NSString *path = [_diskCache.path stringByAppendingPathComponent:kYYImageCacheBitmapDirectoryName];
+    YYDiskCache *bitmapCache = [[YYDiskCache alloc] initWithPath:path inlineThreshold:0]; // files can be mapped
+    bitmapCache.customArchiveBlock = ^(id object) { return (NSData *)object; };
+    bitmapCache.customUnarchiveBlock = ^(NSData *data) { return (id)data; };
+    bitmapCache.fileMappingEnabled = YES;
+    bitmapCache.costLimit = 64 * 1024 * 1024;
+    self.bitmapCache = bitmapCache;
+}
+
+- (BOOL)metricsEnabled {
+    return _memoryCache.metrics != nil;
+}
+
+- (void)setMetricsEnabled:(BOOL)metricsEnabled {
+    if (metricsEnabled) {
+        if (!_memoryCache.metrics) _memoryCache.metrics = [YYCacheMetrics new];
+        if (!_diskCache.metrics) _diskCache.metrics = [YYCacheMetrics new];
+    } else {
+        _memoryCache.metrics = nil;
+        _diskCache.metrics = nil;
+    }
+}
+
 - (void)setImage:(UIImage *)image forKey:(NSString *)key {
     [self setImage:image imageData:nil forKey:key withType:YYImageCacheTypeAll];
 }
@@ -124,6 +437,7 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     
     __weak typeof(self) _self = self;
     if (type & YYImageCacheTypeMemory) { // add to memory cache
+        [self _removeVariantsForKey:key]; // it's created from the old image
         if (image) {
             if (image.isDecodedForDisplay) {
                 [_memoryCache setObject:image forKey:key withCost:[_self imageCost:image]];
@@ -144,11 +458,13 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
         }
     }
     if (type & YYImageCacheTypeDisk) { // add to disk cache
+        [self.bitmapCache removeObjectForKey:key]; // it's created from the old data
         if (imageData) {
             if (image) {
                 [YYDiskCache setExtendedData:[NSKeyedArchiver archivedDataWithRootObject:@(image.scale)] toObject:imageData];
             }
             [_diskCache setObject:imageData forKey:key];
+            [self _diskImageDidChangeForKey:key];
         } else if (image) {
             dispatch_async(YYImageCacheIOQueue(), ^{
                 __strong typeof(_self) self = _self;
@@ -156,6 +472,7 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
                 NSData *data = [image imageDataRepresentation];
                 [YYDiskCache setExtendedData:[NSKeyedArchiver archivedDataWithRootObject:@(image.scale)] toObject:data];
                 [self.diskCache setObject:data forKey:key];
+                [self _diskImageDidChangeForKey:key];
             });
         }
     }
@@ -166,8 +483,14 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
 }
 
 - (void)removeImageForKey:(NSString *)key withType:(YYImageCacheType)type {
-    if (type & YYImageCacheTypeMemory) [_memoryCache removeObjectForKey:key];
-    if (type & YYImageCacheTypeDisk) [_diskCache removeObjectForKey:key];
+    if (type & YYImageCacheTypeMemory) {
+        [_memoryCache removeObjectForKey:key];
+        [self _removeVariantsForKey:key];
+    }
+    if (type & YYImageCacheTypeDisk) {
+        [_diskCache removeObjectForKey:key];
+        [self _diskImageDidChangeForKey:key];
+    }
 }
 
 - (BOOL)containsImageForKey:(NSString *)key {
@@ -179,7 +502,7 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
         if ([_memoryCache containsObjectForKey:key]) return YES;
     }
     if (type & YYImageCacheTypeDisk) {
-        if ([_diskCache containsObjectForKey:key]) return YES;
+        if ([_diskCache containsObjectForKey:key]) return YES; // the bitmap tier is valid only with it
     }
     return NO;
 }
@@ -195,8 +518,7 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
         if (image) return image;
     }
     if (type & YYImageCacheTypeDisk) {
-        NSData *data = (id)[_diskCache objectForKey:key];
-        UIImage *image = [self imageFromData:data];
+        UIImage *image = [self _diskImageForKey:key];
         if (image && (type & YYImageCacheTypeMemory)) {
             [_memoryCache setObject:image forKey:key withCost:[self imageCost:image]];
         }
@@ -220,16 +542,35 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
             }
         }
         
-        if (type & YYImageCacheTypeDisk) {
-            NSData *data = (id)[_diskCache objectForKey:key];
-            image = [self imageFromData:data];
-            if (image) {
-                [_memoryCache setObject:image forKey:key];
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    block(image, YYImageCacheTypeDisk);
-                });
+        if ((type & YYImageCacheTypeDisk) && key) {
+            // the concurrent requests of the same key and type share one disk read and decode
+            NSMutableDictionary *flights = (type & YYImageCacheTypeMemory) ? _allFlights : _diskFlights;
+            pthread_mutex_lock(&_flightLock);
+            NSMutableArray *waiters = flights[key];
+            if (waiters) {
+                [waiters addObject:[block copy]];
+                pthread_mutex_unlock(&_flightLock);
                 return;
             }
+            flights[key] = [NSMutableArray arrayWithObject:[block copy]];
+            pthread_mutex_unlock(&_flightLock);
+            
+            image = [self _diskImageForKey:key];
+            if (image && (type & YYImageCacheTypeMemory)) {
+                [_memoryCache setObject:image forKey:key withCost:[self imageCost:image]];
+            }
+            
+            pthread_mutex_lock(&_flightLock);
+            waiters = flights[key];
+            [flights removeObjectForKey:key];
+            pthread_mutex_unlock(&_flightLock);
+            YYImageCacheType resultType = image ? YYImageCacheTypeDisk : YYImageCacheTypeNone;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                for (void (^waiter)(UIImage *image, YYImageCacheType type) in waiters) {
+                    waiter(image, resultType);
+                }
+            });
+            return;
         }
         
         dispatch_async(dispatch_get_main_queue(), ^{
@@ -252,4 +593,156 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     });
 }
 
+#pragma mark Size Variant
+
++ (NSString *)variantKeyForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize {
+    if (maxPixelSize == 0) return key;
+    return [NSString stringWithFormat:@"%@#yy_px%lu", key, (unsigned long)maxPixelSize];
+}
+
+/// Returns the image scaled down to fit maxPixelSize, or the image itself if it's small enough.
+- (UIImage *)_imageByDownsamplingImage:(UIImage *)image maxPixelSize:(NSUInteger)maxPixelSize {
+    CGImageRef imageRef = image.CGImage;
+    if (!imageRef) return nil;
+    if (MAX(CGImageGetWidth(imageRef), CGImageGetHeight(imageRef)) <= maxPixelSize) return image;
+    CGImageRef newImageRef = YYCGImageCreateDownsampledCopy(imageRef, maxPixelSize);
+    if (!newImageRef) return nil;
+    UIImage *newImage = [UIImage imageWithCGImage:newImageRef scale:image.scale orientation:image.imageOrientation];
+    CGImageRelease(newImageRef);
+    newImage.isDecodedForDisplay = YES;
+    return newImage;
+}
+
+- (void)_setVariant:(UIImage *)image forKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize {
+    [_memoryCache setObject:image forKey:[YYImageCache variantKeyForKey:key maxPixelSize:maxPixelSize] withCost:[self imageCost:image]];
+    pthread_mutex_lock(&_variantLock);
+    NSMutableIndexSet *sizes = _variantSizes[key];
+    if (!sizes) {
+        sizes = [NSMutableIndexSet new];
+        _variantSizes[key] = sizes;
+    }
+    [sizes addIndex:maxPixelSize];
+    if (_variantSizes.count >= _variantPruneCount) [self _pruneVariantSizes];
+    pthread_mutex_unlock(&_variantLock);
+}
+
+/// Remove the sizes of the variants evicted from memory cache, the lock should be held.
+- (void)_pruneVariantSizes {
+    YYMemoryCache *memoryCache = _memoryCache;
+    for (NSString *key in _variantSizes.allKeys) {
+        NSMutableIndexSet *sizes = _variantSizes[key];
+        NSMutableIndexSet *evicted = [NSMutableIndexSet new];
+        [sizes enumerateIndexesUsingBlock:^(NSUInteger size, BOOL *stop) {
+            if (![memoryCache containsObjectForKey:[YYImageCache variantKeyForKey:key maxPixelSize:size]]) [evicted addIndex:size];
+        }];
+        [sizes removeIndexes:evicted];
+        if (sizes.count == 0) [_variantSizes removeObjectForKey:key];
+    }
+    // the variants still in memory are not pruned again until the index doubles
+    _variantPruneCount = MAX(kYYImageCacheVariantIndexLimit, _variantSizes.count * 2);
+}
+
+- (void)_removeAllVariantSizes {
+    pthread_mutex_lock(&_variantLock);
+    [_variantSizes removeAllObjects];
+    _variantPruneCount = kYYImageCacheVariantIndexLimit;
+    pthread_mutex_unlock(&_variantLock);
+}
+
+/// Remove a size from the index, the variant is evicted from memory cache.
+- (void)_removeVariantSize:(NSUInteger)maxPixelSize forKey:(NSString *)key {
+    pthread_mutex_lock(&_variantLock);
+    NSMutableIndexSet *sizes = _variantSizes[key];
+    [sizes removeIndex:maxPixelSize];
+    if (sizes && sizes.count == 0) [_variantSizes removeObjectForKey:key];
+    pthread_mutex_unlock(&_variantLock);
+}
+
+- (void)_removeVariantsForKey:(NSString *)key {
+    pthread_mutex_lock(&_variantLock);
+    NSIndexSet *sizes = _variantSizes[key];
+    if (sizes) [_variantSizes removeObjectForKey:key];
+    pthread_mutex_unlock(&_variantLock);
+    if (!sizes) return;
+    YYMemoryCache *memoryCache = _memoryCache;
+    [sizes enumerateIndexesUsingBlock:^(NSUInteger size, BOOL *stop) {
+        [memoryCache removeObjectForKey:[YYImageCache variantKeyForKey:key maxPixelSize:size]];
+    }];
+}
+
+/// Returns the variant from memory cache, or derives it from a larger image in memory cache.
+- (UIImage *)_memoryVariantForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize {
+    UIImage *image = [_memoryCache objectForKey:[YYImageCache variantKeyForKey:key maxPixelSize:maxPixelSize]];
+    if (image) return image;
+    
+    pthread_mutex_lock(&_variantLock);
+    NSIndexSet *sizes = [_variantSizes[key] copy];
+    pthread_mutex_unlock(&_variantLock);
+    if ([sizes containsIndex:maxPixelSize]) [self _removeVariantSize:maxPixelSize forKey:key];
+    
+    // the nearest larger variant has the least pixels to scale, then the original image
+    UIImage *source = nil;
+    for (NSUInteger size = [sizes indexGreaterThanIndex:maxPixelSize]; size != NSNotFound && !source; size = [sizes indexGreaterThanIndex:size]) {
+        source = [_memoryCache objectForKey:[YYImageCache variantKeyForKey:key maxPixelSize:size]];
+        if (!source) [self _removeVariantSize:size forKey:key];
+    }
+    if (!source) source = [_memoryCache objectForKey:key];
+    if (!source) return nil;
+    
+    image = [self _imageByDownsamplingImage:source maxPixelSize:maxPixelSize];
+    if (image && image != source) [self _setVariant:image forKey:key maxPixelSize:maxPixelSize];
+    return image;
+}
+
+/// Returns the variant decoded from bitmap tier or disk cache.
+- (UIImage *)_diskVariantForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize {
+    UIImage *bitmapImage = [self _bitmapImageForKey:key];
+    if (bitmapImage) return [self _imageByDownsamplingImage:bitmapImage maxPixelSize:maxPixelSize];
+    NSData *data = (id)[_diskCache objectForKey:key];
+    if (!data) return nil;
+    YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:[self _scaleOfImageData:data]];
+    return [decoder frameAtIndex:0 maxPixelSize:maxPixelSize decodeForDisplay:_decodeForDisplay].image;
+}
+
+- (UIImage *)_imageForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize withType:(YYImageCacheType)type resultType:(YYImageCacheType *)resultType {
+    if (resultType) *resultType = YYImageCacheTypeNone;
+    if (!key) return nil;
+    if (type & YYImageCacheTypeMemory) {
+        UIImage *image = [self _memoryVariantForKey:key maxPixelSize:maxPixelSize];
+        if (image) {
+            if (resultType) *resultType = YYImageCacheTypeMemory;
+            return image;
+        }
+    }
+    if (type & YYImageCacheTypeDisk) {
+        UIImage *image = [self _diskVariantForKey:key maxPixelSize:maxPixelSize];
+        if (image) {
+            if (type & YYImageCacheTypeMemory) [self _setVariant:image forKey:key maxPixelSize:maxPixelSize];
+            if (resultType) *resultType = YYImageCacheTypeDisk;
+        }
+        return image;
+    }
+    return nil;
+}
+
+- (UIImage *)getImageForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize withType:(YYImageCacheType)type {
+    if (maxPixelSize == 0) return [self getImageForKey:key withType:type];
+    return [self _imageForKey:key maxPixelSize:maxPixelSize withType:type resultType:NULL];
+}
+
+- (void)getImageForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize withType:(YYImageCacheType)type withBlock:(void (^)(UIImage *image, YYImageCacheType type))block {
+    if (!block) return;
+    if (maxPixelSize == 0) {
+        [self getImageForKey:key withType:type withBlock:block];
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        YYImageCacheType resultType;
+        UIImage *image = [self _imageForKey:key maxPixelSize:maxPixelSize withType:type resultType:&resultType];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            block(image, resultType);
+        });
+    });
+}
+
 @end
@@ -135,6 +135,20 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
 @property (nonatomic, readonly) NSUInteger height;         ///< Image canvas height.
 @property (nonatomic, readonly, getter=isFinalized) BOOL finalized;
 
+/**
+ The memory limit in bytes of canvas checkpoints for blended animation (APNG, WebP).
+ 
+ @discussion A frame of blended animation is composited from a previous frame 
+ (`blendFromIndex`), so decoding a non-sequential frame needs to replay all the frames
+ in between. The decoder keeps the canvas of some evenly spaced frames (as many as
+ the limit allows) when they are decoded, then a frame is replayed from the nearest
+ checkpoint, which makes seeking and restarting much faster.
+ 
+ Default is 0 (no checkpoint), as the memory is not bounded by any shared budget.
+ YYAnimatedImageView sets the limit of YYImage from its share of the frame buffer.
+ */
+@property (nonatomic) NSUInteger blendCheckpointMemoryLimit;
+
 /**
  Creates an image decoder.
  
@@ -150,6 +164,11 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
  image when you do not have the complete image data. The `data` was retained by
  decoder, you should not modify the data in other thread during decoding.
  
+ The PNG, GIF and WebP data is parsed incrementally, only the appended bytes are
+ parsed in each update. Before the data is finalized, the frames of an animated
+ image are available as soon as their data are complete: `frameCount` and the
+ durations are updated, and `frameAtIndex:decodeForDisplay:` returns the frame.
+ 
  @param data  The data to add to the image decoder. Each time you call this 
  function, the 'data' parameter must contain all of the image file data 
  accumulated so far.
@@ -179,6 +198,23 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
  */
 - (nullable YYImageFrame *)frameAtIndex:(NSUInteger)index decodeForDisplay:(BOOL)decodeForDisplay;
 
+/**
+ Decodes and returns a downsampled frame from a specified index.
+ 
+ @discussion The still image is downsampled while decoding (ImageIO thumbnail or 
+ libwebp scaling), so the full size bitmap is never created. The frame of animated
+ image is decoded in full size (it may need blending) and then scaled.
+ 
+ @param index  Frame image index (zero-based).
+ @param maxPixelSize The maximum width and height of the frame in pixels, the aspect
+    ratio is kept. 0 means no limit, the same as `frameAtIndex:decodeForDisplay:`.
+ @param decodeForDisplay Whether decode the image to memory bitmap for display.
+ @return A new frame with image, or nil if an error occurs.
+ */
+- (nullable YYImageFrame *)frameAtIndex:(NSUInteger)index
+                           maxPixelSize:(NSUInteger)maxPixelSize
+                       decodeForDisplay:(BOOL)decodeForDisplay;
+
 /**
  Returns the frame duration from a specified index.
  @param index  Frame image (zero-based).
@@ -406,6 +442,41 @@ CG_EXTERN NSInteger YYUIImageOrientationToEXIFValue(UIImageOrientation orientati
  */
 CG_EXTERN CGImageRef _Nullable YYCGImageCreateDecodedCopy(CGImageRef imageRef, BOOL decodeForDisplay);
 
+/**
+ Create a decoded image which is scaled down to fit a size.
+ 
+ @param imageRef      The source image.
+ @param maxPixelSize  The maximum width and height in pixels, the aspect ratio is kept.
+ 
+ @return A BGRA8888 (premultiplied) or BGRX8888 image, or NULL if an error occurs.
+    If the source image is not larger than maxPixelSize, it's just decoded.
+ */
+CG_EXTERN CGImageRef _Nullable YYCGImageCreateDownsampledCopy(CGImageRef imageRef, size_t maxPixelSize);
+
+/**
+ Composite the pixels of a frame to a canvas, it's used by YYImageDecoder to blend
+ the frames of APNG and WebP.
+ 
+ @discussion Both buffers are BGRA8888 (kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst),
+ the source-over uses NEON or SSE2 if available, and the result is the same as the
+ scalar code: dest = src + round(dest * (255 - src.alpha) / 255).
+ 
+ @param dest            The first pixel of the canvas region.
+ @param destBytesPerRow The bytes per row of canvas.
+ @param src             The first pixel of frame.
+ @param srcBytesPerRow  The bytes per row of frame.
+ @param width           The width of region in pixels.
+ @param height          The height of region in pixels.
+ @param blend           YYImageBlendNone copies the pixels, YYImageBlendOver composites
+    the source over the canvas.
+ @param srcOpaque       If YES, the source is BGRX8888, its alpha is ignored and the
+    pixels are copied with alpha 255 (the `blend` is ignored).
+ */
+CG_EXTERN void YYImageBlendARGB8888(void *dest, size_t destBytesPerRow,
+                                    const void *src, size_t srcBytesPerRow,
+                                    size_t width, size_t height,
+                                    YYImageBlendOperation blend, BOOL srcOpaque);
+
 /**
  Create an image copy with an orientation.
  
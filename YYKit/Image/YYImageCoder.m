@@ -19,8 +19,14 @@
 #import <objc/runtime.h>
 #import <pthread.h>
 #import <zlib.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#import <arm_neon.h>
+#elif defined(__SSE2__)
+#import <emmintrin.h>
+#endif
 #import "YYImage.h"
 #import "YYKitMacro.h"
+#import "_YYImagePNG.h"
 
 #ifndef YYIMAGE_WEBP_ENABLED
 #if __has_include(<webp/decode.h>) && __has_include(<webp/encode.h>) && \
@@ -47,582 +53,145 @@ __has_include("webp/demux.h")  && __has_include("webp/mux.h")
 
 
 ////////////////////////////////////////////////////////////////////////////////
-#pragma mark - Utility (for little endian platform)
-
-#define YY_FOUR_CC(c1,c2,c3,c4) ((uint32_t)(((c4) << 24) | ((c3) << 16) | ((c2) << 8) | (c1)))
-#define YY_TWO_CC(c1,c2) ((uint16_t)(((c2) << 8) | (c1)))
-
-static inline uint16_t yy_swap_endian_uint16(uint16_t value) {
-    return
-    (uint16_t) ((value & 0x00FF) << 8) |
-    (uint16_t) ((value & 0xFF00) >> 8) ;
-}
-
-static inline uint32_t yy_swap_endian_uint32(uint32_t value) {
-    return
-    (uint32_t)((value & 0x000000FFU) << 24) |
-    (uint32_t)((value & 0x0000FF00U) <<  8) |
-    (uint32_t)((value & 0x00FF0000U) >>  8) |
-    (uint32_t)((value & 0xFF000000U) >> 24) ;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-#pragma mark - APNG
+#pragma mark - GIF / WebP Parser
 
 /*
- PNG  spec: http://www.libpng.org/pub/png/spec/1.2/PNG-Structure.html
- APNG spec: https://wiki.mozilla.org/APNG_Specification
- 
- ===============================================================================
- PNG format:
- header (8): 89 50 4e 47 0d 0a 1a 0a
- chunk, chunk, chunk, ...
- 
- ===============================================================================
- chunk format:
- length (4): uint32_t big endian
- fourcc (4): chunk type code
- data   (length): data
- crc32  (4): uint32_t big endian crc32(fourcc + data)
- 
- ===============================================================================
- PNG chunk define:
- 
- IHDR (Image Header) required, must appear first, 13 bytes
- width              (4) pixel count, should not be zero
- height             (4) pixel count, should not be zero
- bit depth          (1) expected: 1, 2, 4, 8, 16
- color type         (1) 1<<0 (palette used), 1<<1 (color used), 1<<2 (alpha channel used)
- compression method (1) 0 (deflate/inflate)
- filter method      (1) 0 (adaptive filtering with five basic filter types)
- interlace method   (1) 0 (no interlace) or 1 (Adam7 interlace)
- 
- IDAT (Image Data) required, must appear consecutively if there's multiple 'IDAT' chunk
- 
- IEND (End) required, must appear last, 0 bytes
- 
- ===============================================================================
- APNG chunk define:
- 
- acTL (Animation Control) required, must appear before 'IDAT', 8 bytes
- num frames     (4) number of frames
- num plays      (4) number of times to loop, 0 indicates infinite looping
- 
- fcTL (Frame Control) required, must appear before the 'IDAT' or 'fdAT' chunks of the frame to which it applies, 26 bytes
- sequence number   (4) sequence number of the animation chunk, starting from 0
- width             (4) width of the following frame
- height            (4) height of the following frame
- x offset          (4) x position at which to render the following frame
- y offset          (4) y position at which to render the following frame
- delay num         (2) frame delay fraction numerator
- delay den         (2) frame delay fraction denominator
- dispose op        (1) type of frame area disposal to be done after rendering this frame (0:none, 1:background 2:previous)
- blend op          (1) type of frame area rendering for this frame (0:source, 1:over)
- 
- fdAT (Frame Data) required
- sequence number   (4) sequence number of the animation chunk
- frame data        (x) frame data for this frame (same as 'IDAT')
- 
- ===============================================================================
- `dispose_op` specifies how the output buffer should be changed at the end of the delay 
- (before rendering the next frame).
- 
- * NONE: no disposal is done on this frame before rendering the next; the contents
-    of the output buffer are left as is.
- * BACKGROUND: the frame's region of the output buffer is to be cleared to fully
-    transparent black before rendering the next frame.
- * PREVIOUS: the frame's region of the output buffer is to be reverted to the previous
-    contents before rendering the next frame.
-
- `blend_op` specifies whether the frame is to be alpha blended into the current output buffer
- content, or whether it should completely replace its region in the output buffer.
+ GIF  spec: https://www.w3.org/Graphics/GIF/spec-gif89a.txt
+ WebP spec: https://developers.google.com/speed/webp/docs/riff_container
  
- * SOURCE: all color components of the frame, including alpha, overwrite the current contents
-    of the frame's output buffer region. 
- * OVER: the frame should be composited onto the output buffer based on its alpha,
-    using a simple OVER operation as described in the "Alpha Channel Processing" section
-    of the PNG specification
+ These parsers only find the frame boundaries, so the decoder knows when a new
+ frame is complete during progressive loading, the frame content is decoded by
+ ImageIO or libwebp. Both of them keep the parse state and only read the bytes
+ appended since the last update, the previous data should be the prefix of the
+ new data.
  */
 
 typedef enum {
-    YY_PNG_ALPHA_TYPE_PALEETE = 1 << 0,
-    YY_PNG_ALPHA_TYPE_COLOR = 1 << 1,
-    YY_PNG_ALPHA_TYPE_ALPHA = 1 << 2,
-} yy_png_alpha_type;
-
-typedef enum {
-    YY_PNG_DISPOSE_OP_NONE = 0,
-    YY_PNG_DISPOSE_OP_BACKGROUND = 1,
-    YY_PNG_DISPOSE_OP_PREVIOUS = 2,
-} yy_png_dispose_op;
-
-typedef enum {
-    YY_PNG_BLEND_OP_SOURCE = 0,
-    YY_PNG_BLEND_OP_OVER = 1,
-} yy_png_blend_op;
-
-typedef struct {
-    uint32_t width;             ///< pixel count, should not be zero
-    uint32_t height;            ///< pixel count, should not be zero
-    uint8_t bit_depth;          ///< expected: 1, 2, 4, 8, 16
-    uint8_t color_type;         ///< see yy_png_alpha_type
-    uint8_t compression_method; ///< 0 (deflate/inflate)
-    uint8_t filter_method;      ///< 0 (adaptive filtering with five basic filter types)
-    uint8_t interlace_method;   ///< 0 (no interlace) or 1 (Adam7 interlace)
-} yy_png_chunk_IHDR;
-
-typedef struct {
-    uint32_t sequence_number;  ///< sequence number of the animation chunk, starting from 0
-    uint32_t width;            ///< width of the following frame
-    uint32_t height;           ///< height of the following frame
-    uint32_t x_offset;         ///< x position at which to render the following frame
-    uint32_t y_offset;         ///< y position at which to render the following frame
-    uint16_t delay_num;        ///< frame delay fraction numerator
-    uint16_t delay_den;        ///< frame delay fraction denominator
-    uint8_t dispose_op;        ///< see yy_png_dispose_op
-    uint8_t blend_op;          ///< see yy_png_blend_op
-} yy_png_chunk_fcTL;
-
-typedef struct {
-    uint32_t offset; ///< chunk offset in PNG data
-    uint32_t fourcc; ///< chunk fourcc
-    uint32_t length; ///< chunk data length
-    uint32_t crc32;  ///< chunk crc32
-} yy_png_chunk_info;
+    YY_GIF_PARSER_STATE_HEADER = 0,    ///< header, logical screen descriptor and global color table
+    YY_GIF_PARSER_STATE_BLOCK,         ///< the introducer of the next block
+    YY_GIF_PARSER_STATE_EXTENSION,     ///< sub-blocks of an extension
+    YY_GIF_PARSER_STATE_IMAGE_DATA,    ///< sub-blocks of an image
+    YY_GIF_PARSER_STATE_END,           ///< trailer received
+    YY_GIF_PARSER_STATE_ERROR,         ///< not a valid gif
+} yy_gif_parser_state;
 
 typedef struct {
-    uint32_t chunk_index; ///< the first `fdAT`/`IDAT` chunk index
-    uint32_t chunk_num;   ///< the `fdAT`/`IDAT` chunk count
-    uint32_t chunk_size;  ///< the `fdAT`/`IDAT` chunk bytes
-    yy_png_chunk_fcTL frame_control;
-} yy_png_frame_info;
+    uint32_t offset;    ///< offset of the next unparsed block or sub-block
+    uint32_t frame_num; ///< count of frames whose image data are all received
+    uint8_t state;      ///< see yy_gif_parser_state
+} yy_gif_parser;
 
-typedef struct {
-    yy_png_chunk_IHDR header;   ///< png header
-    yy_png_chunk_info *chunks;      ///< chunks
-    uint32_t chunk_num;          ///< count of chunks
-    
-    yy_png_frame_info *apng_frames; ///< frame info, NULL if not apng
-    uint32_t apng_frame_num;     ///< 0 if not apng
-    uint32_t apng_loop_num;      ///< 0 indicates infinite looping
-    
-    uint32_t *apng_shared_chunk_indexs; ///< shared chunk index
-    uint32_t apng_shared_chunk_num;     ///< shared chunk count
-    uint32_t apng_shared_chunk_size;    ///< shared chunk bytes
-    uint32_t apng_shared_insert_index;  ///< shared chunk insert index
-    bool apng_first_frame_is_cover;     ///< the first frame is same as png (cover)
-} yy_png_info;
-
-static void yy_png_chunk_IHDR_read(yy_png_chunk_IHDR *IHDR, const uint8_t *data) {
-    IHDR->width = yy_swap_endian_uint32(*((uint32_t *)(data)));
-    IHDR->height = yy_swap_endian_uint32(*((uint32_t *)(data + 4)));
-    IHDR->bit_depth = data[8];
-    IHDR->color_type = data[9];
-    IHDR->compression_method = data[10];
-    IHDR->filter_method = data[11];
-    IHDR->interlace_method = data[12];
-}
-
-static void yy_png_chunk_IHDR_write(yy_png_chunk_IHDR *IHDR, uint8_t *data) {
-    *((uint32_t *)(data)) = yy_swap_endian_uint32(IHDR->width);
-    *((uint32_t *)(data + 4)) = yy_swap_endian_uint32(IHDR->height);
-    data[8] = IHDR->bit_depth;
-    data[9] = IHDR->color_type;
-    data[10] = IHDR->compression_method;
-    data[11] = IHDR->filter_method;
-    data[12] = IHDR->interlace_method;
-}
-
-static void yy_png_chunk_fcTL_read(yy_png_chunk_fcTL *fcTL, const uint8_t *data) {
-    fcTL->sequence_number = yy_swap_endian_uint32(*((uint32_t *)(data)));
-    fcTL->width = yy_swap_endian_uint32(*((uint32_t *)(data + 4)));
-    fcTL->height = yy_swap_endian_uint32(*((uint32_t *)(data + 8)));
-    fcTL->x_offset = yy_swap_endian_uint32(*((uint32_t *)(data + 12)));
-    fcTL->y_offset = yy_swap_endian_uint32(*((uint32_t *)(data + 16)));
-    fcTL->delay_num = yy_swap_endian_uint16(*((uint16_t *)(data + 20)));
-    fcTL->delay_den = yy_swap_endian_uint16(*((uint16_t *)(data + 22)));
-    fcTL->dispose_op = data[24];
-    fcTL->blend_op = data[25];
-}
-
-static void yy_png_chunk_fcTL_write(yy_png_chunk_fcTL *fcTL, uint8_t *data) {
-    *((uint32_t *)(data)) = yy_swap_endian_uint32(fcTL->sequence_number);
-    *((uint32_t *)(data + 4)) = yy_swap_endian_uint32(fcTL->width);
-    *((uint32_t *)(data + 8)) = yy_swap_endian_uint32(fcTL->height);
-    *((uint32_t *)(data + 12)) = yy_swap_endian_uint32(fcTL->x_offset);
-    *((uint32_t *)(data + 16)) = yy_swap_endian_uint32(fcTL->y_offset);
-    *((uint16_t *)(data + 20)) = yy_swap_endian_uint16(fcTL->delay_num);
-    *((uint16_t *)(data + 22)) = yy_swap_endian_uint16(fcTL->delay_den);
-    data[24] = fcTL->dispose_op;
-    data[25] = fcTL->blend_op;
-}
-
-// convert double value to fraction
-static void yy_png_delay_to_fraction(double duration, uint16_t *num, uint16_t *den) {
-    if (duration >= 0xFF) {
-        *num = 0xFF;
-        *den = 1;
-    } else if (duration <= 1.0 / (double)0xFF) {
-        *num = 1;
-        *den = 0xFF;
-    } else {
-        // Use continued fraction to calculate the num and den.
-        long MAX = 10;
-        double eps = (0.5 / (double)0xFF);
-        long p[MAX], q[MAX], a[MAX], i, numl = 0, denl = 0;
-        // The first two convergents are 0/1 and 1/0
-        p[0] = 0; q[0] = 1;
-        p[1] = 1; q[1] = 0;
-        // The rest of the convergents (and continued fraction)
-        for (i = 2; i < MAX; i++) {
-            a[i] = lrint(floor(duration));
-            p[i] = a[i] * p[i - 1] + p[i - 2];
-            q[i] = a[i] * q[i - 1] + q[i - 2];
-            if (p[i] <= 0xFF && q[i] <= 0xFF) { // uint16_t
-                numl = p[i];
-                denl = q[i];
-            } else break;
-            if (fabs(duration - a[i]) < eps) break;
-            duration = 1.0 / (duration - a[i]);
-        }
-        
-        if (numl != 0 && denl != 0) {
-            *num = numl;
-            *den = denl;
-        } else {
-            *num = 1;
-            *den = 100;
-        }
-    }
-}
-
-// convert fraction to double value
-static double yy_png_delay_to_seconds(uint16_t num, uint16_t den) {
-    if (den == 0) {
-        return num / 100.0;
-    } else {
-        return (double)num / (double)den;
-    }
-}
-
-static bool yy_png_validate_animation_chunk_order(yy_png_chunk_info *chunks,  /* input */
-                                                  uint32_t chunk_num,         /* input */
-                                                  uint32_t *first_idat_index, /* output */
-                                                  bool *first_frame_is_cover  /* output */) {
-    /*
-     PNG at least contains 3 chunks: IHDR, IDAT, IEND.
-     `IHDR` must appear first.
-     `IDAT` must appear consecutively.
-     `IEND` must appear end.
-     
-     APNG must contains one `acTL` and at least one 'fcTL' and `fdAT`.
-     `fdAT` must appear consecutively.
-     `fcTL` must appear before `IDAT` or `fdAT`.
-     */
-    if (chunk_num <= 2) return false;
-    if (chunks->fourcc != YY_FOUR_CC('I', 'H', 'D', 'R')) return false;
-    if ((chunks + chunk_num - 1)->fourcc != YY_FOUR_CC('I', 'E', 'N', 'D')) return false;
-    
-    uint32_t prev_fourcc = 0;
-    uint32_t IHDR_num = 0;
-    uint32_t IDAT_num = 0;
-    uint32_t acTL_num = 0;
-    uint32_t fcTL_num = 0;
-    uint32_t first_IDAT = 0;
-    bool first_frame_cover = false;
-    for (uint32_t i = 0; i < chunk_num; i++) {
-        yy_png_chunk_info *chunk = chunks + i;
-        switch (chunk->fourcc) {
-            case YY_FOUR_CC('I', 'H', 'D', 'R'): {  // png header
-                if (i != 0) return false;
-                if (IHDR_num > 0) return false;
-                IHDR_num++;
-            } break;
-            case YY_FOUR_CC('I', 'D', 'A', 'T'): {  // png data
-                if (prev_fourcc != YY_FOUR_CC('I', 'D', 'A', 'T')) {
-                    if (IDAT_num == 0)
-                        first_IDAT = i;
-                    else
-                        return false;
-                }
-                IDAT_num++;
-            } break;
-            case YY_FOUR_CC('a', 'c', 'T', 'L'): {  // apng control
-                if (acTL_num > 0) return false;
-                acTL_num++;
-            } break;
-            case YY_FOUR_CC('f', 'c', 'T', 'L'): {  // apng frame control
-                if (i + 1 == chunk_num) return false;
-                if ((chunk + 1)->fourcc != YY_FOUR_CC('f', 'd', 'A', 'T') &&
-                    (chunk + 1)->fourcc != YY_FOUR_CC('I', 'D', 'A', 'T')) {
-                    return false;
-                }
-                if (fcTL_num == 0) {
-                    if ((chunk + 1)->fourcc == YY_FOUR_CC('I', 'D', 'A', 'T')) {
-                        first_frame_cover = true;
-                    }
-                }
-                fcTL_num++;
-            } break;
-            case YY_FOUR_CC('f', 'd', 'A', 'T'): {  // apng data
-                if (prev_fourcc != YY_FOUR_CC('f', 'd', 'A', 'T') && prev_fourcc != YY_FOUR_CC('f', 'c', 'T', 'L')) {
-                    return false;
-                }
-            } break;
-        }
-        prev_fourcc = chunk->fourcc;
-    }
-    if (IHDR_num != 1) return false;
-    if (IDAT_num == 0) return false;
-    if (acTL_num != 1) return false;
-    if (fcTL_num < acTL_num) return false;
-    *first_idat_index = first_IDAT;
-    *first_frame_is_cover = first_frame_cover;
-    return true;
-}
-
-static void yy_png_info_release(yy_png_info *info) {
-    if (info) {
-        if (info->chunks) free(info->chunks);
-        if (info->apng_frames) free(info->apng_frames);
-        if (info->apng_shared_chunk_indexs) free(info->apng_shared_chunk_indexs);
-        free(info);
-    }
+static inline uint32_t yy_gif_color_table_size(uint8_t packed) {
+    return (packed & 0x80) ? 3 * (1 << ((packed & 0x07) + 1)) : 0;
 }
 
 /**
- Create a png info from a png file. See struct png_info for more information.
+ Parse the blocks appended since last update.
  
- @param data   png/apng file data.
+ @param parser A parser, it should be zero-initialized before the first update.
+ @param data   gif file data.
  @param length the data's length in bytes.
- @return A png info object, you may call yy_png_info_release() to release it.
- Returns NULL if an error occurs.
  */
-static yy_png_info *yy_png_info_create(const uint8_t *data, uint32_t length) {
-    if (length < 32) return NULL;
-    if (*((uint32_t *)data) != YY_FOUR_CC(0x89, 0x50, 0x4E, 0x47)) return NULL;
-    if (*((uint32_t *)(data + 4)) != YY_FOUR_CC(0x0D, 0x0A, 0x1A, 0x0A)) return NULL;
-    
-    uint32_t chunk_realloc_num = 16;
-    yy_png_chunk_info *chunks = malloc(sizeof(yy_png_chunk_info) * chunk_realloc_num);
-    if (!chunks) return NULL;
-    
-    // parse png chunks
-    uint32_t offset = 8;
-    uint32_t chunk_num = 0;
-    uint32_t chunk_capacity = chunk_realloc_num;
-    uint32_t apng_loop_num = 0;
-    int32_t apng_sequence_index = -1;
-    int32_t apng_frame_index = 0;
-    int32_t apng_frame_number = -1;
-    bool apng_chunk_error = false;
-    do {
-        if (chunk_num >= chunk_capacity) {
-            yy_png_chunk_info *new_chunks = realloc(chunks, sizeof(yy_png_chunk_info) * (chunk_capacity + chunk_realloc_num));
-            if (!new_chunks) {
-                free(chunks);
-                return NULL;
-            }
-            chunks = new_chunks;
-            chunk_capacity += chunk_realloc_num;
-        }
-        yy_png_chunk_info *chunk = chunks + chunk_num;
-        const uint8_t *chunk_data = data + offset;
-        chunk->offset = offset;
-        chunk->length = yy_swap_endian_uint32(*((uint32_t *)chunk_data));
-        if ((uint64_t)chunk->offset + (uint64_t)chunk->length + 12 > length) {
-            free(chunks);
-            return NULL;
-        }
-        
-        chunk->fourcc = *((uint32_t *)(chunk_data + 4));
-        if ((uint64_t)chunk->offset + 4 + chunk->length + 4 > (uint64_t)length) break;
-        chunk->crc32 = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8 + chunk->length)));
-        chunk_num++;
-        offset += 12 + chunk->length;
-        
-        switch (chunk->fourcc) {
-            case YY_FOUR_CC('a', 'c', 'T', 'L') : {
-                if (chunk->length == 8) {
-                    apng_frame_number = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8)));
-                    apng_loop_num = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 12)));
-                } else {
-                    apng_chunk_error = true;
+static void yy_gif_parser_update(yy_gif_parser *parser, const uint8_t *data, uint32_t length) {
+    while (parser->offset < length) {
+        const uint8_t *block = data + parser->offset;
+        uint64_t remain = length - parser->offset;
+        switch (parser->state) {
+            case YY_GIF_PARSER_STATE_HEADER: {
+                if (remain < 13) return;
+                if (block[0] != 'G' || block[1] != 'I' || block[2] != 'F') {
+                    parser->state = YY_GIF_PARSER_STATE_ERROR;
+                    return;
                 }
+                uint64_t size = 13 + yy_gif_color_table_size(block[10]);
+                if (remain < size) return;
+                parser->offset += size;
+                parser->state = YY_GIF_PARSER_STATE_BLOCK;
             } break;
-            case YY_FOUR_CC('f', 'c', 'T', 'L') :
-            case YY_FOUR_CC('f', 'd', 'A', 'T') : {
-                if (chunk->fourcc == YY_FOUR_CC('f', 'c', 'T', 'L')) {
-                    if (chunk->length != 26) {
-                        apng_chunk_error = true;
-                    } else {
-                        apng_frame_index++;
-                    }
-                }
-                if (chunk->length > 4) {
-                    uint32_t sequence = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8)));
-                    if (apng_sequence_index + 1 == sequence) {
-                        apng_sequence_index++;
-                    } else {
-                        apng_chunk_error = true;
-                    }
+            case YY_GIF_PARSER_STATE_BLOCK: {
+                if (block[0] == 0x21) { // extension: introducer, label, sub-blocks
+                    if (remain < 2) return;
+                    parser->offset += 2;
+                    parser->state = YY_GIF_PARSER_STATE_EXTENSION;
+                } else if (block[0] == 0x2C) { // image: descriptor (10), local color table, LZW code size (1), sub-blocks
+                    if (remain < 10) return;
+                    uint64_t size = 10 + yy_gif_color_table_size(block[9]) + 1;
+                    if (remain < size) return;
+                    parser->offset += size;
+                    parser->state = YY_GIF_PARSER_STATE_IMAGE_DATA;
+                } else if (block[0] == 0x3B) { // trailer
+                    parser->offset++;
+                    parser->state = YY_GIF_PARSER_STATE_END;
+                    return;
                 } else {
-                    apng_chunk_error = true;
+                    parser->state = YY_GIF_PARSER_STATE_ERROR;
+                    return;
                 }
             } break;
-            case YY_FOUR_CC('I', 'E', 'N', 'D') : {
-                offset = length; // end, break do-while loop
+            case YY_GIF_PARSER_STATE_EXTENSION:
+            case YY_GIF_PARSER_STATE_IMAGE_DATA: {
+                uint8_t size = block[0];
+                if (size == 0) { // block terminator
+                    parser->offset++;
+                    if (parser->state == YY_GIF_PARSER_STATE_IMAGE_DATA) parser->frame_num++;
+                    parser->state = YY_GIF_PARSER_STATE_BLOCK;
+                } else {
+                    if (remain < 1 + (uint64_t)size) return;
+                    parser->offset += 1 + size;
+                }
             } break;
+            default: return;
         }
-    } while (offset + 12 <= length);
-    
-    if (chunk_num < 3 ||
-        chunks->fourcc != YY_FOUR_CC('I', 'H', 'D', 'R') ||
-        chunks->length != 13) {
-        free(chunks);
-        return NULL;
     }
-    
-    // png info
-    yy_png_info *info = calloc(1, sizeof(yy_png_info));
-    if (!info) {
-        free(chunks);
-        return NULL;
-    }
-    info->chunks = chunks;
-    info->chunk_num = chunk_num;
-    yy_png_chunk_IHDR_read(&info->header, data + chunks->offset + 8);
-    
-    // apng info
-    if (!apng_chunk_error && apng_frame_number == apng_frame_index && apng_frame_number >= 1) {
-        bool first_frame_is_cover = false;
-        uint32_t first_IDAT_index = 0;
-        if (!yy_png_validate_animation_chunk_order(info->chunks, info->chunk_num, &first_IDAT_index, &first_frame_is_cover)) {
-            return info; // ignore apng chunk
-        }
-        
-        info->apng_loop_num = apng_loop_num;
-        info->apng_frame_num = apng_frame_number;
-        info->apng_first_frame_is_cover = first_frame_is_cover;
-        info->apng_shared_insert_index = first_IDAT_index;
-        info->apng_frames = calloc(apng_frame_number, sizeof(yy_png_frame_info));
-        if (!info->apng_frames) {
-            yy_png_info_release(info);
-            return NULL;
-        }
-        info->apng_shared_chunk_indexs = calloc(info->chunk_num, sizeof(uint32_t));
-        if (!info->apng_shared_chunk_indexs) {
-            yy_png_info_release(info);
-            return NULL;
-        }
-        
-        int32_t frame_index = -1;
-        uint32_t *shared_chunk_index = info->apng_shared_chunk_indexs;
-        for (int32_t i = 0; i < info->chunk_num; i++) {
-            yy_png_chunk_info *chunk = info->chunks + i;
-            switch (chunk->fourcc) {
-                case YY_FOUR_CC('I', 'D', 'A', 'T'): {
-                    if (info->apng_shared_insert_index == 0) {
-                        info->apng_shared_insert_index = i;
-                    }
-                    if (first_frame_is_cover) {
-                        yy_png_frame_info *frame = info->apng_frames + frame_index;
-                        frame->chunk_num++;
-                        frame->chunk_size += chunk->length + 12;
-                    }
-                } break;
-                case YY_FOUR_CC('a', 'c', 'T', 'L'): {
-                } break;
-                case YY_FOUR_CC('f', 'c', 'T', 'L'): {
-                    frame_index++;
-                    yy_png_frame_info *frame = info->apng_frames + frame_index;
-                    frame->chunk_index = i + 1;
-                    yy_png_chunk_fcTL_read(&frame->frame_control, data + chunk->offset + 8);
-                } break;
-                case YY_FOUR_CC('f', 'd', 'A', 'T'): {
-                    yy_png_frame_info *frame = info->apng_frames + frame_index;
-                    frame->chunk_num++;
-                    frame->chunk_size += chunk->length + 12;
-                } break;
-                default: {
-                    *shared_chunk_index = i;
-                    shared_chunk_index++;
-                    info->apng_shared_chunk_size += chunk->length + 12;
-                    info->apng_shared_chunk_num++;
-                } break;
-            }
-        }
-    }
-    return info;
 }
 
+typedef struct {
+    uint32_t offset;    ///< offset of the next unparsed chunk, 0 before the RIFF header is received
+    uint32_t frame_num; ///< count of frames ('ANMF', or 'VP8 '/'VP8L' of still image) whose data are all received
+    bool ended;         ///< all chunks in RIFF size are received
+    bool error;         ///< not a valid webp
+} yy_webp_parser;
+
 /**
- Copy a png frame data from an apng file.
+ Parse the chunks appended since last update.
  
- @param data  apng file data
- @param info  png info
- @param index frame index (zero-based)
- @param size  output, the size of the frame data
- @return A frame data (single-frame png file), call free() to release the data.
- Returns NULL if an error occurs.
+ @param parser A parser, it should be zero-initialized before the first update.
+ @param data   webp file data.
+ @param length the data's length in bytes.
  */
-static uint8_t *yy_png_copy_frame_data_at_index(const uint8_t *data,
-                                                const yy_png_info *info,
-                                                const uint32_t index,
-                                                uint32_t *size) {
-    if (index >= info->apng_frame_num) return NULL;
-    
-    yy_png_frame_info *frame_info = info->apng_frames + index;
-    uint32_t frame_remux_size = 8 /* PNG Header */ + info->apng_shared_chunk_size + frame_info->chunk_size;
-    if (!(info->apng_first_frame_is_cover && index == 0)) {
-        frame_remux_size -= frame_info->chunk_num * 4; // remove fdAT sequence number
-    }
-    uint8_t *frame_data = malloc(frame_remux_size);
-    if (!frame_data) return NULL;
-    *size = frame_remux_size;
-    
-    uint32_t data_offset = 0;
-    bool inserted = false;
-    memcpy(frame_data, data, 8); // PNG File Header
-    data_offset += 8;
-    for (uint32_t i = 0; i < info->apng_shared_chunk_num; i++) {
-        uint32_t shared_chunk_index = info->apng_shared_chunk_indexs[i];
-        yy_png_chunk_info *shared_chunk_info = info->chunks + shared_chunk_index;
-        
-        if (shared_chunk_index >= info->apng_shared_insert_index && !inserted) { // replace IDAT with fdAT
-            inserted = true;
-            for (uint32_t c = 0; c < frame_info->chunk_num; c++) {
-                yy_png_chunk_info *insert_chunk_info = info->chunks + frame_info->chunk_index + c;
-                if (insert_chunk_info->fourcc == YY_FOUR_CC('f', 'd', 'A', 'T')) {
-                    *((uint32_t *)(frame_data + data_offset)) = yy_swap_endian_uint32(insert_chunk_info->length - 4);
-                    *((uint32_t *)(frame_data + data_offset + 4)) = YY_FOUR_CC('I', 'D', 'A', 'T');
-                    memcpy(frame_data + data_offset + 8, data + insert_chunk_info->offset + 12, insert_chunk_info->length - 4);
-                    uint32_t crc = (uint32_t)crc32(0, frame_data + data_offset + 4, insert_chunk_info->length);
-                    *((uint32_t *)(frame_data + data_offset + insert_chunk_info->length + 4)) = yy_swap_endian_uint32(crc);
-                    data_offset += insert_chunk_info->length + 8;
-                } else { // IDAT
-                    memcpy(frame_data + data_offset, data + insert_chunk_info->offset, insert_chunk_info->length + 12);
-                    data_offset += insert_chunk_info->length + 12;
-                }
-            }
+static void yy_webp_parser_update(yy_webp_parser *parser, const uint8_t *data, uint32_t length) {
+    if (parser->error || parser->ended) return;
+    if (parser->offset == 0) {
+        if (length < 12) return;
+        if (*((uint32_t *)data) != YY_FOUR_CC('R', 'I', 'F', 'F') ||
+            *((uint32_t *)(data + 8)) != YY_FOUR_CC('W', 'E', 'B', 'P')) {
+            parser->error = true;
+            return;
         }
-        
-        if (shared_chunk_info->fourcc == YY_FOUR_CC('I', 'H', 'D', 'R')) {
-            uint8_t tmp[25] = {0};
-            memcpy(tmp, data + shared_chunk_info->offset, 25);
-            yy_png_chunk_IHDR IHDR = info->header;
-            IHDR.width = frame_info->frame_control.width;
-            IHDR.height = frame_info->frame_control.height;
-            yy_png_chunk_IHDR_write(&IHDR, tmp + 8);
-            *((uint32_t *)(tmp + 21)) = yy_swap_endian_uint32((uint32_t)crc32(0, tmp + 4, 17));
-            memcpy(frame_data + data_offset, tmp, 25);
-            data_offset += 25;
-        } else {
-            memcpy(frame_data + data_offset, data + shared_chunk_info->offset, shared_chunk_info->length + 12);
-            data_offset += shared_chunk_info->length + 12;
+        parser->offset = 12;
+    }
+    uint64_t riff_end = (uint64_t)*((uint32_t *)(data + 4)) + 8; // little endian
+    if (length > riff_end) length = (uint32_t)riff_end;
+    
+    while ((uint64_t)parser->offset + 8 <= length) {
+        const uint8_t *chunk_data = data + parser->offset;
+        uint32_t fourcc = *((uint32_t *)chunk_data);
+        uint32_t chunk_length = *((uint32_t *)(chunk_data + 4));
+        uint64_t chunk_size = 8 + (uint64_t)chunk_length + (chunk_length & 1); // padded to even
+        if ((uint64_t)parser->offset + 8 + chunk_length > length) return; // wait for more data
+        switch (fourcc) {
+            case YY_FOUR_CC('A', 'N', 'M', 'F'):
+            case YY_FOUR_CC('V', 'P', '8', ' '):
+            case YY_FOUR_CC('V', 'P', '8', 'L'): {
+                parser->frame_num++;
+            } break;
+        }
+        parser->offset += (uint32_t)chunk_size; // may exceed the length if the padding byte is not received
+        if (parser->offset >= riff_end) {
+            parser->ended = true;
+            return;
         }
     }
-    return frame_data;
 }
 
 
@@ -913,6 +482,112 @@ CGImageRef YYCGImageCreateDecodedCopy(CGImageRef imageRef, BOOL decodeForDisplay
     }
 }
 
+CGImageRef YYCGImageCreateDownsampledCopy(CGImageRef imageRef, size_t maxPixelSize) {
+    if (!imageRef || maxPixelSize == 0) return NULL;
+    size_t width = CGImageGetWidth(imageRef);
+    size_t height = CGImageGetHeight(imageRef);
+    if (width == 0 || height == 0) return NULL;
+    if (MAX(width, height) <= maxPixelSize) return YYCGImageCreateDecodedCopy(imageRef, YES);
+    
+    double ratio = (double)maxPixelSize / MAX(width, height);
+    size_t destWidth = MAX((size_t)round(width * ratio), 1);
+    size_t destHeight = MAX((size_t)round(height * ratio), 1);
+    CGImageAlphaInfo alphaInfo = CGImageGetAlphaInfo(imageRef) & kCGBitmapAlphaInfoMask;
+    BOOL hasAlpha = NO;
+    if (alphaInfo == kCGImageAlphaPremultipliedLast ||
+        alphaInfo == kCGImageAlphaPremultipliedFirst ||
+        alphaInfo == kCGImageAlphaLast ||
+        alphaInfo == kCGImageAlphaFirst) {
+        hasAlpha = YES;
+    }
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host;
+    bitmapInfo |= hasAlpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst;
+    CGContextRef context = CGBitmapContextCreate(NULL, destWidth, destHeight, 8, 0, YYCGColorSpaceGetDeviceRGB(), bitmapInfo);
+    if (!context) return NULL;
+    CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+    CGContextDrawImage(context, CGRectMake(0, 0, destWidth, destHeight), imageRef); // decode and scale
+    CGImageRef newImage = CGBitmapContextCreateImage(context);
+    CFRelease(context);
+    return newImage;
+}
+
+/// Returns round(value / 255) for value in range [0, 255 * 255].
+static inline uint32_t YYImageDiv255(uint32_t value) {
+    return (value + ((value + 128) >> 8) + 128) >> 8;
+}
+
+/// dest = src + dest * (255 - src.alpha) / 255, premultiplied BGRA (alpha is the 4th byte).
+static inline void YYImageBlendRowOver(uint8_t *dest, const uint8_t *src, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = vld4_u8(src + i * 4);
+        uint8x8x4_t d = vld4_u8(dest + i * 4);
+        uint8x8_t inv = vmvn_u8(s.val[3]);
+        for (int c = 0; c < 4; c++) {
+            uint16x8_t t = vmull_u8(d.val[c], inv);
+            d.val[c] = vqadd_u8(s.val[c], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+        }
+        vst4_u8(dest + i * 4, d);
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dest + i * 4));
+        __m128i result[2];
+        for (int h = 0; h < 2; h++) {
+            __m128i s16 = h ? _mm_unpackhi_epi8(s, zero) : _mm_unpacklo_epi8(s, zero);
+            __m128i d16 = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+            __m128i a16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i t = _mm_mullo_epi16(d16, _mm_sub_epi16(mask, a16));
+            t = _mm_add_epi16(t, _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(t, half), 8), half));
+            result[h] = _mm_srli_epi16(t, 8);
+        }
+        _mm_storeu_si128((__m128i *)(dest + i * 4), _mm_adds_epu8(s, _mm_packus_epi16(result[0], result[1])));
+    }
+#endif
+    for (; i < count; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t *d = dest + i * 4;
+        uint32_t inv = 255 - s[3];
+        if (inv == 0) {
+            memcpy(d, s, 4);
+        } else {
+            for (int c = 0; c < 4; c++) {
+                uint32_t value = s[c] + YYImageDiv255(d[c] * inv);
+                d[c] = value > 255 ? 255 : value;
+            }
+        }
+    }
+}
+
+/// dest = src with alpha 255, for the source without alpha (BGRX).
+static inline void YYImageBlendRowOpaque(uint8_t *dest, const uint8_t *src, size_t count) {
+    memcpy(dest, src, count * 4);
+    for (size_t i = 0; i < count; i++) dest[i * 4 + 3] = 0xFF;
+}
+
+void YYImageBlendARGB8888(void *dest, size_t destBytesPerRow,
+                          const void *src, size_t srcBytesPerRow,
+                          size_t width, size_t height,
+                          YYImageBlendOperation blend, BOOL srcOpaque) {
+    if (!dest || !src || width == 0 || height == 0) return;
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *destRow = (uint8_t *)dest + y * destBytesPerRow;
+        const uint8_t *srcRow = (const uint8_t *)src + y * srcBytesPerRow;
+        if (srcOpaque) {
+            YYImageBlendRowOpaque(destRow, srcRow, width);
+        } else if (blend == YYImageBlendOver) {
+            YYImageBlendRowOver(destRow, srcRow, width);
+        } else {
+            memcpy(destRow, srcRow, width * 4);
+        }
+    }
+}
+
 CGImageRef YYCGImageCreateAffineTransformCopy(CGImageRef imageRef, CGAffineTransform transform, CGSize destSize, CGBitmapInfo destBitmapInfo) {
     if (!imageRef) return NULL;
     size_t srcWidth = CGImageGetWidth(imageRef);
@@ -1504,14 +1179,23 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 @end
 
 
+#define YY_APNG_PREDECODE_LIMIT (8 * 1024 * 1024) // 8MB (the pixels of APNG frames decoded concurrently)
+
 @implementation YYImageDecoder {
     pthread_mutex_t _lock; // recursive lock
     
     BOOL _sourceTypeDetected;
+    yy_png_parser _pngParser;   ///< incremental parser of PNG/APNG data
+    yy_gif_parser _gifParser;   ///< incremental parser of GIF data
+    yy_webp_parser _webpParser; ///< incremental parser of WebP data
     CGImageSourceRef _source;
     yy_png_info *_apngSource;
+    BOOL _apngDecodeDirect;           ///< whether the APNG frames can be decoded by yy_png_decode_frame()
+    yy_png_pixel_format _apngFormat;
+    NSMutableDictionary *_apngFramePixels; ///< frame index -> NSData, the frames decoded in advance for blending
 #if YYIMAGE_WEBP_ENABLED
     WebPDemuxer *_webpSource;
+    NSMutableData *_webpData; ///< the data referred by _webpSource, a copy of _data which is only appended
 #endif
     
     UIImageOrientation _orientation;
@@ -1519,16 +1203,23 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     NSArray *_frames; ///< Array<GGImageDecoderFrame>, without image
     BOOL _needBlend;
     NSUInteger _blendFrameIndex;
-    CGContextRef _blendCanvas;
+    CGContextRef _blendCanvas;     ///< draws to _blendBuffer, only for the frame which cannot be composited directly
+    uint8_t *_blendBuffer;         ///< canvas pixels, BGRA8888 premultiplied
+    size_t _blendBytesPerRow;
+    uint8_t *_blendSavedBuffer;    ///< the frame region saved for YYImageDisposePrevious
+    NSMutableDictionary *_blendCheckpoints; ///< frame index -> NSData, the canvas after the frame is blended and disposed
 }
 
 - (void)dealloc {
     if (_source) CFRelease(_source);
     if (_apngSource) yy_png_info_release(_apngSource);
+    yy_png_parser_release(&_pngParser);
 #if YYIMAGE_WEBP_ENABLED
     if (_webpSource) WebPDemuxDelete(_webpSource);
 #endif
     if (_blendCanvas) CFRelease(_blendCanvas);
+    if (_blendBuffer) free(_blendBuffer);
+    if (_blendSavedBuffer) free(_blendSavedBuffer);
     pthread_mutex_destroy(&_lock);
 }
 
@@ -1569,6 +1260,21 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return result;
 }
 
+- (void)setBlendCheckpointMemoryLimit:(NSUInteger)blendCheckpointMemoryLimit {
+    pthread_mutex_lock(&_lock);
+    _blendCheckpointMemoryLimit = blendCheckpointMemoryLimit;
+    [_blendCheckpoints removeAllObjects]; // the spacing is changed
+    pthread_mutex_unlock(&_lock);
+}
+
+- (YYImageFrame *)frameAtIndex:(NSUInteger)index maxPixelSize:(NSUInteger)maxPixelSize decodeForDisplay:(BOOL)decodeForDisplay {
+    YYImageFrame *result = nil;
+    pthread_mutex_lock(&_lock);
+    result = [self _frameAtIndex:index maxPixelSize:maxPixelSize decodeForDisplay:decodeForDisplay];
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
 - (NSTimeInterval)frameDurationAtIndex:(NSUInteger)index {
     NSTimeInterval result = 0;
     dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
@@ -1603,23 +1309,61 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     _finalized = final;
     _data = data;
     
-    YYImageType type = YYImageDetectType((__bridge CFDataRef)data);
-    if (_sourceTypeDetected) {
-        if (_type != type) {
-            return NO;
-        } else {
-            [self _updateSource];
-        }
+    if (_sourceTypeDetected) { // the data is appended, so the type is not changed
+        if ([self _updateParser]) [self _updateSource];
     } else {
         if (_data.length > 16) {
-            _type = type;
+            _type = YYImageDetectType((__bridge CFDataRef)data);
             _sourceTypeDetected = YES;
+            [self _updateParser];
             [self _updateSource];
         }
     }
     return YES;
 }
 
+/**
+ Parse the appended data with the incremental parser of the image type.
+ 
+ @discussion The source of ImageIO, APNG or WebP can only be created with the
+ whole data, so it's updated only when it may produce something new: the first
+ frame is still loading (ImageIO can display it progressively), or a new frame is
+ complete, or the data is finalized.
+ 
+ @return Whether the source should be updated.
+ */
+- (BOOL)_updateParser {
+    const uint8_t *bytes = _data.bytes;
+    uint32_t length = (uint32_t)_data.length;
+    BOOL result = YES;
+    switch (_type) {
+        case YYImageTypePNG: {
+            BOOL imageComplete = _pngParser.image_complete;
+            uint32_t frameNum = _pngParser.complete_frame_num;
+            yy_png_parser_update(&_pngParser, bytes, length);
+            if (!_pngParser.error && imageComplete) {
+                result = _pngParser.complete_frame_num != frameNum;
+            }
+        } break;
+        case YYImageTypeGIF: {
+            uint32_t frameNum = _gifParser.frame_num;
+            yy_gif_parser_update(&_gifParser, bytes, length);
+            if (_gifParser.state != YY_GIF_PARSER_STATE_ERROR && frameNum > 0) {
+                result = _gifParser.frame_num != frameNum;
+            }
+        } break;
+        case YYImageTypeWebP: {
+            uint32_t frameNum = _webpParser.frame_num;
+            yy_webp_parser_update(&_webpParser, bytes, length);
+            if (!_webpParser.error) {
+                result = _webpParser.frame_num != frameNum;
+            }
+        } break;
+        default: break;
+    }
+    return result || _finalized;
+}
+
 - (YYImageFrame *)_frameAtIndex:(NSUInteger)index decodeForDisplay:(BOOL)decodeForDisplay {
     if (index >= _frames.count) return 0;
     _YYImageDecoderFrame *frame = [(_YYImageDecoderFrame *)_frames[index] copy];
@@ -1655,29 +1399,34 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     if (_blendFrameIndex + 1 == frame.index) {
         imageRef = [self _newBlendedImageWithFrame:frame];
         _blendFrameIndex = index;
+        [self _blendSaveCheckpointIfNeeded];
     } else { // should draw canvas from previous frame
         _blendFrameIndex = NSNotFound;
-        CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
+        memset(_blendBuffer, 0, _blendBytesPerRow * _height);
         
         if (frame.blendFromIndex == frame.index) {
-            CGImageRef unblendedImage = [self _newUnblendedImageAtIndex:index extendToCanvas:NO decoded:NULL];
-            if (unblendedImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendedImage);
-                CFRelease(unblendedImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            [self _blendDrawFrame:frame];
+            imageRef = [self _newImageFromBlendCanvas];
             if (frame.dispose == YYImageDisposeBackground) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
+                [self _blendClearFrame:frame];
             }
             _blendFrameIndex = index;
+            [self _blendSaveCheckpointIfNeeded];
         } else { // canvas is not ready
-            for (uint32_t i = (uint32_t)frame.blendFromIndex; i <= (uint32_t)frame.index; i++) {
+            NSUInteger fromIndex = [self _blendRestoreCheckpointForFrame:frame];
+            if (fromIndex == NSNotFound) fromIndex = frame.blendFromIndex;
+            else fromIndex++; // the canvas of checkpoint is ready for next frame
+            for (NSUInteger i = fromIndex; i <= frame.index; i++) {
+                [self _apngPredecodeFramesFromIndex:i toIndex:frame.index];
                 if (i == frame.index) {
                     if (!imageRef) imageRef = [self _newBlendedImageWithFrame:frame];
                 } else {
                     [self _blendImageWithFrame:_frames[i]];
                 }
+                _blendFrameIndex = i;
+                [self _blendSaveCheckpointIfNeeded];
             }
+            [_apngFramePixels removeAllObjects];
             _blendFrameIndex = index;
         }
     }
@@ -1700,6 +1449,47 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return frame;
 }
 
+- (YYImageFrame *)_frameAtIndex:(NSUInteger)index maxPixelSize:(NSUInteger)maxPixelSize decodeForDisplay:(BOOL)decodeForDisplay {
+    if (maxPixelSize == 0 || MAX(_width, _height) <= maxPixelSize) {
+        return [self _frameAtIndex:index decodeForDisplay:decodeForDisplay];
+    }
+    if (index >= _frames.count) return nil;
+    
+    CGImageRef imageRef = NULL;
+    BOOL decoded = NO;
+    if (_frames.count == 1 && _finalized && _type != YYImageTypeICO) {
+        imageRef = [self _newDownsampledImageAtIndex:index maxPixelSize:maxPixelSize decoded:&decoded];
+    }
+    if (!imageRef) { // decode in full size and scale
+        YYImageFrame *fullFrame = [self _frameAtIndex:index decodeForDisplay:YES];
+        imageRef = YYCGImageCreateDownsampledCopy(fullFrame.image.CGImage, maxPixelSize);
+        if (!imageRef) return nil;
+        decoded = YES;
+    }
+    if (decodeForDisplay && !decoded) {
+        CGImageRef imageRefDecoded = YYCGImageCreateDecodedCopy(imageRef, YES);
+        if (imageRefDecoded) {
+            CFRelease(imageRef);
+            imageRef = imageRefDecoded;
+            decoded = YES;
+        }
+    }
+    
+    _YYImageDecoderFrame *frame = [(_YYImageDecoderFrame *)_frames[index] copy];
+    frame.width = CGImageGetWidth(imageRef);
+    frame.height = CGImageGetHeight(imageRef);
+    frame.offsetX = 0;
+    frame.offsetY = 0;
+    frame.dispose = YYImageDisposeNone;
+    frame.blend = YYImageBlendNone;
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:_scale orientation:_orientation];
+    CFRelease(imageRef);
+    if (!image) return nil;
+    image.isDecodedForDisplay = decoded;
+    frame.image = image;
+    return frame;
+}
+
 - (NSDictionary *)_framePropertiesAtIndex:(NSUInteger)index {
     if (index >= _frames.count) return nil;
     if (!_source) return nil;
@@ -1718,6 +1508,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 #pragma private
 
 - (void)_updateSource {
+    NSUInteger frameCount = _frameCount;
     switch (_type) {
         case YYImageTypeWebP: {
             [self _updateSourceWebP];
@@ -1731,6 +1522,9 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
             [self _updateSourceImageIO];
         } break;
     }
+    if (_frameCount != frameCount) {
+        [_blendCheckpoints removeAllObjects]; // the spacing is changed
+    }
 }
 
 - (void)_updateSourceWebP {
@@ -1752,12 +1546,22 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
      
      When using WebPDecode() to decode multi-frame webp, we will get the error
      "VP8_STATUS_UNSUPPORTED_FEATURE", so we first use WebPDemuxer to unpack it.
+     
+     Before the data is finalized, we use the partial demuxer and only expose the
+     frames which are complete. The demuxer refers the bytes, but the data may be
+     mutable, so the appended bytes are copied to our own buffer, the whole data is
+     not copied for each update. The partial demuxer still walks all the chunk
+     headers (not the payloads) each time.
      */
     
+    if (!_webpData) _webpData = [NSMutableData dataWithCapacity:_data.length];
+    if (_webpData.length < _data.length) {
+        [_webpData appendBytes:(const uint8_t *)_data.bytes + _webpData.length length:_data.length - _webpData.length];
+    }
     WebPData webPData = {0};
-    webPData.bytes = _data.bytes;
-    webPData.size = _data.length;
-    WebPDemuxer *demuxer = WebPDemux(&webPData);
+    webPData.bytes = _webpData.bytes;
+    webPData.size = _webpData.length;
+    WebPDemuxer *demuxer = _finalized ? WebPDemux(&webPData) : WebPDemuxPartial(&webPData, NULL);
     if (!demuxer) return;
     
     uint32_t webpFrameCount = WebPDemuxGetI(demuxer, WEBP_FF_FRAME_COUNT);
@@ -1776,6 +1580,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     WebPIterator iter = {0};
     if (WebPDemuxGetFrame(demuxer, 1, &iter)) { // one-based index...
         do {
+            if (!iter.complete) break; // partial data
             _YYImageDecoderFrame *frame = [_YYImageDecoderFrame new];
             [frames addObject:frame];
             if (iter.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND) {
@@ -1815,7 +1620,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
         } while (WebPDemuxNextFrame(&iter));
         WebPDemuxReleaseIterator(&iter);
     }
-    if (frames.count != webpFrameCount) {
+    if (_finalized ? (frames.count != webpFrameCount) : (frames.count == 0)) {
         WebPDemuxDelete(demuxer);
         return;
     }
@@ -1851,12 +1656,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     
     yy_png_info_release(_apngSource);
     _apngSource = nil;
+    _apngDecodeDirect = NO;
     
     [self _updateSourceImageIO]; // decode first frame
     if (_frameCount == 0) return; // png decode failed
-    if (!_finalized) return; // ignore multi-frame before finalized
+    if (!_finalized && _pngParser.complete_frame_num < 2) return; // no complete animation yet
     
-    yy_png_info *apng = yy_png_info_create(_data.bytes, (uint32_t)_data.length);
+    // the chunks are already parsed by _pngParser, partial info contains the complete frames
+    yy_png_info *apng = yy_png_info_create_with_parser(&_pngParser, _data.bytes, (uint32_t)_data.length, !_finalized);
     if (!apng) return; // apng decode failed
     if (apng->apng_frame_num == 0 ||
         (apng->apng_frame_num == 1 && apng->apng_first_frame_is_cover)) {
@@ -1872,12 +1679,17 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     uint32_t canvasHeight = apng->header.height;
     NSMutableArray *frames = [NSMutableArray new];
     BOOL needBlend = NO;
+    BOOL decodeDirect = yy_png_pixel_format_read(_data.bytes, apng, &_apngFormat);
     uint32_t lastBlendIndex = 0;
     for (uint32_t i = 0; i < apng->apng_frame_num; i++) {
         _YYImageDecoderFrame *frame = [_YYImageDecoderFrame new];
         [frames addObject:frame];
         
         yy_png_frame_info *fi = apng->apng_frames + i;
+        if ((uint64_t)fi->frame_control.x_offset + fi->frame_control.width > canvasWidth ||
+            (uint64_t)fi->frame_control.y_offset + fi->frame_control.height > canvasHeight) {
+            decodeDirect = NO; // the frame should be clipped
+        }
         frame.index = i;
         frame.duration = yy_png_delay_to_seconds(fi->frame_control.delay_num, fi->frame_control.delay_den);
         frame.hasAlpha = YES;
@@ -1931,6 +1743,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     _loopCount = apng->apng_loop_num;
     _needBlend = needBlend;
     _apngSource = apng;
+    _apngDecodeDirect = decodeDirect;
     dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
     _frames = frames;
     dispatch_semaphore_signal(_framesLock);
@@ -1960,12 +1773,17 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     _frameCount = CGImageSourceGetCount(_source);
     if (_frameCount == 0) return;
     
-    if (!_finalized) { // ignore multi-frame before finalized
-        _frameCount = 1;
-    } else {
-        if (_type == YYImageTypePNG) { // use custom apng decoder and ignore multi-frame
+    if (!_finalized) { // only the complete frames before finalized
+        if (_type == YYImageTypeGIF && _gifParser.frame_num > 1) { // the complete frames
+            _frameCount = MIN(_frameCount, _gifParser.frame_num);
+        } else {
             _frameCount = 1;
         }
+    }
+    if (_type == YYImageTypePNG) { // use custom apng decoder and ignore multi-frame
+        _frameCount = 1;
+    }
+    if (_finalized || _frameCount > 1) {
         if (_type == YYImageTypeGIF) { // get gif loop count
             CFDictionaryRef properties = CGImageSourceCopyProperties(_source, NULL);
             if (properties) {
@@ -2039,8 +1857,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                          extendToCanvas:(BOOL)extendToCanvas
                                 decoded:(BOOL *)decoded CF_RETURNS_RETAINED {
     
-    if (!_finalized && index > 0) return NULL;
-    if (_frames.count <= index) return NULL;
+    if (_frames.count <= index) return NULL; // the frames before finalized are complete
     _YYImageDecoderFrame *frame = _frames[index];
     
     if (_source) {
@@ -2073,6 +1890,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     }
     
     if (_apngSource) {
+        if (_apngDecodeDirect) {
+            CGImageRef imageRef = [self _newAPNGImageAtIndex:index extendToCanvas:extendToCanvas];
+            if (imageRef) {
+                if (decoded) *decoded = YES;
+                return imageRef;
+            }
+        }
+        
         uint32_t size = 0;
         uint8_t *bytes = yy_png_copy_frame_data_at_index(_data.bytes, _apngSource, (uint32_t)index, &size);
         if (!bytes) return NULL;
@@ -2195,105 +2020,368 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return NULL;
 }
 
+/// Decode the APNG frame without ImageIO, returns a BGRA8888 (premultiplied) image.
+- (CGImageRef)_newAPNGImageAtIndex:(NSUInteger)index extendToCanvas:(BOOL)extendToCanvas CF_RETURNS_RETAINED {
+    if (index >= _apngSource->apng_frame_num) return NULL;
+    yy_png_chunk_fcTL *fcTL = &_apngSource->apng_frames[index].frame_control;
+    size_t width = extendToCanvas ? _width : fcTL->width;
+    size_t height = extendToCanvas ? _height : fcTL->height;
+    size_t bytesPerRow = YYImageByteAlign(width * 4, 32);
+    size_t length = bytesPerRow * height;
+    uint8_t *pixels = extendToCanvas ? calloc(1, length) : malloc(length); // the canvas out of frame is transparent
+    if (!pixels) return NULL;
+    
+    uint8_t *dest = pixels;
+    if (extendToCanvas) dest += fcTL->y_offset * bytesPerRow + fcTL->x_offset * 4; // decode into the canvas directly
+    if (!yy_png_decode_frame(_data.bytes, _apngSource, &_apngFormat, (uint32_t)index, dest, bytesPerRow)) {
+        free(pixels);
+        return NULL;
+    }
+    CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, length, YYCGDataProviderReleaseDataCallback);
+    if (!provider) {
+        free(pixels);
+        return NULL;
+    }
+    CGImageRef imageRef = CGImageCreate(width, height, 8, 32, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst, provider, NULL, false, kCGRenderingIntentDefault);
+    CFRelease(provider);
+    return imageRef;
+}
+
+/// The frames which will be drawn to canvas are decoded concurrently, start from
+/// `fromIndex` until the pixels reach YY_APNG_PREDECODE_LIMIT.
+- (void)_apngPredecodeFramesFromIndex:(NSUInteger)fromIndex toIndex:(NSUInteger)toIndex {
+    if (!_apngDecodeDirect || fromIndex >= toIndex || toIndex >= _frames.count) return;
+    
+    uint32_t *indexes = malloc(sizeof(uint32_t) * (toIndex - fromIndex + 1));
+    if (!indexes) return;
+    NSUInteger count = 0, bytes = 0;
+    for (NSUInteger i = fromIndex; i <= toIndex; i++) {
+        _YYImageDecoderFrame *frame = _frames[i];
+        // see `_blendImageWithFrame:`, only the target frame and the frames without dispose are drawn
+        if (i != toIndex && frame.dispose != YYImageDisposeNone) continue;
+        if (_apngFramePixels[@(i)]) break; // already decoded
+        NSUInteger frameBytes = frame.width * frame.height * 4;
+        if (count > 0 && bytes + frameBytes > YY_APNG_PREDECODE_LIMIT) break;
+        indexes[count++] = (uint32_t)i;
+        bytes += frameBytes;
+    }
+    if (count < 2) { // decode on demand
+        free(indexes);
+        return;
+    }
+    
+    uint8_t **buffers = calloc(count, sizeof(uint8_t *));
+    if (!buffers) {
+        free(indexes);
+        return;
+    }
+    const uint8_t *data = _data.bytes;
+    const yy_png_info *apng = _apngSource;
+    const yy_png_pixel_format *format = &_apngFormat;
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        const yy_png_chunk_fcTL *fcTL = &apng->apng_frames[indexes[i]].frame_control;
+        size_t bytesPerRow = fcTL->width * 4;
+        uint8_t *pixels = malloc(bytesPerRow * fcTL->height);
+        if (!pixels) return;
+        if (yy_png_decode_frame(data, apng, format, indexes[i], pixels, bytesPerRow)) {
+            buffers[i] = pixels;
+        } else {
+            free(pixels);
+        }
+    });
+    
+    if (!_apngFramePixels) _apngFramePixels = [NSMutableDictionary new];
+    for (NSUInteger i = 0; i < count; i++) {
+        if (!buffers[i]) continue;
+        const yy_png_chunk_fcTL *fcTL = &apng->apng_frames[indexes[i]].frame_control;
+        NSData *pixels = [NSData dataWithBytesNoCopy:buffers[i] length:fcTL->width * 4 * fcTL->height freeWhenDone:YES];
+        if (pixels) _apngFramePixels[@(indexes[i])] = pixels;
+        else free(buffers[i]);
+    }
+    free(buffers);
+    free(indexes);
+}
+
+/// Decode a still image with downsampling, returns NULL if it's not supported.
+- (CGImageRef)_newDownsampledImageAtIndex:(NSUInteger)index
+                             maxPixelSize:(NSUInteger)maxPixelSize
+                                  decoded:(BOOL *)decoded CF_RETURNS_RETAINED {
+    if (_source) {
+        // the raw pixels are used (no EXIF transform), the orientation is applied by UIImage
+        NSDictionary *options = @{(id)kCGImageSourceCreateThumbnailFromImageAlways : @(YES),
+                                  (id)kCGImageSourceThumbnailMaxPixelSize : @(maxPixelSize),
+                                  (id)kCGImageSourceShouldCache : @(NO)};
+        return CGImageSourceCreateThumbnailAtIndex(_source, index, (CFDictionaryRef)options);
+    }
+    
+#if YYIMAGE_WEBP_ENABLED
+    if (_webpSource) {
+        WebPIterator iter;
+        if (!WebPDemuxGetFrame(_webpSource, (int)(index + 1), &iter)) return NULL;
+        int frameWidth = iter.width;
+        int frameHeight = iter.height;
+        if (frameWidth < 1 || frameHeight < 1) {
+            WebPDemuxReleaseIterator(&iter);
+            return NULL;
+        }
+        double ratio = (double)maxPixelSize / MAX(frameWidth, frameHeight);
+        int width = MAX((int)round(frameWidth * ratio), 1);
+        int height = MAX((int)round(frameHeight * ratio), 1);
+        
+        WebPDecoderConfig config;
+        if (!WebPInitDecoderConfig(&config) ||
+            WebPGetFeatures(iter.fragment.bytes, iter.fragment.size, &config.input) != VP8_STATUS_OK) {
+            WebPDemuxReleaseIterator(&iter);
+            return NULL;
+        }
+        size_t bytesPerRow = YYImageByteAlign(4 * width, 32);
+        size_t length = bytesPerRow * height;
+        void *pixels = calloc(1, length);
+        if (!pixels) {
+            WebPDemuxReleaseIterator(&iter);
+            return NULL;
+        }
+        config.options.use_scaling = 1;
+        config.options.scaled_width = width;
+        config.options.scaled_height = height;
+        config.output.colorspace = MODE_bgrA;
+        config.output.is_external_memory = 1;
+        config.output.u.RGBA.rgba = pixels;
+        config.output.u.RGBA.stride = (int)bytesPerRow;
+        config.output.u.RGBA.size = length;
+        VP8StatusCode result = WebPDecode(iter.fragment.bytes, iter.fragment.size, &config); // decode and scale
+        WebPDemuxReleaseIterator(&iter);
+        if ((result != VP8_STATUS_OK) && (result != VP8_STATUS_NOT_ENOUGH_DATA)) {
+            free(pixels);
+            return NULL;
+        }
+        
+        CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, length, YYCGDataProviderReleaseDataCallback);
+        if (!provider) {
+            free(pixels);
+            return NULL;
+        }
+        pixels = NULL; // hold by provider
+        CGImageRef image = CGImageCreate(width, height, 8, 32, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst, provider, NULL, false, kCGRenderingIntentDefault);
+        CFRelease(provider);
+        if (decoded) *decoded = YES;
+        return image;
+    }
+#endif
+    
+    return NULL;
+}
+
 - (BOOL)_createBlendContextIfNeeded {
     if (!_blendCanvas) {
         _blendFrameIndex = NSNotFound;
-        _blendCanvas = CGBitmapContextCreate(NULL, _width, _height, 8, 0, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+        _blendBytesPerRow = YYImageByteAlign(_width * 4, 32);
+        _blendBuffer = calloc(1, _blendBytesPerRow * _height);
+        if (!_blendBuffer) return NO;
+        // the pixels are written directly, so the images are not created by CGBitmapContextCreateImage() (copy on write)
+        _blendCanvas = CGBitmapContextCreate(_blendBuffer, _width, _height, 8, _blendBytesPerRow, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+        if (!_blendCanvas) {
+            free(_blendBuffer);
+            _blendBuffer = NULL;
+        }
     }
     BOOL suc = _blendCanvas != NULL;
     return suc;
 }
 
+/// The frame index spacing of checkpoints, or 0 if no checkpoint can be saved.
+- (NSUInteger)_blendCheckpointSpacing {
+    if (!_finalized || _frames.count < 2) return 0;
+    NSUInteger canvasSize = _blendBytesPerRow * _height;
+    if (canvasSize == 0) return 0;
+    NSUInteger maxCount = MIN(_blendCheckpointMemoryLimit / canvasSize, _frames.count);
+    if (maxCount == 0) return 0;
+    return MAX((_frames.count + maxCount - 1) / maxCount, 2); // the next frame needs no checkpoint
+}
+
+/// Save the canvas (after `_blendFrameIndex` is blended and disposed) as a checkpoint.
+- (void)_blendSaveCheckpointIfNeeded {
+    NSUInteger index = _blendFrameIndex;
+    if (index == NSNotFound || index + 1 >= _frames.count) return;
+    NSUInteger spacing = [self _blendCheckpointSpacing];
+    if (spacing == 0 || index % spacing != spacing - 1) return;
+    // no checkpoint is needed if the next frame does not blend from the canvas
+    _YYImageDecoderFrame *next = _frames[index + 1];
+    if (next.blendFromIndex == next.index) return;
+    if (!_blendCheckpoints) _blendCheckpoints = [NSMutableDictionary new];
+    if (_blendCheckpoints[@(index)]) return;
+    NSData *canvas = [NSData dataWithBytes:_blendBuffer length:_blendBytesPerRow * _height];
+    if (canvas) _blendCheckpoints[@(index)] = canvas;
+}
+
+/// Restore the nearest checkpoint to draw the frame, returns its frame index or NSNotFound.
+- (NSUInteger)_blendRestoreCheckpointForFrame:(_YYImageDecoderFrame *)frame {
+    NSUInteger spacing = _blendCheckpoints.count ? [self _blendCheckpointSpacing] : 0;
+    if (spacing == 0 || frame.index == 0) return NSNotFound;
+    // the checkpoints are at (n * spacing - 1)
+    for (NSInteger i = (NSInteger)(frame.index / spacing * spacing) - 1; i >= (NSInteger)frame.blendFromIndex; i -= (NSInteger)spacing) {
+        NSData *canvas = _blendCheckpoints[@(i)];
+        if (canvas.length == _blendBytesPerRow * _height) {
+            memcpy(_blendBuffer, canvas.bytes, canvas.length);
+            return i;
+        }
+    }
+    return NSNotFound;
+}
+
+/// Get the frame region in canvas buffer (top-left origin, clipped to canvas).
+/// srcX and srcY is the origin of the region in frame.
+- (BOOL)_blendRegionOfFrame:(_YYImageDecoderFrame *)frame x:(size_t *)x y:(size_t *)y width:(size_t *)width height:(size_t *)height srcX:(size_t *)srcX srcY:(size_t *)srcY {
+    int64_t left = (int64_t)frame.offsetX;
+    int64_t top = (int64_t)_height - (int64_t)frame.offsetY - (int64_t)frame.height; // offsetY is bottom-left origin
+    int64_t right = left + (int64_t)frame.width;
+    int64_t bottom = top + (int64_t)frame.height;
+    int64_t clippedLeft = MAX(left, 0), clippedTop = MAX(top, 0);
+    int64_t clippedRight = MIN(right, (int64_t)_width), clippedBottom = MIN(bottom, (int64_t)_height);
+    if (clippedLeft >= clippedRight || clippedTop >= clippedBottom) return NO;
+    *x = (size_t)clippedLeft;
+    *y = (size_t)clippedTop;
+    *width = (size_t)(clippedRight - clippedLeft);
+    *height = (size_t)(clippedBottom - clippedTop);
+    if (srcX) *srcX = (size_t)(clippedLeft - left);
+    if (srcY) *srcY = (size_t)(clippedTop - top);
+    return YES;
+}
+
+- (void)_blendClearFrame:(_YYImageDecoderFrame *)frame {
+    size_t x, y, width, height;
+    if (![self _blendRegionOfFrame:frame x:&x y:&y width:&width height:&height srcX:NULL srcY:NULL]) return;
+    for (size_t row = y; row < y + height; row++) {
+        memset(_blendBuffer + row * _blendBytesPerRow + x * 4, 0, width * 4);
+    }
+}
+
+/// Save (or restore) the frame region of canvas for YYImageDisposePrevious.
+- (void)_blendCopyFrame:(_YYImageDecoderFrame *)frame restore:(BOOL)restore {
+    size_t x, y, width, height;
+    if (![self _blendRegionOfFrame:frame x:&x y:&y width:&width height:&height srcX:NULL srcY:NULL]) return;
+    if (!_blendSavedBuffer) {
+        _blendSavedBuffer = malloc(_blendBytesPerRow * _height); // large enough for any frame
+        if (!_blendSavedBuffer) return;
+    }
+    for (size_t row = 0; row < height; row++) {
+        uint8_t *canvas = _blendBuffer + (y + row) * _blendBytesPerRow + x * 4;
+        uint8_t *saved = _blendSavedBuffer + row * width * 4;
+        if (restore) memcpy(canvas, saved, width * 4);
+        else memcpy(saved, canvas, width * 4);
+    }
+}
+
+/// Draw the frame image to canvas with the frame's blend operation, the frame region
+/// should be cleared before if the blend operation is YYImageBlendNone.
+- (void)_blendDrawImage:(CGImageRef)imageRef frame:(_YYImageDecoderFrame *)frame {
+    size_t x, y, width, height, srcX, srcY;
+    if (![self _blendRegionOfFrame:frame x:&x y:&y width:&width height:&height srcX:&srcX srcY:&srcY]) return;
+    
+    // composite the BGRA/BGRX pixels directly, other formats are drawn with CoreGraphics
+    CGBitmapInfo bitmapInfo = CGImageGetBitmapInfo(imageRef);
+    CGImageAlphaInfo alphaInfo = bitmapInfo & kCGBitmapAlphaInfoMask;
+    CGColorSpaceRef space = CGImageGetColorSpace(imageRef);
+    size_t srcBytesPerRow = CGImageGetBytesPerRow(imageRef);
+    if (CGImageGetWidth(imageRef) == frame.width &&
+        CGImageGetHeight(imageRef) == frame.height &&
+        CGImageGetBitsPerComponent(imageRef) == 8 &&
+        CGImageGetBitsPerPixel(imageRef) == 32 &&
+        (bitmapInfo & kCGBitmapByteOrderMask) == kCGBitmapByteOrder32Host &&
+        (alphaInfo == kCGImageAlphaPremultipliedFirst || alphaInfo == kCGImageAlphaNoneSkipFirst) &&
+        space && CGColorSpaceGetModel(space) == kCGColorSpaceModelRGB) {
+        CGDataProviderRef provider = CGImageGetDataProvider(imageRef);
+        CFDataRef data = provider ? CGDataProviderCopyData(provider) : NULL;
+        if (data) {
+            if ((size_t)CFDataGetLength(data) >= srcBytesPerRow * frame.height) {
+                const uint8_t *src = CFDataGetBytePtr(data) + srcY * srcBytesPerRow + srcX * 4;
+                uint8_t *dest = _blendBuffer + y * _blendBytesPerRow + x * 4;
+                YYImageBlendARGB8888(dest, _blendBytesPerRow, src, srcBytesPerRow, width, height,
+                                     frame.blend, alphaInfo == kCGImageAlphaNoneSkipFirst);
+                CFRelease(data);
+                return;
+            }
+            CFRelease(data);
+        }
+    }
+    CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), imageRef);
+}
+
+/// Draw the frame to canvas with the frame's blend operation.
+- (void)_blendDrawFrame:(_YYImageDecoderFrame *)frame {
+    if (_apngDecodeDirect) { // composite the decoded APNG pixels directly
+        NSData *pixels = _apngFramePixels[@(frame.index)];
+        if (pixels) {
+            [_apngFramePixels removeObjectForKey:@(frame.index)];
+        } else {
+            size_t length = frame.width * frame.height * 4;
+            uint8_t *bytes = malloc(length);
+            if (bytes && yy_png_decode_frame(_data.bytes, _apngSource, &_apngFormat, (uint32_t)frame.index, bytes, frame.width * 4)) {
+                pixels = [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+            } else if (bytes) {
+                free(bytes);
+            }
+        }
+        if (pixels) {
+            size_t x, y, width, height, srcX, srcY;
+            if ([self _blendRegionOfFrame:frame x:&x y:&y width:&width height:&height srcX:&srcX srcY:&srcY]) {
+                const uint8_t *src = (const uint8_t *)pixels.bytes + (srcY * frame.width + srcX) * 4;
+                uint8_t *dest = _blendBuffer + y * _blendBytesPerRow + x * 4;
+                YYImageBlendARGB8888(dest, _blendBytesPerRow, src, frame.width * 4, width, height, frame.blend, NO);
+            }
+            return;
+        }
+    }
+    
+    CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
+    if (unblendImage) {
+        if (frame.blend != YYImageBlendOver) [self _blendClearFrame:frame];
+        [self _blendDrawImage:unblendImage frame:frame];
+        CFRelease(unblendImage);
+    }
+}
+
+/// Create an image with a copy of the canvas pixels.
+- (CGImageRef)_newImageFromBlendCanvas CF_RETURNS_RETAINED {
+    size_t length = _blendBytesPerRow * _height;
+    void *pixels = malloc(length);
+    if (!pixels) return NULL;
+    memcpy(pixels, _blendBuffer, length);
+    CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, length, YYCGDataProviderReleaseDataCallback);
+    if (!provider) {
+        free(pixels);
+        return NULL;
+    }
+    CGImageRef imageRef = CGImageCreate(_width, _height, 8, 32, _blendBytesPerRow, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst, provider, NULL, false, kCGRenderingIntentDefault);
+    CFRelease(provider);
+    return imageRef;
+}
+
 - (void)_blendImageWithFrame:(_YYImageDecoderFrame *)frame {
     if (frame.dispose == YYImageDisposePrevious) {
         // nothing
     } else if (frame.dispose == YYImageDisposeBackground) {
-        CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
+        [self _blendClearFrame:frame];
     } else { // no dispose
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-        } else {
-            CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-        }
+        [self _blendDrawFrame:frame];
     }
 }
 
 - (CGImageRef)_newBlendedImageWithFrame:(_YYImageDecoderFrame *)frame CF_RETURNS_RETAINED{
     CGImageRef imageRef = NULL;
     if (frame.dispose == YYImageDisposePrevious) {
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef previousImage = CGBitmapContextCreateImage(_blendCanvas);
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
-            if (previousImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(0, 0, _width, _height), previousImage);
-                CFRelease(previousImage);
-            }
-        } else {
-            CGImageRef previousImage = CGBitmapContextCreateImage(_blendCanvas);
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
-            if (previousImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(0, 0, _width, _height), previousImage);
-                CFRelease(previousImage);
-            }
-        }
+        // only the frame region is changed, it's restored after the image created
+        [self _blendCopyFrame:frame restore:NO];
+        [self _blendDrawFrame:frame];
+        imageRef = [self _newImageFromBlendCanvas];
+        [self _blendCopyFrame:frame restore:YES];
     } else if (frame.dispose == YYImageDisposeBackground) {
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-        } else {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-        }
+        [self _blendDrawFrame:frame];
+        imageRef = [self _newImageFromBlendCanvas];
+        [self _blendClearFrame:frame];
     } else { // no dispose
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-        } else {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-        }
+        [self _blendDrawFrame:frame];
+        imageRef = [self _newImageFromBlendCanvas];
     }
     return imageRef;
 }
@@ -0,0 +1,871 @@
+//
+//  _YYImagePNG.c
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 15/5/13.
+//  Copyright (c) 2015 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#include "_YYImagePNG.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - APNG
+
+void yy_png_chunk_IHDR_read(yy_png_chunk_IHDR *IHDR, const uint8_t *data) {
+    IHDR->width = yy_swap_endian_uint32(*((uint32_t *)(data)));
+    IHDR->height = yy_swap_endian_uint32(*((uint32_t *)(data + 4)));
+    IHDR->bit_depth = data[8];
+    IHDR->color_type = data[9];
+    IHDR->compression_method = data[10];
+    IHDR->filter_method = data[11];
+    IHDR->interlace_method = data[12];
+}
+
+void yy_png_chunk_IHDR_write(yy_png_chunk_IHDR *IHDR, uint8_t *data) {
+    *((uint32_t *)(data)) = yy_swap_endian_uint32(IHDR->width);
+    *((uint32_t *)(data + 4)) = yy_swap_endian_uint32(IHDR->height);
+    data[8] = IHDR->bit_depth;
+    data[9] = IHDR->color_type;
+    data[10] = IHDR->compression_method;
+    data[11] = IHDR->filter_method;
+    data[12] = IHDR->interlace_method;
+}
+
+void yy_png_chunk_fcTL_read(yy_png_chunk_fcTL *fcTL, const uint8_t *data) {
+    fcTL->sequence_number = yy_swap_endian_uint32(*((uint32_t *)(data)));
+    fcTL->width = yy_swap_endian_uint32(*((uint32_t *)(data + 4)));
+    fcTL->height = yy_swap_endian_uint32(*((uint32_t *)(data + 8)));
+    fcTL->x_offset = yy_swap_endian_uint32(*((uint32_t *)(data + 12)));
+    fcTL->y_offset = yy_swap_endian_uint32(*((uint32_t *)(data + 16)));
+    fcTL->delay_num = yy_swap_endian_uint16(*((uint16_t *)(data + 20)));
+    fcTL->delay_den = yy_swap_endian_uint16(*((uint16_t *)(data + 22)));
+    fcTL->dispose_op = data[24];
+    fcTL->blend_op = data[25];
+}
+
+void yy_png_chunk_fcTL_write(yy_png_chunk_fcTL *fcTL, uint8_t *data) {
+    *((uint32_t *)(data)) = yy_swap_endian_uint32(fcTL->sequence_number);
+    *((uint32_t *)(data + 4)) = yy_swap_endian_uint32(fcTL->width);
+    *((uint32_t *)(data + 8)) = yy_swap_endian_uint32(fcTL->height);
+    *((uint32_t *)(data + 12)) = yy_swap_endian_uint32(fcTL->x_offset);
+    *((uint32_t *)(data + 16)) = yy_swap_endian_uint32(fcTL->y_offset);
+    *((uint16_t *)(data + 20)) = yy_swap_endian_uint16(fcTL->delay_num);
+    *((uint16_t *)(data + 22)) = yy_swap_endian_uint16(fcTL->delay_den);
+    data[24] = fcTL->dispose_op;
+    data[25] = fcTL->blend_op;
+}
+
+void yy_png_delay_to_fraction(double duration, uint16_t *num, uint16_t *den) {
+    if (duration >= 0xFF) {
+        *num = 0xFF;
+        *den = 1;
+    } else if (duration <= 1.0 / (double)0xFF) {
+        *num = 1;
+        *den = 0xFF;
+    } else {
+        // Use continued fraction to calculate the num and den.
+        long MAX = 10;
+        double eps = (0.5 / (double)0xFF);
+        long p[MAX], q[MAX], a[MAX], i, numl = 0, denl = 0;
+        // The first two convergents are 0/1 and 1/0
+        p[0] = 0; q[0] = 1;
+        p[1] = 1; q[1] = 0;
+        // The rest of the convergents (and continued fraction)
+        for (i = 2; i < MAX; i++) {
+            a[i] = lrint(floor(duration));
+            p[i] = a[i] * p[i - 1] + p[i - 2];
+            q[i] = a[i] * q[i - 1] + q[i - 2];
+            if (p[i] <= 0xFF && q[i] <= 0xFF) { // uint16_t
+                numl = p[i];
+                denl = q[i];
+            } else break;
+            if (fabs(duration - a[i]) < eps) break;
+            duration = 1.0 / (duration - a[i]);
+        }
+        
+        if (numl != 0 && denl != 0) {
+            *num = numl;
+            *den = denl;
+        } else {
+            *num = 1;
+            *den = 100;
+        }
+    }
+}
+
+double yy_png_delay_to_seconds(uint16_t num, uint16_t den) {
+    if (den == 0) {
+        return num / 100.0;
+    } else {
+        return (double)num / (double)den;
+    }
+}
+
+static bool yy_png_validate_animation_chunk_order(yy_png_chunk_info *chunks,  /* input */
+                                                  uint32_t chunk_num,         /* input */
+                                                  uint32_t *first_idat_index, /* output */
+                                                  bool *first_frame_is_cover  /* output */) {
+    /*
+     PNG at least contains 3 chunks: IHDR, IDAT, IEND.
+     `IHDR` must appear first.
+     `IDAT` must appear consecutively.
+     `IEND` must appear end.
+     
+     APNG must contains one `acTL` and at least one 'fcTL' and `fdAT`.
+     `fdAT` must appear consecutively.
+     `fcTL` must appear before `IDAT` or `fdAT`.
+     */
+    if (chunk_num <= 2) return false;
+    if (chunks->fourcc != YY_FOUR_CC('I', 'H', 'D', 'R')) return false;
+    if ((chunks + chunk_num - 1)->fourcc != YY_FOUR_CC('I', 'E', 'N', 'D')) return false;
+    
+    uint32_t prev_fourcc = 0;
+    uint32_t IHDR_num = 0;
+    uint32_t IDAT_num = 0;
+    uint32_t acTL_num = 0;
+    uint32_t fcTL_num = 0;
+    uint32_t first_IDAT = 0;
+    bool first_frame_cover = false;
+    for (uint32_t i = 0; i < chunk_num; i++) {
+        yy_png_chunk_info *chunk = chunks + i;
+        switch (chunk->fourcc) {
+            case YY_FOUR_CC('I', 'H', 'D', 'R'): {  // png header
+                if (i != 0) return false;
+                if (IHDR_num > 0) return false;
+                IHDR_num++;
+            } break;
+            case YY_FOUR_CC('I', 'D', 'A', 'T'): {  // png data
+                if (prev_fourcc != YY_FOUR_CC('I', 'D', 'A', 'T')) {
+                    if (IDAT_num == 0)
+                        first_IDAT = i;
+                    else
+                        return false;
+                }
+                IDAT_num++;
+            } break;
+            case YY_FOUR_CC('a', 'c', 'T', 'L'): {  // apng control
+                if (acTL_num > 0) return false;
+                acTL_num++;
+            } break;
+            case YY_FOUR_CC('f', 'c', 'T', 'L'): {  // apng frame control
+                if (i + 1 == chunk_num) return false;
+                if ((chunk + 1)->fourcc != YY_FOUR_CC('f', 'd', 'A', 'T') &&
+                    (chunk + 1)->fourcc != YY_FOUR_CC('I', 'D', 'A', 'T')) {
+                    return false;
+                }
+                if (fcTL_num == 0) {
+                    if ((chunk + 1)->fourcc == YY_FOUR_CC('I', 'D', 'A', 'T')) {
+                        first_frame_cover = true;
+                    }
+                }
+                fcTL_num++;
+            } break;
+            case YY_FOUR_CC('f', 'd', 'A', 'T'): {  // apng data
+                if (prev_fourcc != YY_FOUR_CC('f', 'd', 'A', 'T') && prev_fourcc != YY_FOUR_CC('f', 'c', 'T', 'L')) {
+                    return false;
+                }
+            } break;
+        }
+        prev_fourcc = chunk->fourcc;
+    }
+    if (IHDR_num != 1) return false;
+    if (IDAT_num == 0) return false;
+    if (acTL_num != 1) return false;
+    if (fcTL_num < acTL_num) return false;
+    *first_idat_index = first_IDAT;
+    *first_frame_is_cover = first_frame_cover;
+    return true;
+}
+
+void yy_png_info_release(yy_png_info *info) {
+    if (info) {
+        if (info->chunks) free(info->chunks);
+        if (info->apng_frames) free(info->apng_frames);
+        if (info->apng_shared_chunk_indexs) free(info->apng_shared_chunk_indexs);
+        free(info);
+    }
+}
+
+void yy_png_parser_release(yy_png_parser *parser) {
+    if (parser->chunks) free(parser->chunks);
+    memset(parser, 0, sizeof(yy_png_parser));
+}
+
+static inline bool yy_png_fourcc_is_data(uint32_t fourcc) {
+    return fourcc == YY_FOUR_CC('I', 'D', 'A', 'T') || fourcc == YY_FOUR_CC('f', 'd', 'A', 'T');
+}
+
+void yy_png_parser_update(yy_png_parser *parser, const uint8_t *data, uint32_t length) {
+    if (parser->error || parser->ended) return;
+    if (parser->offset == 0) {
+        if (length < 8) return;
+        if (*((uint32_t *)data) != YY_FOUR_CC(0x89, 0x50, 0x4E, 0x47) ||
+            *((uint32_t *)(data + 4)) != YY_FOUR_CC(0x0D, 0x0A, 0x1A, 0x0A)) {
+            parser->error = true;
+            return;
+        }
+        parser->offset = 8;
+    }
+    
+    uint32_t chunk_realloc_num = 16;
+    while ((uint64_t)parser->offset + 12 <= length) {
+        const uint8_t *chunk_data = data + parser->offset;
+        uint32_t chunk_length = yy_swap_endian_uint32(*((uint32_t *)chunk_data));
+        if ((uint64_t)parser->offset + (uint64_t)chunk_length + 12 > length) break; // wait for more data
+        
+        if (parser->chunk_num >= parser->chunk_capacity) {
+            yy_png_chunk_info *new_chunks = realloc(parser->chunks, sizeof(yy_png_chunk_info) * (parser->chunk_capacity + chunk_realloc_num));
+            if (!new_chunks) {
+                parser->error = true;
+                return;
+            }
+            parser->chunks = new_chunks;
+            parser->chunk_capacity += chunk_realloc_num;
+        }
+        yy_png_chunk_info *chunk = parser->chunks + parser->chunk_num;
+        chunk->offset = parser->offset;
+        chunk->length = chunk_length;
+        chunk->fourcc = *((uint32_t *)(chunk_data + 4));
+        chunk->crc32 = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8 + chunk->length)));
+        
+        if (parser->chunk_num > 0 &&
+            yy_png_fourcc_is_data((chunk - 1)->fourcc) &&
+            !yy_png_fourcc_is_data(chunk->fourcc)) { // the data of previous frame ends
+            if ((chunk - 1)->fourcc == YY_FOUR_CC('I', 'D', 'A', 'T')) parser->image_complete = true;
+            parser->complete_frame_num = parser->apng_frame_index;
+            parser->complete_chunk_num = parser->chunk_num;
+        }
+        parser->chunk_num++;
+        parser->offset += 12 + chunk->length;
+        
+        switch (chunk->fourcc) {
+            case YY_FOUR_CC('a', 'c', 'T', 'L') : {
+                if (chunk->length == 8) {
+                    parser->apng_frame_number = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8)));
+                    parser->apng_loop_num = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 12)));
+                } else {
+                    parser->apng_chunk_error = true;
+                }
+            } break;
+            case YY_FOUR_CC('f', 'c', 'T', 'L') :
+            case YY_FOUR_CC('f', 'd', 'A', 'T') : {
+                if (chunk->fourcc == YY_FOUR_CC('f', 'c', 'T', 'L')) {
+                    if (chunk->length != 26) {
+                        parser->apng_chunk_error = true;
+                    } else {
+                        parser->apng_frame_index++;
+                    }
+                }
+                if (chunk->length > 4) {
+                    uint32_t sequence = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8)));
+                    if (parser->apng_sequence_num == sequence) {
+                        parser->apng_sequence_num++;
+                    } else {
+                        parser->apng_chunk_error = true;
+                    }
+                } else {
+                    parser->apng_chunk_error = true;
+                }
+            } break;
+            case YY_FOUR_CC('I', 'E', 'N', 'D') : {
+                parser->ended = true;
+                return; // ignore the data after `IEND`
+            } break;
+        }
+    }
+}
+
+yy_png_info *yy_png_info_create_with_parser(const yy_png_parser *parser, const uint8_t *data, uint32_t length, bool partial) {
+    if (parser->error) return NULL;
+    uint32_t chunk_num = parser->chunk_num;
+    uint32_t apng_frame_number = parser->apng_frame_number;
+    uint32_t apng_frame_index = parser->apng_frame_index;
+    if (partial) {
+        chunk_num = parser->complete_chunk_num;
+        apng_frame_number = apng_frame_index = parser->complete_frame_num;
+    } else {
+        if (length < 32) return NULL;
+        if (!parser->ended && (uint64_t)parser->offset + 12 <= length) return NULL; // truncated chunk
+    }
+    
+    if (chunk_num < (partial ? 2 : 3) ||
+        parser->chunks->fourcc != YY_FOUR_CC('I', 'H', 'D', 'R') ||
+        parser->chunks->length != 13) {
+        return NULL;
+    }
+    
+    yy_png_chunk_info *chunks = malloc(sizeof(yy_png_chunk_info) * (chunk_num + 1));
+    if (!chunks) return NULL;
+    memcpy(chunks, parser->chunks, sizeof(yy_png_chunk_info) * chunk_num);
+    if (partial) {
+        yy_png_chunk_info *chunk = chunks + chunk_num;
+        chunk->offset = 0;
+        chunk->fourcc = YY_FOUR_CC('I', 'E', 'N', 'D');
+        chunk->length = 0;
+        chunk->crc32 = 0xAE426082;
+        chunk_num++;
+    }
+    
+    // png info
+    yy_png_info *info = calloc(1, sizeof(yy_png_info));
+    if (!info) {
+        free(chunks);
+        return NULL;
+    }
+    info->chunks = chunks;
+    info->chunk_num = chunk_num;
+    yy_png_chunk_IHDR_read(&info->header, data + chunks->offset + 8);
+    
+    // apng info
+    if (!parser->apng_chunk_error && apng_frame_number == apng_frame_index && apng_frame_number >= 1) {
+        bool first_frame_is_cover = false;
+        uint32_t first_IDAT_index = 0;
+        if (!yy_png_validate_animation_chunk_order(info->chunks, info->chunk_num, &first_IDAT_index, &first_frame_is_cover)) {
+            return info; // ignore apng chunk
+        }
+        
+        info->apng_loop_num = parser->apng_loop_num;
+        info->apng_frame_num = apng_frame_number;
+        info->apng_first_frame_is_cover = first_frame_is_cover;
+        info->apng_shared_insert_index = first_IDAT_index;
+        info->apng_frames = calloc(apng_frame_number, sizeof(yy_png_frame_info));
+        if (!info->apng_frames) {
+            yy_png_info_release(info);
+            return NULL;
+        }
+        info->apng_shared_chunk_indexs = calloc(info->chunk_num, sizeof(uint32_t));
+        if (!info->apng_shared_chunk_indexs) {
+            yy_png_info_release(info);
+            return NULL;
+        }
+        
+        int32_t frame_index = -1;
+        uint32_t *shared_chunk_index = info->apng_shared_chunk_indexs;
+        for (int32_t i = 0; i < info->chunk_num; i++) {
+            yy_png_chunk_info *chunk = info->chunks + i;
+            switch (chunk->fourcc) {
+                case YY_FOUR_CC('I', 'D', 'A', 'T'): {
+                    if (info->apng_shared_insert_index == 0) {
+                        info->apng_shared_insert_index = i;
+                    }
+                    if (first_frame_is_cover) {
+                        yy_png_frame_info *frame = info->apng_frames + frame_index;
+                        frame->chunk_num++;
+                        frame->chunk_size += chunk->length + 12;
+                    }
+                } break;
+                case YY_FOUR_CC('a', 'c', 'T', 'L'): {
+                } break;
+                case YY_FOUR_CC('f', 'c', 'T', 'L'): {
+                    frame_index++;
+                    yy_png_frame_info *frame = info->apng_frames + frame_index;
+                    frame->chunk_index = i + 1;
+                    yy_png_chunk_fcTL_read(&frame->frame_control, data + chunk->offset + 8);
+                } break;
+                case YY_FOUR_CC('f', 'd', 'A', 'T'): {
+                    yy_png_frame_info *frame = info->apng_frames + frame_index;
+                    frame->chunk_num++;
+                    frame->chunk_size += chunk->length + 12;
+                } break;
+                default: {
+                    *shared_chunk_index = i;
+                    shared_chunk_index++;
+                    info->apng_shared_chunk_size += chunk->length + 12;
+                    info->apng_shared_chunk_num++;
+                } break;
+            }
+        }
+    }
+    return info;
+}
+
+yy_png_info *yy_png_info_create(const uint8_t *data, uint32_t length) {
+    if (length < 32) return NULL;
+    yy_png_parser parser = {0};
+    yy_png_parser_update(&parser, data, length);
+    yy_png_info *info = yy_png_info_create_with_parser(&parser, data, length, false);
+    yy_png_parser_release(&parser);
+    return info;
+}
+
+uint8_t *yy_png_copy_frame_data_at_index(const uint8_t *data,
+                                         const yy_png_info *info,
+                                         const uint32_t index,
+                                         uint32_t *size) {
+    if (index >= info->apng_frame_num) return NULL;
+    
+    yy_png_frame_info *frame_info = info->apng_frames + index;
+    uint32_t frame_remux_size = 8 /* PNG Header */ + info->apng_shared_chunk_size + frame_info->chunk_size;
+    if (!(info->apng_first_frame_is_cover && index == 0)) {
+        frame_remux_size -= frame_info->chunk_num * 4; // remove fdAT sequence number
+    }
+    uint8_t *frame_data = malloc(frame_remux_size);
+    if (!frame_data) return NULL;
+    *size = frame_remux_size;
+    
+    uint32_t data_offset = 0;
+    bool inserted = false;
+    memcpy(frame_data, data, 8); // PNG File Header
+    data_offset += 8;
+    for (uint32_t i = 0; i < info->apng_shared_chunk_num; i++) {
+        uint32_t shared_chunk_index = info->apng_shared_chunk_indexs[i];
+        yy_png_chunk_info *shared_chunk_info = info->chunks + shared_chunk_index;
+        
+        if (shared_chunk_index >= info->apng_shared_insert_index && !inserted) { // replace IDAT with fdAT
+            inserted = true;
+            for (uint32_t c = 0; c < frame_info->chunk_num; c++) {
+                yy_png_chunk_info *insert_chunk_info = info->chunks + frame_info->chunk_index + c;
+                if (insert_chunk_info->fourcc == YY_FOUR_CC('f', 'd', 'A', 'T')) {
+                    *((uint32_t *)(frame_data + data_offset)) = yy_swap_endian_uint32(insert_chunk_info->length - 4);
+                    *((uint32_t *)(frame_data + data_offset + 4)) = YY_FOUR_CC('I', 'D', 'A', 'T');
+                    memcpy(frame_data + data_offset + 8, data + insert_chunk_info->offset + 12, insert_chunk_info->length - 4);
+                    uint32_t crc = (uint32_t)crc32(0, frame_data + data_offset + 4, insert_chunk_info->length);
+                    *((uint32_t *)(frame_data + data_offset + insert_chunk_info->length + 4)) = yy_swap_endian_uint32(crc);
+                    data_offset += insert_chunk_info->length + 8;
+                } else { // IDAT
+                    memcpy(frame_data + data_offset, data + insert_chunk_info->offset, insert_chunk_info->length + 12);
+                    data_offset += insert_chunk_info->length + 12;
+                }
+            }
+        }
+        
+        if (shared_chunk_info->fourcc == YY_FOUR_CC('I', 'H', 'D', 'R')) {
+            uint8_t tmp[25] = {0};
+            memcpy(tmp, data + shared_chunk_info->offset, 25);
+            yy_png_chunk_IHDR IHDR = info->header;
+            IHDR.width = frame_info->frame_control.width;
+            IHDR.height = frame_info->frame_control.height;
+            yy_png_chunk_IHDR_write(&IHDR, tmp + 8);
+            *((uint32_t *)(tmp + 21)) = yy_swap_endian_uint32((uint32_t)crc32(0, tmp + 4, 17));
+            memcpy(frame_data + data_offset, tmp, 25);
+            data_offset += 25;
+        } else if (shared_chunk_info->fourcc == YY_FOUR_CC('I', 'E', 'N', 'D') && shared_chunk_info->length == 0) {
+            // may be not in the data (partial info)
+            static const uint8_t IEND[12] = {0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82};
+            memcpy(frame_data + data_offset, IEND, 12);
+            data_offset += 12;
+        } else {
+            memcpy(frame_data + data_offset, data + shared_chunk_info->offset, shared_chunk_info->length + 12);
+            data_offset += shared_chunk_info->length + 12;
+        }
+    }
+    return frame_data;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - APNG Pixel Decoder
+
+/// Returns round(value / 255) for value in range [0, 255 * 255].
+static inline uint32_t yy_png_div255(uint32_t value) {
+    return (value + ((value + 128) >> 8) + 128) >> 8;
+}
+
+typedef enum {
+    YY_PNG_FILTER_NONE = 0,
+    YY_PNG_FILTER_SUB = 1,
+    YY_PNG_FILTER_UP = 2,
+    YY_PNG_FILTER_AVERAGE = 3,
+    YY_PNG_FILTER_PAETH = 4,
+} yy_png_filter_type;
+
+static inline uint8_t yy_png_paeth_predictor(uint8_t a, uint8_t b, uint8_t c) {
+    int p = (int)a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+static inline uint8x8_t yy_png_load_pixel(const uint8_t *p, uint32_t bpp) {
+    uint32_t v = 0;
+    memcpy(&v, p, bpp);
+    return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static inline void yy_png_store_pixel(uint8_t *p, uint8x8_t v, uint32_t bpp) {
+    uint32_t value = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+    memcpy(p, &value, bpp);
+}
+
+/// Unfilter a row with 3 or 4 bytes per pixel, the dependency between pixels
+/// is serial, so each pixel is processed as a vector.
+static void yy_png_unfilter_row_simd(uint8_t filter, uint8_t *row, const uint8_t *prev, size_t length, uint32_t bpp) {
+    uint8x8_t a = vdup_n_u8(0), c = vdup_n_u8(0);
+    for (size_t i = 0; i < length; i += bpp) {
+        uint8x8_t d = yy_png_load_pixel(row + i, bpp);
+        if (filter == YY_PNG_FILTER_SUB) {
+            a = vadd_u8(d, a);
+        } else if (filter == YY_PNG_FILTER_AVERAGE) {
+            uint8x8_t b = yy_png_load_pixel(prev + i, bpp);
+            a = vadd_u8(d, vhadd_u8(a, b));
+        } else { // paeth
+            uint8x8_t b = yy_png_load_pixel(prev + i, bpp);
+            uint16x8_t pa = vabdl_u8(b, c);
+            uint16x8_t pb = vabdl_u8(a, c);
+            uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));
+            uint8x8_t useA = vand_u8(vmovn_u16(vcleq_u16(pa, pb)), vmovn_u16(vcleq_u16(pa, pc)));
+            uint8x8_t useB = vmovn_u16(vcleq_u16(pb, pc));
+            a = vadd_u8(d, vbsl_u8(useA, a, vbsl_u8(useB, b, c)));
+            c = b;
+        }
+        yy_png_store_pixel(row + i, a, bpp);
+    }
+}
+
+#elif defined(__SSE2__)
+
+static inline __m128i yy_png_load_pixel(const uint8_t *p, uint32_t bpp) {
+    int32_t v = 0;
+    memcpy(&v, p, bpp);
+    return _mm_cvtsi32_si128(v);
+}
+
+static inline void yy_png_store_pixel(uint8_t *p, __m128i v, uint32_t bpp) {
+    int32_t value = _mm_cvtsi128_si32(v);
+    memcpy(p, &value, bpp);
+}
+
+/// Unfilter a row with 3 or 4 bytes per pixel, the dependency between pixels
+/// is serial, so each pixel is processed as a vector.
+static void yy_png_unfilter_row_simd(uint8_t filter, uint8_t *row, const uint8_t *prev, size_t length, uint32_t bpp) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i a = zero, c = zero;
+    for (size_t i = 0; i < length; i += bpp) {
+        __m128i d = yy_png_load_pixel(row + i, bpp);
+        if (filter == YY_PNG_FILTER_SUB) {
+            a = _mm_add_epi8(d, a);
+        } else if (filter == YY_PNG_FILTER_AVERAGE) {
+            __m128i b = yy_png_load_pixel(prev + i, bpp);
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)); // floor
+            a = _mm_add_epi8(d, avg);
+        } else { // paeth
+            __m128i b = yy_png_load_pixel(prev + i, bpp);
+            __m128i a16 = _mm_unpacklo_epi8(a, zero);
+            __m128i b16 = _mm_unpacklo_epi8(b, zero);
+            __m128i c16 = _mm_unpacklo_epi8(c, zero);
+            __m128i pa = _mm_sub_epi16(b16, c16);
+            __m128i pb = _mm_sub_epi16(a16, c16);
+            __m128i pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            __m128i useA = _mm_cmpeq_epi16(smallest, pa);
+            __m128i useB = _mm_cmpeq_epi16(smallest, pb);
+            __m128i nearest = _mm_or_si128(_mm_and_si128(useB, b16), _mm_andnot_si128(useB, c16));
+            nearest = _mm_or_si128(_mm_and_si128(useA, a16), _mm_andnot_si128(useA, nearest));
+            a = _mm_add_epi8(d, _mm_packus_epi16(nearest, nearest));
+            c = b;
+        }
+        yy_png_store_pixel(row + i, a, bpp);
+    }
+}
+
+#endif
+
+bool yy_png_unfilter_row(uint8_t filter, uint8_t *row, const uint8_t *prev, size_t length, uint32_t bpp) {
+    switch (filter) {
+        case YY_PNG_FILTER_NONE: return true;
+        case YY_PNG_FILTER_UP: {
+            size_t i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+            for (; i + 16 <= length; i += 16) {
+                vst1q_u8(row + i, vaddq_u8(vld1q_u8(row + i), vld1q_u8(prev + i)));
+            }
+#elif defined(__SSE2__)
+            for (; i + 16 <= length; i += 16) {
+                __m128i d = _mm_loadu_si128((const __m128i *)(row + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(prev + i));
+                _mm_storeu_si128((__m128i *)(row + i), _mm_add_epi8(d, b));
+            }
+#endif
+            for (; i < length; i++) row[i] += prev[i];
+            return true;
+        }
+        case YY_PNG_FILTER_SUB:
+        case YY_PNG_FILTER_AVERAGE:
+        case YY_PNG_FILTER_PAETH: break;
+        default: return false;
+    }
+    
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__SSE2__)
+    if (bpp == 3 || bpp == 4) {
+        yy_png_unfilter_row_simd(filter, row, prev, length, bpp);
+        return true;
+    }
+#endif
+    
+    size_t i = 0;
+    switch (filter) {
+        case YY_PNG_FILTER_SUB: {
+            for (i = bpp; i < length; i++) row[i] += row[i - bpp];
+        } break;
+        case YY_PNG_FILTER_AVERAGE: {
+            for (; i < bpp && i < length; i++) row[i] += prev[i] >> 1;
+            for (; i < length; i++) row[i] += (row[i - bpp] + prev[i]) >> 1;
+        } break;
+        default: { // paeth
+            for (; i < bpp && i < length; i++) row[i] += prev[i];
+            for (; i < length; i++) row[i] += yy_png_paeth_predictor(row[i - bpp], prev[i], prev[i - bpp]);
+        } break;
+    }
+    return true;
+}
+
+bool yy_png_pixel_format_read(const uint8_t *data, const yy_png_info *info, yy_png_pixel_format *format) {
+    const yy_png_chunk_IHDR *header = &info->header;
+    if (header->compression_method != 0 || header->filter_method != 0) return false;
+    if (header->interlace_method != 0) return false; // Adam7
+    
+    memset(format, 0, sizeof(yy_png_pixel_format));
+    format->color_type = header->color_type;
+    format->bit_depth = header->bit_depth;
+    uint8_t depth = header->bit_depth;
+    switch (header->color_type) {
+        case 0: { // gray
+            if (depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16) return false;
+            format->channels = 1;
+        } break;
+        case 2: { // rgb
+            if (depth != 8 && depth != 16) return false;
+            format->channels = 3;
+        } break;
+        case 3: { // palette
+            if (depth != 1 && depth != 2 && depth != 4 && depth != 8) return false;
+            format->channels = 1;
+        } break;
+        case 4: { // gray + alpha
+            if (depth != 8 && depth != 16) return false;
+            format->channels = 2;
+        } break;
+        case 6: { // rgba
+            if (depth != 8 && depth != 16) return false;
+            format->channels = 4;
+        } break;
+        default: return false;
+    }
+    
+    const uint8_t *plte = NULL, *trns = NULL;
+    uint32_t plte_length = 0, trns_length = 0;
+    for (uint32_t i = 0; i < info->chunk_num; i++) {
+        yy_png_chunk_info *chunk = info->chunks + i;
+        const uint8_t *chunk_data = data + chunk->offset + 8;
+        switch (chunk->fourcc) {
+            case YY_FOUR_CC('i', 'C', 'C', 'P'): return false;
+            case YY_FOUR_CC('g', 'A', 'M', 'A'): {
+                if (chunk->length != 4 || yy_swap_endian_uint32(*((uint32_t *)chunk_data)) != 45455) return false;
+            } break;
+            case YY_FOUR_CC('P', 'L', 'T', 'E'): {
+                plte = chunk_data;
+                plte_length = chunk->length;
+            } break;
+            case YY_FOUR_CC('t', 'R', 'N', 'S'): {
+                trns = chunk_data;
+                trns_length = chunk->length;
+            } break;
+        }
+    }
+    
+    if (format->color_type == 3) {
+        if (!plte || plte_length % 3 != 0 || plte_length / 3 > 256) return false;
+        for (uint32_t i = 0; i < plte_length / 3; i++) {
+            uint32_t a = (trns && i < trns_length) ? trns[i] : 255;
+            uint32_t r = yy_png_div255(plte[i * 3] * a);
+            uint32_t g = yy_png_div255(plte[i * 3 + 1] * a);
+            uint32_t b = yy_png_div255(plte[i * 3 + 2] * a);
+            format->palette[i] = b | (g << 8) | (r << 16) | (a << 24);
+        }
+    } else if (trns) {
+        if (format->color_type == 0 && trns_length == 2) {
+            format->has_trns_key = true;
+            format->trns_key[0] = yy_swap_endian_uint16(*((uint16_t *)trns));
+        } else if (format->color_type == 2 && trns_length == 6) {
+            format->has_trns_key = true;
+            for (int c = 0; c < 3; c++) {
+                format->trns_key[c] = yy_swap_endian_uint16(*((uint16_t *)(trns + c * 2)));
+            }
+        }
+    }
+    return true;
+}
+
+/// Returns round(value * 255 / 65535).
+static inline uint8_t yy_png_sample16_to_8(const uint8_t *p) {
+    uint32_t value = ((uint32_t)p[0] << 8) | p[1];
+    return (value * 255 + 32895) >> 16;
+}
+
+void yy_png_convert_row(const yy_png_pixel_format *format, const uint8_t *row, uint32_t width, uint8_t *dest) {
+    uint32_t *pixels = (uint32_t *)dest;
+    bool wide = format->bit_depth == 16;
+    switch (format->color_type) {
+        case 6: { // rgba
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t r, g, b, a;
+                if (wide) {
+                    const uint8_t *p = row + x * 8;
+                    r = yy_png_sample16_to_8(p); g = yy_png_sample16_to_8(p + 2);
+                    b = yy_png_sample16_to_8(p + 4); a = yy_png_sample16_to_8(p + 6);
+                } else {
+                    const uint8_t *p = row + x * 4;
+                    r = p[0]; g = p[1]; b = p[2]; a = p[3];
+                }
+                if (a == 0) {
+                    pixels[x] = 0;
+                } else {
+                    if (a != 255) {
+                        r = yy_png_div255(r * a);
+                        g = yy_png_div255(g * a);
+                        b = yy_png_div255(b * a);
+                    }
+                    pixels[x] = b | (g << 8) | (r << 16) | (a << 24);
+                }
+            }
+        } break;
+        case 2: { // rgb
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t r, g, b, a = 255;
+                if (wide) {
+                    const uint8_t *p = row + x * 6;
+                    if (format->has_trns_key &&
+                        ((p[0] << 8) | p[1]) == format->trns_key[0] &&
+                        ((p[2] << 8) | p[3]) == format->trns_key[1] &&
+                        ((p[4] << 8) | p[5]) == format->trns_key[2]) a = 0;
+                    r = yy_png_sample16_to_8(p); g = yy_png_sample16_to_8(p + 2); b = yy_png_sample16_to_8(p + 4);
+                } else {
+                    const uint8_t *p = row + x * 3;
+                    r = p[0]; g = p[1]; b = p[2];
+                    if (format->has_trns_key &&
+                        r == format->trns_key[0] && g == format->trns_key[1] && b == format->trns_key[2]) a = 0;
+                }
+                pixels[x] = a ? (b | (g << 8) | (r << 16) | (a << 24)) : 0;
+            }
+        } break;
+        case 4: { // gray + alpha
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t v, a;
+                if (wide) {
+                    v = yy_png_sample16_to_8(row + x * 4);
+                    a = yy_png_sample16_to_8(row + x * 4 + 2);
+                } else {
+                    v = row[x * 2];
+                    a = row[x * 2 + 1];
+                }
+                if (a != 255) v = yy_png_div255(v * a);
+                pixels[x] = v | (v << 8) | (v << 16) | (a << 24);
+            }
+        } break;
+        default: { // gray or palette
+            uint8_t depth = format->bit_depth;
+            uint32_t mask = (1 << (depth == 16 ? 8 : depth)) - 1;
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t sample;
+                if (depth == 16) {
+                    sample = ((uint32_t)row[x * 2] << 8) | row[x * 2 + 1];
+                } else if (depth == 8) {
+                    sample = row[x];
+                } else {
+                    uint32_t bit = x * depth;
+                    sample = (row[bit >> 3] >> (8 - depth - (bit & 7))) & mask;
+                }
+                if (format->color_type == 3) {
+                    pixels[x] = format->palette[sample];
+                } else if (format->has_trns_key && sample == format->trns_key[0]) {
+                    pixels[x] = 0;
+                } else {
+                    uint32_t v = depth == 16 ? yy_png_sample16_to_8(row + x * 2) : sample * 255 / mask;
+                    pixels[x] = v | (v << 8) | (v << 16) | 0xFF000000;
+                }
+            }
+        } break;
+    }
+}
+
+bool yy_png_decode_frame(const uint8_t *data,
+                         const yy_png_info *info,
+                         const yy_png_pixel_format *format,
+                         uint32_t index,
+                         uint8_t *dest,
+                         size_t stride) {
+    if (index >= info->apng_frame_num) return false;
+    const yy_png_frame_info *frame_info = info->apng_frames + index;
+    uint32_t width = frame_info->frame_control.width;
+    uint32_t height = frame_info->frame_control.height;
+    if (width == 0 || height == 0 || frame_info->chunk_num == 0) return false;
+    
+    uint64_t bits = (uint64_t)width * format->channels * format->bit_depth;
+    if (bits > UINT32_MAX) return false;
+    size_t row_length = (size_t)((bits + 7) / 8);
+    uint32_t bpp = format->channels * format->bit_depth / 8;
+    if (bpp == 0) bpp = 1;
+    uint8_t *rows = calloc(2, row_length + 1); // [filter type, scanline] * 2
+    if (!rows) return false;
+    uint8_t *row = rows, *prev = rows + row_length + 1;
+    
+    z_stream stream = {0};
+    if (inflateInit(&stream) != Z_OK) {
+        free(rows);
+        return false;
+    }
+    
+    uint32_t y = 0;
+    size_t filled = 0;
+    bool error = false, ended = false;
+    for (uint32_t c = 0; c < frame_info->chunk_num && !error && !ended && y < height; c++) {
+        const yy_png_chunk_info *chunk = info->chunks + frame_info->chunk_index + c;
+        const uint8_t *payload = data + chunk->offset + 8;
+        uint32_t payload_length = chunk->length;
+        if (chunk->fourcc == YY_FOUR_CC('f', 'd', 'A', 'T')) {
+            payload += 4; // sequence number
+            payload_length -= 4;
+        }
+        stream.next_in = (Bytef *)payload;
+        stream.avail_in = payload_length;
+        bool full = false;
+        do {
+            stream.next_out = row + filled;
+            stream.avail_out = (uInt)(row_length + 1 - filled);
+            int status = inflate(&stream, Z_NO_FLUSH);
+            if (status == Z_BUF_ERROR) break; // need more input
+            if (status != Z_OK && status != Z_STREAM_END) {
+                error = true;
+                break;
+            }
+            filled = row_length + 1 - stream.avail_out;
+            full = stream.avail_out == 0; // there may be more pending output
+            if (full) { // a scanline is ready
+                if (!yy_png_unfilter_row(row[0], row + 1, prev + 1, row_length, bpp)) {
+                    error = true;
+                    break;
+                }
+                yy_png_convert_row(format, row + 1, width, dest + y * stride);
+                uint8_t *tmp = prev;
+                prev = row;
+                row = tmp;
+                filled = 0;
+                y++;
+            }
+            if (status == Z_STREAM_END) ended = true;
+        } while (!ended && y < height && (stream.avail_in > 0 || full));
+    }
+    inflateEnd(&stream);
+    free(rows);
+    return !error && y == height;
+}
@@ -0,0 +1,362 @@
+//
+//  _YYImagePNG.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by ibireme on 15/5/13.
+//  Copyright (c) 2015 ibireme.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+/*
+ The APNG chunk parser and pixel decoder used by YYImageCoder. It's plain C with
+ zlib (no Foundation or CoreGraphics), so it can be built and checked alone.
+ */
+
+#ifndef _YYImagePNG_h
+#define _YYImagePNG_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Private to YYKit, hide the symbols so they don't collide with other copies
+// (such as YYImage) linked into the same binary.
+#pragma GCC visibility push(hidden)
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Utility (for little endian platform)
+
+#define YY_FOUR_CC(c1,c2,c3,c4) ((uint32_t)(((c4) << 24) | ((c3) << 16) | ((c2) << 8) | (c1)))
+#define YY_TWO_CC(c1,c2) ((uint16_t)(((c2) << 8) | (c1)))
+
+static inline uint16_t yy_swap_endian_uint16(uint16_t value) {
+    return
+    (uint16_t) ((value & 0x00FF) << 8) |
+    (uint16_t) ((value & 0xFF00) >> 8) ;
+}
+
+static inline uint32_t yy_swap_endian_uint32(uint32_t value) {
+    return
+    (uint32_t)((value & 0x000000FFU) << 24) |
+    (uint32_t)((value & 0x0000FF00U) <<  8) |
+    (uint32_t)((value & 0x00FF0000U) >>  8) |
+    (uint32_t)((value & 0xFF000000U) >> 24) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - APNG
+
+/*
+ PNG  spec: http://www.libpng.org/pub/png/spec/1.2/PNG-Structure.html
+ APNG spec: https://wiki.mozilla.org/APNG_Specification
+ 
+ ===============================================================================
+ PNG format:
+ header (8): 89 50 4e 47 0d 0a 1a 0a
+ chunk, chunk, chunk, ...
+ 
+ ===============================================================================
+ chunk format:
+ length (4): uint32_t big endian
+ fourcc (4): chunk type code
+ data   (length): data
+ crc32  (4): uint32_t big endian crc32(fourcc + data)
+ 
+ ===============================================================================
+ PNG chunk define:
+ 
+ IHDR (Image Header) required, must appear first, 13 bytes
+ width              (4) pixel count, should not be zero
+ height             (4) pixel count, should not be zero
+ bit depth          (1) expected: 1, 2, 4, 8, 16
+ color type         (1) 1<<0 (palette used), 1<<1 (color used), 1<<2 (alpha channel used)
+ compression method (1) 0 (deflate/inflate)
+ filter method      (1) 0 (adaptive filtering with five basic filter types)
+ interlace method   (1) 0 (no interlace) or 1 (Adam7 interlace)
+ 
+ IDAT (Image Data) required, must appear consecutively if there's multiple 'IDAT' chunk
+ 
+ IEND (End) required, must appear last, 0 bytes
+ 
+ ===============================================================================
+ APNG chunk define:
+ 
+ acTL (Animation Control) required, must appear before 'IDAT', 8 bytes
+ num frames     (4) number of frames
+ num plays      (4) number of times to loop, 0 indicates infinite looping
+ 
+ fcTL (Frame Control) required, must appear before the 'IDAT' or 'fdAT' chunks of the frame to which it applies, 26 bytes
+ sequence number   (4) sequence number of the animation chunk, starting from 0
+ width             (4) width of the following frame
+ height            (4) height of the following frame
+ x offset          (4) x position at which to render the following frame
+ y offset          (4) y position at which to render the following frame
+ delay num         (2) frame delay fraction numerator
+ delay den         (2) frame delay fraction denominator
+ dispose op        (1) type of frame area disposal to be done after rendering this frame (0:none, 1:background 2:previous)
+ blend op          (1) type of frame area rendering for this frame (0:source, 1:over)
+ 
+ fdAT (Frame Data) required
+ sequence number   (4) sequence number of the animation chunk
+ frame data        (x) frame data for this frame (same as 'IDAT')
+ 
+ ===============================================================================
+ `dispose_op` specifies how the output buffer should be changed at the end of the delay 
+ (before rendering the next frame).
+ 
+ * NONE: no disposal is done on this frame before rendering the next; the contents
+    of the output buffer are left as is.
+ * BACKGROUND: the frame's region of the output buffer is to be cleared to fully
+    transparent black before rendering the next frame.
+ * PREVIOUS: the frame's region of the output buffer is to be reverted to the previous
+    contents before rendering the next frame.
+
+ `blend_op` specifies whether the frame is to be alpha blended into the current output buffer
+ content, or whether it should completely replace its region in the output buffer.
+ 
+ * SOURCE: all color components of the frame, including alpha, overwrite the current contents
+    of the frame's output buffer region. 
+ * OVER: the frame should be composited onto the output buffer based on its alpha,
+    using a simple OVER operation as described in the "Alpha Channel Processing" section
+    of the PNG specification
+ */
+
+typedef enum {
+    YY_PNG_ALPHA_TYPE_PALEETE = 1 << 0,
+    YY_PNG_ALPHA_TYPE_COLOR = 1 << 1,
+    YY_PNG_ALPHA_TYPE_ALPHA = 1 << 2,
+} yy_png_alpha_type;
+
+typedef enum {
+    YY_PNG_DISPOSE_OP_NONE = 0,
+    YY_PNG_DISPOSE_OP_BACKGROUND = 1,
+    YY_PNG_DISPOSE_OP_PREVIOUS = 2,
+} yy_png_dispose_op;
+
+typedef enum {
+    YY_PNG_BLEND_OP_SOURCE = 0,
+    YY_PNG_BLEND_OP_OVER = 1,
+} yy_png_blend_op;
+
+typedef struct {
+    uint32_t width;             ///< pixel count, should not be zero
+    uint32_t height;            ///< pixel count, should not be zero
+    uint8_t bit_depth;          ///< expected: 1, 2, 4, 8, 16
+    uint8_t color_type;         ///< see yy_png_alpha_type
+    uint8_t compression_method; ///< 0 (deflate/inflate)
+    uint8_t filter_method;      ///< 0 (adaptive filtering with five basic filter types)
+    uint8_t interlace_method;   ///< 0 (no interlace) or 1 (Adam7 interlace)
+} yy_png_chunk_IHDR;
+
+typedef struct {
+    uint32_t sequence_number;  ///< sequence number of the animation chunk, starting from 0
+    uint32_t width;            ///< width of the following frame
+    uint32_t height;           ///< height of the following frame
+    uint32_t x_offset;         ///< x position at which to render the following frame
+    uint32_t y_offset;         ///< y position at which to render the following frame
+    uint16_t delay_num;        ///< frame delay fraction numerator
+    uint16_t delay_den;        ///< frame delay fraction denominator
+    uint8_t dispose_op;        ///< see yy_png_dispose_op
+    uint8_t blend_op;          ///< see yy_png_blend_op
+} yy_png_chunk_fcTL;
+
+typedef struct {
+    uint32_t offset; ///< chunk offset in PNG data
+    uint32_t fourcc; ///< chunk fourcc
+    uint32_t length; ///< chunk data length
+    uint32_t crc32;  ///< chunk crc32
+} yy_png_chunk_info;
+
+typedef struct {
+    uint32_t chunk_index; ///< the first `fdAT`/`IDAT` chunk index
+    uint32_t chunk_num;   ///< the `fdAT`/`IDAT` chunk count
+    uint32_t chunk_size;  ///< the `fdAT`/`IDAT` chunk bytes
+    yy_png_chunk_fcTL frame_control;
+} yy_png_frame_info;
+
+typedef struct {
+    yy_png_chunk_IHDR header;   ///< png header
+    yy_png_chunk_info *chunks;      ///< chunks
+    uint32_t chunk_num;          ///< count of chunks
+    
+    yy_png_frame_info *apng_frames; ///< frame info, NULL if not apng
+    uint32_t apng_frame_num;     ///< 0 if not apng
+    uint32_t apng_loop_num;      ///< 0 indicates infinite looping
+    
+    uint32_t *apng_shared_chunk_indexs; ///< shared chunk index
+    uint32_t apng_shared_chunk_num;     ///< shared chunk count
+    uint32_t apng_shared_chunk_size;    ///< shared chunk bytes
+    uint32_t apng_shared_insert_index;  ///< shared chunk insert index
+    bool apng_first_frame_is_cover;     ///< the first frame is same as png (cover)
+} yy_png_info;
+
+/*
+ The PNG parser reads chunks incrementally: each update only parses the chunks
+ appended since the last update, and a chunk is accepted only after all its bytes
+ (including crc) are received.
+ 
+ A frame is complete when a chunk other than its `IDAT`/`fdAT` is received.
+ */
+typedef struct {
+    yy_png_chunk_info *chunks;    ///< received chunks
+    uint32_t chunk_num;           ///< count of received chunks
+    uint32_t chunk_capacity;      ///< capacity of `chunks`
+    uint32_t offset;              ///< offset of the next chunk, 0 before the PNG header is received
+    
+    uint32_t apng_loop_num;       ///< from `acTL`
+    uint32_t apng_frame_number;   ///< from `acTL`, 0 if not found
+    uint32_t apng_frame_index;    ///< count of received `fcTL`
+    uint32_t apng_sequence_num;   ///< count of received `fcTL` and `fdAT`
+    bool apng_chunk_error;        ///< invalid apng chunk received
+    
+    uint32_t complete_frame_num;  ///< count of apng frames whose data chunks are all received
+    uint32_t complete_chunk_num;  ///< count of chunks before the end of the last complete apng frame
+    bool image_complete;          ///< all `IDAT` chunks are received
+    bool ended;                   ///< `IEND` received
+    bool error;                   ///< not a png file
+} yy_png_parser;
+
+void yy_png_chunk_IHDR_read(yy_png_chunk_IHDR *IHDR, const uint8_t *data);
+void yy_png_chunk_IHDR_write(yy_png_chunk_IHDR *IHDR, uint8_t *data);
+void yy_png_chunk_fcTL_read(yy_png_chunk_fcTL *fcTL, const uint8_t *data);
+void yy_png_chunk_fcTL_write(yy_png_chunk_fcTL *fcTL, uint8_t *data);
+
+/// Convert double value to fraction.
+void yy_png_delay_to_fraction(double duration, uint16_t *num, uint16_t *den);
+
+/// Convert fraction to double value.
+double yy_png_delay_to_seconds(uint16_t num, uint16_t den);
+
+void yy_png_info_release(yy_png_info *info);
+void yy_png_parser_release(yy_png_parser *parser);
+
+/**
+ Parse the chunks appended since last update.
+ 
+ @param parser A parser, it should be zero-initialized before the first update.
+ @param data   png/apng file data, the previous data should be its prefix.
+ @param length the data's length in bytes.
+ */
+void yy_png_parser_update(yy_png_parser *parser, const uint8_t *data, uint32_t length);
+
+/**
+ Create a png info from a parser. See struct png_info for more information.
+ 
+ @param parser  A parser which has parsed the data.
+ @param data    png/apng file data.
+ @param length  the data's length in bytes.
+ @param partial Whether the data is incomplete. If true, the info only contains
+                the complete apng frames, and ends with an `IEND` chunk which is
+                not in the data (offset is 0).
+ @return A png info object, you may call yy_png_info_release() to release it.
+ Returns NULL if an error occurs.
+ */
+yy_png_info *yy_png_info_create_with_parser(const yy_png_parser *parser, const uint8_t *data, uint32_t length, bool partial);
+
+/**
+ Create a png info from a png file. See struct png_info for more information.
+ 
+ @param data   png/apng file data.
+ @param length the data's length in bytes.
+ @return A png info object, you may call yy_png_info_release() to release it.
+ Returns NULL if an error occurs.
+ */
+yy_png_info *yy_png_info_create(const uint8_t *data, uint32_t length);
+
+/**
+ Copy a png frame data from an apng file.
+ 
+ @param data  apng file data
+ @param info  png info
+ @param index frame index (zero-based)
+ @param size  output, the size of the frame data
+ @return A frame data (single-frame png file), call free() to release the data.
+ Returns NULL if an error occurs.
+ */
+uint8_t *yy_png_copy_frame_data_at_index(const uint8_t *data,
+                                         const yy_png_info *info,
+                                         const uint32_t index,
+                                         uint32_t *size);
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - APNG Pixel Decoder
+
+/*
+ Decode the APNG frames without ImageIO: the `IDAT`/`fdAT` chunks of a frame are
+ inflated with zlib stream, each scanline is unfiltered (NEON/SSE2 if available)
+ and converted to premultiplied BGRA8888 (kCGBitmapByteOrder32Host |
+ kCGImageAlphaPremultipliedFirst) directly.
+ 
+ It's plain C with zlib, and read-only to the png data and info, so the frames
+ can be decoded concurrently. Interlaced image and color profile ('iCCP', or
+ 'gAMA' which is not sRGB) are not supported, the decoder falls back to ImageIO.
+ */
+
+/// The shared state to convert the scanlines of all frames.
+typedef struct {
+    uint8_t color_type;
+    uint8_t bit_depth;
+    uint8_t channels;       ///< samples per pixel
+    bool has_trns_key;      ///< the transparent color of gray or rgb image
+    uint16_t trns_key[3];   ///< gray, or red, green and blue
+    uint32_t palette[256];  ///< premultiplied BGRA8888 (little endian) of palette
+} yy_png_pixel_format;
+
+/**
+ Check whether the png can be decoded by yy_png_decode_frame() and read the
+ pixel format.
+ 
+ @param data   png/apng file data
+ @param info   png info
+ @param format output, the pixel format
+ @return false if the png is not supported.
+ */
+bool yy_png_pixel_format_read(const uint8_t *data, const yy_png_info *info, yy_png_pixel_format *format);
+
+/**
+ Reverse the filter of a scanline.
+ 
+ @param filter filter type, see yy_png_filter_type
+ @param row    the scanline (without the filter type byte)
+ @param prev   the previous unfiltered scanline, all zero for the first row
+ @param length the bytes of scanline
+ @param bpp    bytes per complete pixel, rounding up to 1
+ @return false if the filter type is invalid.
+ */
+bool yy_png_unfilter_row(uint8_t filter, uint8_t *row, const uint8_t *prev, size_t length, uint32_t bpp);
+
+/// Convert an unfiltered scanline to premultiplied BGRA8888.
+void yy_png_convert_row(const yy_png_pixel_format *format, const uint8_t *row, uint32_t width, uint8_t *dest);
+
+/**
+ Decode a frame of apng file to premultiplied BGRA8888 pixels.
+ 
+ @param data   apng file data
+ @param info   png info (with apng frames)
+ @param format pixel format read by yy_png_pixel_format_read()
+ @param index  frame index (zero-based)
+ @param dest   output, the first pixel of frame, the size is the frame size in fcTL
+ @param stride bytes per row of dest
+ @return false if an error occurs.
+ */
+bool yy_png_decode_frame(const uint8_t *data,
+                         const yy_png_info *info,
+                         const yy_png_pixel_format *format,
+                         uint32_t index,
+                         uint8_t *dest,
+                         size_t stride);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
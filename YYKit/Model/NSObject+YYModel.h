@@ -187,6 +187,36 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (id)modelInitWithCoder:(NSCoder *)aDecoder;
 
+/**
+ Encode the receiver to a compact binary data. It's much faster and smaller than
+ NSKeyedArchiver with `modelEncodeWithCoder:`.
+ 
+ @discussion The model's properties are packed by the order of the property name,
+ with a fingerprint of the properties' names and types. Nested models, NSArray, 
+ NSDictionary, NSSet, NSString, NSNumber, NSData, NSDate and NSURL are supported,
+ other objects which conform to `NSCoding` are encoded with NSKeyedArchiver.
+ The receiver may be a model or a supported Foundation object.
+ 
+ @return A binary data, or nil if an error occurs.
+ */
+- (nullable NSData *)modelToBinaryData;
+
+/**
+ Creates and returns a new instance of the receiver from the binary data created
+ by `modelToBinaryData`.
+ 
+ @discussion If a model class's properties is changed after the data is created,
+ the data is treated as invalid and this method returns nil.
+ 
+ Example: [NSObject modelWithBinaryData:data] returns any kind of object,
+          [YYAuthor modelWithBinaryData:data] returns nil if the object is not YYAuthor.
+ 
+ @param data  A binary data created by `modelToBinaryData`.
+ 
+ @return A new instance created from the data, or nil if an error occurs.
+ */
++ (nullable instancetype)modelWithBinaryData:(NSData *)data;
+
 /**
  Get a hash code with the receiver's properties.
  
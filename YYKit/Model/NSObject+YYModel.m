@@ -459,6 +459,13 @@ static force_inline id YYValueForMultiKeys(__unsafe_unretained NSDictionary *dic
     BOOL _hasCustomTransformFromDictionary;
     BOOL _hasCustomTransformToDictionary;
     BOOL _hasCustomClassFromDictionary;
+    
+    /// Array<_YYModelPropertyMeta>, property meta used by binary coding, sorted by name.
+    NSArray *_binaryPropertyMetas;
+    /// Hash of the binary properties' names and type encodings.
+    uint32_t _binaryFingerprint;
+    /// YES if the instances can be encoded as a model (not a Foundation or system class).
+    BOOL _binaryCodable;
 }
 @end
 
@@ -601,6 +608,47 @@ static force_inline id YYValueForMultiKeys(__unsafe_unretained NSDictionary *dic
     _hasCustomTransformToDictionary = ([cls instancesRespondToSelector:@selector(modelCustomTransformToDictionary:)]);
     _hasCustomClassFromDictionary = ([cls respondsToSelector:@selector(modelCustomClassForDictionary:)]);
     
+    // binary coding
+    if (!_nsType) {
+        const char *image = class_getImageName(cls);
+        _binaryCodable = !(image && (strstr(image, "/System/Library/") || strstr(image, "/usr/lib/")));
+    }
+    NSMutableArray *binaryPropertyMetas = [NSMutableArray new];
+    for (_YYModelPropertyMeta *propertyMeta in _allPropertyMetas) {
+        switch (propertyMeta->_type & YYEncodingTypeMask) {
+            case YYEncodingTypeLongDouble: break;
+            case YYEncodingTypeObject:
+            case YYEncodingTypeClass:
+            case YYEncodingTypeSEL: {
+                [binaryPropertyMetas addObject:propertyMeta];
+            } break;
+            case YYEncodingTypeStruct: {
+                if (propertyMeta->_isKVCCompatible && propertyMeta->_isStructAvailableForKeyedArchiver) {
+                    [binaryPropertyMetas addObject:propertyMeta];
+                }
+            } break;
+            default: {
+                if (propertyMeta->_isCNumber) [binaryPropertyMetas addObject:propertyMeta];
+            } break;
+        }
+    }
+    [binaryPropertyMetas sortUsingComparator:^NSComparisonResult(_YYModelPropertyMeta *p1, _YYModelPropertyMeta *p2) {
+        return [p1->_name compare:p2->_name];
+    }];
+    uint32_t fingerprint = 2166136261U; // FNV-1a
+    for (_YYModelPropertyMeta *propertyMeta in binaryPropertyMetas) {
+        const char *strs[2] = {propertyMeta->_name.UTF8String, propertyMeta->_info.typeEncoding.UTF8String};
+        for (int i = 0; i < 2; i++) {
+            const char *str = strs[i] ?: "";
+            do {
+                fingerprint ^= (uint8_t)*str;
+                fingerprint *= 16777619U;
+            } while (*str++);
+        }
+    }
+    _binaryPropertyMetas = binaryPropertyMetas.copy;
+    _binaryFingerprint = fingerprint;
+    
     return self;
 }
 
@@ -1410,6 +1458,601 @@ static NSString *ModelDescription(NSObject *model) {
 }
 
 
+/*
+ Binary model format (little-endian, same as all iOS devices):
+ 
+ header:  'Y' 'Y' 'M' 'B' version(1 byte) value
+ value:   tag(1 byte) payload
+ model:   class name(string), fingerprint(uint32), properties sorted by name
+ 
+ The C number properties are packed without tag, other properties are encoded
+ as tagged value. The fingerprint is a hash of the properties' names and types,
+ if the model class is changed, the data is treated as invalid.
+ */
+
+#define kModelBinaryVersion 1
+#define kModelBinaryMaxDepth 64
+static const uint8_t kModelBinaryMagic[4] = {'Y', 'Y', 'M', 'B'};
+
+typedef NS_ENUM (uint8_t, YYModelBinaryTag) {
+    YYModelBinaryTagNil = 0,
+    YYModelBinaryTagNull,       ///< NSNull
+    YYModelBinaryTagInt,        ///< zigzag varint
+    YYModelBinaryTagUInt,       ///< varint
+    YYModelBinaryTagDouble,     ///< 8 bytes
+    YYModelBinaryTagTrue,       ///< kCFBooleanTrue
+    YYModelBinaryTagFalse,      ///< kCFBooleanFalse
+    YYModelBinaryTagString,     ///< varint length, UTF-8 bytes
+    YYModelBinaryTagData,       ///< varint length, bytes
+    YYModelBinaryTagDate,       ///< 8 bytes time interval since reference date
+    YYModelBinaryTagURL,        ///< string
+    YYModelBinaryTagDecimal,    ///< string
+    YYModelBinaryTagArray,      ///< varint count, values
+    YYModelBinaryTagDictionary, ///< varint count, key-value pairs
+    YYModelBinaryTagSet,        ///< varint count, values
+    YYModelBinaryTagModel,      ///< see above
+    YYModelBinaryTagArchive,    ///< data archived by NSKeyedArchiver
+};
+
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+    BOOL failed;
+} YYModelBinaryWriter;
+
+typedef struct {
+    const uint8_t *cur;
+    const uint8_t *end;
+    BOOL failed;
+} YYModelBinaryReader;
+
+static force_inline uint8_t *ModelBinaryWriterGrow(YYModelBinaryWriter *writer, size_t length) {
+    if (writer->failed) return NULL;
+    if (writer->capacity - writer->length < length) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 256;
+        while (capacity - writer->length < length) capacity *= 2;
+        uint8_t *bytes = realloc(writer->bytes, capacity);
+        if (!bytes) {
+            writer->failed = YES;
+            return NULL;
+        }
+        writer->bytes = bytes;
+        writer->capacity = capacity;
+    }
+    uint8_t *ptr = writer->bytes + writer->length;
+    writer->length += length;
+    return ptr;
+}
+
+static force_inline void ModelBinaryWriteBytes(YYModelBinaryWriter *writer, const void *bytes, size_t length) {
+    uint8_t *ptr = ModelBinaryWriterGrow(writer, length);
+    if (ptr && length) memcpy(ptr, bytes, length);
+}
+
+static force_inline void ModelBinaryWriteByte(YYModelBinaryWriter *writer, uint8_t byte) {
+    uint8_t *ptr = ModelBinaryWriterGrow(writer, 1);
+    if (ptr) *ptr = byte;
+}
+
+static force_inline void ModelBinaryWriteVarint(YYModelBinaryWriter *writer, uint64_t value) {
+    uint8_t buf[10];
+    size_t len = 0;
+    while (value >= 0x80) {
+        buf[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (uint8_t)value;
+    ModelBinaryWriteBytes(writer, buf, len);
+}
+
+static force_inline void ModelBinaryWriteZigzag(YYModelBinaryWriter *writer, int64_t value) {
+    ModelBinaryWriteVarint(writer, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static force_inline void ModelBinaryWriteString(YYModelBinaryWriter *writer, __unsafe_unretained NSString *string) {
+    NSUInteger length = string.length;
+    NSUInteger maxLength = [string maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    // reserve the max length, then shrink to the used length
+    ModelBinaryWriteVarint(writer, 0);
+    size_t lengthOffset = writer->length - 1;
+    uint8_t *ptr = ModelBinaryWriterGrow(writer, maxLength);
+    if (!ptr) return;
+    NSUInteger used = 0;
+    [string getBytes:ptr maxLength:maxLength usedLength:&used encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, length) remainingRange:NULL];
+    writer->length -= maxLength;
+    if (used < 0x80) {
+        writer->bytes[lengthOffset] = (uint8_t)used;
+        writer->length += used;
+    } else {
+        uint8_t buf[10];
+        size_t len = 0;
+        uint64_t value = used;
+        while (value >= 0x80) {
+            buf[len++] = (uint8_t)(value | 0x80);
+            value >>= 7;
+        }
+        buf[len++] = (uint8_t)value;
+        if (!ModelBinaryWriterGrow(writer, len - 1 + used)) return;
+        memmove(writer->bytes + lengthOffset + len, writer->bytes + lengthOffset + 1, used);
+        memcpy(writer->bytes + lengthOffset, buf, len);
+    }
+}
+
+static force_inline BOOL ModelBinaryReadBytes(YYModelBinaryReader *reader, void *bytes, size_t length) {
+    if (reader->failed || (size_t)(reader->end - reader->cur) < length) {
+        reader->failed = YES;
+        return NO;
+    }
+    memcpy(bytes, reader->cur, length);
+    reader->cur += length;
+    return YES;
+}
+
+static force_inline uint8_t ModelBinaryReadByte(YYModelBinaryReader *reader) {
+    uint8_t byte = 0;
+    ModelBinaryReadBytes(reader, &byte, 1);
+    return byte;
+}
+
+static force_inline uint64_t ModelBinaryReadVarint(YYModelBinaryReader *reader) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->failed || reader->cur >= reader->end) break;
+        uint8_t byte = *reader->cur++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    reader->failed = YES;
+    return 0;
+}
+
+static force_inline int64_t ModelBinaryReadZigzag(YYModelBinaryReader *reader) {
+    uint64_t value = ModelBinaryReadVarint(reader);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/// Returns the pointer to the next `length` bytes, or NULL if there's not enough data.
+static force_inline const uint8_t *ModelBinaryReadPointer(YYModelBinaryReader *reader, uint64_t length) {
+    if (reader->failed || (uint64_t)(reader->end - reader->cur) < length) {
+        reader->failed = YES;
+        return NULL;
+    }
+    const uint8_t *ptr = reader->cur;
+    reader->cur += length;
+    return ptr;
+}
+
+static force_inline NSString *ModelBinaryReadString(YYModelBinaryReader *reader) {
+    uint64_t length = ModelBinaryReadVarint(reader);
+    const uint8_t *ptr = ModelBinaryReadPointer(reader, length);
+    if (!ptr) return nil;
+    NSString *string = [[NSString alloc] initWithBytes:ptr length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+    if (!string) reader->failed = YES;
+    return string;
+}
+
+static void ModelBinaryWriteObject(YYModelBinaryWriter *writer, __unsafe_unretained id object, int depth);
+static id ModelBinaryReadObject(YYModelBinaryReader *reader, int depth);
+
+/// Write the model's properties (without tag).
+static void ModelBinaryWriteModel(YYModelBinaryWriter *writer, __unsafe_unretained id model, __unsafe_unretained _YYModelMeta *modelMeta, int depth) {
+    ModelBinaryWriteString(writer, NSStringFromClass([model class]));
+    uint32_t fingerprint = modelMeta->_binaryFingerprint;
+    ModelBinaryWriteBytes(writer, &fingerprint, sizeof(fingerprint));
+    
+    for (_YYModelPropertyMeta *propertyMeta in modelMeta->_binaryPropertyMetas) {
+        if (writer->failed) return;
+        SEL getter = propertyMeta->_getter;
+        switch (propertyMeta->_type & YYEncodingTypeMask) {
+            case YYEncodingTypeBool: {
+                bool value = ((bool (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteByte(writer, value ? 1 : 0);
+            } break;
+            case YYEncodingTypeInt8:
+            case YYEncodingTypeUInt8: {
+                uint8_t value = ((uint8_t (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteByte(writer, value);
+            } break;
+            case YYEncodingTypeInt16:
+            case YYEncodingTypeUInt16: {
+                uint16_t value = ((uint16_t (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteBytes(writer, &value, sizeof(value));
+            } break;
+            case YYEncodingTypeInt32: {
+                int32_t value = ((int32_t (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteZigzag(writer, value);
+            } break;
+            case YYEncodingTypeUInt32: {
+                uint32_t value = ((uint32_t (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteVarint(writer, value);
+            } break;
+            case YYEncodingTypeInt64: {
+                int64_t value = ((int64_t (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteZigzag(writer, value);
+            } break;
+            case YYEncodingTypeUInt64: {
+                uint64_t value = ((uint64_t (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteVarint(writer, value);
+            } break;
+            case YYEncodingTypeFloat: {
+                float value = ((float (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteBytes(writer, &value, sizeof(value));
+            } break;
+            case YYEncodingTypeDouble: {
+                double value = ((double (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteBytes(writer, &value, sizeof(value));
+            } break;
+            case YYEncodingTypeObject: {
+                id value = ((id (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteObject(writer, value, depth + 1);
+            } break;
+            case YYEncodingTypeClass: {
+                Class value = ((Class (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteObject(writer, value ? NSStringFromClass(value) : nil, depth + 1);
+            } break;
+            case YYEncodingTypeSEL: {
+                SEL value = ((SEL (*)(id, SEL))(void *) objc_msgSend)((id)model, getter);
+                ModelBinaryWriteObject(writer, value ? NSStringFromSelector(value) : nil, depth + 1);
+            } break;
+            case YYEncodingTypeStruct: {
+                // only the structs with float/double fields (CGRect, UIEdgeInsets...), see _isStructAvailableForKeyedArchiver
+                NSValue *value = nil;
+                @try {
+                    value = [model valueForKey:NSStringFromSelector(getter)];
+                } @catch (NSException *exception) {}
+                NSUInteger size = 0;
+                const char *type = propertyMeta->_info.typeEncoding.UTF8String;
+                if (type) NSGetSizeAndAlignment(type, &size, NULL);
+                if (![value isKindOfClass:[NSValue class]] || size == 0 || strcmp(value.objCType, type) != 0) {
+                    ModelBinaryWriteByte(writer, 0);
+                } else {
+                    ModelBinaryWriteByte(writer, 1);
+                    uint8_t *ptr = ModelBinaryWriterGrow(writer, size);
+                    if (ptr) [value getValue:ptr];
+                }
+            } break;
+            default: break;
+        }
+    }
+}
+
+static void ModelBinaryWriteObject(YYModelBinaryWriter *writer, __unsafe_unretained id object, int depth) {
+    if (writer->failed) return;
+    if (depth > kModelBinaryMaxDepth) {
+        writer->failed = YES;
+        return;
+    }
+    if (!object) {
+        ModelBinaryWriteByte(writer, YYModelBinaryTagNil);
+        return;
+    }
+    if (object == (id)kCFNull) {
+        ModelBinaryWriteByte(writer, YYModelBinaryTagNull);
+        return;
+    }
+    
+    Class cls = [object class];
+    YYEncodingNSType nsType = YYClassGetNSType(cls);
+    switch (nsType) {
+        case YYEncodingTypeNSString:
+        case YYEncodingTypeNSMutableString: {
+            ModelBinaryWriteByte(writer, YYModelBinaryTagString);
+            ModelBinaryWriteString(writer, object);
+        } return;
+        case YYEncodingTypeNSDecimalNumber: {
+            ModelBinaryWriteByte(writer, YYModelBinaryTagDecimal);
+            ModelBinaryWriteString(writer, ((NSDecimalNumber *)object).stringValue);
+        } return;
+        case YYEncodingTypeNSNumber: {
+            if (object == (id)kCFBooleanTrue) {
+                ModelBinaryWriteByte(writer, YYModelBinaryTagTrue);
+                return;
+            }
+            if (object == (id)kCFBooleanFalse) {
+                ModelBinaryWriteByte(writer, YYModelBinaryTagFalse);
+                return;
+            }
+            const char *type = ((NSNumber *)object).objCType;
+            switch (type ? type[0] : 0) {
+                case 'f':
+                case 'd': {
+                    double value = ((NSNumber *)object).doubleValue;
+                    ModelBinaryWriteByte(writer, YYModelBinaryTagDouble);
+                    ModelBinaryWriteBytes(writer, &value, sizeof(value));
+                } return;
+                case 'Q':
+                case 'L':
+                case 'I': {
+                    ModelBinaryWriteByte(writer, YYModelBinaryTagUInt);
+                    ModelBinaryWriteVarint(writer, ((NSNumber *)object).unsignedLongLongValue);
+                } return;
+                default: {
+                    ModelBinaryWriteByte(writer, YYModelBinaryTagInt);
+                    ModelBinaryWriteZigzag(writer, ((NSNumber *)object).longLongValue);
+                } return;
+            }
+        }
+        case YYEncodingTypeNSData:
+        case YYEncodingTypeNSMutableData: {
+            NSData *data = object;
+            ModelBinaryWriteByte(writer, YYModelBinaryTagData);
+            ModelBinaryWriteVarint(writer, data.length);
+            ModelBinaryWriteBytes(writer, data.bytes, data.length);
+        } return;
+        case YYEncodingTypeNSDate: {
+            double value = ((NSDate *)object).timeIntervalSinceReferenceDate;
+            ModelBinaryWriteByte(writer, YYModelBinaryTagDate);
+            ModelBinaryWriteBytes(writer, &value, sizeof(value));
+        } return;
+        case YYEncodingTypeNSURL: {
+            ModelBinaryWriteByte(writer, YYModelBinaryTagURL);
+            ModelBinaryWriteString(writer, ((NSURL *)object).absoluteString);
+        } return;
+        case YYEncodingTypeNSArray:
+        case YYEncodingTypeNSMutableArray: {
+            ModelBinaryWriteByte(writer, YYModelBinaryTagArray);
+            ModelBinaryWriteVarint(writer, ((NSArray *)object).count);
+            for (id one in (NSArray *)object) {
+                ModelBinaryWriteObject(writer, one, depth + 1);
+            }
+        } return;
+        case YYEncodingTypeNSDictionary:
+        case YYEncodingTypeNSMutableDictionary: {
+            ModelBinaryWriteByte(writer, YYModelBinaryTagDictionary);
+            ModelBinaryWriteVarint(writer, ((NSDictionary *)object).count);
+            [((NSDictionary *)object) enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+                ModelBinaryWriteObject(writer, key, depth + 1);
+                ModelBinaryWriteObject(writer, obj, depth + 1);
+                if (writer->failed) *stop = YES;
+            }];
+        } return;
+        case YYEncodingTypeNSSet:
+        case YYEncodingTypeNSMutableSet: {
+            ModelBinaryWriteByte(writer, YYModelBinaryTagSet);
+            ModelBinaryWriteVarint(writer, ((NSSet *)object).count);
+            for (id one in (NSSet *)object) {
+                ModelBinaryWriteObject(writer, one, depth + 1);
+            }
+        } return;
+        default: break;
+    }
+    
+    if (nsType == YYEncodingTypeNSUnknown) {
+        _YYModelMeta *modelMeta = [_YYModelMeta metaWithClass:cls];
+        if (modelMeta->_binaryCodable) {
+            ModelBinaryWriteByte(writer, YYModelBinaryTagModel);
+            ModelBinaryWriteModel(writer, object, modelMeta, depth);
+            return;
+        }
+    }
+    
+    // NSValue, UIColor, NSAttributedString...
+    NSData *archive = nil;
+    if ([object conformsToProtocol:@protocol(NSCoding)]) {
+        @try {
+            archive = [NSKeyedArchiver archivedDataWithRootObject:object];
+        } @catch (NSException *exception) {}
+    }
+    if (archive) {
+        ModelBinaryWriteByte(writer, YYModelBinaryTagArchive);
+        ModelBinaryWriteVarint(writer, archive.length);
+        ModelBinaryWriteBytes(writer, archive.bytes, archive.length);
+    } else {
+        ModelBinaryWriteByte(writer, YYModelBinaryTagNil);
+    }
+}
+
+/// Read the model's properties (without tag).
+static id ModelBinaryReadModel(YYModelBinaryReader *reader, int depth) {
+    NSString *className = ModelBinaryReadString(reader);
+    uint32_t fingerprint = 0;
+    if (!ModelBinaryReadBytes(reader, &fingerprint, sizeof(fingerprint))) return nil;
+    Class cls = className ? NSClassFromString(className) : Nil;
+    _YYModelMeta *modelMeta = [_YYModelMeta metaWithClass:cls];
+    if (!modelMeta || !modelMeta->_binaryCodable || modelMeta->_binaryFingerprint != fingerprint) {
+        reader->failed = YES;
+        return nil;
+    }
+    
+    id model = [cls new];
+    if (!model) {
+        reader->failed = YES;
+        return nil;
+    }
+    for (_YYModelPropertyMeta *propertyMeta in modelMeta->_binaryPropertyMetas) {
+        if (reader->failed) return nil;
+        SEL setter = propertyMeta->_setter;
+        switch (propertyMeta->_type & YYEncodingTypeMask) {
+            case YYEncodingTypeBool: {
+                bool value = ModelBinaryReadByte(reader) != 0;
+                ((void (*)(id, SEL, bool))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeInt8:
+            case YYEncodingTypeUInt8: {
+                uint8_t value = ModelBinaryReadByte(reader);
+                ((void (*)(id, SEL, uint8_t))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeInt16:
+            case YYEncodingTypeUInt16: {
+                uint16_t value = 0;
+                ModelBinaryReadBytes(reader, &value, sizeof(value));
+                ((void (*)(id, SEL, uint16_t))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeInt32: {
+                int32_t value = (int32_t)ModelBinaryReadZigzag(reader);
+                ((void (*)(id, SEL, int32_t))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeUInt32: {
+                uint32_t value = (uint32_t)ModelBinaryReadVarint(reader);
+                ((void (*)(id, SEL, uint32_t))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeInt64: {
+                int64_t value = ModelBinaryReadZigzag(reader);
+                ((void (*)(id, SEL, int64_t))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeUInt64: {
+                uint64_t value = ModelBinaryReadVarint(reader);
+                ((void (*)(id, SEL, uint64_t))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeFloat: {
+                float value = 0;
+                ModelBinaryReadBytes(reader, &value, sizeof(value));
+                ((void (*)(id, SEL, float))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeDouble: {
+                double value = 0;
+                ModelBinaryReadBytes(reader, &value, sizeof(value));
+                ((void (*)(id, SEL, double))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeObject: {
+                id value = ModelBinaryReadObject(reader, depth + 1);
+                if (reader->failed) return nil;
+                if (value && propertyMeta->_cls && ![value isKindOfClass:propertyMeta->_cls]) break;
+                switch (propertyMeta->_nsType) {
+                    case YYEncodingTypeNSMutableString:
+                    case YYEncodingTypeNSMutableData:
+                    case YYEncodingTypeNSMutableArray:
+                    case YYEncodingTypeNSMutableDictionary:
+                    case YYEncodingTypeNSMutableSet: {
+                        value = [value mutableCopy];
+                    } break;
+                    default: break;
+                }
+                ((void (*)(id, SEL, id))(void *) objc_msgSend)((id)model, setter, value);
+            } break;
+            case YYEncodingTypeClass: {
+                NSString *value = ModelBinaryReadObject(reader, depth + 1);
+                if ([value isKindOfClass:[NSString class]]) {
+                    Class valueCls = NSClassFromString(value);
+                    if (valueCls) ((void (*)(id, SEL, Class))(void *) objc_msgSend)((id)model, setter, valueCls);
+                }
+            } break;
+            case YYEncodingTypeSEL: {
+                NSString *value = ModelBinaryReadObject(reader, depth + 1);
+                if ([value isKindOfClass:[NSString class]]) {
+                    SEL sel = NSSelectorFromString(value);
+                    ((void (*)(id, SEL, SEL))(void *) objc_msgSend)((id)model, setter, sel);
+                }
+            } break;
+            case YYEncodingTypeStruct: {
+                if (!ModelBinaryReadByte(reader)) break;
+                NSUInteger size = 0;
+                const char *type = propertyMeta->_info.typeEncoding.UTF8String;
+                if (type) NSGetSizeAndAlignment(type, &size, NULL);
+                const uint8_t *ptr = ModelBinaryReadPointer(reader, size);
+                if (!ptr || size == 0) {
+                    reader->failed = YES;
+                    break;
+                }
+                NSValue *value = [NSValue valueWithBytes:ptr objCType:type];
+                @try {
+                    [model setValue:value forKey:propertyMeta->_name];
+                } @catch (NSException *exception) {}
+            } break;
+            default: break;
+        }
+    }
+    return reader->failed ? nil : model;
+}
+
+static id ModelBinaryReadObject(YYModelBinaryReader *reader, int depth) {
+    if (reader->failed) return nil;
+    if (depth > kModelBinaryMaxDepth) {
+        reader->failed = YES;
+        return nil;
+    }
+    YYModelBinaryTag tag = ModelBinaryReadByte(reader);
+    if (reader->failed) return nil;
+    switch (tag) {
+        case YYModelBinaryTagNil: return nil;
+        case YYModelBinaryTagNull: return (id)kCFNull;
+        case YYModelBinaryTagInt: {
+            int64_t value = ModelBinaryReadZigzag(reader);
+            return reader->failed ? nil : @(value);
+        }
+        case YYModelBinaryTagUInt: {
+            uint64_t value = ModelBinaryReadVarint(reader);
+            return reader->failed ? nil : @(value);
+        }
+        case YYModelBinaryTagDouble: {
+            double value = 0;
+            if (!ModelBinaryReadBytes(reader, &value, sizeof(value))) return nil;
+            return @(value);
+        }
+        case YYModelBinaryTagTrue: return (id)kCFBooleanTrue;
+        case YYModelBinaryTagFalse: return (id)kCFBooleanFalse;
+        case YYModelBinaryTagString: return ModelBinaryReadString(reader);
+        case YYModelBinaryTagData: {
+            uint64_t length = ModelBinaryReadVarint(reader);
+            const uint8_t *ptr = ModelBinaryReadPointer(reader, length);
+            if (!ptr) return nil;
+            return [NSData dataWithBytes:ptr length:(NSUInteger)length];
+        }
+        case YYModelBinaryTagDate: {
+            double value = 0;
+            if (!ModelBinaryReadBytes(reader, &value, sizeof(value))) return nil;
+            return [NSDate dateWithTimeIntervalSinceReferenceDate:value];
+        }
+        case YYModelBinaryTagURL: {
+            NSString *string = ModelBinaryReadString(reader);
+            return string ? [NSURL URLWithString:string] : nil;
+        }
+        case YYModelBinaryTagDecimal: {
+            NSString *string = ModelBinaryReadString(reader);
+            return string ? [NSDecimalNumber decimalNumberWithString:string] : nil;
+        }
+        case YYModelBinaryTagArray:
+        case YYModelBinaryTagSet: {
+            uint64_t count = ModelBinaryReadVarint(reader);
+            // each value takes at least 1 byte
+            if (reader->failed || count > (uint64_t)(reader->end - reader->cur)) {
+                reader->failed = YES;
+                return nil;
+            }
+            NSMutableArray *array = [[NSMutableArray alloc] initWithCapacity:(NSUInteger)count];
+            for (uint64_t i = 0; i < count; i++) {
+                id one = ModelBinaryReadObject(reader, depth + 1);
+                if (reader->failed) return nil;
+                if (one) [array addObject:one];
+            }
+            return tag == YYModelBinaryTagSet ? [NSSet setWithArray:array] : array.copy;
+        }
+        case YYModelBinaryTagDictionary: {
+            uint64_t count = ModelBinaryReadVarint(reader);
+            if (reader->failed || count > (uint64_t)(reader->end - reader->cur) / 2) {
+                reader->failed = YES;
+                return nil;
+            }
+            NSMutableDictionary *dic = [[NSMutableDictionary alloc] initWithCapacity:(NSUInteger)count];
+            for (uint64_t i = 0; i < count; i++) {
+                id key = ModelBinaryReadObject(reader, depth + 1);
+                id obj = ModelBinaryReadObject(reader, depth + 1);
+                if (reader->failed) return nil;
+                if (key && obj) dic[key] = obj;
+            }
+            return dic.copy;
+        }
+        case YYModelBinaryTagModel: return ModelBinaryReadModel(reader, depth);
+        case YYModelBinaryTagArchive: {
+            uint64_t length = ModelBinaryReadVarint(reader);
+            const uint8_t *ptr = ModelBinaryReadPointer(reader, length);
+            if (!ptr) return nil;
+            NSData *data = [NSData dataWithBytes:ptr length:(NSUInteger)length];
+            id object = nil;
+            @try {
+                object = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+            } @catch (NSException *exception) {}
+            return object;
+        }
+        default: {
+            reader->failed = YES;
+            return nil;
+        }
+    }
+}
+
+
 @implementation NSObject (YYModel)
 
 + (NSDictionary *)_yy_dictionaryWithJSON:(id)json {
@@ -1708,6 +2351,32 @@ static NSString *ModelDescription(NSObject *model) {
     return self;
 }
 
+- (NSData *)modelToBinaryData {
+    YYModelBinaryWriter writer = {0};
+    ModelBinaryWriteBytes(&writer, kModelBinaryMagic, sizeof(kModelBinaryMagic));
+    ModelBinaryWriteByte(&writer, kModelBinaryVersion);
+    ModelBinaryWriteObject(&writer, self, 0);
+    if (writer.failed) {
+        if (writer.bytes) free(writer.bytes);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:writer.bytes length:writer.length freeWhenDone:YES];
+}
+
++ (instancetype)modelWithBinaryData:(NSData *)data {
+    if (![data isKindOfClass:[NSData class]] || data.length <= sizeof(kModelBinaryMagic) + 1) return nil;
+    const uint8_t *bytes = data.bytes;
+    if (memcmp(bytes, kModelBinaryMagic, sizeof(kModelBinaryMagic)) != 0) return nil;
+    if (bytes[sizeof(kModelBinaryMagic)] != kModelBinaryVersion) return nil;
+    YYModelBinaryReader reader = {0};
+    reader.cur = bytes + sizeof(kModelBinaryMagic) + 1;
+    reader.end = bytes + data.length;
+    id object = ModelBinaryReadObject(&reader, 0);
+    if (reader.failed || reader.cur != reader.end) return nil;
+    if (![object isKindOfClass:self]) return nil;
+    return object;
+}
+
 - (NSUInteger)modelHash {
     if (self == (id)kCFNull) return [self hash];
     _YYModelMeta *modelMeta = [_YYModelMeta metaWithClass:self.class];
@@ -57,6 +57,8 @@ FOUNDATION_EXPORT const unsigned char YYKitVersionString[];
 #import <YYKit/YYMemoryCache.h>
 #import <YYKit/YYDiskCache.h>
 #import <YYKit/YYKVStorage.h>
+#import <YYKit/YYCacheMetrics.h>
+#import <YYKit/YYCacheTrace.h>
 
 #import <YYKit/YYImage.h>
 #import <YYKit/YYFrameImage.h>
@@ -148,6 +150,8 @@ FOUNDATION_EXPORT const unsigned char YYKitVersionString[];
 #import "YYMemoryCache.h"
 #import "YYDiskCache.h"
 #import "YYKVStorage.h"
+#import "YYCacheMetrics.h"
+#import "YYCacheTrace.h"
 
 #import "YYImage.h"
 #import "YYFrameImage.h"